@@ -0,0 +1,646 @@
+/*
+ * VibeOS Block Buffer Cache
+ *
+ * Fixed pool of 4KB blocks. Lookups go through a chained hash table,
+ * eviction takes the tail of a doubly linked LRU list. Writes only mark
+ * blocks dirty; they reach the disk on eviction, on bcache_flush(), or
+ * once the oldest dirty block is BCACHE_FLUSH_TICKS old.
+ *
+ * Misses are collected into a batch of scatter-gather requests (one per
+ * run of consecutive blocks, each segment a cache block) and handed to the
+ * block driver together, so every run of a read - plus any read-ahead -
+ * is in flight at once.
+ *
+ * Large miss runs (streaming reads/writes of whole blocks) go straight
+ * between the caller's buffer and the disk and are not cached, so a
+ * single big file can't flush everything else out.
+ */
+
+#include "bcache.h"
+#include "hal/hal.h"
+#include "printf.h"
+#include "string.h"
+#include "memory.h"
+#include "process.h"
+#include "spinlock.h"
+
+#define BCACHE_HASH_SIZE     1024   // Power of two
+#define BCACHE_MAX_RUN       64     // Blocks per disk request
+#define BCACHE_MAX_REQS      16     // Disk requests per batch
+#define BCACHE_BYPASS_BLOCKS 16     // Whole-block runs this long skip the cache
+
+typedef struct bcache_buf {
+    int dev;
+    uint32_t block;                 // lba / BCACHE_BLOCK_SECTORS
+    uint8_t valid;
+    uint8_t dirty;
+    uint8_t pending;                // Being filled by the current batch
+    uint8_t *data;                  // BCACHE_BLOCK_SIZE bytes
+    struct bcache_buf *hash_next;
+    struct bcache_buf *lru_prev;    // Towards most recently used
+    struct bcache_buf *lru_next;    // Towards least recently used
+} bcache_buf_t;
+
+static bcache_buf_t *pool = NULL;
+static int pool_size = 0;
+static bcache_buf_t *hash_table[BCACHE_HASH_SIZE];
+static bcache_buf_t *lru_head = NULL;   // Most recently used
+static bcache_buf_t *lru_tail = NULL;   // Least recently used
+
+static int dirty_count = 0;
+static uint64_t dirty_since = 0;        // Tick the oldest dirty block was dirtied
+
+static uint32_t readahead_blocks = 0;
+static uint32_t readahead_limit = 0;    // Never prefetch at or past this LBA
+static int seq_dev = -1;                // Where the last read ended
+static uint32_t seq_next_lba = 0;
+
+static bcache_stats_t stats;
+
+// Read batch under construction
+typedef struct {
+    uint8_t *dst;                   // Caller buffer for [lba, end), NULL for read-ahead
+    uint32_t lba;
+    uint32_t end;
+    int direct;                     // Reading straight into dst
+    int nbufs;
+    bcache_buf_t **bufs;            // Cache blocks being filled (if !direct)
+} batch_run_t;
+
+static hal_blk_req_t batch_reqs[BCACHE_MAX_REQS];
+static batch_run_t batch_runs[BCACHE_MAX_REQS];
+static hal_blk_seg_t batch_segs[BCACHE_MAX_REQS * BCACHE_MAX_RUN];
+static bcache_buf_t *batch_bufs[BCACHE_MAX_REQS * BCACHE_MAX_RUN];
+static int batch_count = 0;
+static int batch_nsegs = 0;
+static uint32_t batch_blocks = 0;       // Cache blocks claimed by the batch
+static uint32_t max_run = BCACHE_MAX_RUN;  // Clamped so a batch can't claim the whole pool
+
+// Align a pointer up to 64 bytes (DMA on the Pi wants cache-line alignment)
+static uint8_t *align64(uint8_t *p) {
+    return (uint8_t *)(((uint64_t)p + 63) & ~(uint64_t)63);
+}
+
+// ============ Device I/O ============
+
+static int dev_batch(int dev, int write, const hal_blk_req_t *reqs, int n) {
+    if (dev != BCACHE_DEV_DISK) return -1;
+    return write ? hal_blk_write_batch(reqs, n) : hal_blk_read_batch(reqs, n);
+}
+
+static int dev_io(int dev, int write, uint32_t lba, void *buf, uint32_t count) {
+    hal_blk_seg_t seg = { buf, count };
+    hal_blk_req_t req = { lba, &seg, 1 };
+    return dev_batch(dev, write, &req, 1);
+}
+
+// ============ Hash / LRU ============
+
+static uint32_t hash_of(int dev, uint32_t block) {
+    return (block ^ ((uint32_t)dev << 16)) & (BCACHE_HASH_SIZE - 1);
+}
+
+static bcache_buf_t *lookup(int dev, uint32_t block) {
+    bcache_buf_t *b = hash_table[hash_of(dev, block)];
+    while (b) {
+        if (b->block == block && b->dev == dev) return b;
+        b = b->hash_next;
+    }
+    return NULL;
+}
+
+static void hash_remove(bcache_buf_t *b) {
+    bcache_buf_t **pp = &hash_table[hash_of(b->dev, b->block)];
+    while (*pp) {
+        if (*pp == b) {
+            *pp = b->hash_next;
+            b->hash_next = NULL;
+            return;
+        }
+        pp = &(*pp)->hash_next;
+    }
+}
+
+static void lru_unlink(bcache_buf_t *b) {
+    if (b->lru_prev) b->lru_prev->lru_next = b->lru_next;
+    else lru_head = b->lru_next;
+    if (b->lru_next) b->lru_next->lru_prev = b->lru_prev;
+    else lru_tail = b->lru_prev;
+    b->lru_prev = b->lru_next = NULL;
+}
+
+static void lru_push_front(bcache_buf_t *b) {
+    b->lru_prev = NULL;
+    b->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = b;
+    lru_head = b;
+    if (!lru_tail) lru_tail = b;
+}
+
+static void touch(bcache_buf_t *b) {
+    if (b == lru_head) return;
+    lru_unlink(b);
+    lru_push_front(b);
+}
+
+// Move a block to the LRU end and drop it from the hash (contents discarded)
+static void invalidate(bcache_buf_t *b) {
+    if (b->dirty) {
+        b->dirty = 0;
+        dirty_count--;
+    }
+    if (b->valid) hash_remove(b);
+    b->valid = 0;
+    b->pending = 0;
+    lru_unlink(b);
+    b->lru_prev = lru_tail;
+    b->lru_next = NULL;
+    if (lru_tail) lru_tail->lru_next = b;
+    lru_tail = b;
+    if (!lru_head) lru_head = b;
+}
+
+static void mark_dirty(bcache_buf_t *b) {
+    if (b->dirty) return;
+    b->dirty = 1;
+    if (dirty_count++ == 0) {
+        dirty_since = hal_timer_get_ticks();
+    }
+}
+
+// Recycle the least recently used block for (dev, block)
+// Data is NOT loaded - caller fills b->data
+static bcache_buf_t *alloc_block(int dev, uint32_t block) {
+    bcache_buf_t *b = lru_tail;
+    while (b->pending) {
+        b = b->lru_prev;  // Never steal a block the current batch is filling
+    }
+
+    if (b->valid) {
+        if (b->dirty) {
+            if (dev_io(b->dev, 1, b->block * BCACHE_BLOCK_SECTORS,
+                       b->data, BCACHE_BLOCK_SECTORS) < 0) {
+                printf("[BCACHE] Writeback of block %u failed, data lost\n", b->block);
+            } else {
+                stats.writebacks++;
+            }
+            b->dirty = 0;
+            dirty_count--;
+        }
+        hash_remove(b);
+    }
+
+    b->dev = dev;
+    b->block = block;
+    b->valid = 1;
+    uint32_t h = hash_of(dev, block);
+    b->hash_next = hash_table[h];
+    hash_table[h] = b;
+    touch(b);
+    return b;
+}
+
+// Load a whole block through the cache
+static bcache_buf_t *get_block(int dev, uint32_t block) {
+    bcache_buf_t *b = lookup(dev, block);
+    if (b) {
+        stats.hits++;
+        touch(b);
+        return b;
+    }
+
+    stats.misses++;
+    b = alloc_block(dev, block);
+    if (dev_io(dev, 0, block * BCACHE_BLOCK_SECTORS, b->data, BCACHE_BLOCK_SECTORS) < 0) {
+        invalidate(b);
+        return NULL;
+    }
+    return b;
+}
+
+// Copy the part of a cached block that overlaps [lba, end) into dst (dst holds lba)
+static void copy_out(const bcache_buf_t *b, uint8_t *dst, uint32_t lba, uint32_t end) {
+    uint32_t blk_lba = b->block * BCACHE_BLOCK_SECTORS;
+    uint32_t from = lba > blk_lba ? lba : blk_lba;
+    uint32_t to = end < blk_lba + BCACHE_BLOCK_SECTORS ? end : blk_lba + BCACHE_BLOCK_SECTORS;
+    memcpy(dst + (from - lba) * 512, b->data + (from - blk_lba) * 512, (to - from) * 512);
+}
+
+static int flush_locked(void);
+
+// Flush if the oldest dirty data has been sitting around too long
+static void age_check(void) {
+    if (dirty_count > 0 && hal_timer_get_ticks() - dirty_since >= BCACHE_FLUSH_TICKS) {
+        flush_locked();
+    }
+}
+
+// ============ Read batches ============
+
+// Send the batch to the disk and wait for all of it, then hand the data out
+static int batch_submit(int dev) {
+    if (batch_count == 0) return 0;
+
+    int result = dev_batch(dev, 0, batch_reqs, batch_count);
+
+    for (int i = 0; i < batch_count; i++) {
+        batch_run_t *run = &batch_runs[i];
+        for (int k = 0; k < run->nbufs; k++) {
+            bcache_buf_t *b = run->bufs[k];
+            if (result < 0) {
+                invalidate(b);
+                continue;
+            }
+            b->pending = 0;
+            if (run->dst) copy_out(b, run->dst, run->lba, run->end);
+        }
+    }
+
+    batch_count = 0;
+    batch_nsegs = 0;
+    batch_blocks = 0;
+    return result;
+}
+
+// Drop a half-built batch without touching the disk
+static void batch_abort(void) {
+    for (int i = 0; i < batch_count; i++) {
+        for (int k = 0; k < batch_runs[i].nbufs; k++) {
+            invalidate(batch_runs[i].bufs[k]);
+        }
+    }
+    batch_count = 0;
+    batch_nsegs = 0;
+    batch_blocks = 0;
+}
+
+// Add a run of missing blocks to the batch (submitting first if it is full)
+// dst/lba/end describe the caller's buffer; dst == NULL for read-ahead
+static int batch_add(int dev, uint32_t block, uint32_t nblocks, int direct,
+                     uint8_t *dst, uint32_t lba, uint32_t end) {
+    if (batch_count == BCACHE_MAX_REQS ||
+        batch_nsegs + (int)nblocks > BCACHE_MAX_REQS * BCACHE_MAX_RUN ||
+        (!direct && batch_blocks + nblocks > max_run)) {
+        if (batch_submit(dev) < 0) return -1;
+    }
+
+    uint32_t run_lba = block * BCACHE_BLOCK_SECTORS;
+    hal_blk_req_t *req = &batch_reqs[batch_count];
+    batch_run_t *run = &batch_runs[batch_count];
+    hal_blk_seg_t *segs = &batch_segs[batch_nsegs];
+
+    req->sector = run_lba;
+    req->segs = segs;
+    run->dst = dst;
+    run->lba = lba;
+    run->end = end;
+    run->direct = direct;
+    run->bufs = &batch_bufs[batch_nsegs];
+
+    if (direct) {
+        segs[0].buf = dst + (run_lba - lba) * 512;
+        segs[0].count = nblocks * BCACHE_BLOCK_SECTORS;
+        req->nsegs = 1;
+        run->nbufs = 0;
+        batch_nsegs++;
+    } else {
+        // Scatter straight into freshly claimed cache blocks
+        for (uint32_t i = 0; i < nblocks; i++) {
+            bcache_buf_t *b = alloc_block(dev, block + i);
+            b->pending = 1;
+            segs[i].buf = b->data;
+            segs[i].count = BCACHE_BLOCK_SECTORS;
+            run->bufs[i] = b;
+        }
+        req->nsegs = nblocks;
+        run->nbufs = nblocks;
+        batch_nsegs += nblocks;
+        batch_blocks += nblocks;
+    }
+
+    batch_count++;
+    return 0;
+}
+
+// Queue one caller range: hits are copied now, misses join the batch
+static int read_range(int dev, uint8_t *dst, uint32_t lba, uint32_t count) {
+    uint32_t end = lba + count;
+    uint32_t block = lba / BCACHE_BLOCK_SECTORS;
+    uint32_t last = (end - 1) / BCACHE_BLOCK_SECTORS;
+
+    while (block <= last) {
+        bcache_buf_t *b = lookup(dev, block);
+
+        if (b && b->pending) {
+            // Another range of this batch is still loading it
+            if (batch_submit(dev) < 0) return -1;
+            b = lookup(dev, block);
+        }
+
+        if (b) {
+            copy_out(b, dst, lba, end);
+            stats.hits++;
+            touch(b);
+            block++;
+            continue;
+        }
+
+        // Miss - gather the run of consecutive missing blocks
+        uint32_t run = 1;
+        while (block + run <= last && run < max_run && !lookup(dev, block + run)) {
+            run++;
+        }
+        stats.misses += run;
+
+        // Streaming read of whole blocks goes straight into the caller's buffer
+        uint32_t run_lba = block * BCACHE_BLOCK_SECTORS;
+        uint32_t run_end = run_lba + run * BCACHE_BLOCK_SECTORS;
+        int direct = run >= BCACHE_BYPASS_BLOCKS && run_lba >= lba && run_end <= end &&
+                     ((uint64_t)(dst + (run_lba - lba) * 512) & 63) == 0;
+
+        if (batch_add(dev, block, run, direct, dst, lba, end) < 0) return -1;
+        block += run;
+    }
+    return 0;
+}
+
+// Queue up to readahead_blocks blocks starting at block
+static int queue_readahead(int dev, uint32_t block) {
+    uint32_t n = 0;
+    while (n < readahead_blocks && n < max_run && !lookup(dev, block + n) &&
+           (block + n + 1) * BCACHE_BLOCK_SECTORS <= readahead_limit) {
+        n++;
+    }
+    if (n == 0) return 0;
+
+    stats.readahead += n;
+    return batch_add(dev, block, n, 0, NULL, 0, 0);
+}
+
+// ============ Public API ============
+
+int bcache_init(void) {
+    if (pool) return 0;
+
+    // Try for the full size, settle for less on small heaps
+    int n = BCACHE_NUM_BLOCKS;
+    uint8_t *mem = NULL;
+    while (n >= 64) {
+        mem = malloc((size_t)n * BCACHE_BLOCK_SIZE + 64);
+        if (mem) break;
+        n /= 2;
+    }
+    pool = mem ? malloc(sizeof(bcache_buf_t) * n) : NULL;
+    if (!pool) {
+        printf("[BCACHE] Out of memory, cache disabled\n");
+        if (mem) free(mem);
+        return -1;
+    }
+
+    uint8_t *data = align64(mem);
+    memset(pool, 0, sizeof(bcache_buf_t) * n);
+    memset(hash_table, 0, sizeof(hash_table));
+    lru_head = lru_tail = NULL;
+    for (int i = 0; i < n; i++) {
+        pool[i].data = data + (size_t)i * BCACHE_BLOCK_SIZE;
+        lru_push_front(&pool[i]);
+    }
+    pool_size = n;
+    if (max_run > (uint32_t)n / 2) max_run = n / 2;
+
+    printf("[BCACHE] %d blocks (%d KB)\n", n, n * BCACHE_BLOCK_SIZE / 1024);
+    return 0;
+}
+
+static int read_vec_locked(int dev, const bcache_io_t *ios, int n) {
+
+    if (!pool) {
+        int result = 0;
+        for (int i = 0; i < n; i++) {
+            if (ios[i].count == 0) continue;
+            if (dev_io(dev, 0, ios[i].lba, ios[i].buf, ios[i].count) < 0) result = -1;
+        }
+        return result;
+    }
+
+    age_check();
+
+    uint32_t total = 0;
+    for (int i = 0; i < n; i++) {
+        if (ios[i].count == 0) continue;
+        if (read_range(dev, (uint8_t *)ios[i].buf, ios[i].lba, ios[i].count) < 0) {
+            batch_abort();
+            return -1;
+        }
+        total += ios[i].count;
+    }
+
+    // Sequential small reads: keep the next window in RAM ahead of the
+    // reader. The prefetch rides along in the same batch as the misses.
+    const bcache_io_t *tail = &ios[n - 1];
+    uint32_t tail_end = tail->lba + tail->count;
+    if (readahead_blocks && dev == seq_dev && ios[0].lba == seq_next_lba &&
+        total < BCACHE_BYPASS_BLOCKS * BCACHE_BLOCK_SECTORS && tail->count > 0) {
+        uint32_t next = (tail_end + BCACHE_BLOCK_SECTORS - 1) / BCACHE_BLOCK_SECTORS;
+        if (!lookup(dev, next) && queue_readahead(dev, next) < 0) {
+            batch_abort();
+            return -1;
+        }
+    }
+    seq_dev = dev;
+    seq_next_lba = tail_end;
+
+    return batch_submit(dev);
+}
+
+static int write_locked(int dev, uint32_t lba, const void *buf, uint32_t count) {
+    if (!pool) return dev_io(dev, 1, lba, (void *)buf, count);
+
+    age_check();
+
+    const uint8_t *src = (const uint8_t *)buf;
+    uint32_t end = lba + count;
+    uint32_t block = lba / BCACHE_BLOCK_SECTORS;
+    uint32_t last = (end - 1) / BCACHE_BLOCK_SECTORS;
+
+    while (block <= last) {
+        uint32_t blk_lba = block * BCACHE_BLOCK_SECTORS;
+        uint32_t from = lba > blk_lba ? lba : blk_lba;
+        uint32_t to = end < blk_lba + BCACHE_BLOCK_SECTORS ? end : blk_lba + BCACHE_BLOCK_SECTORS;
+        int whole = (from == blk_lba && to == blk_lba + BCACHE_BLOCK_SECTORS);
+        bcache_buf_t *b = lookup(dev, block);
+
+        if (!b && whole) {
+            // Long run of whole, uncached blocks: write through in one request
+            uint32_t run = 1;
+            while (block + run <= last && !lookup(dev, block + run) &&
+                   (block + run + 1) * BCACHE_BLOCK_SECTORS <= end) {
+                run++;
+            }
+            const uint8_t *run_src = src + (blk_lba - lba) * 512;
+            if (run >= BCACHE_BYPASS_BLOCKS && ((uint64_t)run_src & 63) == 0) {
+                if (dev_io(dev, 1, blk_lba, (void *)run_src, run * BCACHE_BLOCK_SECTORS) < 0) {
+                    return -1;
+                }
+                block += run;
+                continue;
+            }
+        }
+
+        if (!b) {
+            // Whole blocks need no read; partial ones are filled from disk first
+            b = whole ? alloc_block(dev, block) : get_block(dev, block);
+            if (!b) return -1;
+        } else {
+            touch(b);
+        }
+
+        memcpy(b->data + (from - blk_lba) * 512, src + (from - lba) * 512, (to - from) * 512);
+        mark_dirty(b);
+        block++;
+    }
+
+    return 0;
+}
+
+static const uint8_t *sector_locked(int dev, uint32_t lba) {
+    if (!pool) {
+        // Cache disabled: single uncached sector
+        static uint8_t fallback[512] __attribute__((aligned(64)));
+        return dev_io(dev, 0, lba, fallback, 1) < 0 ? NULL : fallback;
+    }
+
+    age_check();
+
+    bcache_buf_t *b = get_block(dev, lba / BCACHE_BLOCK_SECTORS);
+    if (!b) return NULL;
+    return b->data + (lba % BCACHE_BLOCK_SECTORS) * 512;
+}
+
+static int flush_locked(void) {
+    if (!pool || dirty_count == 0) return 0;
+
+    // Collect dirty blocks, sorted by (dev, block) so neighbours merge
+    static bcache_buf_t *list[BCACHE_NUM_BLOCKS];
+    int n = 0;
+    for (int i = 0; i < pool_size; i++) {
+        if (pool[i].valid && pool[i].dirty) {
+            bcache_buf_t *b = &pool[i];
+            int j = n++;
+            while (j > 0 && (list[j - 1]->dev > b->dev ||
+                   (list[j - 1]->dev == b->dev && list[j - 1]->block > b->block))) {
+                list[j] = list[j - 1];
+                j--;
+            }
+            list[j] = b;
+        }
+    }
+
+    // Each run of neighbouring blocks is one gather request; a batch of
+    // runs on the same device goes to the disk together
+    int result = 0;
+    int i = 0;
+    while (i < n) {
+        int dev = list[i]->dev;
+        int start = i;
+        int nreqs = 0;
+        int nsegs = 0;
+
+        while (i < n && list[i]->dev == dev && nreqs < BCACHE_MAX_REQS) {
+            int run = 1;
+            while (i + run < n && run < BCACHE_MAX_RUN &&
+                   list[i + run]->dev == dev &&
+                   list[i + run]->block == list[i]->block + run) {
+                run++;
+            }
+
+            hal_blk_seg_t *segs = &batch_segs[nsegs];
+            for (int k = 0; k < run; k++) {
+                segs[k].buf = list[i + k]->data;
+                segs[k].count = BCACHE_BLOCK_SECTORS;
+            }
+            batch_reqs[nreqs].sector = list[i]->block * BCACHE_BLOCK_SECTORS;
+            batch_reqs[nreqs].segs = segs;
+            batch_reqs[nreqs].nsegs = run;
+            nreqs++;
+            nsegs += run;
+            i += run;
+        }
+
+        if (dev_batch(dev, 1, batch_reqs, nreqs) < 0) {
+            printf("[BCACHE] Flush of %d blocks failed\n", i - start);
+            result = -1;
+            continue;
+        }
+        for (int k = start; k < i; k++) {
+            list[k]->dirty = 0;
+            dirty_count--;
+        }
+        stats.writebacks += i - start;
+    }
+
+    // Failed blocks stay dirty; restart their clock so we don't retry every access
+    dirty_since = hal_timer_get_ticks();
+    return result;
+}
+
+// ============ Locked entry points ============
+
+// Processes now sleep while their disk requests run, and other cores run
+// processes too, so a second caller can enter the cache mid-operation.
+// One owner at a time; others yield.
+static mutex_t cache_mutex = MUTEX_INIT;
+
+static void cache_lock(void) {
+    mutex_lock(&cache_mutex);
+}
+
+static void cache_unlock(void) {
+    mutex_unlock(&cache_mutex);
+}
+
+int bcache_read_vec(int dev, const bcache_io_t *ios, int n) {
+    if (n <= 0) return 0;
+    cache_lock();
+    int result = read_vec_locked(dev, ios, n);
+    cache_unlock();
+    return result;
+}
+
+int bcache_read(int dev, uint32_t lba, void *buf, uint32_t count) {
+    bcache_io_t io = { lba, count, buf };
+    return bcache_read_vec(dev, &io, 1);
+}
+
+int bcache_write(int dev, uint32_t lba, const void *buf, uint32_t count) {
+    if (count == 0) return 0;
+    cache_lock();
+    int result = write_locked(dev, lba, buf, count);
+    cache_unlock();
+    return result;
+}
+
+const uint8_t *bcache_sector(int dev, uint32_t lba) {
+    cache_lock();
+    const uint8_t *data = sector_locked(dev, lba);
+    cache_unlock();
+    return data;
+}
+
+int bcache_flush(void) {
+    cache_lock();
+    int result = flush_locked();
+    cache_unlock();
+    return result;
+}
+
+void bcache_set_readahead(uint32_t sectors, uint32_t limit_lba) {
+    uint32_t blocks = sectors / BCACHE_BLOCK_SECTORS;
+    if (blocks > BCACHE_MAX_RUN) blocks = BCACHE_MAX_RUN;
+    readahead_blocks = blocks;
+    readahead_limit = limit_lba;
+}
+
+void bcache_get_stats(bcache_stats_t *out) {
+    *out = stats;
+}
@@ -0,0 +1,69 @@
+/*
+ * VibeOS Block Buffer Cache
+ *
+ * Hashed, LRU-evicted cache of disk blocks keyed by (device, LBA).
+ * Sits between filesystems and the block driver: absorbs repeated reads
+ * (FAT, directories, hot executables), delays and coalesces writes, and
+ * prefetches ahead of sequential readers.
+ */
+
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+
+// Devices (only the boot disk for now, routed to hal_blk_*)
+#define BCACHE_DEV_DISK 0
+
+// A cache block is 8 sectors (4KB), aligned on absolute LBA
+#define BCACHE_BLOCK_SECTORS 8
+#define BCACHE_BLOCK_SIZE    (BCACHE_BLOCK_SECTORS * 512)
+
+// Number of cached blocks (8MB total)
+#define BCACHE_NUM_BLOCKS 2048
+
+// Dirty blocks older than this are written back on the next cache access
+#define BCACHE_FLUSH_TICKS 300  // 3 seconds at 100Hz
+
+typedef struct {
+    uint64_t hits;          // Blocks served from RAM
+    uint64_t misses;        // Blocks that had to be read from disk
+    uint64_t writebacks;    // Dirty blocks written to disk
+    uint64_t readahead;     // Blocks prefetched by sequential read-ahead
+} bcache_stats_t;
+
+// One range of a vectored read
+typedef struct {
+    uint32_t lba;
+    uint32_t count;         // Sectors
+    void *buf;
+} bcache_io_t;
+
+// Allocate the cache (safe to call more than once)
+int bcache_init(void);
+
+// Read/write count sectors starting at lba, same contract as hal_blk_read/write
+// Returns 0 on success, -1 on error
+int bcache_read(int dev, uint32_t lba, void *buf, uint32_t count);
+int bcache_write(int dev, uint32_t lba, const void *buf, uint32_t count);
+
+// Read several ranges; all their misses go to the disk as one batch
+// Returns 0 on success, -1 on error
+int bcache_read_vec(int dev, const bcache_io_t *ios, int n);
+
+// Get a pointer to one cached sector (loads it on a miss)
+// Only valid until the next bcache call; use bcache_write to modify
+const uint8_t *bcache_sector(int dev, uint32_t lba);
+
+// Write all dirty blocks to disk
+// Returns 0 on success, -1 if any writeback failed
+int bcache_flush(void);
+
+// Set sequential read-ahead window in sectors (0 = disabled)
+// Read-ahead never goes at or beyond limit_lba (end of the filesystem)
+void bcache_set_readahead(uint32_t sectors, uint32_t limit_lba);
+
+// Get counters (for sysmon)
+void bcache_get_stats(bcache_stats_t *stats);
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * VibeOS Internet Checksum
+ *
+ * The NEON version loads 64 bytes a pass and pairwise-adds the 16-bit
+ * words into four 32-bit accumulators (UADALP), widening those into 64-bit
+ * lanes every so often before they can overflow. Carries are folded back
+ * in once at the end, which is what makes the one's complement sum safe to
+ * do out of order.
+ */
+
+#include "checksum.h"
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+// Passes of 64 bytes before the 32-bit lanes must be widened: each pass
+// adds two 16-bit words to every lane, so 16384 passes stay below 2^32
+#define CSUM_NEON_BLOCK 16384
+
+// 64-bit accumulator down to a 32-bit partial sum
+static inline uint32_t csum_fold64(uint64_t acc) {
+    acc = (acc & 0xffffffff) + (acc >> 32);
+    acc = (acc & 0xffffffff) + (acc >> 32);
+    return (uint32_t)acc;
+}
+
+// Words are put together from bytes: with the MMU off memory is Device
+// type, where a halfword load from an odd address faults
+uint32_t csum_partial_scalar(const void *data, uint32_t len, uint32_t sum) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t acc = sum;
+
+    while (len > 1) {
+        acc += p[0] | ((uint32_t)p[1] << 8);
+        p += 2;
+        len -= 2;
+    }
+    if (len == 1) {
+        acc += p[0];
+    }
+
+    return csum_fold64(acc);
+}
+
+uint32_t csum_partial(const void *data, uint32_t len, uint32_t sum) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t acc = sum;
+
+#ifdef __ARM_NEON
+    // Byte loads, reinterpreted as words, so any alignment is fine
+    if (len >= 64) {
+        uint64x2_t wide = vdupq_n_u64(0);
+
+        while (len >= 64) {
+            uint32_t passes = len / 64;
+            if (passes > CSUM_NEON_BLOCK) passes = CSUM_NEON_BLOCK;
+            len -= passes * 64;
+
+            uint32x4_t s0 = vdupq_n_u32(0);
+            uint32x4_t s1 = s0, s2 = s0, s3 = s0;
+            for (; passes; passes--) {
+                s0 = vpadalq_u16(s0, vreinterpretq_u16_u8(vld1q_u8(p)));
+                s1 = vpadalq_u16(s1, vreinterpretq_u16_u8(vld1q_u8(p + 16)));
+                s2 = vpadalq_u16(s2, vreinterpretq_u16_u8(vld1q_u8(p + 32)));
+                s3 = vpadalq_u16(s3, vreinterpretq_u16_u8(vld1q_u8(p + 48)));
+                p += 64;
+            }
+
+            wide = vpadalq_u32(wide, s0);
+            wide = vpadalq_u32(wide, s1);
+            wide = vpadalq_u32(wide, s2);
+            wide = vpadalq_u32(wide, s3);
+        }
+
+        acc += vgetq_lane_u64(wide, 0);
+        acc += vgetq_lane_u64(wide, 1);
+    }
+
+    while (len >= 16) {
+        acc += vaddlvq_u16(vreinterpretq_u16_u8(vld1q_u8(p)));
+        p += 16;
+        len -= 16;
+    }
+#endif
+
+    // Whatever's left, a word at a time (little-endian, like the loads above)
+    while (len > 1) {
+        acc += p[0] | ((uint32_t)p[1] << 8);
+        p += 2;
+        len -= 2;
+    }
+    if (len == 1) {
+        acc += p[0];
+    }
+
+    return csum_fold64(acc);
+}
@@ -0,0 +1,40 @@
+/*
+ * VibeOS Internet Checksum
+ *
+ * RFC 1071 one's complement sums for IP, ICMP, UDP and TCP. Partial sums
+ * are 32-bit, over 16-bit words in memory order, so they chain: sum a
+ * pseudo-header, then a header, then the payload, and fold once at the end.
+ * Only the last piece may have an odd length.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+
+// Add data to a partial sum. Uses NEON where the CPU has it.
+uint32_t csum_partial(const void *data, uint32_t len, uint32_t sum);
+
+// Plain 16-bit word loop, for comparison (csumbench)
+uint32_t csum_partial_scalar(const void *data, uint32_t len, uint32_t sum);
+
+// Add two partial sums
+static inline uint32_t csum_add(uint32_t a, uint32_t b) {
+    uint32_t r = a + b;
+    return r + (r < a);  // End-around carry
+}
+
+// Fold a partial sum to 16 bits, uninverted (what an offloading device
+// wants seeded into the checksum field)
+static inline uint16_t csum_fold_raw(uint32_t sum) {
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)sum;
+}
+
+// Fold and invert: the value that goes into a header
+static inline uint16_t csum_fold(uint32_t sum) {
+    return (uint16_t)~csum_fold_raw(sum);
+}
+
+#endif
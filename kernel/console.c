@@ -4,6 +4,17 @@
  * Provides terminal-like text output on the framebuffer.
  * Handles cursor positioning, scrolling, and basic escape sequences.
  *
+ * Output goes into a grid of character cells first, and only rows that
+ * changed are drawn: at most once per timer tick from putc, at the end of
+ * console_puts and printf, and otherwise by the "console" kernel thread,
+ * which the CPU 0 timer wakes when something is left undrawn. The grid
+ * is a ring of rows: scrolling moves an index and the pixels catch up at
+ * the next flush, one scroll however many lines went by.
+ *
+ * One spinlock covers the grid, the cursor and drawing to the screen, so
+ * cores take turns; the kapi's framebuffer calls take it too. The panic
+ * screen draws without it.
+ *
  * Hardware scroll support:
  * On Pi, uses GPU virtual offset for fast scrolling (no memmove).
  * Falls back to software scroll on QEMU or if hardware scroll unavailable.
@@ -12,9 +23,16 @@
 #include "console.h"
 #include "fb.h"
 #include "font.h"
+#include "memory.h"
 #include "string.h"
 #include "printf.h"
 #include "hal/hal.h"
+#include "spinlock.h"
+#include "process.h"
+
+static spinlock_t console_spin = SPINLOCK_INIT;
+static wait_queue_t console_wait = WAIT_QUEUE_INIT;
+static volatile int console_thread_running = 0;
 
 // Console state
 static int console_initialized = 0;
@@ -26,34 +44,107 @@ static uint32_t fg_color = COLOR_WHITE;
 static uint32_t bg_color = COLOR_BLACK;
 
 // Cursor blink state
-static int cursor_visible = 0;
+static int cursor_visible = 1;
 static int cursor_enabled = 1;
+static int drawn_cursor_row = -1;        // Where the cursor is on screen now
+static int drawn_cursor_col = -1;
 
 // Hardware scroll state
 static uint32_t scroll_offset = 0;       // Current Y pixel offset in virtual framebuffer
 static uint32_t virtual_height = 0;      // Total virtual framebuffer height (pixels)
 static int hw_scroll_available = 0;      // Whether hardware scroll is supported
 
-// Text buffer for scrolling (unused with hardware scroll)
+// Character cells, one ring slot per row: screen row r is slot
+// (top_slot + r) % num_rows
 static char *text_buffer = NULL;
 static uint32_t *fg_buffer = NULL;
 static uint32_t *bg_buffer = NULL;
+static int top_slot = 0;
+
+// Columns of each slot not yet drawn (lo > hi = clean)
+static int16_t *dirty_lo = NULL;
+static int16_t *dirty_hi = NULL;
+static int needs_flush = 0;              // Some slot is dirty
+static int pending_scroll = 0;           // Lines scrolled since the last flush
+static uint64_t last_flush_tick = 0;
 
 // Line buffer for batched rendering
 // Framebuffer is non-cacheable on Pi, so we draw to cached RAM first
-#define LINE_BUF_WIDTH 800
+#define LINE_BUF_WIDTH 1280
 static uint32_t line_buffer[LINE_BUF_WIDTH * FONT_HEIGHT] __attribute__((aligned(64)));
-static int line_buf_row = -1;      // Which row is buffered (-1 = none)
-static int line_buf_min_col = -1;  // Leftmost column drawn
-static int line_buf_max_col = -1;  // Rightmost column drawn
+
+// Expansion tables for the colour pairs in use; output rarely has more
+// than a handful
+#define NUM_GLYPH_LUTS 8
+static fb_glyph_lut_t glyph_luts[NUM_GLYPH_LUTS];
+static int glyph_luts_used = 0;
+static int glyph_lut_victim = 0;
+
+static const fb_glyph_lut_t *get_glyph_lut(uint32_t fg, uint32_t bg) {
+    for (int i = 0; i < glyph_luts_used; i++) {
+        if (glyph_luts[i].fg == fg && glyph_luts[i].bg == bg) {
+            return &glyph_luts[i];
+        }
+    }
+
+    fb_glyph_lut_t *lut;
+    if (glyph_luts_used < NUM_GLYPH_LUTS) {
+        lut = &glyph_luts[glyph_luts_used++];
+    } else {
+        lut = &glyph_luts[glyph_lut_victim];
+        glyph_lut_victim = (glyph_lut_victim + 1) % NUM_GLYPH_LUTS;
+    }
+    fb_glyph_lut_init(lut, fg, bg);
+    return lut;
+}
+
+static int row_slot(int row) {
+    int slot = top_slot + row;
+    return slot >= num_rows ? slot - num_rows : slot;
+}
+
+static void mark_dirty(int row, int col_lo, int col_hi) {
+    int slot = row_slot(row);
+    if (col_lo < dirty_lo[slot]) dirty_lo[slot] = col_lo;
+    if (col_hi > dirty_hi[slot]) dirty_hi[slot] = col_hi;
+    needs_flush = 1;
+}
+
+// Blank cells in the current colours
+static void clear_cells(int row, int col, int width) {
+    int base = row_slot(row) * num_cols + col;
+    memset(&text_buffer[base], ' ', width);
+    memset32(&fg_buffer[base], fg_color, width);
+    memset32(&bg_buffer[base], bg_color, width);
+    mark_dirty(row, col, col + width - 1);
+}
 
 void console_init(void) {
     if (fb_base == NULL) return;
 
     // Calculate dimensions
-    num_cols = fb_width / FONT_WIDTH;
+    uint32_t width = fb_width < LINE_BUF_WIDTH ? fb_width : LINE_BUF_WIDTH;
+    num_cols = width / FONT_WIDTH;
     num_rows = fb_height / FONT_HEIGHT;
 
+    int cells = num_rows * num_cols;
+    text_buffer = malloc(cells);
+    fg_buffer = malloc(cells * sizeof(uint32_t));
+    bg_buffer = malloc(cells * sizeof(uint32_t));
+    dirty_lo = malloc(num_rows * sizeof(int16_t));
+    dirty_hi = malloc(num_rows * sizeof(int16_t));
+    if (!text_buffer || !fg_buffer || !bg_buffer || !dirty_lo || !dirty_hi) return;
+
+    // Don't clear screen - keep boot messages visible. The cells start
+    // out blank and clean, so nothing is drawn over them until written.
+    memset(text_buffer, ' ', cells);
+    memset32(fg_buffer, fg_color, cells);
+    memset32(bg_buffer, bg_color, cells);
+    for (int i = 0; i < num_rows; i++) {
+        dirty_lo[i] = num_cols;
+        dirty_hi[i] = -1;
+    }
+
     // Check for hardware scroll support (Pi has virtual FB 2x height)
     virtual_height = hal_fb_get_virtual_height();
     if (virtual_height > fb_height) {
@@ -67,20 +158,33 @@ void console_init(void) {
     cursor_row = 0;
     cursor_col = 0;
 
-    // Don't clear screen - keep boot messages visible
-
     console_initialized = 1;
 }
 
-// Flush only the drawn portion of line buffer to framebuffer
-static void line_buf_flush(void) {
-    if (line_buf_row < 0 || line_buf_min_col < 0) return;
+// Draw columns lo..hi of a row into the line buffer, then copy them out
+static void render_row(int row, int lo, int hi) {
+    int base = row_slot(row) * num_cols;
+    const fb_glyph_lut_t *lut = NULL;
+
+    for (int col = lo; col <= hi; col++) {
+        uint32_t fg = fg_buffer[base + col];
+        uint32_t bg = bg_buffer[base + col];
+
+        // The cursor is the cell drawn inverted
+        if (row == drawn_cursor_row && col == drawn_cursor_col) {
+            uint32_t t = fg;
+            fg = bg;
+            bg = t;
+        }
+        if (!lut || lut->fg != fg || lut->bg != bg) lut = get_glyph_lut(fg, bg);
+
+        fb_blit_glyph(&line_buffer[col * FONT_WIDTH], LINE_BUF_WIDTH, text_buffer[base + col], lut);
+    }
 
     // Calculate pixel region to copy
-    uint32_t x_start = line_buf_min_col * FONT_WIDTH;
-    uint32_t x_end = (line_buf_max_col + 1) * FONT_WIDTH;
-    uint32_t width_bytes = (x_end - x_start) * sizeof(uint32_t);
-    uint32_t y_fb = scroll_offset + line_buf_row * FONT_HEIGHT;
+    uint32_t x_start = lo * FONT_WIDTH;
+    uint32_t width_bytes = (hi - lo + 1) * FONT_WIDTH * sizeof(uint32_t);
+    uint32_t y_fb = scroll_offset + row * FONT_HEIGHT;
 
     uint32_t *src = &line_buffer[x_start];
     uint32_t *dst = &fb_base[y_fb * fb_width + x_start];
@@ -92,61 +196,24 @@ static void line_buf_flush(void) {
                         width_bytes, FONT_HEIGHT);
     } else {
         // Fallback: 16 separate copies
-        for (int row = 0; row < FONT_HEIGHT; row++) {
+        for (int r = 0; r < FONT_HEIGHT; r++) {
             memcpy(dst, src, width_bytes);
             src += LINE_BUF_WIDTH;
             dst += fb_width;
         }
     }
-
-    line_buf_min_col = -1;
-    line_buf_max_col = -1;
-}
-
-// Draw character to line buffer (cached RAM)
-static void draw_char_at(int row, int col, char c) {
-    // If switching rows, flush old row first
-    if (row != line_buf_row && line_buf_row >= 0) {
-        line_buf_flush();
-    }
-    line_buf_row = row;
-
-    // Draw character into line buffer
-    uint32_t x = col * FONT_WIDTH;
-    if (x + FONT_WIDTH > LINE_BUF_WIDTH) return;
-
-    const uint8_t *glyph = font_data[(uint8_t)c];
-
-    for (int r = 0; r < FONT_HEIGHT; r++) {
-        uint32_t *row_ptr = &line_buffer[r * LINE_BUF_WIDTH + x];
-        uint8_t bits = glyph[r];
-        row_ptr[0] = (bits & 0x80) ? fg_color : bg_color;
-        row_ptr[1] = (bits & 0x40) ? fg_color : bg_color;
-        row_ptr[2] = (bits & 0x20) ? fg_color : bg_color;
-        row_ptr[3] = (bits & 0x10) ? fg_color : bg_color;
-        row_ptr[4] = (bits & 0x08) ? fg_color : bg_color;
-        row_ptr[5] = (bits & 0x04) ? fg_color : bg_color;
-        row_ptr[6] = (bits & 0x02) ? fg_color : bg_color;
-        row_ptr[7] = (bits & 0x01) ? fg_color : bg_color;
-    }
-
-    // Track drawn region
-    if (line_buf_min_col < 0 || col < line_buf_min_col) line_buf_min_col = col;
-    if (col > line_buf_max_col) line_buf_max_col = col;
 }
 
-static void scroll_up(void) {
-    // Flush line buffer before scrolling
-    line_buf_flush();
-    line_buf_row = -1;
-
-    uint32_t line_pixels = fb_width * FONT_HEIGHT;
+// Move the pixels up by the lines scrolled since the last flush. The rows
+// that came in at the bottom are dirty and get drawn afterwards.
+static void scroll_pixels(int lines) {
+    uint32_t shift = lines * FONT_HEIGHT;
 
     if (!hw_scroll_available) {
         // Software scroll fallback (QEMU)
         uint32_t total_pixels = fb_width * fb_height;
-        memmove(fb_base, fb_base + line_pixels, (total_pixels - line_pixels) * sizeof(uint32_t));
-        memset32(fb_base + (total_pixels - line_pixels), bg_color, line_pixels);
+        uint32_t shift_pixels = fb_width * shift;
+        memmove(fb_base, fb_base + shift_pixels, (total_pixels - shift_pixels) * sizeof(uint32_t));
         return;
     }
 
@@ -155,21 +222,74 @@ static void scroll_up(void) {
     uint32_t max_offset = virtual_height - fb_height;
 
     // Check if we need to wrap around
-    if (scroll_offset + FONT_HEIGHT > max_offset) {
+    if (scroll_offset + shift > max_offset) {
         // Copy visible portion back to top of buffer, then reset offset
         memmove(fb_base, fb_base + scroll_offset * fb_width, fb_height * fb_width * sizeof(uint32_t));
         scroll_offset = 0;
     }
 
-    // Scroll by one line
-    scroll_offset += FONT_HEIGHT;
+    scroll_offset += shift;
+}
+
+uint64_t console_lock(void) {
+    return spin_lock_irqsave(&console_spin);
+}
+
+void console_unlock(uint64_t flags) {
+    spin_unlock_irqrestore(&console_spin, flags);
+}
+
+// Caller holds console_spin
+static void flush_locked(void) {
+
+    // Redraw the cell the cursor leaves and the one it lands on
+    int want_row = -1, want_col = -1;
+    if (cursor_enabled && cursor_visible) {
+        want_row = cursor_row;
+        want_col = cursor_col;
+    }
+    if (want_row != drawn_cursor_row || want_col != drawn_cursor_col) {
+        if (drawn_cursor_row >= 0) mark_dirty(drawn_cursor_row, drawn_cursor_col, drawn_cursor_col);
+        if (want_row >= 0) mark_dirty(want_row, want_col, want_col);
+        drawn_cursor_row = want_row;
+        drawn_cursor_col = want_col;
+    }
+    if (!needs_flush) return;
+    needs_flush = 0;
+    last_flush_tick = hal_timer_get_ticks();
+
+    // A whole screen or more of scrolling is just a redraw
+    int lines = pending_scroll;
+    pending_scroll = 0;
+    if (lines >= num_rows) {
+        for (int row = 0; row < num_rows; row++) mark_dirty(row, 0, num_cols - 1);
+    } else if (lines > 0) {
+        scroll_pixels(lines);
+    }
+
+    for (int row = 0; row < num_rows; row++) {
+        int slot = row_slot(row);
+        if (dirty_lo[slot] > dirty_hi[slot]) continue;
+        render_row(row, dirty_lo[slot], dirty_hi[slot]);
+        dirty_lo[slot] = num_cols;
+        dirty_hi[slot] = -1;
+    }
 
-    // Clear the new bottom line
-    uint32_t new_bottom_y = scroll_offset + fb_height - FONT_HEIGHT;
-    memset32(fb_base + new_bottom_y * fb_width, bg_color, line_pixels);
+    // Update GPU display offset once the new rows are in place
+    if (lines > 0 && hw_scroll_available) {
+        hal_fb_set_scroll_offset(scroll_offset);
+    }
+}
 
-    // Update GPU display offset
-    hal_fb_set_scroll_offset(scroll_offset);
+static void scroll_up(void) {
+    // The top row becomes the new bottom row
+    top_slot = row_slot(1);
+    clear_cells(num_rows - 1, 0, num_cols);
+    if (pending_scroll < num_rows) pending_scroll++;
+
+    // Its pixels move up with everything else
+    if (drawn_cursor_row >= 0) drawn_cursor_row--;
+    if (drawn_cursor_row < 0) drawn_cursor_col = -1;
 }
 
 static void newline(void) {
@@ -182,23 +302,15 @@ static void newline(void) {
     }
 }
 
-// Forward declaration
-static void draw_cursor(int show);
-
-void console_putc(char c) {
-    // If console not initialized, fall back to UART
-    if (!console_initialized) {
-        extern void uart_putc(char c);
-        if (c == '\n') uart_putc('\r');
-        uart_putc(c);
-        return;
-    }
-
-    // Hide cursor before any operation that might move it
-    if (cursor_visible) {
-        draw_cursor(0);
-    }
+static void put_cell(char c) {
+    int i = row_slot(cursor_row) * num_cols + cursor_col;
+    text_buffer[i] = c;
+    fg_buffer[i] = fg_color;
+    bg_buffer[i] = bg_color;
+    mark_dirty(cursor_row, cursor_col, cursor_col);
+}
 
+static void console_write_char(char c) {
     switch (c) {
         case '\n':
             newline();
@@ -225,7 +337,7 @@ void console_putc(char c) {
 
         default:
             if (c >= 32 && c < 127) {
-                draw_char_at(cursor_row, cursor_col, c);
+                put_cell(c);
                 cursor_col++;
 
                 if (cursor_col >= num_cols) {
@@ -234,14 +346,32 @@ void console_putc(char c) {
             }
             break;
     }
+}
 
-    // Show cursor at new position (static cursor, always visible)
-    if (cursor_enabled && !cursor_visible) {
-        draw_cursor(1);
-    } else {
-        // Flush line buffer even when cursor is disabled (for games like snake)
-        line_buf_flush();
+void console_putc(char c) {
+    // If console not initialized, fall back to UART
+    if (!console_initialized) {
+        extern void uart_putc(char c);
+        if (c == '\n') uart_putc('\r');
+        uart_putc(c);
+        return;
+    }
+
+    uint64_t flags = console_lock();
+    console_write_char(c);
+
+    // Draw at most once a tick; callers about to wait flush the rest
+    if (hal_timer_get_ticks() != last_flush_tick) {
+        flush_locked();
     }
+    console_unlock(flags);
+}
+
+void console_flush(void) {
+    if (!console_initialized) return;
+    uint64_t flags = console_lock();
+    flush_locked();
+    console_unlock(flags);
 }
 
 void console_puts(const char *s) {
@@ -250,18 +380,22 @@ void console_puts(const char *s) {
         printf("%s", s);
         return;
     }
+    if (!console_initialized) {
+        while (*s) console_putc(*s++);
+        return;
+    }
+    uint64_t flags = console_lock();
     while (*s) {
-        console_putc(*s++);
+        console_write_char(*s++);
     }
     // Flush for immediate display
-    line_buf_flush();
+    flush_locked();
+    console_unlock(flags);
 }
 
 void console_clear(void) {
-    // Discard any pending line buffer
-    line_buf_row = -1;
-    line_buf_min_col = -1;
-    line_buf_max_col = -1;
+    if (!console_initialized) return;
+    uint64_t flags = console_lock();
 
     // Reset scroll offset when clearing
     if (hw_scroll_available) {
@@ -269,43 +403,34 @@ void console_clear(void) {
         hal_fb_set_scroll_offset(0);
     }
     fb_clear(bg_color);
+
+    // The screen now matches blank cells, so nothing is left to draw
+    top_slot = 0;
+    pending_scroll = 0;
+    for (int row = 0; row < num_rows; row++) {
+        clear_cells(row, 0, num_cols);
+        dirty_lo[row] = num_cols;
+        dirty_hi[row] = -1;
+    }
+    needs_flush = 0;
+    drawn_cursor_row = -1;
+    drawn_cursor_col = -1;
     cursor_row = 0;
     cursor_col = 0;
+    console_unlock(flags);
 }
 
-// Fast clear from cursor position to end of line using fb_fill_rect
+// Fast clear from cursor position to end of line
 void console_clear_to_eol(void) {
-    if (!console_initialized || fb_base == NULL) return;
-
-    // Flush line buffer if on this row
-    if (line_buf_row == cursor_row) {
-        line_buf_flush();
-        line_buf_row = -1;
-    }
-
-    // Hide cursor before clearing
-    if (cursor_visible) {
-        draw_cursor(0);
-    }
-
-    // Calculate pixel coordinates (account for hardware scroll offset)
-    uint32_t x = cursor_col * FONT_WIDTH;
-    uint32_t y = scroll_offset + cursor_row * FONT_HEIGHT;
-    uint32_t w = fb_width - x;  // Width to end of screen
-    uint32_t h = FONT_HEIGHT;
-
-    // Use fast fb_fill_rect instead of putc(' ') loop
-    fb_fill_rect(x, y, w, h, bg_color);
-
-    // Show cursor at current position
-    if (cursor_enabled && !cursor_visible) {
-        draw_cursor(1);
-    }
+    if (!console_initialized) return;
+    uint64_t flags = console_lock();
+    clear_cells(cursor_row, cursor_col, num_cols - cursor_col);
+    console_unlock(flags);
 }
 
-// Fast rectangular clear using fb_fill_rect
+// Fast rectangular clear
 void console_clear_region(int row, int col, int width, int height) {
-    if (!console_initialized || fb_base == NULL) return;
+    if (!console_initialized) return;
 
     // Clip to console bounds
     if (row < 0) row = 0;
@@ -314,53 +439,32 @@ void console_clear_region(int row, int col, int width, int height) {
     if (col + width > num_cols) width = num_cols - col;
     if (width <= 0 || height <= 0) return;
 
-    // Flush line buffer if it overlaps
-    if (line_buf_row >= row && line_buf_row < row + height) {
-        line_buf_flush();
-        line_buf_row = -1;
-    }
-
-    // Hide cursor if it's in the region
-    if (cursor_visible) {
-        draw_cursor(0);
-    }
-
-    // Calculate pixel coordinates (account for hardware scroll offset)
-    uint32_t px = col * FONT_WIDTH;
-    uint32_t py = scroll_offset + row * FONT_HEIGHT;
-    uint32_t pw = width * FONT_WIDTH;
-    uint32_t ph = height * FONT_HEIGHT;
-
-    // Use fast fb_fill_rect
-    fb_fill_rect(px, py, pw, ph, bg_color);
-
-    // Restore cursor
-    if (cursor_enabled && !cursor_visible) {
-        draw_cursor(1);
+    uint64_t flags = console_lock();
+    for (int r = row; r < row + height; r++) {
+        clear_cells(r, col, width);
     }
+    console_unlock(flags);
 }
 
 void console_set_cursor(int row, int col) {
-    // Hide cursor before moving
-    if (cursor_visible) {
-        draw_cursor(0);
-    }
+    uint64_t flags = console_lock();
     if (row >= 0 && row < num_rows) cursor_row = row;
     if (col >= 0 && col < num_cols) cursor_col = col;
-    // Show cursor at new position
-    if (cursor_enabled && !cursor_visible) {
-        draw_cursor(1);
-    }
+    console_unlock(flags);
 }
 
 void console_get_cursor(int *row, int *col) {
+    uint64_t flags = console_lock();
     if (row) *row = cursor_row;
     if (col) *col = cursor_col;
+    console_unlock(flags);
 }
 
 void console_set_color(uint32_t fg, uint32_t bg) {
+    uint64_t flags = console_lock();
     fg_color = fg;
     bg_color = bg;
+    console_unlock(flags);
 }
 
 int console_rows(void) {
@@ -371,55 +475,59 @@ int console_cols(void) {
     return num_cols;
 }
 
-// Draw/undraw cursor at current position by inverting pixels
-static void draw_cursor(int show) {
-    if (!console_initialized || fb_base == NULL) return;
-    if (show == cursor_visible) return;  // Already in desired state
+// Anything left to draw? An unlocked peek: it only decides whether the
+// thread is worth waking, and the thread's flush sorts out the rest.
+static int flush_pending(void) {
+    if (needs_flush) return 1;
+    int want_row = (cursor_enabled && cursor_visible) ? cursor_row : -1;
+    int want_col = want_row >= 0 ? cursor_col : -1;
+    return want_row != drawn_cursor_row || want_col != drawn_cursor_col;
+}
 
-    // Flush line buffer if cursor is on buffered row
-    if (line_buf_row == cursor_row) {
-        line_buf_flush();
+// Called by the CPU 0 timer every tick. Drawing waits for the thread:
+// it's too slow for interrupt context.
+void console_tick(void) {
+    if (console_thread_running && console_initialized && flush_pending()) {
+        wait_queue_wake(&console_wait);
     }
+}
 
-    uint32_t x = cursor_col * FONT_WIDTH;
-    // Account for hardware scroll offset
-    uint32_t y = scroll_offset + cursor_row * FONT_HEIGHT;
-
-    // Get the actual buffer height limit
-    uint32_t buf_height = hw_scroll_available ? virtual_height : fb_height;
-
-    // Toggle pixels (XOR-style invert)
-    for (int dy = 0; dy < FONT_HEIGHT; dy++) {
-        for (int dx = 0; dx < FONT_WIDTH; dx++) {
-            uint32_t px = x + dx;
-            uint32_t py = y + dy;
-            if (px < fb_width && py < buf_height) {
-                uint32_t *pixel = fb_base + py * fb_width + px;
-                // Invert: swap fg and bg
-                *pixel = (*pixel == bg_color) ? fg_color : bg_color;
-            }
-        }
+static void console_thread(void) {
+    for (;;) {
+        uint32_t seq = console_wait.seq;
+        if (!flush_pending()) wait_queue_sleep(&console_wait, seq, 0);
+        console_flush();
+    }
+}
+
+void console_start_thread(void) {
+    if (process_create_kernel("console", console_thread) > 0) {
+        console_thread_running = 1;
     }
-    cursor_visible = show;
 }
 
 // Toggle cursor visibility (called by timer)
 void console_blink_cursor(void) {
-    if (!cursor_enabled) return;
-    draw_cursor(!cursor_visible);
+    if (!cursor_enabled || !console_initialized) return;
+    uint64_t flags = console_lock();
+    cursor_visible = !cursor_visible;
+    flush_locked();
+    console_unlock(flags);
 }
 
 // Enable/disable cursor
 void console_set_cursor_enabled(int enabled) {
-    if (!enabled && cursor_visible) {
-        draw_cursor(0);  // Hide cursor
-    }
+    uint64_t flags = console_lock();
     cursor_enabled = enabled;
+    if (enabled) cursor_visible = 1;
+    console_unlock(flags);
 }
 
 // Force redraw cursor (call after moving cursor)
 void console_show_cursor(void) {
-    if (cursor_enabled && !cursor_visible) {
-        draw_cursor(1);
-    }
+    if (!cursor_enabled || !console_initialized) return;
+    uint64_t flags = console_lock();
+    cursor_visible = 1;
+    flush_locked();
+    console_unlock(flags);
 }
@@ -18,6 +18,9 @@ void console_puts(const char *s);
 void console_clear(void);
 void console_clear_to_eol(void);  // Fast clear from cursor to end of line
 void console_clear_region(int row, int col, int width, int height);  // Fast rect clear
+void console_flush(void);  // Draw what's changed now instead of at the next tick
+void console_tick(void);   // CPU 0 timer: wake the thread if anything is undrawn
+void console_start_thread(void);  // Start the thread that draws deferred output
 
 // Cursor
 void console_set_cursor(int row, int col);
@@ -33,4 +36,9 @@ void console_set_color(uint32_t fg, uint32_t bg);
 int console_rows(void);
 int console_cols(void);
 
+// Serializes the console and kapi framebuffer drawing across cores
+// (IRQs stay masked while it's held)
+uint64_t console_lock(void);
+void console_unlock(uint64_t flags);
+
 #endif
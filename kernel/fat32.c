@@ -10,6 +10,8 @@
 #include "printf.h"
 #include "string.h"
 #include "memory.h"
+#include "bcache.h"
+#include "spinlock.h"
 
 // Boot sector (BIOS Parameter Block)
 typedef struct __attribute__((packed)) {
@@ -47,9 +49,35 @@ typedef struct __attribute__((packed)) {
 static fat32_fs_t fs;
 static int fs_initialized = 0;
 
+// Bumped whenever entries may move or a chain is replaced (write_file,
+// delete, rename). Every open-file handle compares against it.
+static uint32_t fs_generation = 1;
+
+// Per-entry counters, hashed on the entry's (dir cluster, index). Growing a
+// file through a handle bumps only its slot, so other files' handles keep
+// their cache; a collision just costs a spurious reload.
+#define ENTRY_GEN_SLOTS 64
+static uint32_t entry_generation[ENTRY_GEN_SLOTS];
+
+static uint32_t *entry_gen_slot(const fat32_file_t *file) {
+    uint32_t h = file->entry_cluster * 31 + file->entry_offset;
+    return &entry_generation[h % ENTRY_GEN_SLOTS];
+}
+
+static int file_stale(const fat32_file_t *file) {
+    return file->generation != fs_generation ||
+           file->entry_generation != *entry_gen_slot(file);
+}
+
 // Partition offset (sector where FAT32 partition starts)
 static uint32_t partition_offset = 0;
 
+// Where fat_alloc_cluster() starts looking (everything below was in use)
+static uint32_t alloc_hint = 2;
+
+// Cluster runs fat32_read_at() submits per batch
+#define FAT32_READ_BATCH 16
+
 // Sector buffer
 static uint8_t sector_buf[512] __attribute__((aligned(16)));
 
@@ -57,80 +85,56 @@ static uint8_t sector_buf[512] __attribute__((aligned(16)));
 static uint8_t *cluster_buf = NULL;
 static uint32_t cluster_buf_size = 0;
 
-// FAT sector cache - avoids repeated disk reads when traversing cluster chains
-// Larger cache = fewer disk reads when scanning FAT (df, free space checks)
-#define FAT_CACHE_SIZE 64
-static struct {
-    uint32_t sector;      // Which FAT sector is cached (0 = invalid)
-    uint8_t data[512];    // Cached sector data
-    uint32_t lru_counter; // For LRU eviction
-} fat_cache[FAT_CACHE_SIZE];
-static uint32_t fat_cache_counter = 0;
+// Public entry points run one caller at a time: they share sector_buf,
+// cluster_buf, the allocation hint and open-file cursors. The mutex is
+// recursive, so fat32_append() -> fat32_write_at() and friends can nest.
+static mutex_t fs_mutex = MUTEX_INIT;
+
+static void fs_unlock(int *scope) {
+    (void)scope;
+    mutex_unlock(&fs_mutex);
+}
+
+// Hold fs_mutex until the enclosing function returns
+#define FS_LOCKED() \
+    mutex_lock(&fs_mutex); \
+    int fs_scope __attribute__((cleanup(fs_unlock), unused)) = 0
+
+// All sector I/O goes through the block buffer cache (bcache.c), which
+// keeps FAT sectors, directories and recently used file data in RAM
 
 // Read a sector from disk (adds partition offset)
 static int read_sector(uint32_t sector, void *buf) {
-    return hal_blk_read(partition_offset + sector, buf, 1);
+    return bcache_read(BCACHE_DEV_DISK, partition_offset + sector, buf, 1);
 }
 
 // Write a sector to disk (adds partition offset)
 static int write_sector(uint32_t sector, const void *buf) {
-    return hal_blk_write(partition_offset + sector, buf, 1);
+    return bcache_write(BCACHE_DEV_DISK, partition_offset + sector, buf, 1);
 }
 
 // Write multiple sectors (adds partition offset)
 static int write_sectors(uint32_t sector, uint32_t count, const void *buf) {
-    return hal_blk_write(partition_offset + sector, buf, count);
+    return bcache_write(BCACHE_DEV_DISK, partition_offset + sector, buf, count);
 }
 
 // Read multiple sectors (adds partition offset)
 static int read_sectors(uint32_t sector, uint32_t count, void *buf) {
-    return hal_blk_read(partition_offset + sector, buf, count);
+    return bcache_read(BCACHE_DEV_DISK, partition_offset + sector, buf, count);
 }
 
-// Read a FAT sector with caching
-// Returns pointer to cached data, or NULL on error
-static uint8_t *fat_read_sector_cached(uint32_t sector) {
-    // Check if already cached
-    for (int i = 0; i < FAT_CACHE_SIZE; i++) {
-        if (fat_cache[i].sector == sector && fat_cache[i].sector != 0) {
-            fat_cache[i].lru_counter = ++fat_cache_counter;
-            return fat_cache[i].data;
-        }
-    }
-
-    // Not cached - find LRU entry to evict
-    int lru_idx = 0;
-    uint32_t min_counter = fat_cache[0].lru_counter;
-    for (int i = 1; i < FAT_CACHE_SIZE; i++) {
-        if (fat_cache[i].sector == 0) {
-            // Found empty slot, use it
-            lru_idx = i;
-            break;
-        }
-        if (fat_cache[i].lru_counter < min_counter) {
-            min_counter = fat_cache[i].lru_counter;
-            lru_idx = i;
-        }
+// Read several sector ranges as one batch (all misses in flight together)
+static int read_sectors_vec(bcache_io_t *ios, int n) {
+    for (int i = 0; i < n; i++) {
+        ios[i].lba += partition_offset;
     }
-
-    // Read sector into cache
-    if (read_sector(sector, fat_cache[lru_idx].data) < 0) {
-        return NULL;
-    }
-
-    fat_cache[lru_idx].sector = sector;
-    fat_cache[lru_idx].lru_counter = ++fat_cache_counter;
-    return fat_cache[lru_idx].data;
+    return bcache_read_vec(BCACHE_DEV_DISK, ios, n);
 }
 
-// Invalidate a FAT sector in the cache (call after writes)
-static void fat_cache_invalidate(uint32_t sector) {
-    for (int i = 0; i < FAT_CACHE_SIZE; i++) {
-        if (fat_cache[i].sector == sector) {
-            fat_cache[i].sector = 0;
-            return;
-        }
-    }
+// Get a pointer to a cached FAT sector (valid until the next disk access)
+// Returns NULL on error
+static const uint8_t *fat_read_sector_cached(uint32_t sector) {
+    return bcache_sector(BCACHE_DEV_DISK, partition_offset + sector);
 }
 
 // MBR partition entry structure
@@ -217,12 +221,12 @@ static uint32_t fat_next_cluster(uint32_t cluster) {
     uint32_t entry_offset = fat_offset % fs.bytes_per_sector;
 
     // Use cached FAT read
-    uint8_t *data = fat_read_sector_cached(fat_sector);
+    const uint8_t *data = fat_read_sector_cached(fat_sector);
     if (!data) {
         return FAT32_EOC;
     }
 
-    uint32_t next = *(uint32_t *)(data + entry_offset);
+    uint32_t next = *(const uint32_t *)(data + entry_offset);
     return next & 0x0FFFFFFF;  // FAT32 uses only 28 bits
 }
 
@@ -241,14 +245,11 @@ static int fat_set_cluster(uint32_t cluster, uint32_t value) {
     uint32_t *entry = (uint32_t *)(sector_buf + entry_offset);
     *entry = (*entry & 0xF0000000) | (value & 0x0FFFFFFF);
 
-    // Write to FAT1
+    // Write to FAT1 (cached - reaches the disk on the next flush)
     if (write_sector(fat_sector, sector_buf) < 0) {
         return -1;
     }
 
-    // Invalidate cache for this sector (it's now stale)
-    fat_cache_invalidate(fat_sector);
-
     // Write to FAT2 (if exists)
     if (fs.num_fats > 1) {
         uint32_t fat2_sector = fat_sector + fs.fat_size;
@@ -262,14 +263,22 @@ static int fat_set_cluster(uint32_t cluster, uint32_t value) {
 
 // Find a free cluster and mark it as end-of-chain
 static uint32_t fat_alloc_cluster(void) {
-    // Start searching from cluster 2 (first data cluster)
-    for (uint32_t cluster = 2; cluster < fs.total_clusters + 2; cluster++) {
+    // Start at the hint so growing files don't rescan the whole FAT, and
+    // so consecutive allocations tend to come out physically contiguous
+    uint32_t end = fs.total_clusters + 2;
+    if (alloc_hint < 2 || alloc_hint >= end) alloc_hint = 2;
+
+    for (uint32_t i = 0; i < fs.total_clusters; i++) {
+        uint32_t cluster = alloc_hint + i;
+        if (cluster >= end) cluster -= fs.total_clusters;
+
         uint32_t entry = fat_next_cluster(cluster);
         if (entry == FAT32_FREE) {
             // Mark as end of chain
             if (fat_set_cluster(cluster, FAT32_EOC) < 0) {
                 return 0;
             }
+            alloc_hint = cluster + 1;
             return cluster;
         }
     }
@@ -283,6 +292,7 @@ static int fat_free_chain(uint32_t cluster) {
         if (fat_set_cluster(cluster, FAT32_FREE) < 0) {
             return -1;
         }
+        if (cluster < alloc_hint) alloc_hint = cluster;
         cluster = next;
     }
     return 0;
@@ -347,8 +357,11 @@ static int name_match(const char *name1, const char *name2) {
 }
 
 int fat32_init(void) {
+    FS_LOCKED();
     printf("[FAT32] Initializing...\n");
 
+    bcache_init();
+
     // Find FAT32 partition (handles MBR parsing)
     partition_offset = find_fat32_partition();
     printf("[FAT32] Partition offset: %u sectors\n", partition_offset);
@@ -454,6 +467,9 @@ int fat32_init(void) {
         return -1;
     }
 
+    // Sequential readers get the next 8 clusters prefetched
+    bcache_set_readahead(8 * fs.sectors_per_cluster, partition_offset + total_sectors_32);
+
     fs_initialized = 1;
     printf("[FAT32] Filesystem ready!\n");
     return 0;
@@ -589,7 +605,10 @@ static fat32_dirent_t *find_entry_in_dir(uint32_t dir_cluster, const char *name,
 
 // Resolve a path to a directory entry
 // Returns the entry or NULL if not found
-static fat32_dirent_t *resolve_path(const char *path, uint32_t *out_cluster) {
+// out_entry_cluster/out_entry_offset (optional) receive the location of the
+// entry itself (directory cluster + index); both are 0 for the root directory
+static fat32_dirent_t *resolve_path_ex(const char *path, uint32_t *out_cluster,
+                                       uint32_t *out_entry_cluster, uint32_t *out_entry_offset) {
     if (!fs_initialized || !path) return NULL;
 
     // Start at root
@@ -605,6 +624,8 @@ static fat32_dirent_t *resolve_path(const char *path, uint32_t *out_cluster) {
         root_entry.cluster_hi = (fs.root_cluster >> 16) & 0xFFFF;
         root_entry.cluster_lo = fs.root_cluster & 0xFFFF;
         if (out_cluster) *out_cluster = fs.root_cluster;
+        if (out_entry_cluster) *out_entry_cluster = 0;
+        if (out_entry_offset) *out_entry_offset = 0;
         return &root_entry;
     }
 
@@ -622,7 +643,7 @@ static fat32_dirent_t *resolve_path(const char *path, uint32_t *out_cluster) {
         if (component[0] == '\0') continue;
 
        // printf("[FAT32] resolve: looking for '%s' in cluster %u\n", component, current_cluster);
-        entry = find_entry_in_dir(current_cluster, component, NULL, NULL);
+        entry = find_entry_in_dir(current_cluster, component, out_entry_cluster, out_entry_offset);
         if (!entry) {
             printf("[FAT32] resolve: '%s' not found!\n", component);
             return NULL;  // Not found
@@ -646,7 +667,12 @@ static fat32_dirent_t *resolve_path(const char *path, uint32_t *out_cluster) {
     return entry;
 }
 
+static fat32_dirent_t *resolve_path(const char *path, uint32_t *out_cluster) {
+    return resolve_path_ex(path, out_cluster, NULL, NULL);
+}
+
 int fat32_read_file(const char *path, void *buf, size_t size) {
+    FS_LOCKED();
     if (!fs_initialized) return -1;
 
     uint32_t cluster;
@@ -691,6 +717,7 @@ int fat32_read_file(const char *path, void *buf, size_t size) {
  * Returns bytes read, or -1 on error
  */
 int fat32_read_file_offset(const char *path, void *buf, size_t size, size_t offset) {
+    FS_LOCKED();
     if (!fs_initialized) return -1;
 
     uint32_t cluster;
@@ -751,7 +778,145 @@ int fat32_read_file_offset(const char *path, void *buf, size_t size, size_t offs
     return (int)bytes_read;
 }
 
+// Fill an open-file handle from a path lookup. The cursor survives a reload
+// while the chain still starts at the same cluster: chains only ever grow in
+// place, and write_file allocates a new one before freeing the old.
+static int fat32_file_load(fat32_file_t *file) {
+    uint32_t first_cluster, entry_cluster, entry_offset;
+    fat32_dirent_t *entry = resolve_path_ex(file->path, &first_cluster,
+                                            &entry_cluster, &entry_offset);
+    if (!entry) return -1;
+
+    if (first_cluster != file->first_cluster || first_cluster < 2 ||
+        file->cursor_offset >= entry->size) {
+        file->cursor_offset = 0;
+        file->cursor_cluster = 0;
+    }
+
+    file->attr = entry->attr;
+    file->first_cluster = first_cluster;
+    file->size = entry->size;
+    file->entry_cluster = entry_cluster;
+    file->entry_offset = entry_offset;
+    file->generation = fs_generation;
+    file->entry_generation = *entry_gen_slot(file);
+    return 0;
+}
+
+int fat32_open(const char *path, fat32_file_t *file) {
+    FS_LOCKED();
+    if (!fs_initialized || !path || !file) return -1;
+
+    int len = strlen(path);
+    if (len >= (int)sizeof(file->path)) return -1;
+    memcpy(file->path, path, len + 1);
+    file->first_cluster = 0;
+
+    return fat32_file_load(file);
+}
+
+/*
+ * Read from an open file handle.
+ * Starts from the cached (offset, cluster) cursor when the request lies at or
+ * beyond it, so sequential readers only follow one or two FAT links per call
+ * instead of walking the chain from the first cluster every time.
+ */
+int fat32_read_at(fat32_file_t *file, void *buf, size_t size, size_t offset) {
+    FS_LOCKED();
+    if (!fs_initialized || !file) return -1;
+
+    // This file or the tree changed since we cached it - look it up again
+    if (file_stale(file)) {
+        if (fat32_file_load(file) < 0) return -1;
+    }
+
+    if (file->attr & FAT_ATTR_DIRECTORY) return -1;
+
+    if (offset >= file->size) return 0;
+    if (offset + size > file->size) {
+        size = file->size - offset;
+    }
+    if (size == 0) return 0;
+
+    // Pick a starting point: the cursor if it is not past the offset
+    uint32_t cluster = file->first_cluster;
+    size_t file_pos = 0;
+    if (file->cursor_cluster >= 2 && file->cursor_offset <= offset) {
+        cluster = file->cursor_cluster;
+        file_pos = file->cursor_offset;
+    }
+
+    while (cluster >= 2 && cluster < FAT32_EOC && file_pos + cluster_buf_size <= offset) {
+        file_pos += cluster_buf_size;
+        cluster = fat_next_cluster(cluster);
+    }
+
+    uint8_t *dst = (uint8_t *)buf;
+    size_t bytes_read = 0;
+
+    // Whole-cluster runs are queued here and read as one batch, so a
+    // fragmented file still has all of its runs in flight at once
+    bcache_io_t runs[FAT32_READ_BATCH];
+    int nruns = 0;
+
+    while (cluster >= 2 && cluster < FAT32_EOC && bytes_read < size) {
+        size_t cluster_offset = (file_pos < offset) ? offset - file_pos : 0;
+        size_t remaining = size - bytes_read;
+
+        // Remember where we are so the next call can pick up from here
+        file->cursor_cluster = cluster;
+        file->cursor_offset = file_pos;
+
+        // Whole clusters into an aligned buffer: skip cluster_buf and merge
+        // physically contiguous clusters into a single multi-sector read
+        if (cluster_offset == 0 && remaining >= cluster_buf_size &&
+            ((uint64_t)(dst + bytes_read) & 63) == 0) {
+            uint32_t run = 1;
+            uint32_t next = fat_next_cluster(cluster);
+            while (next == cluster + run && (run + 1) * cluster_buf_size <= remaining) {
+                run++;
+                next = fat_next_cluster(next);
+            }
+
+            runs[nruns].lba = cluster_to_sector(cluster);
+            runs[nruns].count = run * fs.sectors_per_cluster;
+            runs[nruns].buf = dst + bytes_read;
+            if (++nruns == FAT32_READ_BATCH) {
+                if (read_sectors_vec(runs, nruns) < 0) return -1;
+                nruns = 0;
+            }
+
+            bytes_read += run * cluster_buf_size;
+            file_pos += run * cluster_buf_size;
+            file->cursor_cluster = cluster + run - 1;
+            file->cursor_offset = file_pos - cluster_buf_size;
+            cluster = next;
+            continue;
+        }
+
+        if (read_cluster(cluster, cluster_buf) < 0) {
+            return -1;
+        }
+
+        size_t to_copy = cluster_buf_size - cluster_offset;
+        if (to_copy > remaining) to_copy = remaining;
+
+        memcpy(dst + bytes_read, cluster_buf + cluster_offset, to_copy);
+        bytes_read += to_copy;
+        file_pos += cluster_buf_size;
+
+        cluster = fat_next_cluster(cluster);
+    }
+
+    if (nruns > 0 && read_sectors_vec(runs, nruns) < 0) {
+        return -1;
+    }
+
+    return (int)bytes_read;
+}
+
 int fat32_file_size(const char *path) {
+    FS_LOCKED();
     if (!fs_initialized) return -1;
 
     fat32_dirent_t *entry = resolve_path(path, NULL);
@@ -762,6 +927,7 @@ int fat32_file_size(const char *path) {
 }
 
 int fat32_is_dir(const char *path) {
+    FS_LOCKED();
     if (!fs_initialized) {
         printf("[FAT32] is_dir(%s): not initialized\n", path);
         return -1;
@@ -779,6 +945,7 @@ int fat32_is_dir(const char *path) {
 }
 
 int fat32_list_dir(const char *path, fat32_dir_callback callback, void *user_data) {
+    FS_LOCKED();
     if (!fs_initialized || !callback) return -1;
 
     uint32_t dir_cluster;
@@ -1440,6 +1607,7 @@ static int update_dir_entry(uint32_t dir_cluster, const char *name, uint32_t fir
 }
 
 int fat32_create_file(const char *path) {
+    FS_LOCKED();
     if (!fs_initialized) return -1;
 
     char filename[256];
@@ -1464,6 +1632,7 @@ int fat32_create_file(const char *path) {
 }
 
 int fat32_mkdir(const char *path) {
+    FS_LOCKED();
     if (!fs_initialized) return -1;
 
     char dirname[256];
@@ -1529,7 +1698,9 @@ int fat32_mkdir(const char *path) {
 }
 
 int fat32_write_file(const char *path, const void *buf, size_t size) {
+    FS_LOCKED();
     if (!fs_initialized) return -1;
+    fs_generation++;
 
     char filename[256];
     uint32_t parent_cluster;
@@ -1612,6 +1783,195 @@ int fat32_write_file(const char *path, const void *buf, size_t size) {
     return (int)size;
 }
 
+// Find the cluster holding byte `target` of an open file, starting from the
+// handle's cursor when it is not past the target
+// Returns the cluster (pos receives its file offset), or 0 if the chain is short
+static uint32_t file_seek_cluster(fat32_file_t *file, size_t target, size_t *pos) {
+    uint32_t cluster = file->first_cluster;
+    size_t file_pos = 0;
+    if (file->cursor_cluster >= 2 && file->cursor_offset <= target) {
+        cluster = file->cursor_cluster;
+        file_pos = file->cursor_offset;
+    }
+
+    while (cluster >= 2 && cluster < FAT32_EOC && file_pos + cluster_buf_size <= target) {
+        file_pos += cluster_buf_size;
+        cluster = fat_next_cluster(cluster);
+    }
+
+    if (cluster < 2 || cluster >= FAT32_EOC) return 0;
+    *pos = file_pos;
+    return cluster;
+}
+
+// Rewrite just the first-cluster and size fields of a handle's 8.3 entry
+static int file_update_entry(fat32_file_t *file) {
+    if (file->entry_cluster < 2) return -1;
+
+    uint32_t byte = file->entry_offset * 32;
+    uint32_t sector = cluster_to_sector(file->entry_cluster) + byte / fs.bytes_per_sector;
+    if (read_sector(sector, sector_buf) < 0) {
+        return -1;
+    }
+
+    uint8_t *e = sector_buf + (byte % fs.bytes_per_sector);
+    write16(e + 20, (file->first_cluster >> 16) & 0xFFFF);  // cluster_hi
+    write16(e + 26, file->first_cluster & 0xFFFF);          // cluster_lo
+    write32(e + 28, file->size);
+
+    return write_sector(sector, sector_buf);
+}
+
+/*
+ * Write into an open file at a byte offset.
+ * Only the clusters covering [offset, offset + size) are touched: whole
+ * clusters are written straight from buf, partial ones are read, patched and
+ * written back. Growing the file links new clusters onto the tail (found from
+ * the handle's cursor, so repeated appends don't walk the chain) and then
+ * updates the size in place in the directory entry. Writing past the end
+ * fills the gap with zeros.
+ */
+int fat32_write_at(fat32_file_t *file, const void *buf, size_t size, size_t offset) {
+    FS_LOCKED();
+    if (!fs_initialized || !file || (!buf && size > 0)) return -1;
+
+    if (file_stale(file)) {
+        if (fat32_file_load(file) < 0) return -1;
+    }
+
+    if (file->attr & FAT_ATTR_DIRECTORY) return -1;
+    if (size == 0) return 0;
+
+    size_t end = offset + size;
+    if (end < offset || end > 0xFFFFFFFF) return -1;  // FAT32 size limit
+
+    uint32_t cluster_size = cluster_buf_size;
+    size_t old_size = file->size;
+
+    // Clusters the file has now, and clusters it needs afterwards
+    uint32_t have = 0;
+    if (file->first_cluster >= 2) {
+        have = (old_size + cluster_size - 1) / cluster_size;
+        if (have == 0) have = 1;
+    }
+    uint32_t need = (end + cluster_size - 1) / cluster_size;
+
+    // Grow the chain from its tail
+    if (need > have) {
+        size_t tail_pos;
+        uint32_t old_tail = 0;
+        if (have > 0) {
+            old_tail = file_seek_cluster(file, (size_t)(have - 1) * cluster_size, &tail_pos);
+            if (old_tail == 0) return -1;
+        }
+
+        uint32_t tail = old_tail;
+        uint32_t first_new = 0;
+        for (uint32_t i = have; i < need; i++) {
+            uint32_t cluster = fat_alloc_cluster();
+            if (cluster == 0) {
+                // Out of space - give back what we took
+                if (first_new) fat_free_chain(first_new);
+                if (old_tail) fat_set_cluster(old_tail, FAT32_EOC);
+                return -1;
+            }
+            if (first_new == 0) first_new = cluster;
+            if (tail) fat_set_cluster(tail, cluster);
+            tail = cluster;
+        }
+
+        if (have == 0) file->first_cluster = first_new;
+    }
+
+    // Bytes between the old end of file and offset become zeros
+    size_t start = offset < old_size ? offset : old_size;
+    const uint8_t *src = (const uint8_t *)buf;
+
+    size_t file_pos;
+    uint32_t cluster = file_seek_cluster(file, start, &file_pos);
+    if (cluster == 0) return -1;
+
+    while (cluster >= 2 && cluster < FAT32_EOC && file_pos < end) {
+        file->cursor_cluster = cluster;
+        file->cursor_offset = file_pos;
+
+        size_t lo = start > file_pos ? start - file_pos : 0;
+        size_t hi = end - file_pos < cluster_size ? end - file_pos : cluster_size;
+
+        // Whole clusters of caller data: merge physically contiguous clusters
+        // into a single multi-sector write, no read needed
+        if (lo == 0 && hi == cluster_size && file_pos >= offset) {
+            uint32_t run = 1;
+            uint32_t next = fat_next_cluster(cluster);
+            while (next == cluster + run && file_pos + (run + 1) * cluster_size <= end) {
+                run++;
+                next = fat_next_cluster(next);
+            }
+
+            if (write_sectors(cluster_to_sector(cluster), run * fs.sectors_per_cluster,
+                              src + (file_pos - offset)) < 0) {
+                return -1;
+            }
+
+            file_pos += run * cluster_size;
+            file->cursor_cluster = cluster + run - 1;
+            file->cursor_offset = file_pos - cluster_size;
+            cluster = next;
+            continue;
+        }
+
+        // Partial cluster: start from what's on disk, or zeros if it's new
+        if (file_pos < (size_t)have * cluster_size) {
+            if (read_cluster(cluster, cluster_buf) < 0) {
+                return -1;
+            }
+        } else {
+            memset(cluster_buf, 0, cluster_size);
+        }
+
+        size_t data_lo = offset > file_pos ? offset - file_pos : 0;
+        if (data_lo > hi) data_lo = hi;
+        if (data_lo > lo) {
+            memset(cluster_buf + lo, 0, data_lo - lo);
+        }
+        if (hi > data_lo) {
+            memcpy(cluster_buf + data_lo, src + (file_pos + data_lo - offset), hi - data_lo);
+        }
+
+        if (write_cluster(cluster, cluster_buf) < 0) {
+            return -1;
+        }
+
+        file_pos += cluster_size;
+        if (file_pos < end) cluster = fat_next_cluster(cluster);
+    }
+
+    if (file_pos < end) return -1;  // Chain ended early (corrupt FAT)
+
+    // Only the directory entry's size/first cluster change - and only if they did
+    if (end > old_size || have == 0) {
+        if (end > old_size) file->size = end;
+        if (file_update_entry(file) < 0) return -1;
+
+        // Other handles on this file must reload; this one is current
+        file->entry_generation = ++*entry_gen_slot(file);
+    }
+
+    return (int)size;
+}
+
+int fat32_append(fat32_file_t *file, const void *buf, size_t size) {
+    FS_LOCKED();
+    if (!fs_initialized || !file) return -1;
+
+    // Pick up the current size before using it as the offset
+    if (file_stale(file)) {
+        if (fat32_file_load(file) < 0) return -1;
+    }
+
+    return fat32_write_at(file, buf, size, file->size);
+}
+
 // Delete a directory entry including its LFN entries
 // This finds all LFN entries associated with the 8.3 entry and marks them all as deleted
 static int delete_dir_entry_with_lfn(uint32_t dir_cluster, const char *name) {
@@ -1747,7 +2107,9 @@ static int delete_dir_entry_with_lfn(uint32_t dir_cluster, const char *name) {
 }
 
 int fat32_delete(const char *path) {
+    FS_LOCKED();
     if (!fs_initialized) return -1;
+    fs_generation++;
 
     char filename[256];
     uint32_t parent_cluster;
@@ -1777,7 +2139,9 @@ int fat32_delete(const char *path) {
 }
 
 int fat32_rename(const char *oldpath, const char *newname) {
+    FS_LOCKED();
     if (!fs_initialized) return -1;
+    fs_generation++;
 
     char filename[256];
     uint32_t parent_cluster;
@@ -1861,7 +2225,9 @@ static int is_dir_empty(uint32_t dir_cluster) {
 }
 
 int fat32_delete_dir(const char *path) {
+    FS_LOCKED();
     if (!fs_initialized) return -1;
+    fs_generation++;
 
     char dirname[256];
     uint32_t parent_cluster;
@@ -1982,7 +2348,9 @@ static int delete_dir_contents(const char *dir_path) {
 }
 
 int fat32_delete_recursive(const char *path) {
+    FS_LOCKED();
     if (!fs_initialized) return -1;
+    fs_generation++;
 
     char name[256];
     uint32_t parent_cluster;
@@ -2017,6 +2385,7 @@ int fat32_delete_recursive(const char *path) {
 
 // Get total disk space in KB
 int fat32_get_total_kb(void) {
+    FS_LOCKED();
     if (!fs_initialized) return 0;
     // total_clusters * sectors_per_cluster * bytes_per_sector / 1024
     uint64_t total_bytes = (uint64_t)fs.total_clusters * fs.sectors_per_cluster * fs.bytes_per_sector;
@@ -2025,6 +2394,7 @@ int fat32_get_total_kb(void) {
 
 // Get free disk space in KB (counts free clusters in FAT)
 int fat32_get_free_kb(void) {
+    FS_LOCKED();
     if (!fs_initialized) return 0;
 
     uint32_t free_clusters = 0;
@@ -2038,3 +2408,9 @@ int fat32_get_free_kb(void) {
     uint64_t free_bytes = (uint64_t)free_clusters * fs.sectors_per_cluster * fs.bytes_per_sector;
     return (int)(free_bytes / 1024);
 }
+
+// Write back everything the block cache is holding
+int fat32_sync(void) {
+    FS_LOCKED();
+    return bcache_flush();
+}
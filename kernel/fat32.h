@@ -64,6 +64,22 @@ typedef struct {
     uint32_t total_clusters;
 } fat32_fs_t;
 
+// Open-file state (one per file handle)
+// Caches the directory entry and the last (offset, cluster) position so
+// sequential reads don't re-resolve the path or re-walk the cluster chain.
+typedef struct {
+    char path[256];             // Absolute path (used to revalidate)
+    uint8_t attr;               // Entry attributes
+    uint32_t first_cluster;     // First data cluster (0 = empty file)
+    uint32_t size;              // File size in bytes
+    uint32_t entry_cluster;     // Directory cluster holding the 8.3 entry
+    uint32_t entry_offset;      // Entry index within that cluster
+    uint32_t cursor_offset;     // File offset of cursor_cluster (cluster aligned)
+    uint32_t cursor_cluster;    // Cluster at cursor_offset (0 = no cursor yet)
+    uint32_t generation;        // Filesystem generation when cached
+    uint32_t entry_generation;  // Per-entry generation when cached
+} fat32_file_t;
+
 // Initialize FAT32 filesystem (reads from virtio-blk)
 int fat32_init(void);
 
@@ -79,6 +95,14 @@ int fat32_read_file(const char *path, void *buf, size_t size);
 // Returns: bytes read, or -1 on error
 int fat32_read_file_offset(const char *path, void *buf, size_t size, size_t offset);
 
+// Open a file/directory handle
+// Returns 0 on success, -1 if not found
+int fat32_open(const char *path, fat32_file_t *file);
+
+// Read from an open handle, continuing from its cached cluster cursor
+// Returns: bytes read, or -1 on error
+int fat32_read_at(fat32_file_t *file, void *buf, size_t size, size_t offset);
+
 // Get file size
 // Returns: file size in bytes, or -1 on error
 int fat32_file_size(const char *path);
@@ -110,6 +134,15 @@ int fat32_mkdir(const char *path);
 // Returns bytes written, or -1 on error
 int fat32_write_file(const char *path, const void *buf, size_t size);
 
+// Write into an open file at a byte offset, extending it as needed
+// Only the touched clusters and the directory entry are rewritten
+// Returns bytes written, or -1 on error
+int fat32_write_at(fat32_file_t *file, const void *buf, size_t size, size_t offset);
+
+// Append to the end of an open file
+// Returns bytes written, or -1 on error
+int fat32_append(fat32_file_t *file, const void *buf, size_t size);
+
 // Delete a file (not directories)
 // Returns 0 on success, -1 on error
 int fat32_delete(const char *path);
@@ -135,4 +168,8 @@ int fat32_get_total_kb(void);
 // Returns free disk space in KB (counts free clusters)
 int fat32_get_free_kb(void);
 
+// Flush cached writes to disk (vfs calls this after each mutating operation)
+// Returns 0 on success, -1 on error
+int fat32_sync(void);
+
 #endif
@@ -10,6 +10,10 @@
 #include "string.h"
 #include "hal/hal.h"
 
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
 // Framebuffer state - these are exported for backward compatibility
 uint32_t fb_width = 0;
 uint32_t fb_height = 0;        // Visible display height
@@ -83,36 +87,63 @@ void fb_clear(uint32_t color) {
 // Include font data
 #include "font.h"
 
-void fb_draw_char(uint32_t x, uint32_t y, char c, uint32_t fg, uint32_t bg) {
-    // Quick bounds check for entire character (use buffer height for hw scroll)
-    if (x + FONT_WIDTH > fb_width || y + FONT_HEIGHT > fb_buffer_height) return;
+void fb_glyph_lut_init(fb_glyph_lut_t *lut, uint32_t fg, uint32_t bg) {
+    for (int n = 0; n < 16; n++) {
+        for (int i = 0; i < 4; i++) {
+            lut->nibble[n][i] = (n & (8 >> i)) ? fg : bg;
+        }
+    }
+    lut->fg = fg;
+    lut->bg = bg;
+}
 
+void fb_blit_glyph(uint32_t *dst, uint32_t stride, char c, const fb_glyph_lut_t *lut) {
     const uint8_t *glyph = font_data[(uint8_t)c];
-    uint32_t *row_ptr = &fb_base[y * fb_width + x];
 
     for (int row = 0; row < FONT_HEIGHT; row++) {
         uint8_t bits = glyph[row];
-        // Unroll the 8-pixel row for speed
-        row_ptr[0] = (bits & 0x80) ? fg : bg;
-        row_ptr[1] = (bits & 0x40) ? fg : bg;
-        row_ptr[2] = (bits & 0x20) ? fg : bg;
-        row_ptr[3] = (bits & 0x10) ? fg : bg;
-        row_ptr[4] = (bits & 0x08) ? fg : bg;
-        row_ptr[5] = (bits & 0x04) ? fg : bg;
-        row_ptr[6] = (bits & 0x02) ? fg : bg;
-        row_ptr[7] = (bits & 0x01) ? fg : bg;
-        row_ptr += fb_width;
+#ifdef __ARM_NEON
+        vst1q_u32(dst, vld1q_u32(lut->nibble[bits >> 4]));
+        vst1q_u32(dst + 4, vld1q_u32(lut->nibble[bits & 15]));
+#else
+        const uint32_t *hi = lut->nibble[bits >> 4];
+        const uint32_t *lo = lut->nibble[bits & 15];
+        dst[0] = hi[0];
+        dst[1] = hi[1];
+        dst[2] = hi[2];
+        dst[3] = hi[3];
+        dst[4] = lo[0];
+        dst[5] = lo[1];
+        dst[6] = lo[2];
+        dst[7] = lo[3];
+#endif
+        dst += stride;
     }
 }
 
+void fb_draw_char(uint32_t x, uint32_t y, char c, uint32_t fg, uint32_t bg) {
+    // Quick bounds check for entire character (use buffer height for hw scroll)
+    if (x + FONT_WIDTH > fb_width || y + FONT_HEIGHT > fb_buffer_height) return;
+
+    fb_glyph_lut_t lut;
+    fb_glyph_lut_init(&lut, fg, bg);
+    fb_blit_glyph(&fb_base[y * fb_width + x], fb_width, c, &lut);
+}
+
 void fb_draw_string(uint32_t x, uint32_t y, const char *s, uint32_t fg, uint32_t bg) {
+    // One table for the whole string
+    fb_glyph_lut_t lut;
+    fb_glyph_lut_init(&lut, fg, bg);
+
     uint32_t orig_x = x;
     while (*s) {
         if (*s == '\n') {
             x = orig_x;
             y += FONT_HEIGHT;
         } else {
-            fb_draw_char(x, y, *s, fg, bg);
+            if (x + FONT_WIDTH <= fb_width && y + FONT_HEIGHT <= fb_buffer_height) {
+                fb_blit_glyph(&fb_base[y * fb_width + x], fb_width, *s, &lut);
+            }
             x += FONT_WIDTH;
         }
         s++;
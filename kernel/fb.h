@@ -30,6 +30,16 @@ void fb_clear(uint32_t color);
 #define COLOR_BLUE    0x000000FF
 #define COLOR_CYAN    0x0000FFFF
 
+// Glyph expansion: a 1bpp font row goes through a table of the 16 possible
+// nibbles, already in fg/bg, so it takes two 4-pixel copies and no compares
+typedef struct {
+    uint32_t nibble[16][4] __attribute__((aligned(16)));
+    uint32_t fg, bg;
+} fb_glyph_lut_t;
+
+void fb_glyph_lut_init(fb_glyph_lut_t *lut, uint32_t fg, uint32_t bg);
+void fb_blit_glyph(uint32_t *dst, uint32_t stride, char c, const fb_glyph_lut_t *lut);  // stride in pixels
+
 // Text drawing
 void fb_draw_char(uint32_t x, uint32_t y, char c, uint32_t fg, uint32_t bg);
 void fb_draw_char_fg_only(uint32_t x, uint32_t y, char c, uint32_t fg);  // For batch rendering
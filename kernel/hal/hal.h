@@ -44,6 +44,7 @@ void hal_irq_disable(void);
 void hal_irq_enable_irq(uint32_t irq);
 void hal_irq_disable_irq(uint32_t irq);
 void hal_irq_register_handler(uint32_t irq, void (*handler)(void));
+void hal_irq_init_secondary(void);   // Per-core setup, run on each secondary core
 
 /*
  * Timer
@@ -52,6 +53,7 @@ void hal_irq_register_handler(uint32_t irq, void (*handler)(void));
 void hal_timer_init(uint32_t interval_ms);
 uint64_t hal_timer_get_ticks(void);
 void hal_timer_set_interval(uint32_t interval_ms);
+void hal_timer_init_secondary(void); // Start the calling core's tick (after hal_timer_init)
 
 /*
  * Block Device (Storage)
@@ -61,6 +63,23 @@ int hal_blk_init(void);
 int hal_blk_read(uint32_t sector, void *buf, uint32_t count);
 int hal_blk_write(uint32_t sector, const void *buf, uint32_t count);
 
+// Scatter-gather batch I/O: each request covers a contiguous run of sectors
+// split across memory segments. Devices that can queue keep every request
+// of a batch in flight at once. Returns 0 if all succeeded, -1 otherwise.
+typedef struct {
+    void *buf;
+    uint32_t count;             // Sectors
+} hal_blk_seg_t;
+
+typedef struct {
+    uint64_t sector;            // First sector
+    const hal_blk_seg_t *segs;  // Filled/drained in order
+    int nsegs;
+} hal_blk_req_t;
+
+int hal_blk_read_batch(const hal_blk_req_t *reqs, int n);
+int hal_blk_write_batch(const hal_blk_req_t *reqs, int n);
+
 /*
  * Input Devices
  * Keyboard and mouse/touch
@@ -165,7 +184,14 @@ void gpio_set_pull_mask(uint32_t pins_mask, int bank, int pull);
  */
 const char *hal_get_cpu_name(void);     // e.g., "Cortex-A72"
 uint32_t hal_get_cpu_freq_mhz(void);    // e.g., 1500 for 1.5GHz
-int hal_get_cpu_cores(void);            // e.g., 4
+int hal_get_cpu_cores(void);            // Cores running the scheduler, e.g., 4
+
+/*
+ * SMP
+ * Release a parked secondary core. It enters secondary_main() on the stack
+ * smp.c published in smp_boot_stack[cpu].
+ */
+void hal_cpu_start(int cpu);
 
 /*
  * USB Device Info
@@ -1070,3 +1070,84 @@ int hal_blk_write(uint32_t sector, const void *buf, uint32_t count) {
 
     return 0;
 }
+
+/*
+ * Scatter-gather batches
+ * The SD host runs one transfer at a time, so requests go in order.
+ * Multi-segment requests bounce through one buffer so each still costs a
+ * single CMD18/CMD25 instead of one command per segment.
+ */
+static uint8_t *bounce_mem = NULL;
+static uint8_t *bounce_buf = NULL;
+static uint32_t bounce_sectors = 0;
+
+static int ensure_bounce(uint32_t sectors) {
+    if (sectors <= bounce_sectors) return 0;
+    if (bounce_mem) free(bounce_mem);
+    bounce_mem = malloc(sectors * 512 + 64);
+    if (!bounce_mem) {
+        bounce_buf = NULL;
+        bounce_sectors = 0;
+        return -1;
+    }
+    /* DMA wants 64-byte (cache line) alignment */
+    bounce_buf = (uint8_t *)(((uint64_t)bounce_mem + 63) & ~(uint64_t)63);
+    bounce_sectors = sectors;
+    return 0;
+}
+
+static int blk_run_req(int write, const hal_blk_req_t *req) {
+    if (req->nsegs == 1) {
+        return write ? hal_blk_write(req->sector, req->segs[0].buf, req->segs[0].count)
+                     : hal_blk_read(req->sector, req->segs[0].buf, req->segs[0].count);
+    }
+
+    uint32_t total = 0;
+    for (int i = 0; i < req->nsegs; i++) total += req->segs[i].count;
+
+    if (ensure_bounce(total) < 0) {
+        /* No memory for the bounce buffer - one command per segment */
+        uint32_t sector = req->sector;
+        for (int i = 0; i < req->nsegs; i++) {
+            const hal_blk_seg_t *seg = &req->segs[i];
+            int ret = write ? hal_blk_write(sector, seg->buf, seg->count)
+                            : hal_blk_read(sector, seg->buf, seg->count);
+            if (ret < 0) return -1;
+            sector += seg->count;
+        }
+        return 0;
+    }
+
+    if (write) {
+        uint8_t *p = bounce_buf;
+        for (int i = 0; i < req->nsegs; i++) {
+            memcpy(p, req->segs[i].buf, req->segs[i].count * 512);
+            p += req->segs[i].count * 512;
+        }
+        return hal_blk_write(req->sector, bounce_buf, total);
+    }
+
+    if (hal_blk_read(req->sector, bounce_buf, total) < 0) return -1;
+    uint8_t *p = bounce_buf;
+    for (int i = 0; i < req->nsegs; i++) {
+        memcpy(req->segs[i].buf, p, req->segs[i].count * 512);
+        p += req->segs[i].count * 512;
+    }
+    return 0;
+}
+
+int hal_blk_read_batch(const hal_blk_req_t *reqs, int n) {
+    int result = 0;
+    for (int i = 0; i < n; i++) {
+        if (blk_run_req(0, &reqs[i]) < 0) result = -1;
+    }
+    return result;
+}
+
+int hal_blk_write_batch(const hal_blk_req_t *reqs, int n) {
+    int result = 0;
+    for (int i = 0; i < n; i++) {
+        if (blk_run_req(1, &reqs[i]) < 0) result = -1;
+    }
+    return result;
+}
@@ -13,6 +13,9 @@
 #include "../../printf.h"
 #include "../../string.h"
 #include "../../process.h"
+#include "../../smp.h"
+#include "../../keyboard.h"
+#include "../../console.h"
 
 void led_init(void);
 void led_toggle(void);
@@ -31,6 +34,10 @@ static volatile uint32_t *const core_gpu_route     = (uint32_t *)(CORE_CTRL_BASE
 static volatile uint32_t *const core0_timer_ctl    = (uint32_t *)(CORE_CTRL_BASE + 0x40);
 static volatile uint32_t *const core0_irq_src      = (uint32_t *)(CORE_CTRL_BASE + 0x60);
 
+/* Core N's timer control / IRQ source registers follow core 0's, 4 bytes apart */
+#define core_timer_ctl(n)   (core0_timer_ctl + (n))
+#define core_irq_src(n)     (core0_irq_src + (n))
+
 /* Bits in core0_irq_src */
 #define CORE_IRQ_PHYS_SECURE    0x01
 #define CORE_IRQ_PHYS_NONSEC    0x02
@@ -211,7 +218,7 @@ static void service_peripheral_irqs(void) {
  * Top-level IRQ handler, called from exception vectors
  */
 void handle_irq(void) {
-    uint32_t src = *core0_irq_src;
+    uint32_t src = *core_irq_src(smp_cpu_id());
 
     /* Physical timer fired? */
     if (src & CORE_IRQ_PHYS_NONSEC) {
@@ -240,13 +247,28 @@ void handle_irq(void) {
  * Timer tick handler - reschedules itself for the next interval
  */
 static void on_timer_tick(void) {
-    tick_count++;
+    cpu_t *cpu = cpu_this();
 
     /* Reload for next tick */
     uint64_t freq;
     asm volatile("mrs %0, cntfrq_el0" : "=r"(freq));
     asm volatile("msr cntp_tval_el0, %0" :: "r"((freq * tick_period_ms) / 1000));
 
+    // Idle accounting: no process means this core was parked in wfi
+    if (!cpu->current) {
+        cpu->idle_ticks++;
+    }
+
+    // Every core preempts on its own tick; the rest is CPU 0's job
+    if (cpu->id != 0) {
+        if ((++cpu->ticks % 20) == 0) {
+            process_schedule_from_irq();
+        }
+        return;
+    }
+
+    tick_count++;
+
     // Heartbeat LED - toggle every 500ms (50 ticks) = 1Hz
     // (Disk activity will override with faster blinks during I/O)
     if ((tick_count % 50) == 0) {
@@ -257,8 +279,17 @@ static void on_timer_tick(void) {
     // This is much more efficient than SOF-based polling (1000 IRQs/sec)
     hal_usb_keyboard_tick();
 
+    // Wake sleepers whose time is up. USB input has no IRQ of its own here,
+    // so input waiters get to recheck on every tick.
+    process_timer_tick(tick_count);
+    wait_queue_wake(&input_wait_queue);
+
+    // Draw console output nobody has flushed yet (in the console thread -
+    // drawing from here is what broke USB, see below)
+    console_tick();
+
     // Preemptive scheduling - switch every 20 ticks (200ms timeslice)
-    if ((tick_count % 20) == 0) {
+    if ((++cpu->ticks % 20) == 0) {
         process_schedule_from_irq();
     }
 
@@ -291,6 +322,12 @@ void hal_irq_init(void) {
     printf("[IRQ] Pi interrupt system ready\n");
 }
 
+// Timer interrupts for this core (peripheral IRQs stay routed to core 0)
+void hal_irq_init_secondary(void) {
+    *core_timer_ctl(smp_cpu_id()) = CORE_IRQ_PHYS_NONSEC;
+    mem_barrier();
+}
+
 void hal_irq_enable(void) {
     asm volatile("msr daifclr, #2" ::: "memory");
 }
@@ -356,6 +393,13 @@ void hal_timer_init(uint32_t interval_ms) {
     printf("[TIMER] Generic timer running\n");
 }
 
+void hal_timer_init_secondary(void) {
+    uint64_t freq;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    asm volatile("msr cntp_tval_el0, %0" :: "r"((freq * tick_period_ms) / 1000));
+    asm volatile("msr cntp_ctl_el0, %0" :: "r"(1UL));
+}
+
 uint64_t hal_timer_get_ticks(void) {
     return tick_count;
 }
@@ -6,6 +6,7 @@
 
 #include "../hal.h"
 #include "usb/usb_types.h"
+#include "../../smp.h"
 
 // Pi system timer (1MHz free-running counter)
 #define PI_SYSTIMER_LO  (*(volatile uint32_t *)0x3F003004)
@@ -180,7 +181,20 @@ uint32_t hal_get_cpu_freq_mhz(void) {
 }
 
 int hal_get_cpu_cores(void) {
-    return 4;  // Pi Zero 2W has 4 cores
+    return smp_cpu_count();  // Pi Zero 2W has 4 cores
+}
+
+// Firmware armstub spin table: core N polls the 64-bit slot at 0xd8 + 8*N
+// (with caches off) and jumps to whatever address appears there
+#define SPIN_TABLE_BASE 0xd8
+
+void hal_cpu_start(int cpu) {
+    extern void secondary_entry(void);
+    volatile uint64_t *release = (volatile uint64_t *)(uintptr_t)(SPIN_TABLE_BASE + 8 * cpu);
+
+    *release = (uint64_t)secondary_entry;
+    asm volatile("dc civac, %0" :: "r"(release) : "memory");
+    asm volatile("dsb sy; sev" ::: "memory");
 }
 
 // USB Device List
@@ -20,3 +20,11 @@ int hal_blk_read(uint32_t sector, void *buf, uint32_t count) {
 int hal_blk_write(uint32_t sector, const void *buf, uint32_t count) {
     return virtio_blk_write(sector, count, buf);
 }
+
+int hal_blk_read_batch(const hal_blk_req_t *reqs, int n) {
+    return virtio_blk_rw_batch(0, reqs, n);
+}
+
+int hal_blk_write_batch(const hal_blk_req_t *reqs, int n) {
+    return virtio_blk_rw_batch(1, reqs, n);
+}
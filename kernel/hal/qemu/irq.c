@@ -11,6 +11,7 @@
 #include "../../virtio_sound.h"
 #include "../../console.h"
 #include "../../process.h"
+#include "../../smp.h"
 
 // QEMU virt machine GIC addresses
 #define GICD_BASE   0x08000000UL  // Distributor
@@ -57,15 +58,30 @@ static inline void isb(void) {
     asm volatile("isb" ::: "memory");
 }
 
-// Timer IRQ handler
+// Timer IRQ handler (every core has its own timer)
 static void timer_handler(void) {
-    timer_ticks++;
+    cpu_t *cpu = cpu_this();
 
-    // Pump audio if playing
-    virtio_sound_pump();
+    // CPU 0 keeps system time, drives audio and wakes sleepers
+    if (cpu->id == 0) {
+        timer_ticks++;
+
+        // Pump audio if playing
+        virtio_sound_pump();
+
+        process_timer_tick(timer_ticks);
+
+        // Draw console output nobody has flushed yet
+        console_tick();
+    }
+
+    // Idle accounting: no process means this core was parked in wfi
+    if (!cpu->current) {
+        cpu->idle_ticks++;
+    }
 
     // Preemptive scheduling - switch every 20 ticks (200ms timeslice)
-    if ((timer_ticks % 20) == 0) {
+    if ((++cpu->ticks % 20) == 0) {
         process_schedule_from_irq();
     }
 
@@ -147,6 +163,21 @@ void hal_irq_init(void) {
     printf("[IRQ] GIC initialized (Secure, Group 0)\n");
 }
 
+// SGIs and PPIs (IRQs 0-31) and the CPU interface are banked per core
+void hal_irq_init_secondary(void) {
+    dsb();
+    GICD_IGROUPR(0) = 0x00000000;
+    for (uint32_t i = 0; i < 8; i++) {
+        GICD_IPRIORITYR(i) = 0xA0A0A0A0;
+    }
+    dsb();
+
+    GICC_PMR = 0xFF;
+    dsb();
+    GICC_CTLR = 0x1;
+    dsb();
+}
+
 void hal_irq_enable(void) {
     asm volatile("msr daifclr, #2" ::: "memory");
 }
@@ -206,6 +237,16 @@ void hal_timer_init(uint32_t interval_ms) {
     printf("[TIMER] Timer initialized\n");
 }
 
+void hal_timer_init_secondary(void) {
+    asm volatile("msr cntp_tval_el0, %0" :: "r"(timer_interval_ticks));
+    isb();
+    asm volatile("msr cntp_ctl_el0, %0" :: "r"((uint64_t)1));
+    isb();
+
+    // Enables the timer PPI in this core's banked enable register
+    hal_irq_enable_irq(TIMER_IRQ);
+}
+
 uint64_t hal_timer_get_ticks(void) {
     return timer_ticks;
 }
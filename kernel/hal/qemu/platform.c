@@ -3,6 +3,7 @@
  */
 
 #include "../hal.h"
+#include "../../smp.h"
 
 const char *hal_platform_name(void) {
     return "QEMU virt (aarch64)";
@@ -100,7 +101,14 @@ uint32_t hal_get_cpu_freq_mhz(void) {
 }
 
 int hal_get_cpu_cores(void) {
-    return 1;  // Single core in QEMU by default
+    return smp_cpu_count();  // However many -smp gave us
+}
+
+// No firmware (we're the -bios), so no PSCI: secondaries wait in boot.S for
+// their smp_boot_stack[] entry and just need waking
+void hal_cpu_start(int cpu) {
+    (void)cpu;
+    asm volatile("dsb sy; sev" ::: "memory");
 }
 
 // USB Device List - QEMU uses virtio, no USB
@@ -83,6 +83,12 @@ void sleep_ms(uint32_t ms) {
     uint64_t ticks_to_wait = (ms + 9) / 10;
     if (ticks_to_wait == 0) ticks_to_wait = 1;
 
+    // Processes block on the timer wheel; the kernel itself can only wfi
+    if (current_process) {
+        process_sleep_ticks(ticks_to_wait);
+        return;
+    }
+
     uint64_t target = hal_timer_get_ticks() + ticks_to_wait;
     while (hal_timer_get_ticks() < target) {
         wfi();
@@ -15,10 +15,13 @@
 #include "virtio_sound.h"
 #include "fat32.h"
 #include "net.h"
+#include "checksum.h"
 #include "tls.h"
 #include "ttf.h"
 #include "klog.h"
+#include "bcache.h"
 #include "hal/hal.h"
+#include "smp.h"
 
 // Global kernel API instance
 kapi_t kapi;
@@ -29,11 +32,45 @@ static size_t kapi_get_ram_total(void) {
     return (size_t)ram_size;
 }
 
+// Disk cache counters (sysmon)
+static void kapi_get_disk_cache_stats(uint64_t *hits, uint64_t *misses,
+                                      uint64_t *writebacks, uint64_t *readahead) {
+    bcache_stats_t st;
+    bcache_get_stats(&st);
+    if (hits) *hits = st.hits;
+    if (misses) *misses = st.misses;
+    if (writebacks) *writebacks = st.writebacks;
+    if (readahead) *readahead = st.readahead;
+}
+
+static void kapi_disk_sync(void) {
+    bcache_flush();
+}
+
+// Wait queue sleep with the timeout in milliseconds (100Hz timer)
+// Yields and sleeps are where a killed program, back in its own code with
+// no kernel lock held, actually exits (see process_kill)
+static int kapi_wait_queue_sleep(wait_queue_t *wq, uint32_t seq, uint32_t timeout_ms) {
+    int ret = wait_queue_sleep(wq, seq, timeout_ms ? (timeout_ms + 9) / 10 : 0);
+    process_exit_if_killed((uint64_t)__builtin_return_address(0));
+    return ret;
+}
+
 // Wrapper for exit (needs to match signature)
 static void kapi_exit(int status) {
     process_exit(status);
 }
 
+static void kapi_yield(void) {
+    process_yield();
+    process_exit_if_killed((uint64_t)__builtin_return_address(0));
+}
+
+static void kapi_sleep_ms(uint32_t ms) {
+    sleep_ms(ms);
+    process_exit_if_killed((uint64_t)__builtin_return_address(0));
+}
+
 
 // Print integer (simple implementation)
 static void kapi_print_int(int n) {
@@ -98,6 +135,39 @@ static void kapi_set_color(uint32_t fg, uint32_t bg) {
     console_set_color(fg, bg);
 }
 
+// Framebuffer drawing shares the console's lock so two cores (or a program
+// and the console) don't interleave on screen
+static void kapi_fb_put_pixel(uint32_t x, uint32_t y, uint32_t color) {
+    uint64_t flags = console_lock();
+    fb_put_pixel(x, y, color);
+    console_unlock(flags);
+}
+
+static void kapi_fb_fill_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t color) {
+    uint64_t flags = console_lock();
+    fb_fill_rect(x, y, w, h, color);
+    console_unlock(flags);
+}
+
+static void kapi_fb_draw_char(uint32_t x, uint32_t y, char c, uint32_t fg, uint32_t bg) {
+    uint64_t flags = console_lock();
+    fb_draw_char(x, y, c, fg, bg);
+    console_unlock(flags);
+}
+
+static void kapi_fb_draw_string(uint32_t x, uint32_t y, const char *s, uint32_t fg, uint32_t bg) {
+    uint64_t flags = console_lock();
+    fb_draw_string(x, y, s, fg, bg);
+    console_unlock(flags);
+}
+
+static int kapi_fb_flip(int buffer) {
+    uint64_t flags = console_lock();
+    int ret = fb_flip(buffer);
+    console_unlock(flags);
+    return ret;
+}
+
 // Wrapper for VFS open (allocates handle)
 static void *kapi_open(const char *path) {
     return (void *)vfs_open_handle(path);
@@ -118,6 +188,16 @@ static int kapi_write(void *file, const char *buf, size_t size) {
     return vfs_write((vfs_node_t *)file, buf, size);
 }
 
+// Wrapper for VFS positional write
+static int kapi_pwrite(void *file, const char *buf, size_t size, size_t offset) {
+    return vfs_pwrite((vfs_node_t *)file, buf, size, offset);
+}
+
+// Wrapper for VFS append
+static int kapi_append(void *file, const char *buf, size_t size) {
+    return vfs_append((vfs_node_t *)file, buf, size);
+}
+
 // Wrapper for is_dir
 static int kapi_is_dir(void *node) {
     return vfs_is_dir((vfs_node_t *)node);
@@ -235,7 +315,7 @@ void kapi_init(void) {
     kapi.exit = kapi_exit;
     kapi.exec = kapi_exec;
     kapi.exec_args = kapi_exec_args;
-    kapi.yield = process_yield;  // Voluntary yield + preemptive backup
+    kapi.yield = kapi_yield;  // Voluntary yield + preemptive backup
     kapi.spawn = kapi_spawn;
     kapi.spawn_args = kapi_spawn_args;
 
@@ -247,10 +327,10 @@ void kapi_init(void) {
     kapi.fb_base = fb_base;
     kapi.fb_width = fb_width;
     kapi.fb_height = fb_height;
-    kapi.fb_put_pixel = fb_put_pixel;
-    kapi.fb_fill_rect = fb_fill_rect;
-    kapi.fb_draw_char = fb_draw_char;
-    kapi.fb_draw_string = fb_draw_string;
+    kapi.fb_put_pixel = kapi_fb_put_pixel;
+    kapi.fb_fill_rect = kapi_fb_fill_rect;
+    kapi.fb_draw_char = kapi_fb_draw_char;
+    kapi.fb_draw_string = kapi_fb_draw_string;
 
     // Font access
     extern const uint8_t font_data[256][16];
@@ -288,7 +368,7 @@ void kapi_init(void) {
 
     // Power management / timing
     kapi.wfi = wfi;
-    kapi.sleep_ms = sleep_ms;
+    kapi.sleep_ms = kapi_sleep_ms;
 
     // Sound
     kapi.sound_play_wav = virtio_sound_play_wav;
@@ -369,7 +449,7 @@ void kapi_init(void) {
 
     // Hardware double buffering
     kapi.fb_has_hw_double_buffer = fb_has_hw_double_buffer;
-    kapi.fb_flip = fb_flip;
+    kapi.fb_flip = kapi_fb_flip;
     kapi.fb_get_backbuffer = fb_get_backbuffer;
 
     // DMA (hardware accelerated memory copies)
@@ -378,4 +458,83 @@ void kapi_init(void) {
     kapi.dma_copy_2d = hal_dma_copy_2d;
     kapi.dma_fb_copy = hal_dma_fb_copy;
     kapi.dma_fill = hal_dma_fill;
+
+    // Disk block cache
+    kapi.get_disk_cache_stats = kapi_get_disk_cache_stats;
+    kapi.disk_sync = kapi_disk_sync;
+
+    // Incremental file writes
+    kapi.pwrite = kapi_pwrite;
+    kapi.append = kapi_append;
+
+    // Heap fragmentation
+    kapi.get_mem_largest_free = memory_largest_free;
+
+    // Partial window redraw (desktop fills it in)
+    kapi.window_invalidate_rect = 0;
+
+    // High-resolution timing
+    kapi.get_time_us = hal_get_time_us;
+
+    // Streaming audio
+    kapi.sound_stream_start = virtio_sound_stream_start;
+    kapi.sound_stream_queue = (int (*)(const void *, uint32_t))virtio_sound_stream_queue;
+    kapi.sound_stream_retired = virtio_sound_stream_retired;
+
+    // Blocking waits
+    kapi.wait_queue_sleep = kapi_wait_queue_sleep;
+    kapi.wait_queue_wake = wait_queue_wake;
+    kapi.input_wait_queue = &input_wait_queue;
+    kapi.tcp_wait_readable = tcp_wait_readable;
+    kapi.window_wait_event = 0;  // Desktop fills it in
+    kapi.get_cpu_ticks = smp_get_cpu_ticks;
+    kapi.stdio_wait_key = 0;     // Terminal fills it in
+
+    // Network interfaces
+    kapi.net_get_if_stats = net_get_if_stats;
+    kapi.net_set_loss = net_set_loss;
+    kapi.tcp_get_stats = tcp_get_stats;
+    kapi.tcp_set_bufsize = tcp_set_bufsize;
+    kapi.tls_set_bufsize = tls_set_bufsize;
+    kapi.tcp_recv_zc = tcp_recv_zc;
+    kapi.tcp_recv_done = tcp_recv_done;
+    kapi.tcp_listen = tcp_listen;
+    kapi.tcp_accept = tcp_accept;
+    kapi.csum_partial = csum_partial;
+    kapi.csum_partial_scalar = csum_partial_scalar;
+    kapi.dns_lookup = dns_lookup;
+    kapi.dns_flush = dns_flush;
+    kapi.dns_get_stats = dns_get_stats;
+
+    // Font cache
+    kapi.ttf_measure = ttf_measure;
+    kapi.ttf_flush = ttf_flush;
+    kapi.ttf_get_stats = ttf_get_stats;
+
+    // Bulk output
+    kapi.stdio_write = 0;        // Terminal fills it in
+
+    kapi.tls_connect_bufsize = tls_connect_bufsize;
+}
+
+// Hooks left behind by an exited desktop or terminal would otherwise point
+// at whatever program gets loaded there next
+#define RELEASE_HOOK(hook) \
+    if ((uint64_t)kapi.hook - base < size) kapi.hook = 0
+
+void kapi_release_hooks(uint64_t base, uint64_t size) {
+    RELEASE_HOOK(window_create);
+    RELEASE_HOOK(window_destroy);
+    RELEASE_HOOK(window_get_buffer);
+    RELEASE_HOOK(window_poll_event);
+    RELEASE_HOOK(window_invalidate);
+    RELEASE_HOOK(window_set_title);
+    RELEASE_HOOK(window_invalidate_rect);
+    RELEASE_HOOK(window_wait_event);
+    RELEASE_HOOK(stdio_putc);
+    RELEASE_HOOK(stdio_puts);
+    RELEASE_HOOK(stdio_write);
+    RELEASE_HOOK(stdio_getc);
+    RELEASE_HOOK(stdio_has_key);
+    RELEASE_HOOK(stdio_wait_key);
 }
@@ -11,6 +11,9 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "process.h"  // wait_queue_t
+#include "net.h"      // net_if_stats_t
+#include "ttf.h"      // ttf_stats_t
 
 // Kernel API version
 #define KAPI_VERSION 1
@@ -146,7 +149,7 @@ typedef struct {
     int (*get_alloc_count)(void);                            // Number of allocations
 
     // Networking
-    int (*net_ping)(uint32_t ip, uint16_t seq, uint32_t timeout_ms);  // Ping an IP, returns 0 on success
+    int (*net_ping)(uint32_t ip, uint16_t seq, uint32_t timeout_ms);  // Ping an IP, returns RTT in us or -1
     void (*net_poll)(void);                                           // Process incoming packets
     uint32_t (*net_get_ip)(void);                                     // Get our IP address
     void (*net_get_mac)(uint8_t *mac);                               // Get our MAC address (6 bytes)
@@ -214,6 +217,66 @@ typedef struct {
                        uint32_t width, uint32_t height);
     int (*dma_fill)(void *dst, uint32_t value, uint32_t len);   // Fill with 32-bit value
 
+    // Disk block cache
+    void (*get_disk_cache_stats)(uint64_t *hits, uint64_t *misses,     // Block counters since boot
+                                 uint64_t *writebacks, uint64_t *readahead);
+    void (*disk_sync)(void);                 // Write all cached dirty blocks to disk
+
+    // Incremental file writes (write() replaces the whole file)
+    int (*pwrite)(void *file, const char *buf, size_t size, size_t offset);  // Write at offset, extends file
+    int (*append)(void *file, const char *buf, size_t size);                 // Write at end of file
+
+    // Heap fragmentation
+    size_t (*get_mem_largest_free)(void);    // Largest single free block in bytes
+
+    // Partial window redraw (set by desktop, like the window API above)
+    void (*window_invalidate_rect)(int wid, int x, int y, int w, int h);  // Content coords
+
+    // High-resolution timing
+    uint32_t (*get_time_us)(void);           // Microsecond counter (wraps, use differences)
+
+    // Streaming audio (PCM buffers play back to back)
+    int (*sound_stream_start)(uint8_t channels, uint32_t sample_rate);  // Start an empty stream
+    int (*sound_stream_queue)(const void *data, uint32_t samples);      // Queue buffer, -1 if full
+    uint32_t (*sound_stream_retired)(void);  // Buffers finished playing (reuse them)
+
+    // Blocking waits (timeout_ms 0 = wait forever)
+    int (*wait_queue_sleep)(wait_queue_t *wq, uint32_t seq, uint32_t timeout_ms);  // 0 woken, -1 timeout
+    void (*wait_queue_wake)(wait_queue_t *wq);
+    wait_queue_t *input_wait_queue;          // Woken on every key press / mouse event
+    int (*tcp_wait_readable)(int sock, uint32_t timeout_ms);  // 1 readable or closed, 0 timeout
+    int (*window_wait_event)(int wid, uint32_t timeout_ms);   // Desktop provides; 1 event pending
+    void (*get_cpu_ticks)(uint64_t *idle, uint64_t *total);   // Timer ticks over all cores
+    int (*stdio_wait_key)(uint32_t timeout_ms);  // Terminal provides; 1 key pending, 0 timeout
+
+    // Network interfaces (0 = lo, 1 = eth0)
+    int (*net_get_if_stats)(int index, net_if_stats_t *out);  // -1 if no such interface
+    void (*net_set_loss)(uint32_t per_mille);                 // Testing: drop outgoing packets
+    void (*tcp_get_stats)(tcp_stats_t *out);                  // Retransmits, dup ACKs, ...
+    int (*tcp_set_bufsize)(int sock, uint32_t rx_size, uint32_t tx_size);  // Grow buffers/window
+    int (*tls_set_bufsize)(int sock, uint32_t rx_size, uint32_t tx_size);  // Same, TLS socket
+    int (*tcp_recv_zc)(int sock, const void **data);          // Borrow received bytes in place
+    void (*tcp_recv_done)(int sock, uint32_t len);            // ...and give them back
+    int (*tcp_listen)(uint16_t port, int backlog);            // Listening socket or -1
+    int (*tcp_accept)(int listener, uint32_t timeout_ms);     // Connected socket, -1 on timeout
+    uint32_t (*csum_partial)(const void *data, uint32_t len, uint32_t sum);  // Internet checksum (NEON)
+    uint32_t (*csum_partial_scalar)(const void *data, uint32_t len, uint32_t sum);  // Same, word loop
+    int (*dns_lookup)(const char *hostname, dns_answer_t *out); // 0 if resolved; says where from
+    void (*dns_flush)(void);                                  // Drop the cache, reread /etc/hosts
+    void (*dns_get_stats)(dns_stats_t *out);                  // Cache hits, queries, timeouts, ...
+
+    // Font cache
+    int (*ttf_measure)(const char *text, int len, int size, int style);  // UTF-8 width, kerned, cached
+    void (*ttf_flush)(void);                                  // Drop cached glyphs and runs
+    void (*ttf_get_stats)(ttf_stats_t *out);                  // Glyph and run cache hits, pages, ...
+
+    // Bulk output
+    void (*stdio_write)(const char *buf, uint32_t len);      // Terminal provides; len bytes, no NUL needed
+
+    // TLS with buffers sized before the handshake (0 keeps the default)
+    int (*tls_connect_bufsize)(uint32_t ip, uint16_t port, const char *hostname,
+                               uint32_t rx_size, uint32_t tx_size);
+
 } kapi_t;
 
 // TTF font style flags (for ttf_get_glyph)
@@ -238,4 +301,8 @@ extern kapi_t kapi;
 // Initialize the kernel API
 void kapi_init(void);
 
+// Clear the hooks (window_*, stdio_*) that point into [base, base + size),
+// the code of a program that has exited
+void kapi_release_hooks(uint64_t base, uint64_t size);
+
 #endif
@@ -26,6 +26,7 @@
 #include "ttf.h"
 #include "klog.h"
 #include "hal/hal.h"
+#include "smp.h"
 
 // UART functions now use HAL
 void uart_putc(char c) {
@@ -52,6 +53,9 @@ int uart_getc_blocking(void) {
 }
 
 void kernel_main(void) {
+    // Per-core state (TPIDR_EL1) before anything can touch the scheduler
+    smp_init();
+
     // Raw UART test first
     uart_putc('V');
     uart_putc('I');
@@ -231,6 +235,14 @@ void kernel_main(void) {
     // Initialize block device (for persistent storage)
 #ifdef TARGET_QEMU
     virtio_blk_init();
+
+    // Register block IRQ handler (completes queued disk requests)
+    uint32_t blk_irq = virtio_blk_get_irq();
+    if (blk_irq > 0) {
+        irq_register_handler(blk_irq, virtio_blk_irq_handler);
+        irq_enable_irq(blk_irq);
+        printf("[KERNEL] Block IRQ %d registered\n", blk_irq);
+    }
 #else
     // For Pi, use HAL block device (EMMC/SD card)
     if (hal_blk_init() < 0) {
@@ -252,10 +264,10 @@ void kernel_main(void) {
         irq_enable_irq(net_irq);
         printf("[KERNEL] Network IRQ %d registered\n", net_irq);
     }
+#endif
 
-    // Initialize network stack (IP, ARP, ICMP)
+    // Initialize network stack (IP, ARP, ICMP) - lo works without a NIC
     net_init();
-#endif
 
     // Initialize filesystem (will use FAT32 if disk available)
     vfs_init();
@@ -272,6 +284,12 @@ void kernel_main(void) {
     // Initialize process subsystem
     process_init();
 
+    // Received packets are handled by a kernel thread from here on
+    net_softirq_start();
+
+    // ...and console output putc leaves undrawn
+    console_start_thread();
+
     // Load embedded binaries into VFS
     initramfs_init();
 
@@ -283,6 +301,9 @@ void kernel_main(void) {
 #endif
     // Pi: interrupts already enabled before USB init
 
+    // Bring up the other cores - they idle in the scheduler
+    smp_start_secondaries();
+
     printf("\n");
     printf("[KERNEL] Starting shell...\n");
 
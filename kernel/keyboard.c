@@ -111,6 +111,8 @@ static volatile int key_buf_write = 0;
 // Are we using interrupt-driven mode?
 static int irq_mode = 0;
 
+wait_queue_t input_wait_queue = WAIT_QUEUE_INIT;
+
 // Legacy virtio queue layout requires specific alignment and contiguous layout
 // For queue size N:
 //   Descriptor table: N * 16 bytes, 16-byte aligned
@@ -441,6 +443,7 @@ static void process_events(void) {
     // Check for new events
     mb();  // Ensure we see device updates
     uint16_t current_used = used->idx;
+    int old_write = key_buf_write;
     while (last_used_idx != current_used) {
         uint16_t idx = last_used_idx % QUEUE_SIZE;
         uint32_t desc_idx = used->ring[idx].id;
@@ -531,6 +534,10 @@ static void process_events(void) {
 
     // Ack interrupt (in case we use interrupts later)
     write32(kbd_base + VIRTIO_MMIO_INTERRUPT_ACK/4, read32(kbd_base + VIRTIO_MMIO_INTERRUPT_STATUS/4));
+
+    if (key_buf_write != old_write) {
+        wait_queue_wake(&input_wait_queue);
+    }
 }
 
 int keyboard_has_key(void) {
@@ -8,6 +8,10 @@
 #define KEYBOARD_H
 
 #include <stdint.h>
+#include "process.h"
+
+// Woken on every key press and mouse event (mouse.c shares it)
+extern wait_queue_t input_wait_queue;
 
 // Initialize keyboard
 int keyboard_init(void);
@@ -1,8 +1,16 @@
 /*
  * VibeOS Memory Management
  *
- * Simple first-fit heap allocator. Not the fastest, but easy to understand.
- * Each allocation has a header with size and free flag.
+ * Two-level heap allocator:
+ *   - Small requests (up to 2KB) come from per-size-class slabs. A slab is a
+ *     SLAB_SIZE-aligned chunk carved into equal objects with a free list, so
+ *     malloc and free are a couple of pointer swaps.
+ *   - Everything else (including the slabs themselves) comes from a
+ *     boundary-tag allocator. Every block records its own size and the size
+ *     of the block before it, so free() merges with both neighbours in O(1).
+ *     Free blocks sit in power-of-two bins with a bitmap of non-empty bins.
+ * A byte map with one entry per SLAB_SIZE page tells free() which side a
+ * pointer came from.
  *
  * RAM is detected at runtime by parsing the Device Tree Blob (DTB).
  */
@@ -10,6 +18,8 @@
 #include "memory.h"
 #include "dtb.h"
 #include "printf.h"
+#include "string.h"
+#include "spinlock.h"
 
 // Detected RAM info (populated by memory_init)
 uint64_t ram_base;
@@ -19,23 +29,82 @@ uint64_t ram_size;
 uint64_t heap_start;
 uint64_t heap_end;
 
-// Block header - sits before each allocation
+// Program area: [heap_end, program_end)
+uint64_t program_end;
+
+#define ALIGN_UP(x, align) (((x) + ((align) - 1)) & ~((align) - 1))
+
+// ============ Large blocks (boundary tags) ============
+
+// Block header - sits before each large allocation and each slab
+// size covers the whole block including this header; bit 0 = in use
 typedef struct block_header {
-    size_t size;                    // Size of data area (not including header)
-    uint8_t is_free;                // 1 if block is free, 0 if allocated
-    struct block_header *next;      // Next block in list
+    size_t size;
+    size_t prev_size;               // Size of the physically previous block (0 = first)
+    // Free blocks only (overlaps the data area):
+    struct block_header *next_free;
+    struct block_header *prev_free;
 } block_header_t;
 
-#define HEADER_SIZE sizeof(block_header_t)
-#define ALIGN_UP(x, align) (((x) + ((align) - 1)) & ~((align) - 1))
+#define HEADER_SIZE     16          // size + prev_size; keeps data 16-aligned
+#define MIN_BLOCK       32          // Header + free-list links
+#define BLOCK_USED      1UL
+#define BLOCK_SIZE(b)   ((b)->size & ~(size_t)15)
+#define NUM_BINS        48
+
+static block_header_t *bins[NUM_BINS];  // Free blocks by floor(log2(size))
+static uint64_t bin_map = 0;            // Bit n set = bins[n] not empty
+static uint8_t *block_limit;            // End of the block area
+
+// ============ Small objects (slabs) ============
 
-static block_header_t *free_list = NULL;
+#define SLAB_SHIFT      15
+#define SLAB_SIZE       (1UL << SLAB_SHIFT)   // 32KB
+#define SMALL_MAX       2048
+#define NUM_CLASSES     14
+
+static const uint16_t class_size[NUM_CLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+
+// Slab header - first bytes of each slab, objects follow
+typedef struct slab {
+    struct slab *next;              // Partial list links (slabs with free objects)
+    struct slab *prev;
+    void *free_objs;                // Singly linked free objects
+    uint16_t in_use;
+    uint16_t total;
+    uint8_t cls;
+    uint8_t on_list;
+} slab_t;
+
+#define SLAB_HDR ALIGN_UP(sizeof(slab_t), 16)
+
+static slab_t *partial[NUM_CLASSES];           // Slabs with at least one free object
+static uint8_t size_to_class[SMALL_MAX / 16 + 1];  // (size + 15) / 16 -> class
+
+// One byte per SLAB_SIZE page of the heap: 1 = page is a slab
+static uint8_t *page_map;
+static uint64_t page_base;
+static size_t page_count;
 
 // O(1) counters - updated on malloc/free instead of scanning
-static size_t stat_used = 0;      // Total bytes in use (including headers)
-static size_t stat_free = 0;      // Total bytes free
+static size_t stat_used = 0;      // Bytes handed out (block sizes incl. headers, or class sizes)
+static size_t stat_free = 0;      // Bytes in free blocks plus free slab objects
 static int stat_alloc_count = 0;  // Number of active allocations
 
+// Processes are preempted from the timer IRQ and run on every core, so mask
+// IRQs and take a spinlock around every heap operation
+static spinlock_t heap_spin = SPINLOCK_INIT;
+
+static inline uint64_t heap_lock(void) {
+    return spin_lock_irqsave(&heap_spin);
+}
+
+static inline void heap_unlock(uint64_t flags) {
+    spin_unlock_irqrestore(&heap_spin, flags);
+}
+
 // Defined in linker script - end of BSS in RAM
 // Declared as char[] so the symbol name gives the address directly
 extern char _bss_end[];
@@ -52,6 +121,235 @@ extern char _bss_end[];
 // Leave some room below stack for safety (1MB)
 #define STACK_BUFFER (1 * 1024 * 1024)
 
+// ============ Large block helpers ============
+
+static inline int bin_index(size_t size) {
+    int bin = 63 - __builtin_clzl(size);
+    return bin < NUM_BINS ? bin : NUM_BINS - 1;
+}
+
+static inline block_header_t *next_block(block_header_t *b) {
+    return (block_header_t *)((uint8_t *)b + BLOCK_SIZE(b));
+}
+
+static void bin_insert(block_header_t *b) {
+    int bin = bin_index(BLOCK_SIZE(b));
+    b->prev_free = NULL;
+    b->next_free = bins[bin];
+    if (bins[bin]) bins[bin]->prev_free = b;
+    bins[bin] = b;
+    bin_map |= 1UL << bin;
+}
+
+static void bin_remove(block_header_t *b) {
+    int bin = bin_index(BLOCK_SIZE(b));
+    if (b->prev_free) b->prev_free->next_free = b->next_free;
+    else bins[bin] = b->next_free;
+    if (b->next_free) b->next_free->prev_free = b->prev_free;
+    if (!bins[bin]) bin_map &= ~(1UL << bin);
+}
+
+// Set a block's size and flags, keeping the next block's back link in sync
+static void set_block(block_header_t *b, size_t size, size_t flags) {
+    b->size = size | flags;
+    block_header_t *n = next_block(b);
+    if ((uint8_t *)n < block_limit) n->prev_size = size;
+}
+
+// Shrink a used block to size bytes and free the tail if it is worth keeping
+static void trim_block(block_header_t *b, size_t size) {
+    size_t total = BLOCK_SIZE(b);
+    if (total - size < MIN_BLOCK) return;
+
+    set_block(b, size, BLOCK_USED);
+    block_header_t *rest = next_block(b);
+    rest->prev_size = size;
+    set_block(rest, total - size, 0);
+    stat_free += total - size;
+
+    // The tail can border a free block (realloc growing into a neighbour)
+    block_header_t *n = next_block(rest);
+    if ((uint8_t *)n < block_limit && !(n->size & BLOCK_USED)) {
+        bin_remove(n);
+        set_block(rest, BLOCK_SIZE(rest) + BLOCK_SIZE(n), 0);
+    }
+    bin_insert(rest);
+}
+
+// Take a block of at least need bytes (header included) off the free bins
+static block_header_t *large_alloc(size_t need) {
+    int bin = bin_index(need);
+    block_header_t *b = NULL;
+
+    // First fit within the request's own bin...
+    for (block_header_t *c = bins[bin]; c; c = c->next_free) {
+        if (BLOCK_SIZE(c) >= need) {
+            b = c;
+            break;
+        }
+    }
+
+    // ...otherwise the smallest non-empty larger bin always fits
+    if (!b) {
+        uint64_t larger = bin_map & ~((2UL << bin) - 1);
+        if (!larger) return NULL;
+        b = bins[__builtin_ctzl(larger)];
+    }
+
+    bin_remove(b);
+    stat_free -= BLOCK_SIZE(b);
+    set_block(b, BLOCK_SIZE(b), BLOCK_USED);
+    trim_block(b, need);
+    return b;
+}
+
+// Same, but the data area starts on an align boundary
+static block_header_t *large_alloc_aligned(size_t need, size_t align) {
+    block_header_t *b = large_alloc(need + align + MIN_BLOCK);
+    if (!b) return NULL;
+
+    uint64_t data = (uint64_t)b + HEADER_SIZE;
+    uint64_t aligned = ALIGN_UP(data, align);
+    if (aligned != data) {
+        if (aligned - data < MIN_BLOCK) aligned += align;
+
+        // Hand the space in front back as a free block of its own. Its
+        // physical predecessor is in use (free blocks never touch), so
+        // there is nothing to merge with.
+        size_t front = aligned - data;
+        size_t total = BLOCK_SIZE(b);
+        block_header_t *a = (block_header_t *)(aligned - HEADER_SIZE);
+        set_block(a, total - front, BLOCK_USED);
+        set_block(b, front, 0);
+        bin_insert(b);
+        stat_free += front;
+        b = a;
+    }
+
+    trim_block(b, need);
+    return b;
+}
+
+// Return a block to the bins, merging with free neighbours on both sides
+static void large_free(block_header_t *b) {
+    size_t size = BLOCK_SIZE(b);
+    stat_free += size;
+
+    block_header_t *n = next_block(b);
+    if ((uint8_t *)n < block_limit && !(n->size & BLOCK_USED)) {
+        bin_remove(n);
+        size += BLOCK_SIZE(n);
+    }
+
+    if (b->prev_size) {
+        block_header_t *p = (block_header_t *)((uint8_t *)b - b->prev_size);
+        if (!(p->size & BLOCK_USED)) {
+            bin_remove(p);
+            size += BLOCK_SIZE(p);
+            b = p;
+        }
+    }
+
+    set_block(b, size, 0);
+    bin_insert(b);
+}
+
+// ============ Slab helpers ============
+
+static inline int is_slab_ptr(const void *ptr) {
+    uint64_t addr = (uint64_t)ptr;
+    if (addr < page_base) return 0;
+    size_t page = (addr - page_base) >> SLAB_SHIFT;
+    return page < page_count && page_map[page];
+}
+
+static inline slab_t *slab_of(const void *ptr) {
+    return (slab_t *)((uint64_t)ptr & ~(SLAB_SIZE - 1));
+}
+
+static void slab_link(slab_t *s) {
+    s->prev = NULL;
+    s->next = partial[s->cls];
+    if (s->next) s->next->prev = s;
+    partial[s->cls] = s;
+    s->on_list = 1;
+}
+
+static void slab_unlink(slab_t *s) {
+    if (s->prev) s->prev->next = s->next;
+    else partial[s->cls] = s->next;
+    if (s->next) s->next->prev = s->prev;
+    s->on_list = 0;
+}
+
+static slab_t *slab_create(int cls) {
+    block_header_t *b = large_alloc_aligned(HEADER_SIZE + SLAB_SIZE, SLAB_SIZE);
+    if (!b) return NULL;
+
+    slab_t *s = (slab_t *)((uint8_t *)b + HEADER_SIZE);
+    size_t size = class_size[cls];
+    s->cls = cls;
+    s->in_use = 0;
+    s->total = (SLAB_SIZE - SLAB_HDR) / size;
+    s->free_objs = NULL;
+
+    // Push in reverse so objects are handed out in address order
+    uint8_t *obj = (uint8_t *)s + SLAB_HDR + (size_t)(s->total - 1) * size;
+    for (int i = 0; i < s->total; i++, obj -= size) {
+        *(void **)obj = s->free_objs;
+        s->free_objs = obj;
+    }
+
+    page_map[((uint64_t)s - page_base) >> SLAB_SHIFT] = 1;
+    stat_free += (size_t)s->total * size;
+    slab_link(s);
+    return s;
+}
+
+static void slab_destroy(slab_t *s) {
+    slab_unlink(s);
+    page_map[((uint64_t)s - page_base) >> SLAB_SHIFT] = 0;
+    stat_free -= (size_t)s->total * class_size[s->cls];
+    large_free((block_header_t *)((uint8_t *)s - HEADER_SIZE));
+}
+
+static void *small_alloc(int cls) {
+    slab_t *s = partial[cls];
+    if (!s) {
+        s = slab_create(cls);
+        if (!s) return NULL;
+    }
+
+    void *obj = s->free_objs;
+    s->free_objs = *(void **)obj;
+    s->in_use++;
+    if (!s->free_objs) slab_unlink(s);
+
+    stat_free -= class_size[cls];
+    stat_used += class_size[cls];
+    return obj;
+}
+
+static void small_free(void *ptr) {
+    slab_t *s = slab_of(ptr);
+    *(void **)ptr = s->free_objs;
+    s->free_objs = ptr;
+    s->in_use--;
+
+    stat_free += class_size[s->cls];
+    stat_used -= class_size[s->cls];
+
+    if (!s->on_list) {
+        slab_link(s);
+    }
+
+    // Give empty slabs back, but keep the last one so a class that
+    // hovers around a slab boundary doesn't create/destroy every call
+    if (s->in_use == 0 && (partial[s->cls] != s || s->next)) {
+        slab_destroy(s);
+    }
+}
+
 void memory_init(void) {
     // Note: Don't use printf here - console isn't initialized yet!
 
@@ -93,104 +391,88 @@ void memory_init(void) {
     }
 
     heap_end = heap_max;
+    program_end = heap_end + program_reserve;
 
     printf("[MEM] heap: 0x%lx - 0x%lx, stack at 0x%lx\n",
            heap_start, heap_end, (uint64_t)KERNEL_STACK_TOP);
 
-    // Initialize with one giant free block
-    free_list = (block_header_t *)heap_start;
-    free_list->size = heap_end - heap_start - HEADER_SIZE;
-    free_list->is_free = 1;
-    free_list->next = NULL;
+    // Slab page map lives at the bottom of the heap
+    page_base = heap_start & ~(SLAB_SIZE - 1);
+    page_count = ((heap_end - page_base) >> SLAB_SHIFT) + 1;
+    page_map = (uint8_t *)heap_start;
+    memset(page_map, 0, page_count);
+
+    // Request size (in 16-byte units) -> smallest class that fits
+    int cls = 0;
+    for (int i = 0; i <= SMALL_MAX / 16; i++) {
+        while (class_size[cls] < i * 16) cls++;
+        size_to_class[i] = cls;
+    }
+
+    // Initialize with one giant free block after the map
+    block_header_t *first = (block_header_t *)ALIGN_UP(heap_start + page_count, 16);
+    block_limit = (uint8_t *)(heap_end & ~15UL);
+    first->prev_size = 0;
+    first->size = block_limit - (uint8_t *)first;
+    bin_insert(first);
 
     // Initialize O(1) counters
     stat_used = 0;
-    stat_free = free_list->size;
+    stat_free = BLOCK_SIZE(first);
     stat_alloc_count = 0;
 }
 
 void *malloc(size_t size) {
-    if (size == 0) return NULL;
-
-    // Align size to 16 bytes
-    size = ALIGN_UP(size, 16);
-
-    block_header_t *current = free_list;
-
-    // First-fit: find first block that's big enough
-    while (current != NULL) {
-        if (current->is_free && current->size >= size) {
-            // Found a suitable block
-            size_t old_size = current->size;
-
-            // Split if there's enough room for another block
-            if (current->size >= size + HEADER_SIZE + 16) {
-                // Create new block after this allocation
-                block_header_t *new_block = (block_header_t *)((uint8_t *)current + HEADER_SIZE + size);
-                new_block->size = current->size - size - HEADER_SIZE;
-                new_block->is_free = 1;
-                new_block->next = current->next;
-
-                current->size = size;
-                current->next = new_block;
-
-                // Update counters: we used size+header, free lost size+header
-                stat_used += size + HEADER_SIZE;
-                stat_free -= size + HEADER_SIZE;
-            } else {
-                // No split: entire block becomes used
-                stat_used += old_size + HEADER_SIZE;
-                stat_free -= old_size;
-            }
-
-            current->is_free = 0;
-            stat_alloc_count++;
-            return (void *)((uint8_t *)current + HEADER_SIZE);
+    if (size == 0 || size > heap_end - heap_start) return NULL;
+
+    uint64_t flags = heap_lock();
+    void *ptr = NULL;
+
+    if (size <= SMALL_MAX) {
+        ptr = small_alloc(size_to_class[(size + 15) >> 4]);
+    }
+
+    // Large requests, or small ones when no new slab fits
+    if (!ptr) {
+        block_header_t *b = large_alloc(ALIGN_UP(size, 16) + HEADER_SIZE);
+        if (b) {
+            stat_used += BLOCK_SIZE(b);
+            ptr = (uint8_t *)b + HEADER_SIZE;
         }
-        current = current->next;
     }
 
-    // No suitable block found
-    return NULL;
+    if (ptr) stat_alloc_count++;
+    heap_unlock(flags);
+    return ptr;
 }
 
 void free(void *ptr) {
     if (ptr == NULL) return;
 
-    // Get header
-    block_header_t *block = (block_header_t *)((uint8_t *)ptr - HEADER_SIZE);
-
-    // Update counters before marking free
-    stat_used -= block->size + HEADER_SIZE;
-    stat_free += block->size;
-    stat_alloc_count--;
-
-    block->is_free = 1;
-
-    // Coalesce adjacent free blocks
-    block_header_t *current = free_list;
-    while (current != NULL) {
-        if (current->is_free && current->next != NULL && current->next->is_free) {
-            // Merge with next block - reclaim header space
-            stat_free += HEADER_SIZE;
-            current->size += HEADER_SIZE + current->next->size;
-            current->next = current->next->next;
-            // Don't advance - check if we can merge again
-        } else {
-            current = current->next;
+    uint64_t flags = heap_lock();
+
+    if (is_slab_ptr(ptr)) {
+        small_free(ptr);
+        stat_alloc_count--;
+    } else {
+        block_header_t *block = (block_header_t *)((uint8_t *)ptr - HEADER_SIZE);
+        if (block->size & BLOCK_USED) {  // Ignore double frees
+            stat_used -= BLOCK_SIZE(block);
+            large_free(block);
+            stat_alloc_count--;
         }
     }
+
+    heap_unlock(flags);
 }
 
 void *calloc(size_t nmemb, size_t size) {
+    if (size != 0 && nmemb > (size_t)-1 / size) return NULL;
+
     size_t total = nmemb * size;
     void *ptr = malloc(total);
     if (ptr != NULL) {
-        // Zero the memory
-        uint8_t *p = (uint8_t *)ptr;
-        for (size_t i = 0; i < total; i++) {
-            p[i] = 0;
-        }
+        memset(ptr, 0, total);
     }
     return ptr;
 }
@@ -202,21 +484,47 @@ void *realloc(void *ptr, size_t size) {
         return NULL;
     }
 
-    block_header_t *block = (block_header_t *)((uint8_t *)ptr - HEADER_SIZE);
+    uint64_t flags = heap_lock();
+    size_t old_size;
 
-    // If current block is big enough, just return it
-    if (block->size >= size) {
-        return ptr;
+    if (is_slab_ptr(ptr)) {
+        old_size = class_size[slab_of(ptr)->cls];
+        if (old_size >= size) {
+            heap_unlock(flags);
+            return ptr;
+        }
+    } else {
+        block_header_t *block = (block_header_t *)((uint8_t *)ptr - HEADER_SIZE);
+        size_t have = BLOCK_SIZE(block);
+        size_t need = ALIGN_UP(size, 16) + HEADER_SIZE;
+        old_size = have - HEADER_SIZE;
+
+        // If current block is big enough, just return it
+        if (have >= need) {
+            heap_unlock(flags);
+            return ptr;
+        }
+
+        // Grow in place when the next block is free and big enough
+        block_header_t *next = next_block(block);
+        if ((uint8_t *)next < block_limit && !(next->size & BLOCK_USED) &&
+            have + BLOCK_SIZE(next) >= need) {
+            bin_remove(next);
+            stat_free -= BLOCK_SIZE(next);
+            set_block(block, have + BLOCK_SIZE(next), BLOCK_USED);
+            trim_block(block, need);
+            stat_used += BLOCK_SIZE(block) - have;
+            heap_unlock(flags);
+            return ptr;
+        }
     }
 
+    heap_unlock(flags);
+
     // Otherwise allocate new block and copy
     void *new_ptr = malloc(size);
     if (new_ptr != NULL) {
-        uint8_t *src = (uint8_t *)ptr;
-        uint8_t *dst = (uint8_t *)new_ptr;
-        for (size_t i = 0; i < block->size; i++) {
-            dst[i] = src[i];
-        }
+        memcpy(new_ptr, ptr, old_size);
         free(ptr);
     }
     return new_ptr;
@@ -247,3 +555,19 @@ uint64_t memory_get_sp(void) {
 int memory_alloc_count(void) {
     return stat_alloc_count;  // O(1) - no scanning!
 }
+
+size_t memory_largest_free(void) {
+    uint64_t flags = heap_lock();
+    size_t largest = 0;
+
+    // The biggest block is somewhere in the highest non-empty bin
+    if (bin_map) {
+        int bin = 63 - __builtin_clzl(bin_map);
+        for (block_header_t *b = bins[bin]; b; b = b->next_free) {
+            if (BLOCK_SIZE(b) > largest) largest = BLOCK_SIZE(b);
+        }
+    }
+
+    heap_unlock(flags);
+    return largest ? largest - HEADER_SIZE : 0;
+}
@@ -16,10 +16,13 @@ extern uint64_t ram_size;
 extern uint64_t heap_start;
 extern uint64_t heap_end;
 
+// End of the program area that follows the heap (set by memory_init)
+extern uint64_t program_end;
+
 // Initialize memory management (parses DTB to detect RAM)
 void memory_init(void);
 
-// Simple heap allocator
+// Heap allocator (size-class slabs + boundary-tag blocks)
 void *malloc(size_t size);
 void free(void *ptr);
 void *calloc(size_t nmemb, size_t size);
@@ -28,6 +31,7 @@ void *realloc(void *ptr, size_t size);
 // Memory stats
 size_t memory_used(void);
 size_t memory_free(void);
+size_t memory_largest_free(void);  // Biggest single allocation that would succeed
 
 // Heap bounds (for debugging)
 uint64_t memory_heap_start(void);
@@ -7,6 +7,7 @@
  */
 
 #include "mouse.h"
+#include "keyboard.h"
 #include "printf.h"
 #include "string.h"
 #include "hal/hal.h"
@@ -280,6 +281,7 @@ void mouse_poll(void) {
 
     mb();
     uint16_t current_used = used->idx;
+    int got_events = (last_used_idx != current_used);
 
     while (last_used_idx != current_used) {
         uint16_t idx = last_used_idx % QUEUE_SIZE;
@@ -330,6 +332,10 @@ void mouse_poll(void) {
     write32(mouse_base + VIRTIO_MMIO_QUEUE_NOTIFY/4, 0);
     write32(mouse_base + VIRTIO_MMIO_INTERRUPT_ACK/4,
             read32(mouse_base + VIRTIO_MMIO_INTERRUPT_STATUS/4));
+
+    if (got_events) {
+        wait_queue_wake(&input_wait_queue);
+    }
 }
 
 void mouse_get_pos(int *x, int *y) {
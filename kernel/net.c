@@ -6,19 +6,116 @@
 
 #include "net.h"
 #include "virtio_net.h"
+#include "checksum.h"
+#include "irq.h"
+#include "hal/hal.h"
 #include "printf.h"
 #include "string.h"
+#include "memory.h"
+#include "spinlock.h"
+#include "process.h"
+#include "vfs.h"
+
+// The stack runs one caller at a time - processes on other cores call in
+// through the kapi. Public entry points take net_mutex (it's recursive, so
+// dns_resolve() -> udp_send() nests); waits drop it while asleep.
+static mutex_t net_mutex = MUTEX_INIT;
+
+// Received packets are handled as deferred work, softirq style. The NIC's
+// IRQ handler (and lo_xmit) only raise it; the netsoftirq kernel thread
+// then drains up to NET_RX_BUDGET frames per pass, runs the protocol
+// handlers and the TCP timers, and wakes everyone sleeping on
+// net_rx_wait_queue to recheck their sockets.
+#define NET_RX_BUDGET 64
+#define NET_SOFTIRQ_IDLE_TICKS 10   // Wake this often anyway, in case an IRQ went missing
+
+static volatile int net_softirq_pending = 0;
+static wait_queue_t net_softirq_wait = WAIT_QUEUE_INIT;
+static volatile int net_softirq_pid = 0;     // 0 until the thread is running
+static volatile int net_timers_armed = 0;    // TCP retransmit and ARP timers left running
+
+static int net_rx_action(int budget);
+static void net_softirq_kick(void);
+
+// Leaving the stack with work raised and nobody left to do it hands the
+// work to the thread. Frames sent while we held it go to the device in
+// one batch, now.
+static void net_release(void) {
+    if (net_mutex.depth == 1) virtio_net_kick();
+    int kick = net_mutex.depth == 1 && net_softirq_pending;
+    mutex_unlock(&net_mutex);
+    if (kick) net_softirq_kick();
+}
+
+static void net_unlock(int *scope) {
+    (void)scope;
+    net_release();
+}
+
+// Hold net_mutex until the enclosing function returns
+#define NET_LOCKED() \
+    mutex_lock(&net_mutex); \
+    int net_scope __attribute__((cleanup(net_unlock), unused)) = 0
+
+// Run raised softirq work right here. A caller that already holds the
+// stack does it instead of handing it over - that keeps loopback traffic,
+// which has no IRQ behind it, on the sending process's core.
+static void net_softirq_flush(void) {
+    if (!net_softirq_pending && net_softirq_pid) return;
+    net_softirq_pending = 0;
+    net_rx_action(NET_RX_BUDGET);
+}
+
+// Sleep until received packets have been handled or ticks pass (0 = no
+// limit), letting other processes use the stack meanwhile. seq is
+// net_rx_wait_queue.seq from before the caller checked its condition.
+// Only call it holding net_mutex once.
+static void net_wait(uint32_t seq, uint32_t ticks) {
+    net_softirq_flush();
+    if (net_rx_wait_queue.seq != seq) return;
+
+    // Nobody else handles packets before the thread starts: poll every tick
+    if (!net_softirq_pid && (ticks == 0 || ticks > 1)) ticks = 1;
+
+    net_release();
+    wait_queue_sleep(&net_rx_wait_queue, seq, ticks);
+    mutex_lock(&net_mutex);
+}
 
 // Our MAC and IP
 static uint8_t our_mac[6];
 static uint32_t our_ip = NET_IP;
 
-// ARP table
-#define ARP_TABLE_SIZE 16
+// ARP neighbor cache (see arp_find)
+#define ARP_TABLE_SIZE      64
+#define ARP_HASH_SIZE       16
+#define ARP_HASH(ip)        ((uint32_t)((ip) * 2654435761u) >> 28)
+#define ARP_RETRY_TICKS     100             // Resend unanswered requests every second...
+#define ARP_MAX_PROBES      3               // ...this many times in all
+#define ARP_REACHABLE_TICKS (30 * 100)      // Trust an answer this long
+#define ARP_GC_TICKS        (300 * 100)     // Forget stale neighbors unused this long
+#define ARP_DEFEND_TICKS    (10 * 100)      // Reassert our address at most this often
 static arp_entry_t arp_table[ARP_TABLE_SIZE];
+static int8_t arp_buckets[ARP_HASH_SIZE];   // First entry of each chain, -1 = none
+static uint64_t arp_timers_last = 0;
+static uint64_t arp_last_announce = 0;
+
+// Packets waiting on ARP: the first ones sent to a neighbor go out when it
+// answers instead of being lost
+#define ARP_QUEUE_LEN        16
+#define ARP_QUEUE_PER_NEIGH  4
+#define ARP_QUEUE_MTU        (NET_MTU - sizeof(eth_header_t))
+
+typedef struct {
+    uint32_t len;               // 0 = free
+    uint32_t next_hop;
+    uint32_t order;             // Sequence number, to send them in order
+    uint16_t csum_offset;
+    uint8_t data[ARP_QUEUE_MTU];
+} arp_queued_t;
 
-// Packet buffer
-static uint8_t pkt_buf[1600];
+static arp_queued_t arp_queue[ARP_QUEUE_LEN];
+static uint32_t arp_queue_order = 0;
 
 // Broadcast MAC
 static const uint8_t broadcast_mac[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
@@ -27,6 +124,8 @@ static const uint8_t broadcast_mac[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 static volatile int ping_received = 0;
 static volatile uint16_t ping_id = 0;
 static volatile uint16_t ping_seq = 0;
+static uint32_t ping_sent_us = 0;
+static uint32_t ping_rtt_us = 0;
 
 // UDP listener table
 #define UDP_MAX_LISTENERS 8
@@ -86,8 +185,12 @@ void net_init(void) {
 
     // Clear ARP table
     memset(arp_table, 0, sizeof(arp_table));
+    memset(arp_buckets, 0xff, sizeof(arp_buckets));
 
     printf("[NET] Stack initialized, IP=%s\n", ip_to_str(our_ip));
+
+    // Let the link know where we are
+    arp_announce();
 }
 
 uint32_t net_get_ip(void) {
@@ -98,63 +201,246 @@ void net_get_mac(uint8_t *mac) {
     memcpy(mac, our_mac, 6);
 }
 
-// Send ethernet frame
-int eth_send(const uint8_t *dst_mac, uint16_t ethertype, const void *data, uint32_t len) {
-    if (len > NET_MTU - sizeof(eth_header_t)) {
-        return -1;
+// ============ Interfaces and routing ============
+
+// An interface takes finished IP packets; next_hop is the neighbor on the
+// link to hand them to (the destination itself, or the gateway). A nonzero
+// csum_offset means the TCP/UDP checksum at that offset from the start of
+// the IP payload was left partial for the device (see net_csum_offload).
+typedef struct net_iface {
+    net_if_stats_t stats;    // Name, address and counters
+    int (*xmit)(struct net_iface *ifp, uint32_t next_hop, const void *pkt, uint32_t len,
+                uint16_t csum_offset);
+} net_iface_t;
+
+static int lo_xmit(net_iface_t *ifp, uint32_t next_hop, const void *pkt, uint32_t len,
+                   uint16_t csum_offset);
+static int eth_xmit(net_iface_t *ifp, uint32_t next_hop, const void *pkt, uint32_t len,
+                    uint16_t csum_offset);
+static int eth_output(const uint8_t *dst_mac, uint16_t ethertype, const void *data, uint32_t len,
+                      uint16_t csum_start, uint16_t csum_offset);
+
+static net_iface_t net_ifaces[NET_IF_COUNT] = {
+    [NET_IF_LO]   = { { "lo",   NET_LOOPBACK_IP, NET_LOOPBACK_MASK }, lo_xmit },
+    [NET_IF_ETH0] = { { "eth0", NET_IP,          NET_NETMASK },       eth_xmit },
+};
+
+#define IS_LOOPBACK(ip) (((ip) & NET_LOOPBACK_MASK) == (NET_LOOPBACK_IP & NET_LOOPBACK_MASK))
+
+// Packet rates: counters as of the last measurement (net_update_rates)
+#define NET_RATE_TICKS 100
+static uint64_t net_rate_last = 0;
+static uint32_t net_rate_rx[NET_IF_COUNT];
+static uint32_t net_rate_tx[NET_IF_COUNT];
+
+// Loss injection for testing recovery: drop this many packets per
+// thousand on the way out, on every interface (0 = off)
+static uint32_t net_loss_per_mille = 0;
+static uint32_t net_loss_rand = 12345;
+
+void net_set_loss(uint32_t per_mille) {
+    net_loss_per_mille = per_mille > 1000 ? 1000 : per_mille;
+}
+
+// Loopback queue: lo_xmit() copies packets in, net_rx_action() feeds them
+// to ip_handle(). Queuing (rather than calling ip_handle directly) keeps a
+// handler's reply from re-entering the stack underneath it.
+#define LO_QUEUE_LEN 32
+#define LO_MTU (NET_MTU - sizeof(eth_header_t))
+
+typedef struct {
+    uint32_t len;
+    uint8_t data[LO_MTU];
+} lo_slot_t;
+
+static lo_slot_t lo_queue[LO_QUEUE_LEN];
+static volatile uint32_t lo_head = 0;   // Next to deliver
+static volatile uint32_t lo_tail = 0;   // Next free
+
+// Pick the interface for a destination: 127/8 and our own address stay on
+// lo, everything else goes out eth0 (via the gateway when off-link)
+static net_iface_t *net_route(uint32_t dst_ip, uint32_t *next_hop) {
+    *next_hop = dst_ip;
+    if (IS_LOOPBACK(dst_ip) || dst_ip == our_ip) {
+        return &net_ifaces[NET_IF_LO];
+    }
+
+    net_iface_t *eth = &net_ifaces[NET_IF_ETH0];
+    if ((dst_ip & eth->stats.netmask) != (eth->stats.ip & eth->stats.netmask)) {
+        *next_hop = NET_GATEWAY;
     }
+    return eth;
+}
 
-    // Build frame
-    eth_header_t *eth = (eth_header_t *)pkt_buf;
-    memcpy(eth->dst, dst_mac, 6);
-    memcpy(eth->src, our_mac, 6);
-    eth->ethertype = htons(ethertype);
+uint32_t net_source_ip(uint32_t dst_ip) {
+    uint32_t next_hop;
+    net_iface_t *ifp = net_route(dst_ip, &next_hop);
+    // Talking to our own eth0 address over lo keeps that address
+    return dst_ip == our_ip ? our_ip : ifp->stats.ip;
+}
 
-    memcpy(pkt_buf + sizeof(eth_header_t), data, len);
+// Whether TCP and UDP checksums to dst_ip can be left to the interface:
+// eth0 when the device negotiated checksum offload, and always on lo,
+// where packets never leave memory and nobody checks them
+static int net_csum_offload(uint32_t dst_ip) {
+    uint32_t next_hop;
+    net_iface_t *ifp = net_route(dst_ip, &next_hop);
+    return ifp == &net_ifaces[NET_IF_LO] || virtio_net_csum_offload();
+}
 
-    return virtio_net_send(pkt_buf, sizeof(eth_header_t) + len);
+int net_get_if_stats(int index, net_if_stats_t *out) {
+    if (index < 0 || index >= NET_IF_COUNT || !out) return -1;
+    memcpy(out, &net_ifaces[index].stats, sizeof(*out));
+    if (index == NET_IF_ETH0) {
+        virtio_net_stats_t drv;
+        virtio_net_get_stats(&drv);
+        out->tx_kicks = drv.tx_kicks;
+    }
+    return 0;
 }
 
-// ARP table lookup
-const uint8_t *arp_lookup(uint32_t ip) {
-    for (int i = 0; i < ARP_TABLE_SIZE; i++) {
-        if (arp_table[i].valid && arp_table[i].ip == ip) {
-            return arp_table[i].mac;
-        }
+// Remeasure every interface's packets per second, once a second
+static void net_update_rates(void) {
+    uint64_t now = timer_get_ticks();
+    uint64_t elapsed = now - net_rate_last;
+    if (elapsed < NET_RATE_TICKS) return;
+
+    for (int i = 0; i < NET_IF_COUNT; i++) {
+        net_if_stats_t *st = &net_ifaces[i].stats;
+        st->rx_pps = (uint32_t)((uint64_t)(st->rx_packets - net_rate_rx[i]) * 100 / elapsed);
+        st->tx_pps = (uint32_t)((uint64_t)(st->tx_packets - net_rate_tx[i]) * 100 / elapsed);
+        net_rate_rx[i] = st->rx_packets;
+        net_rate_tx[i] = st->tx_packets;
+    }
+    net_rate_last = now;
+}
+
+static int lo_xmit(net_iface_t *ifp, uint32_t next_hop, const void *pkt, uint32_t len,
+                   uint16_t csum_offset) {
+    (void)ifp; (void)next_hop; (void)csum_offset;
+    if (len > LO_MTU) return -1;
+
+    uint32_t next = (lo_tail + 1) % LO_QUEUE_LEN;
+    if (next == lo_head) return -1;  // Full - nobody's polling
+
+    lo_slot_t *slot = &lo_queue[lo_tail];
+    memcpy(slot->data, pkt, len);
+    slot->len = len;
+    lo_tail = next;
+
+    // Raised quietly: the stack is locked, so whoever holds it either
+    // handles this before waiting or passes it on as they unlock
+    net_softirq_pending = 1;
+    return 0;
+}
+
+// ============ ARP neighbor cache ============
+
+// Hash chains of entries, keyed by IP. Each entry moves through the usual
+// neighbor states: INCOMPLETE while its first request is out (packets for
+// it wait in arp_queue), REACHABLE once answered, STALE when that's
+// ARP_REACHABLE_TICKS old. A stale entry still sends, but its next use
+// starts a PROBE of unicast requests; no answer to those, or to the first
+// broadcasts, and the entry goes. Stale entries nobody uses are aged out.
+static arp_entry_t *arp_find(uint32_t ip) {
+    for (int i = arp_buckets[ARP_HASH(ip)]; i >= 0; i = arp_table[i].next) {
+        if (arp_table[i].ip == ip) return &arp_table[i];
     }
     return NULL;
 }
 
-// Add/update ARP entry
-static void arp_add(uint32_t ip, const uint8_t *mac) {
-    // Check if already exists
-    for (int i = 0; i < ARP_TABLE_SIZE; i++) {
-        if (arp_table[i].valid && arp_table[i].ip == ip) {
-            memcpy(arp_table[i].mac, mac, 6);
-            return;
-        }
+static void arp_unlink(arp_entry_t *e) {
+    int idx = e - arp_table;
+    int8_t *link = &arp_buckets[ARP_HASH(e->ip)];
+    while (*link >= 0 && *link != idx) link = &arp_table[(int)*link].next;
+    if (*link == idx) *link = e->next;
+    e->state = ARP_STATE_FREE;
+}
+
+// A fresh entry for ip: a free one, or the least recently used that isn't
+// still waiting for its first answer. NULL if every entry is.
+static arp_entry_t *arp_alloc(uint32_t ip) {
+    arp_entry_t *e = NULL;
+    for (int i = 0; i < ARP_TABLE_SIZE && !e; i++) {
+        if (arp_table[i].state == ARP_STATE_FREE) e = &arp_table[i];
+    }
+    for (int i = 0; i < ARP_TABLE_SIZE && !e; i++) {
+        arp_entry_t *c = &arp_table[i];
+        if (c->state == ARP_STATE_INCOMPLETE) continue;
+        if (!e || c->used < e->used) e = c;
     }
+    if (!e) return NULL;
+    if (e->state != ARP_STATE_FREE) arp_unlink(e);
+
+    memset(e, 0, sizeof(*e));
+    e->ip = ip;
+    int8_t *bucket = &arp_buckets[ARP_HASH(ip)];
+    e->next = *bucket;
+    *bucket = e - arp_table;
+    return e;
+}
 
-    // Find free slot
-    for (int i = 0; i < ARP_TABLE_SIZE; i++) {
-        if (!arp_table[i].valid) {
-            arp_table[i].ip = ip;
-            memcpy(arp_table[i].mac, mac, 6);
-            arp_table[i].valid = 1;
-            printf("[ARP] Added %s -> %02x:%02x:%02x:%02x:%02x:%02x\n",
-                   ip_to_str(ip), mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-            return;
+// ARP table lookup: the MAC to send to, if we have one
+const uint8_t *arp_lookup(uint32_t ip) {
+    arp_entry_t *e = arp_find(ip);
+    if (!e || e->state == ARP_STATE_INCOMPLETE) return NULL;
+    return e->mac;
+}
+
+// Hold a packet for a neighbor that hasn't answered yet. When it already
+// has ARP_QUEUE_PER_NEIGH waiting, the oldest is dropped to make room.
+static int arp_queue_packet(arp_entry_t *e, const void *pkt, uint32_t len, uint16_t csum_offset) {
+    if (len > ARP_QUEUE_MTU) return -1;
+
+    arp_queued_t *slot = NULL;
+    if (e->queued >= ARP_QUEUE_PER_NEIGH) {
+        for (int i = 0; i < ARP_QUEUE_LEN; i++) {
+            arp_queued_t *q = &arp_queue[i];
+            if (q->len && q->next_hop == e->ip && (!slot || q->order < slot->order)) slot = q;
+        }
+        net_ifaces[NET_IF_ETH0].stats.tx_dropped++;
+        e->queued--;
+    } else {
+        for (int i = 0; i < ARP_QUEUE_LEN && !slot; i++) {
+            if (!arp_queue[i].len) slot = &arp_queue[i];
         }
     }
+    if (!slot) return -1;
+
+    memcpy(slot->data, pkt, len);
+    slot->len = len;
+    slot->next_hop = e->ip;
+    slot->csum_offset = csum_offset;
+    slot->order = arp_queue_order++;
+    e->queued++;
+    return 0;
+}
+
+// Send (or with mac NULL, drop) everything queued for e, oldest first
+static void arp_queue_flush(arp_entry_t *e, const uint8_t *mac) {
+    while (e->queued) {
+        arp_queued_t *slot = NULL;
+        for (int i = 0; i < ARP_QUEUE_LEN; i++) {
+            arp_queued_t *q = &arp_queue[i];
+            if (q->len && q->next_hop == e->ip && (!slot || q->order < slot->order)) slot = q;
+        }
+        if (!slot) break;
 
-    // Table full - overwrite first entry (simple LRU)
-    arp_table[0].ip = ip;
-    memcpy(arp_table[0].mac, mac, 6);
-    arp_table[0].valid = 1;
+        if (mac) {
+            uint16_t csum_start = slot->csum_offset ? sizeof(eth_header_t) + sizeof(ip_header_t) : 0;
+            eth_output(mac, ETH_TYPE_IP, slot->data, slot->len, csum_start, slot->csum_offset);
+        } else {
+            net_ifaces[NET_IF_ETH0].stats.tx_dropped++;
+        }
+        slot->len = 0;
+        e->queued--;
+    }
+    e->queued = 0;
 }
 
-// Send ARP request
-void arp_request(uint32_t ip) {
+// Send an ARP request for ip: broadcast, or straight to dst_mac when
+// checking on a neighbor we already know
+static void arp_send_request(uint32_t ip, const uint8_t *dst_mac) {
     arp_packet_t arp;
     arp.htype = htons(1);        // Ethernet
     arp.ptype = htons(0x0800);   // IPv4
@@ -171,8 +457,102 @@ void arp_request(uint32_t ip) {
     uint32_t ip_net = htonl(ip);
     memcpy(arp.tpa, &ip_net, 4);
 
+    eth_send(dst_mac ? dst_mac : broadcast_mac, ETH_TYPE_ARP, &arp, sizeof(arp));
+}
+
+// Send ARP request
+void arp_request(uint32_t ip) {
     printf("[ARP] Requesting %s\n", ip_to_str(ip));
-    eth_send(broadcast_mac, ETH_TYPE_ARP, &arp, sizeof(arp));
+    arp_send_request(ip, NULL);
+}
+
+// Gratuitous ARP: a broadcast request for our own address, so everyone on
+// the link (re)learns our MAC
+void arp_announce(void) {
+    arp_last_announce = timer_get_ticks();
+    arp_send_request(our_ip, NULL);
+}
+
+// Retry unanswered requests, age entries, and drop the ones that are gone.
+// Returns how many neighbors are waiting on an answer, which keeps the
+// softirq ticking.
+static int arp_timers(void) {
+    uint64_t now = timer_get_ticks();
+    int waiting = 0;
+
+    if (now == arp_timers_last) {
+        for (int i = 0; i < ARP_TABLE_SIZE; i++) {
+            uint8_t state = arp_table[i].state;
+            if (state == ARP_STATE_INCOMPLETE || state == ARP_STATE_PROBE) waiting++;
+        }
+        return waiting;
+    }
+    arp_timers_last = now;
+
+    for (int i = 0; i < ARP_TABLE_SIZE; i++) {
+        arp_entry_t *e = &arp_table[i];
+        switch (e->state) {
+            case ARP_STATE_INCOMPLETE:
+            case ARP_STATE_PROBE:
+                if (now - e->updated < ARP_RETRY_TICKS) {
+                    waiting++;
+                    break;
+                }
+                if (e->probes >= ARP_MAX_PROBES) {
+                    printf("[ARP] No reply from %s\n", ip_to_str(e->ip));
+                    arp_queue_flush(e, NULL);
+                    arp_unlink(e);
+                    break;
+                }
+                arp_send_request(e->ip, e->state == ARP_STATE_PROBE ? e->mac : NULL);
+                e->probes++;
+                e->updated = now;
+                waiting++;
+                break;
+            case ARP_STATE_REACHABLE:
+                if (now - e->updated >= ARP_REACHABLE_TICKS) e->state = ARP_STATE_STALE;
+                break;
+            case ARP_STATE_STALE:
+                if (now - e->used >= ARP_GC_TICKS && now - e->updated >= ARP_GC_TICKS) {
+                    arp_unlink(e);
+                }
+                break;
+        }
+    }
+    return waiting;
+}
+
+// We heard from ip at mac. confirmed: it answered us directly, so it's
+// reachable; otherwise (a request, a gratuitous ARP) a new MAC is only
+// taken as stale, to be checked on first use.
+static void arp_update(arp_entry_t *e, const uint8_t *mac, int confirmed) {
+    uint64_t now = timer_get_ticks();
+    int changed = memcmp(e->mac, mac, 6) != 0;
+
+    if (e->state == ARP_STATE_INCOMPLETE) {
+        memcpy(e->mac, mac, 6);
+        printf("[ARP] Added %s -> %02x:%02x:%02x:%02x:%02x:%02x\n",
+               ip_to_str(e->ip), mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        e->state = confirmed ? ARP_STATE_REACHABLE : ARP_STATE_STALE;
+        e->probes = 0;
+        e->updated = now;
+        arp_queue_flush(e, e->mac);
+        return;
+    }
+
+    if (changed) {
+        printf("[ARP] %s moved to %02x:%02x:%02x:%02x:%02x:%02x\n",
+               ip_to_str(e->ip), mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        memcpy(e->mac, mac, 6);
+    }
+    if (confirmed) {
+        e->state = ARP_STATE_REACHABLE;
+        e->probes = 0;
+        e->updated = now;
+    } else if (changed) {
+        e->state = ARP_STATE_STALE;
+        e->updated = now;
+    }
 }
 
 // Handle incoming ARP packet
@@ -192,56 +572,138 @@ static void arp_handle(const uint8_t *pkt, uint32_t len) {
     target_ip = ntohl(target_ip);
 
     uint16_t op = ntohs(arp->oper);
+    int for_us = (target_ip == our_ip);
+
+    // Someone else claiming our address: say it's ours, now and then
+    if (sender_ip == our_ip) {
+        if (memcmp(arp->sha, our_mac, 6) != 0) {
+            printf("[ARP] Address conflict: %s also claimed by %02x:%02x:%02x:%02x:%02x:%02x\n",
+                   ip_to_str(our_ip), arp->sha[0], arp->sha[1], arp->sha[2],
+                   arp->sha[3], arp->sha[4], arp->sha[5]);
+            if (timer_get_ticks() - arp_last_announce >= ARP_DEFEND_TICKS) arp_announce();
+        }
+        return;
+    }
+
+    // Learn the sender: always update a neighbor we know (that's how
+    // gratuitous ARPs move an address), but only add one that's talking to
+    // us. A sender of 0.0.0.0 is probing for an address and has none yet.
+    if (sender_ip != 0) {
+        arp_entry_t *e = arp_find(sender_ip);
+        if (!e && for_us && (e = arp_alloc(sender_ip)) != NULL) {
+            e->state = ARP_STATE_INCOMPLETE;
+            e->used = timer_get_ticks();
+        }
+        if (e) arp_update(e, arp->sha, op == ARP_OP_REPLY && for_us);
+    }
+
+    if (op == ARP_OP_REQUEST && for_us) {
+        printf("[ARP] Request for our IP from %s\n", ip_to_str(sender_ip));
+
+        // Send reply
+        arp_packet_t reply;
+        reply.htype = htons(1);
+        reply.ptype = htons(0x0800);
+        reply.hlen = 6;
+        reply.plen = 4;
+        reply.oper = htons(ARP_OP_REPLY);
+        memcpy(reply.sha, our_mac, 6);
+        uint32_t our_ip_net = htonl(our_ip);
+        memcpy(reply.spa, &our_ip_net, 4);
+        memcpy(reply.tha, arp->sha, 6);
+        memcpy(reply.tpa, arp->spa, 4);
+
+        eth_send(arp->sha, ETH_TYPE_ARP, &reply, sizeof(reply));
+    }
+}
 
-    // Learn sender's MAC (even if not for us)
-    arp_add(sender_ip, arp->sha);
+static int eth_xmit(net_iface_t *ifp, uint32_t next_hop, const void *pkt, uint32_t len,
+                    uint16_t csum_offset) {
+    (void)ifp;
+    uint64_t now = timer_get_ticks();
+    arp_entry_t *e = arp_find(next_hop);
+    if (!e) {
+        // First packet for this neighbor: ask, and hold it until it answers
+        e = arp_alloc(next_hop);
+        if (!e) return -1;
+        e->state = ARP_STATE_INCOMPLETE;
+        e->probes = 1;
+        e->updated = now;
+        arp_request(next_hop);
+    }
+    e->used = now;
+    if (e->state == ARP_STATE_INCOMPLETE) {
+        return arp_queue_packet(e, pkt, len, csum_offset);
+    }
+    if (e->state == ARP_STATE_STALE) {
+        // Keep sending to the MAC we have, but check it's still right
+        e->state = ARP_STATE_PROBE;
+        e->probes = 1;
+        e->updated = now;
+        arp_send_request(next_hop, e->mac);
+    }
 
-    if (op == ARP_OP_REQUEST) {
-        // Is this asking for our MAC?
-        if (target_ip == our_ip) {
-            printf("[ARP] Request for our IP from %s\n", ip_to_str(sender_ip));
+    // The device sums from the TCP/UDP header on
+    uint16_t csum_start = csum_offset ? sizeof(eth_header_t) + sizeof(ip_header_t) : 0;
+    return eth_output(e->mac, ETH_TYPE_IP, pkt, len, csum_start, csum_offset);
+}
 
-            // Send reply
-            arp_packet_t reply;
-            reply.htype = htons(1);
-            reply.ptype = htons(0x0800);
-            reply.hlen = 6;
-            reply.plen = 4;
-            reply.oper = htons(ARP_OP_REPLY);
-            memcpy(reply.sha, our_mac, 6);
-            uint32_t our_ip_net = htonl(our_ip);
-            memcpy(reply.spa, &our_ip_net, 4);
-            memcpy(reply.tha, arp->sha, 6);
-            memcpy(reply.tpa, arp->spa, 4);
+// Send ethernet frame
+int eth_send(const uint8_t *dst_mac, uint16_t ethertype, const void *data, uint32_t len) {
+    return eth_output(dst_mac, ethertype, data, len, 0, 0);
+}
 
-            eth_send(arp->sha, ETH_TYPE_ARP, &reply, sizeof(reply));
-            printf("[ARP] Sent reply\n");
-        }
-    } else if (op == ARP_OP_REPLY) {
-        printf("[ARP] Reply from %s\n", ip_to_str(sender_ip));
-        // Already added to table above
+static int eth_output(const uint8_t *dst_mac, uint16_t ethertype, const void *data, uint32_t len,
+                      uint16_t csum_start, uint16_t csum_offset) {
+    if (len > NET_MTU - sizeof(eth_header_t)) {
+        return -1;
     }
+
+    // Build the header; the driver copies it and the payload straight
+    // into its ring
+    eth_header_t eth;
+    memcpy(eth.dst, dst_mac, 6);
+    memcpy(eth.src, our_mac, 6);
+    eth.ethertype = htons(ethertype);
+
+    return virtio_net_sendv(&eth, sizeof(eth), data, len, csum_start, csum_offset);
 }
 
 // IP checksum
 uint16_t ip_checksum(const void *data, uint32_t len) {
-    const uint16_t *ptr = (const uint16_t *)data;
-    uint32_t sum = 0;
-
-    while (len > 1) {
-        sum += *ptr++;
-        len -= 2;
-    }
+    return csum_fold(csum_partial(data, len, 0));
+}
 
-    if (len == 1) {
-        sum += *(const uint8_t *)ptr;
-    }
+// Partial sum of the TCP/UDP pseudo-header (addresses in network order)
+static uint32_t ip_pseudo_sum(uint32_t src_ip, uint32_t dst_ip, uint8_t protocol, uint32_t len) {
+    uint32_t sum = 0;
+    sum = csum_add(sum, (src_ip >> 16) & 0xffff);
+    sum = csum_add(sum, src_ip & 0xffff);
+    sum = csum_add(sum, (dst_ip >> 16) & 0xffff);
+    sum = csum_add(sum, dst_ip & 0xffff);
+    sum = csum_add(sum, htons(protocol));
+    sum = csum_add(sum, htons(len));
+    return sum;
+}
 
-    while (sum >> 16) {
-        sum = (sum & 0xffff) + (sum >> 16);
+// Check a received packet's TCP, UDP or ICMP checksum
+static int ip_payload_csum_ok(const ip_header_t *ip, const uint8_t *payload, uint32_t len) {
+    switch (ip->protocol) {
+        case IP_PROTO_TCP:
+            return csum_fold(csum_partial(payload, len,
+                   ip_pseudo_sum(ip->src_ip, ip->dst_ip, IP_PROTO_TCP, len))) == 0;
+        case IP_PROTO_UDP:
+            // Zero means the sender didn't compute one
+            if (len < sizeof(udp_header_t) || ((const udp_header_t *)payload)->checksum == 0) {
+                return 1;
+            }
+            return csum_fold(csum_partial(payload, len,
+                   ip_pseudo_sum(ip->src_ip, ip->dst_ip, IP_PROTO_UDP, len))) == 0;
+        case IP_PROTO_ICMP:
+            return ip_checksum(payload, len) == 0;
+        default:
+            return 1;
     }
-
-    return ~sum;
 }
 
 // Handle incoming ICMP packet
@@ -277,11 +739,14 @@ static void icmp_handle(const uint8_t *pkt, uint32_t len, uint32_t src_ip) {
         printf("[ICMP] Sent echo reply\n");
     }
     else if (icmp->type == ICMP_ECHO_REPLY) {
+        // Timed as the reply is handled, not when net_ping() next runs
+        uint32_t now = hal_get_time_us();
         printf("[ICMP] Echo reply from %s id=%d seq=%d\n",
                ip_to_str(src_ip), ntohs(icmp->id), ntohs(icmp->seq));
 
         // Check if this matches our pending ping
         if (ntohs(icmp->id) == ping_id && ntohs(icmp->seq) == ping_seq) {
+            ping_rtt_us = now - ping_sent_us;
             ping_received = 1;
         }
     }
@@ -312,11 +777,13 @@ static void udp_handle(const uint8_t *pkt, uint32_t len, uint32_t src_ip) {
     // No listener - silently drop (don't spam debug output)
 }
 
-// Forward declaration for TCP handler
-static void tcp_handle(const uint8_t *pkt, uint32_t len, uint32_t src_ip);
+// Forward declarations for TCP
+static void tcp_handle(const uint8_t *pkt, uint32_t len, uint32_t src_ip, uint32_t dst_ip);
+static int tcp_timers(void);
 
-// Handle incoming IP packet
-static void ip_handle(const uint8_t *pkt, uint32_t len) {
+// Handle incoming IP packet (ifp = interface it arrived on). csum_ok says
+// the payload checksum needn't be checked: lo, or the device did it.
+static void ip_handle(net_iface_t *ifp, const uint8_t *pkt, uint32_t len, int csum_ok) {
     if (len < sizeof(ip_header_t)) return;
 
     const ip_header_t *ip = (const ip_header_t *)pkt;
@@ -330,12 +797,26 @@ static void ip_handle(const uint8_t *pkt, uint32_t len) {
 
     // Check if it's for us
     uint32_t dst_ip = ntohl(ip->dst_ip);
-    if (dst_ip != our_ip && dst_ip != 0xffffffff) return;
+    if (IS_LOOPBACK(dst_ip)) {
+        // 127/8 arriving from the wire is spoofed
+        if (ifp != &net_ifaces[NET_IF_LO]) return;
+    } else if (dst_ip != our_ip && dst_ip != 0xffffffff) {
+        return;
+    }
+
+    uint32_t total_len = ntohs(ip->total_len);
+    if (total_len < ihl || total_len > len) return;
 
     uint32_t src_ip = ntohl(ip->src_ip);
-    uint32_t payload_len = ntohs(ip->total_len) - ihl;
+    uint32_t payload_len = total_len - ihl;
     const uint8_t *payload = pkt + ihl;
 
+    if (!csum_ok && (ip_checksum(ip, ihl) != 0 ||
+                     !ip_payload_csum_ok(ip, payload, payload_len))) {
+        ifp->stats.rx_csum_errors++;
+        return;
+    }
+
     switch (ip->protocol) {
         case IP_PROTO_ICMP:
             icmp_handle(payload, payload_len, src_ip);
@@ -344,7 +825,7 @@ static void ip_handle(const uint8_t *pkt, uint32_t len) {
             udp_handle(payload, payload_len, src_ip);
             break;
         case IP_PROTO_TCP:
-            tcp_handle(payload, payload_len, src_ip);
+            tcp_handle(payload, payload_len, src_ip, dst_ip);
             break;
         default:
             printf("[IP] Unknown protocol %d from %s\n", ip->protocol, ip_to_str(src_ip));
@@ -352,28 +833,15 @@ static void ip_handle(const uint8_t *pkt, uint32_t len) {
     }
 }
 
-// Send IP packet
-int ip_send(uint32_t dst_ip, uint8_t protocol, const void *data, uint32_t len) {
+// Send IP packet. csum_offset: see net_iface_t.
+static int ip_output(uint32_t dst_ip, uint8_t protocol, const void *data, uint32_t len,
+                     uint16_t csum_offset) {
     if (len > NET_MTU - sizeof(eth_header_t) - sizeof(ip_header_t)) {
         return -1;
     }
 
-    // Determine next hop MAC
-    const uint8_t *dst_mac;
-    uint32_t next_hop = dst_ip;
-
-    // If destination is not on local network, use gateway
-    if ((dst_ip & NET_NETMASK) != (our_ip & NET_NETMASK)) {
-        next_hop = NET_GATEWAY;
-    }
-
-    dst_mac = arp_lookup(next_hop);
-    if (!dst_mac) {
-        // Need to ARP first
-        printf("[IP] No ARP entry for %s, sending request\n", ip_to_str(next_hop));
-        arp_request(next_hop);
-        return -1;  // Caller should retry
-    }
+    uint32_t next_hop;
+    net_iface_t *ifp = net_route(dst_ip, &next_hop);
 
     // Build IP packet
     static uint8_t ip_buf[1600];
@@ -387,7 +855,7 @@ int ip_send(uint32_t dst_ip, uint8_t protocol, const void *data, uint32_t len) {
     ip->ttl = 64;
     ip->protocol = protocol;
     ip->checksum = 0;
-    ip->src_ip = htonl(our_ip);
+    ip->src_ip = htonl(net_source_ip(dst_ip));
     ip->dst_ip = htonl(dst_ip);
 
     // Calculate header checksum
@@ -396,7 +864,26 @@ int ip_send(uint32_t dst_ip, uint8_t protocol, const void *data, uint32_t len) {
     // Copy payload
     memcpy(ip_buf + sizeof(ip_header_t), data, len);
 
-    return eth_send(dst_mac, ETH_TYPE_IP, ip_buf, sizeof(ip_header_t) + len);
+    uint32_t total = sizeof(ip_header_t) + len;
+    if (net_loss_per_mille) {
+        net_loss_rand = net_loss_rand * 1103515245 + 12345;
+        if ((net_loss_rand >> 16) % 1000 < net_loss_per_mille) {
+            // Pretend it went out - the sender finds out the hard way
+            ifp->stats.tx_dropped++;
+            return 0;
+        }
+    }
+    if (ifp->xmit(ifp, next_hop, ip_buf, total, csum_offset) < 0) {
+        ifp->stats.tx_dropped++;
+        return -1;
+    }
+    ifp->stats.tx_packets++;
+    ifp->stats.tx_bytes += total;
+    return 0;
+}
+
+int ip_send(uint32_t dst_ip, uint8_t protocol, const void *data, uint32_t len) {
+    return ip_output(dst_ip, protocol, data, len, 0);
 }
 
 // Send ICMP echo request
@@ -424,19 +911,29 @@ int icmp_send_echo_request(uint32_t dst_ip, uint16_t id, uint16_t seq, const voi
     return ip_send(dst_ip, IP_PROTO_ICMP, icmp_buf, sizeof(icmp_header_t) + len);
 }
 
-// Process incoming packets
-void net_poll(void) {
-    static uint8_t rx_buf[1600];
-
-    while (virtio_net_has_packet()) {
-        int len = virtio_net_recv(rx_buf, sizeof(rx_buf));
-        if (len <= 0) break;
-
-        if (len < (int)sizeof(eth_header_t)) continue;
+// One softirq pass: handle up to budget frames from eth0 and as many from
+// lo, then run the TCP and ARP timers and update the packet rates. A full batch leaves the softirq raised for
+// the next pass. Caller holds net_mutex. Returns the packets handled.
+static int net_rx_action(int budget) {
+    // Frames are handled where the device wrote them; TCP copies payload
+    // straight from there into the socket's ring
+    const uint8_t *rx_buf;
+    int len;
+    int eth_done = 0;
+
+    while (eth_done < budget && (len = virtio_net_rx_peek(&rx_buf)) > 0) {
+        eth_done++;
+        if (len < (int)sizeof(eth_header_t)) {
+            virtio_net_rx_release();
+            continue;
+        }
 
-        eth_header_t *eth = (eth_header_t *)rx_buf;
+        const eth_header_t *eth = (const eth_header_t *)rx_buf;
         uint16_t ethertype = ntohs(eth->ethertype);
 
+        net_ifaces[NET_IF_ETH0].stats.rx_packets++;
+        net_ifaces[NET_IF_ETH0].stats.rx_bytes += len;
+
         const uint8_t *payload = rx_buf + sizeof(eth_header_t);
         uint32_t payload_len = len - sizeof(eth_header_t);
 
@@ -445,44 +942,96 @@ void net_poll(void) {
                 arp_handle(payload, payload_len);
                 break;
             case ETH_TYPE_IP:
-                ip_handle(payload, payload_len);
+                ip_handle(&net_ifaces[NET_IF_ETH0], payload, payload_len,
+                          virtio_net_rx_csum_ok());
                 break;
             default:
                 // Ignore unknown ethertypes
                 break;
         }
+        virtio_net_rx_release();
     }
-}
 
-// Blocking ping with timeout
-int net_ping(uint32_t ip, uint16_t seq, uint32_t timeout_ms) {
-    // First, make sure we have ARP entry for the target (or gateway)
-    uint32_t next_hop = ip;
-    if ((ip & NET_NETMASK) != (our_ip & NET_NETMASK)) {
-        next_hop = NET_GATEWAY;
+    // Deliver what we sent ourselves. Replies queued by the handlers are
+    // picked up in the same pass, bounded so two chatty ends can't spin here.
+    net_iface_t *lo = &net_ifaces[NET_IF_LO];
+    int lo_done = 0;
+    while (lo_done < budget && lo_head != lo_tail) {
+        lo_slot_t *slot = &lo_queue[lo_head];
+        lo->stats.rx_packets++;
+        lo->stats.rx_bytes += slot->len;
+        ip_handle(lo, slot->data, slot->len, 1);
+        // Only free the slot now - the handler may still be reading it
+        lo_head = (lo_head + 1) % LO_QUEUE_LEN;
+        lo_done++;
     }
 
-    // Try to get ARP entry, send request if needed
-    if (!arp_lookup(next_hop)) {
-        arp_request(next_hop);
+    if (eth_done == budget || lo_done == budget) net_softirq_pending = 1;
 
-        // Wait for ARP reply (up to 1 second)
-        for (int i = 0; i < 100 && !arp_lookup(next_hop); i++) {
-            net_poll();
-            // Simple delay (~10ms)
-            for (volatile int j = 0; j < 100000; j++);
-        }
+    net_timers_armed = tcp_timers() + arp_timers();
+    net_update_rates();
 
-        if (!arp_lookup(next_hop)) {
-            printf("[PING] ARP timeout for %s\n", ip_to_str(next_hop));
-            return -1;
+    // Replies and ACKs the batch produced, and the buffers it freed, go to
+    // the device together
+    virtio_net_kick();
+
+    // Sockets may have changed: let their readers and writers look
+    if (eth_done || lo_done) wait_queue_wake(&net_rx_wait_queue);
+    return eth_done + lo_done;
+}
+
+// Process incoming packets now, without waiting for the softirq
+void net_poll(void) {
+    NET_LOCKED();
+    net_softirq_pending = 0;
+    net_rx_action(NET_RX_BUDGET);
+}
+
+static void net_softirq_kick(void) {
+    wait_queue_wake(&net_softirq_wait);
+}
+
+// Raise the softirq. Safe from IRQ handlers.
+void net_softirq_raise(void) {
+    net_softirq_pending = 1;
+    net_softirq_kick();
+}
+
+// The netsoftirq kernel thread. Sleeps until raised, or every tick while a
+// retransmit timer is running.
+static void net_softirq_thread(void) {
+    for (;;) {
+        uint32_t seq = net_softirq_wait.seq;
+        if (!net_softirq_pending) {
+            wait_queue_sleep(&net_softirq_wait, seq,
+                             net_timers_armed ? 1 : NET_SOFTIRQ_IDLE_TICKS);
         }
+
+        mutex_lock(&net_mutex);
+        net_softirq_pending = 0;
+        net_rx_action(NET_RX_BUDGET);
+        mutex_unlock(&net_mutex);
+
+        // Still raised after a full batch: give everyone else a turn before
+        // the next, so a flood can't starve the desktop
+        if (net_softirq_pending) process_yield();
     }
+}
+
+void net_softirq_start(void) {
+    int pid = process_create_kernel("netsoftirq", net_softirq_thread);
+    if (pid > 0) net_softirq_pid = pid;
+}
+
+// Blocking ping with timeout
+int net_ping(uint32_t ip, uint16_t seq, uint32_t timeout_ms) {
+    NET_LOCKED();
 
     // Set up ping tracking
     ping_id = 0x1234;
     ping_seq = seq;
     ping_received = 0;
+    ping_sent_us = hal_get_time_us();
 
     // Send echo request
     uint8_t ping_data[56];
@@ -493,14 +1042,16 @@ int net_ping(uint32_t ip, uint16_t seq, uint32_t timeout_ms) {
     }
 
     // Wait for reply
-    for (uint32_t i = 0; i < timeout_ms / 10 && !ping_received; i++) {
-        net_poll();
-        // Simple delay (~10ms)
-        for (volatile int j = 0; j < 100000; j++);
+    uint64_t deadline = timer_get_ticks() + timeout_ms / 10;
+    for (;;) {
+        uint32_t wseq = net_rx_wait_queue.seq;
+        uint64_t now = timer_get_ticks();
+        if (ping_received || now >= deadline) break;
+        net_wait(wseq, (uint32_t)(deadline - now));
     }
 
     if (ping_received) {
-        return 0;  // TODO: return actual RTT
+        return (int)ping_rtt_us;
     }
 
     return -1;  // Timeout
@@ -508,6 +1059,8 @@ int net_ping(uint32_t ip, uint16_t seq, uint32_t timeout_ms) {
 
 // UDP bind - register a listener for a port
 void udp_bind(uint16_t port, udp_recv_callback_t callback) {
+    NET_LOCKED();
+
     // Check if already bound
     for (int i = 0; i < UDP_MAX_LISTENERS; i++) {
         if (udp_listeners[i].port == port && udp_listeners[i].callback) {
@@ -531,6 +1084,8 @@ void udp_bind(uint16_t port, udp_recv_callback_t callback) {
 
 // UDP unbind - remove a listener
 void udp_unbind(uint16_t port) {
+    NET_LOCKED();
+
     for (int i = 0; i < UDP_MAX_LISTENERS; i++) {
         if (udp_listeners[i].port == port) {
             udp_listeners[i].callback = NULL;
@@ -542,6 +1097,8 @@ void udp_unbind(uint16_t port) {
 
 // Send UDP packet
 int udp_send(uint32_t dst_ip, uint16_t src_port, uint16_t dst_port, const void *data, uint32_t len) {
+    NET_LOCKED();
+
     if (len > NET_MTU - sizeof(eth_header_t) - sizeof(ip_header_t) - sizeof(udp_header_t)) {
         return -1;
     }
@@ -553,16 +1110,30 @@ int udp_send(uint32_t dst_ip, uint16_t src_port, uint16_t dst_port, const void *
     udp->src_port = htons(src_port);
     udp->dst_port = htons(dst_port);
     udp->length = htons(sizeof(udp_header_t) + len);
-    udp->checksum = 0;  // Checksum optional for IPv4
+    udp->checksum = 0;
 
     // Copy data
     memcpy(udp_buf + sizeof(udp_header_t), data, len);
 
-    return ip_send(dst_ip, IP_PROTO_UDP, udp_buf, sizeof(udp_header_t) + len);
+    uint32_t total = sizeof(udp_header_t) + len;
+    uint32_t sum = ip_pseudo_sum(htonl(net_source_ip(dst_ip)), htonl(dst_ip), IP_PROTO_UDP, total);
+    if (net_csum_offload(dst_ip)) {
+        udp->checksum = csum_fold_raw(sum);
+        return ip_output(dst_ip, IP_PROTO_UDP, udp_buf, total, offsetof(udp_header_t, checksum));
+    }
+
+    // All ones stands in for a sum that works out to zero
+    uint16_t csum = csum_fold(csum_partial(udp_buf, total, sum));
+    udp->checksum = csum ? csum : 0xffff;
+    return ip_send(dst_ip, IP_PROTO_UDP, udp_buf, total);
 }
 
 // DNS resolver
-// Simple implementation - sends query to NET_DNS and waits for response
+// Names are answered from /etc/hosts, then the cache, and only then by a
+// query to NET_DNS. Queries all go out from one client port and replies
+// are matched back by transaction ID, so several callers can be waiting on
+// the server at once; a caller asking for a name that's already in flight
+// waits on that query rather than sending its own.
 
 // DNS header
 typedef struct __attribute__((packed)) {
@@ -574,81 +1145,72 @@ typedef struct __attribute__((packed)) {
     uint16_t arcount;
 } dns_header_t;
 
-// DNS response state
-static volatile int dns_response_received = 0;
-static volatile uint32_t dns_resolved_ip = 0;
-static volatile uint16_t dns_query_id = 0;
-
-// DNS response handler
-static void dns_recv_handler(uint32_t src_ip, uint16_t src_port, uint16_t dst_port, const void *data, uint32_t len) {
-    (void)src_ip; (void)src_port; (void)dst_port;
-
-    if (len < sizeof(dns_header_t)) return;
-
-    const dns_header_t *dns = (const dns_header_t *)data;
-
-    // Check if this is response to our query
-    if (ntohs(dns->id) != dns_query_id) return;
-
-    // Check flags: QR=1 (response), RCODE=0 (no error)
-    uint16_t flags = ntohs(dns->flags);
-    if (!(flags & 0x8000)) return;  // Not a response
-    if (flags & 0x000f) return;     // Error code set
-
-    uint16_t ancount = ntohs(dns->ancount);
-    if (ancount == 0) return;  // No answers
-
-    // Skip header and question section
-    const uint8_t *ptr = (const uint8_t *)data + sizeof(dns_header_t);
-    const uint8_t *end = (const uint8_t *)data + len;
-
-    // Skip question (QNAME + QTYPE + QCLASS)
-    // QNAME is a sequence of labels ending with 0
-    while (ptr < end && *ptr != 0) {
-        if ((*ptr & 0xc0) == 0xc0) {
-            // Pointer - skip 2 bytes
-            ptr += 2;
-            goto parse_answer;
-        }
-        ptr += 1 + *ptr;  // Skip length byte + label
-    }
-    if (ptr < end) ptr++;  // Skip null terminator
-    ptr += 4;  // Skip QTYPE (2) + QCLASS (2)
-
-parse_answer:
-    // Parse answer records
-    for (int i = 0; i < ancount && ptr + 12 <= end; i++) {
-        // Skip NAME (may be pointer)
-        if ((*ptr & 0xc0) == 0xc0) {
-            ptr += 2;  // Pointer
-        } else {
-            while (ptr < end && *ptr != 0) {
-                ptr += 1 + *ptr;
-            }
-            if (ptr < end) ptr++;
-        }
-
-        if (ptr + 10 > end) break;
-
-        uint16_t type = (ptr[0] << 8) | ptr[1];
-        // uint16_t class = (ptr[2] << 8) | ptr[3];
-        // uint32_t ttl = (ptr[4] << 24) | (ptr[5] << 16) | (ptr[6] << 8) | ptr[7];
-        uint16_t rdlength = (ptr[8] << 8) | ptr[9];
-        ptr += 10;
+#define DNS_CLIENT_PORT     10053
+#define DNS_NAME_MAX        128     // Including the terminator
+#define DNS_QUERY_MAX       (sizeof(dns_header_t) + DNS_NAME_MAX + 1 + 4)
+#define DNS_CACHE_SIZE      64
+#define DNS_MAX_PENDING     8
+#define DNS_TIMEOUT_TICKS   500     // Give up on the server after 5s...
+#define DNS_RETRY_TICKS     100     // ...resending every second until then
+
+// How long answers are kept, in seconds. Record TTLs are clamped to
+// [DNS_TTL_MIN, DNS_TTL_MAX]; "no such name" is kept for the SOA minimum
+// when the server sends one (RFC 2308), DNS_NEG_TTL otherwise, and a
+// server that failed or never answered is left alone for DNS_FAIL_TTL.
+#define DNS_TTL_MIN         5
+#define DNS_TTL_MAX         3600
+#define DNS_NEG_TTL         60
+#define DNS_NEG_TTL_MAX     300
+#define DNS_FAIL_TTL        5
+
+#define DNS_HOSTS_PATH      "/etc/hosts"
+#define DNS_HOSTS_MAX       32
+#define DNS_HOSTS_FILE_MAX  8192
+#define DNS_HOSTS_RECHECK   (10 * 100)  // Ticks between looks at the file
+
+#define DNS_TYPE_A      1
+#define DNS_TYPE_CNAME  5
+#define DNS_TYPE_SOA    6
 
-        if (ptr + rdlength > end) break;
+typedef struct {
+    char name[DNS_NAME_MAX];    // Lowercase, no trailing dot
+    uint32_t hash;
+    uint32_t ip;                // 0 for a cached failure
+    int rcode;                  // What the failure was (DNS_RCODE_*)
+    uint64_t expires;           // Ticks; 0 = free slot
+    uint64_t last_used;
+} dns_cache_entry_t;
 
-        // Type A = 1 (IPv4 address)
-        if (type == 1 && rdlength == 4) {
-            // Found an A record!
-            dns_resolved_ip = MAKE_IP(ptr[0], ptr[1], ptr[2], ptr[3]);
-            dns_response_received = 1;
-            return;
-        }
+typedef struct {
+    int in_use;
+    int waiters;
+    uint16_t id;
+    char name[DNS_NAME_MAX];
+    uint8_t query[DNS_QUERY_MAX];
+    uint32_t query_len;
+    uint64_t deadline;          // Ticks
+    uint64_t next_send;
+    int sends;
+    int done;                   // Answered, failed or timed out
+    uint32_t ip;
+    uint32_t ttl;
+    int rcode;
+} dns_pending_t;
 
-        ptr += rdlength;
-    }
-}
+typedef struct {
+    char name[DNS_NAME_MAX];
+    uint32_t hash;
+    uint32_t ip;
+} dns_host_t;
+
+static dns_cache_entry_t dns_cache[DNS_CACHE_SIZE];
+static dns_pending_t dns_pending[DNS_MAX_PENDING];
+static dns_host_t dns_hosts[DNS_HOSTS_MAX];
+static int dns_hosts_count = 0;
+static uint64_t dns_hosts_checked = 0;      // Ticks, 0 = never
+static int dns_port_bound = 0;
+static uint16_t dns_next_id = 1;
+static dns_stats_t dns_stats;
 
 // Resolve hostname to IP
 // Check if string is an IP address (e.g., "10.0.2.2") and parse it
@@ -679,110 +1241,521 @@ static uint32_t parse_ip_string(const char *str) {
     return MAKE_IP(octets[0], octets[1], octets[2], octets[3]);
 }
 
-uint32_t dns_resolve(const char *hostname) {
-    // First check if it's already an IP address
-    uint32_t ip = parse_ip_string(hostname);
-    if (ip != 0) {
-        return ip;  // It's an IP, no DNS needed
-    }
+static char dns_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
 
-    // Build DNS query
-    uint8_t query[512];
-    dns_header_t *dns = (dns_header_t *)query;
+// Copy a name in the form it's cached under: lowercase, no trailing dot.
+// Returns its FNV-1a hash, or 0 if it's empty or too long.
+static uint32_t dns_normalize(const char *in, char *out) {
+    uint32_t hash = 2166136261u;
+    int n = 0;
+    while (in[n]) {
+        if (n >= DNS_NAME_MAX - 1) return 0;
+        out[n] = dns_lower(in[n]);
+        n++;
+    }
+    if (n > 0 && out[n - 1] == '.') n--;
+    out[n] = '\0';
+    if (n == 0) return 0;
+    for (int i = 0; i < n; i++) {
+        hash = (hash ^ (uint8_t)out[i]) * 16777619u;
+    }
+    return hash ? hash : 1;
+}
 
-    // Use a simple incrementing ID
-    static uint16_t next_id = 1;
-    dns_query_id = next_id++;
+static void dns_copy_name(char *dst, const char *src) {
+    strncpy(dst, src, DNS_NAME_MAX - 1);
+    dst[DNS_NAME_MAX - 1] = '\0';
+}
 
-    dns->id = htons(dns_query_id);
-    dns->flags = htons(0x0100);  // RD (recursion desired)
-    dns->qdcount = htons(1);
-    dns->ancount = 0;
-    dns->nscount = 0;
-    dns->arcount = 0;
+// ---- Cache ----
 
-    // Build QNAME from hostname
-    uint8_t *ptr = query + sizeof(dns_header_t);
-    const char *src = hostname;
+static dns_cache_entry_t *dns_cache_find(const char *name, uint32_t hash, uint64_t now) {
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        dns_cache_entry_t *e = &dns_cache[i];
+        if (e->expires > now && e->hash == hash && strcmp(e->name, name) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
 
-    while (*src) {
-        // Find next dot or end
-        const char *dot = src;
-        while (*dot && *dot != '.') dot++;
+static void dns_cache_put(const char *name, uint32_t ip, int rcode, uint32_t ttl) {
+    char norm[DNS_NAME_MAX];
+    uint32_t hash = dns_normalize(name, norm);
+    if (!hash) return;
 
-        uint8_t label_len = dot - src;
-        if (label_len > 63) return 0;  // Label too long
+    uint64_t now = timer_get_ticks();
+    dns_cache_entry_t *slot = dns_cache_find(norm, hash, now);
 
-        *ptr++ = label_len;
-        while (src < dot) {
-            *ptr++ = *src++;
+    // Otherwise a free or expired slot, or failing that the least recently used
+    for (int i = 0; !slot && i < DNS_CACHE_SIZE; i++) {
+        if (dns_cache[i].expires <= now) slot = &dns_cache[i];
+    }
+    if (!slot) {
+        slot = &dns_cache[0];
+        for (int i = 1; i < DNS_CACHE_SIZE; i++) {
+            if (dns_cache[i].last_used < slot->last_used) slot = &dns_cache[i];
         }
-        if (*src == '.') src++;
     }
-    *ptr++ = 0;  // Null terminator
-
-    // QTYPE = A (1), QCLASS = IN (1)
-    *ptr++ = 0; *ptr++ = 1;  // QTYPE
-    *ptr++ = 0; *ptr++ = 1;  // QCLASS
 
-    uint32_t query_len = ptr - query;
+    dns_copy_name(slot->name, norm);
+    slot->hash = hash;
+    slot->ip = ip;
+    slot->rcode = rcode;
+    slot->expires = now + (uint64_t)ttl * 100;
+    slot->last_used = now;
+}
 
-    // Bind to receive DNS responses on port 53 (we're the client, but use same port for simplicity)
-    // Actually, use ephemeral port
-    uint16_t local_port = 10053 + (dns_query_id % 100);
-    dns_response_received = 0;
-    dns_resolved_ip = 0;
+void dns_flush(void) {
+    NET_LOCKED();
+    memset(dns_cache, 0, sizeof(dns_cache));
+    dns_hosts_checked = 0;
+}
 
-    udp_bind(local_port, dns_recv_handler);
+void dns_get_stats(dns_stats_t *out) {
+    if (!out) return;
+    NET_LOCKED();
 
-    // First, make sure we can reach DNS server (ARP)
-    uint32_t dns_server = NET_DNS;
-    uint32_t next_hop = dns_server;
-    if ((dns_server & NET_NETMASK) != (our_ip & NET_NETMASK)) {
-        next_hop = NET_GATEWAY;
+    uint64_t now = timer_get_ticks();
+    dns_stats.entries = 0;
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        if (dns_cache[i].expires > now) dns_stats.entries++;
     }
+    dns_stats.hosts_entries = dns_hosts_count;
+    memcpy(out, &dns_stats, sizeof(*out));
+}
 
-    if (!arp_lookup(next_hop)) {
-        arp_request(next_hop);
-        for (int i = 0; i < 100 && !arp_lookup(next_hop); i++) {
-            net_poll();
-            for (volatile int j = 0; j < 100000; j++);
-        }
-        if (!arp_lookup(next_hop)) {
-            udp_unbind(local_port);
-            return 0;
+// ---- /etc/hosts ----
+
+// "address name [aliases...]" per line, # starts a comment
+static void dns_hosts_parse(char *text) {
+    dns_hosts_count = 0;
+
+    char *p = text;
+    while (*p) {
+        char *line = p;
+        while (*p && *p != '\n') p++;
+        if (*p) *p++ = '\0';
+
+        char *hash = line;
+        while (*hash && *hash != '#') hash++;
+        *hash = '\0';
+
+        uint32_t ip = 0;
+        char *s = line;
+        for (;;) {
+            while (*s == ' ' || *s == '\t' || *s == '\r') s++;
+            if (!*s) break;
+            char *tok = s;
+            while (*s && *s != ' ' && *s != '\t' && *s != '\r') s++;
+            if (*s) *s++ = '\0';
+
+            if (!ip) {
+                ip = parse_ip_string(tok);
+                if (!ip) break;     // Not an IPv4 line
+                continue;
+            }
+            if (dns_hosts_count >= DNS_HOSTS_MAX) return;
+
+            dns_host_t *h = &dns_hosts[dns_hosts_count];
+            h->hash = dns_normalize(tok, h->name);
+            if (!h->hash) continue;
+            h->ip = ip;
+            dns_hosts_count++;
         }
     }
+}
+
+// Reread /etc/hosts once every DNS_HOSTS_RECHECK ticks, so edits that
+// keep the size show up too. Only claiming the recheck and parsing hold the
+// stack: the file is read in between, so a slow disk doesn't hold up packets.
+static void dns_hosts_refresh(void) {
+    mutex_lock(&net_mutex);
+    uint64_t now = timer_get_ticks();
+    int due = !dns_hosts_checked || now - dns_hosts_checked >= DNS_HOSTS_RECHECK;
+    if (due) dns_hosts_checked = now ? now : 1;
+    net_release();
+    if (!due) return;
+
+    // Our own handle: vfs_lookup()'s node is shared with other callers
+    vfs_node_t *node = vfs_open_handle(DNS_HOSTS_PATH);
+    long size = (node && vfs_is_file(node)) ? (long)node->size : 0;
+    long want = size > DNS_HOSTS_FILE_MAX ? DNS_HOSTS_FILE_MAX : size;
+    char *text = malloc(want + 1);
+    int n = (text && want) ? vfs_read(node, text, want, 0) : 0;
+    vfs_close_handle(node);
+    if (!text) return;
+    text[n > 0 ? n : 0] = '\0';
+
+    NET_LOCKED();
+    dns_hosts_parse(text);
+    free(text);
+}
+
+static dns_host_t *dns_hosts_find(const char *name, uint32_t hash) {
+    for (int i = 0; i < dns_hosts_count; i++) {
+        if (dns_hosts[i].hash == hash && strcmp(dns_hosts[i].name, name) == 0) {
+            return &dns_hosts[i];
+        }
+    }
+    return NULL;
+}
+
+// ---- Queries ----
+
+// Step over a (possibly compressed) name. Returns NULL if it runs off the end.
+static const uint8_t *dns_skip_name(const uint8_t *p, const uint8_t *end) {
+    while (p < end) {
+        uint8_t len = *p;
+        if (len == 0) return p + 1;
+        if ((len & 0xc0) == 0xc0) return (p + 2 <= end) ? p + 2 : NULL;
+        if (len & 0xc0) return NULL;
+        p += 1 + len;
+    }
+    return NULL;
+}
+
+static uint32_t dns_get32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Finish a query: record the outcome for its waiters and the cache
+static void dns_complete(dns_pending_t *q, uint32_t ip, int rcode, uint32_t ttl) {
+    q->done = 1;
+    q->ip = ip;
+    q->rcode = rcode;
+    q->ttl = ttl;
+    dns_cache_put(q->name, ip, rcode, ttl);
+}
+
+// DNS response handler
+static void dns_recv_handler(uint32_t src_ip, uint16_t src_port, uint16_t dst_port, const void *data, uint32_t len) {
+    (void)dst_port;
+
+    if (src_ip != NET_DNS || src_port != 53) return;
+    if (len < sizeof(dns_header_t)) return;
+
+    const dns_header_t *dns = (const dns_header_t *)data;
+    uint16_t flags = ntohs(dns->flags);
+    if (!(flags & 0x8000)) return;  // Not a response
+
+    // Match it to the query in flight with this ID
+    uint16_t id = ntohs(dns->id);
+    dns_pending_t *q = NULL;
+    for (int i = 0; i < DNS_MAX_PENDING; i++) {
+        if (dns_pending[i].in_use && !dns_pending[i].done && dns_pending[i].id == id) {
+            q = &dns_pending[i];
+            break;
+        }
+    }
+    if (!q) return;
+
+    // The question comes back as we sent it - check it's ours (servers
+    // may change the case of names)
+    if (len < q->query_len || ntohs(dns->qdcount) != 1) return;
+    const uint8_t *qd = q->query + sizeof(dns_header_t);
+    const uint8_t *rd = (const uint8_t *)data + sizeof(dns_header_t);
+    for (uint32_t i = 0; i < q->query_len - sizeof(dns_header_t); i++) {
+        if (dns_lower(rd[i]) != dns_lower(qd[i])) return;
+    }
+
+    const uint8_t *ptr = (const uint8_t *)data + q->query_len;
+    const uint8_t *end = (const uint8_t *)data + len;
+    int rcode = flags & 0x000f;
+
+    if (rcode != DNS_RCODE_NOERROR && rcode != DNS_RCODE_NXDOMAIN) {
+        dns_complete(q, 0, rcode, DNS_FAIL_TTL);
+        return;
+    }
+
+    // Answers: the first A record, through any CNAMEs. The chain lasts as
+    // long as its shortest-lived link.
+    uint32_t chain_ttl = DNS_TTL_MAX;
+    uint16_t ancount = ntohs(dns->ancount);
+    for (int i = 0; i < ancount; i++) {
+        ptr = dns_skip_name(ptr, end);
+        if (!ptr || ptr + 10 > end) break;
+
+        uint16_t type = (ptr[0] << 8) | ptr[1];
+        uint32_t ttl = dns_get32(ptr + 4);
+        uint16_t rdlength = (ptr[8] << 8) | ptr[9];
+        ptr += 10;
+        if (ptr + rdlength > end) break;
+
+        if (ttl < chain_ttl && (type == DNS_TYPE_A || type == DNS_TYPE_CNAME)) chain_ttl = ttl;
+
+        if (type == DNS_TYPE_A && rdlength == 4) {
+            if (chain_ttl < DNS_TTL_MIN) chain_ttl = DNS_TTL_MIN;
+            dns_complete(q, MAKE_IP(ptr[0], ptr[1], ptr[2], ptr[3]), DNS_RCODE_NOERROR, chain_ttl);
+            return;
+        }
+        ptr += rdlength;
+    }
+
+    // No address: a negative answer. Its lifetime is in the authority
+    // section's SOA, the lesser of the record's TTL and its MINIMUM field.
+    uint32_t neg_ttl = DNS_NEG_TTL;
+    uint16_t nscount = ntohs(dns->nscount);
+    for (int i = 0; ptr && i < nscount; i++) {
+        ptr = dns_skip_name(ptr, end);
+        if (!ptr || ptr + 10 > end) break;
+
+        uint16_t type = (ptr[0] << 8) | ptr[1];
+        uint32_t ttl = dns_get32(ptr + 4);
+        uint16_t rdlength = (ptr[8] << 8) | ptr[9];
+        ptr += 10;
+        if (ptr + rdlength > end) break;
 
-    // Send DNS query
-    if (udp_send(dns_server, local_port, 53, query, query_len) < 0) {
-        udp_unbind(local_port);
+        if (type == DNS_TYPE_SOA && rdlength >= 20) {
+            uint32_t minimum = dns_get32(ptr + rdlength - 4);
+            neg_ttl = ttl < minimum ? ttl : minimum;
+            break;
+        }
+        ptr += rdlength;
+    }
+    if (neg_ttl < DNS_TTL_MIN) neg_ttl = DNS_TTL_MIN;
+    if (neg_ttl > DNS_NEG_TTL_MAX) neg_ttl = DNS_NEG_TTL_MAX;
+    dns_complete(q, 0, rcode, neg_ttl);
+}
+
+// Claim a pending slot for name and build its query. NULL if all are busy
+// or the name can't be encoded.
+static dns_pending_t *dns_pending_start(const char *name, uint64_t now) {
+    dns_pending_t *q = NULL;
+    for (int i = 0; i < DNS_MAX_PENDING; i++) {
+        if (!dns_pending[i].in_use) {
+            q = &dns_pending[i];
+            break;
+        }
+    }
+    if (!q) return NULL;
+
+    dns_header_t *dns = (dns_header_t *)q->query;
+    dns->flags = htons(0x0100);  // RD (recursion desired)
+    dns->qdcount = htons(1);
+    dns->ancount = 0;
+    dns->nscount = 0;
+    dns->arcount = 0;
+
+    // Build QNAME from hostname
+    uint8_t *ptr = q->query + sizeof(dns_header_t);
+    const char *src = name;
+
+    while (*src) {
+        // Find next dot or end
+        const char *dot = src;
+        while (*dot && *dot != '.') dot++;
+
+        uint32_t label_len = dot - src;
+        if (label_len == 0 || label_len > 63) return NULL;  // Empty or too long
+
+        *ptr++ = label_len;
+        while (src < dot) {
+            *ptr++ = *src++;
+        }
+        if (*src == '.') src++;
+    }
+    *ptr++ = 0;  // Null terminator
+
+    // QTYPE = A (1), QCLASS = IN (1)
+    *ptr++ = 0; *ptr++ = 1;  // QTYPE
+    *ptr++ = 0; *ptr++ = 1;  // QCLASS
+
+    // IDs in flight must differ; skip 0 so it never matches a fresh slot
+    uint16_t id;
+    int clash;
+    do {
+        id = dns_next_id++;
+        clash = (id == 0);
+        for (int i = 0; i < DNS_MAX_PENDING && !clash; i++) {
+            clash = dns_pending[i].in_use && dns_pending[i].id == id;
+        }
+    } while (clash);
+
+    dns->id = htons(id);
+    q->id = id;
+    q->query_len = ptr - q->query;
+    dns_copy_name(q->name, name);
+    q->in_use = 1;
+    q->waiters = 0;
+    q->sends = 0;
+    q->done = 0;
+    q->deadline = now + DNS_TIMEOUT_TICKS;
+    q->next_send = now;
+    return q;
+}
+
+// (Re)send q's query. Until ARP answers for the route it waits in the
+// neighbor queue; udp_send() failing at all fails the query.
+static void dns_send_query(dns_pending_t *q) {
+    q->next_send = timer_get_ticks() + DNS_RETRY_TICKS;
+
+    if (!dns_port_bound) {
+        udp_bind(DNS_CLIENT_PORT, dns_recv_handler);
+        dns_port_bound = 1;
+    }
+
+    if (udp_send(NET_DNS, DNS_CLIENT_PORT, 53, q->query, q->query_len) < 0) {
+        dns_complete(q, 0, DNS_RCODE_TIMEOUT, DNS_FAIL_TTL);
+        return;
+    }
+    dns_stats.queries++;
+    if (q->sends++) dns_stats.retransmits++;
+}
+
+int dns_lookup(const char *hostname, dns_answer_t *out) {
+    dns_answer_t ans = { 0, 0, DNS_SRC_LITERAL, DNS_RCODE_NOERROR };
+    if (out) *out = ans;
+    if (!hostname) return -1;
+
+    // First check if it's already an IP address
+    ans.ip = parse_ip_string(hostname);
+    if (ans.ip != 0) {
+        if (out) *out = ans;
+        return 0;  // It's an IP, no DNS needed
+    }
+
+    char name[DNS_NAME_MAX];
+    uint32_t hash = dns_normalize(hostname, name);
+    if (!hash) return -1;
+
+    dns_hosts_refresh();
+
+    NET_LOCKED();
+    dns_stats.lookups++;
+    uint64_t now = timer_get_ticks();
+
+    dns_host_t *host = dns_hosts_find(name, hash);
+    if (host) {
+        dns_stats.hosts_hits++;
+        ans.ip = host->ip;
+        ans.source = DNS_SRC_HOSTS;
+        if (out) *out = ans;
         return 0;
     }
 
-    // Wait for response (up to 5 seconds)
-    for (int i = 0; i < 500 && !dns_response_received; i++) {
-        net_poll();
-        for (volatile int j = 0; j < 100000; j++);
+    dns_cache_entry_t *e = dns_cache_find(name, hash, now);
+    if (e) {
+        dns_stats.hits++;
+        if (!e->ip) dns_stats.negative_hits++;
+        e->last_used = now;
+        ans.ip = e->ip;
+        ans.rcode = e->rcode;
+        ans.ttl = (uint32_t)((e->expires - now + 99) / 100);
+        ans.source = DNS_SRC_CACHE;
+        if (out) *out = ans;
+        return ans.ip ? 0 : -1;
     }
 
-    udp_unbind(local_port);
+    // Not known: join the query for this name if there is one, else start it
+    dns_stats.misses++;
+    ans.source = DNS_SRC_SERVER;
 
-    if (dns_response_received) {
-        printf("[DNS] Resolved %s -> %s\n", hostname, ip_to_str(dns_resolved_ip));
-        return dns_resolved_ip;
+    dns_pending_t *q = NULL;
+    for (int i = 0; i < DNS_MAX_PENDING; i++) {
+        if (dns_pending[i].in_use && strcmp(dns_pending[i].name, name) == 0) {
+            q = &dns_pending[i];
+            break;
+        }
+    }
+    if (q) {
+        dns_stats.coalesced++;
+    } else {
+        q = dns_pending_start(name, now);
+        if (!q) {
+            ans.rcode = DNS_RCODE_TIMEOUT;
+            if (out) *out = ans;
+            return -1;
+        }
+    }
+    q->waiters++;
+
+    for (;;) {
+        uint32_t seq = net_rx_wait_queue.seq;
+        now = timer_get_ticks();
+        if (q->done) break;
+        if (now >= q->deadline) {
+            dns_stats.timeouts++;
+            dns_complete(q, 0, DNS_RCODE_TIMEOUT, DNS_FAIL_TTL);
+            break;
+        }
+        if (now >= q->next_send) {
+            dns_send_query(q);
+            continue;
+        }
+        uint64_t wake = q->next_send < q->deadline ? q->next_send : q->deadline;
+        net_wait(seq, (uint32_t)(wake - now));
     }
 
-    printf("[DNS] Failed to resolve %s\n", hostname);
-    return 0;
+    ans.ip = q->ip;
+    ans.rcode = q->rcode;
+    ans.ttl = q->ttl;
+    if (--q->waiters == 0) q->in_use = 0;
+
+    if (ans.rcode == DNS_RCODE_NXDOMAIN) dns_stats.nxdomain++;
+    if (ans.ip) {
+        printf("[DNS] Resolved %s -> %s\n", hostname, ip_to_str(ans.ip));
+    } else {
+        printf("[DNS] Failed to resolve %s\n", hostname);
+    }
+    if (out) *out = ans;
+    return ans.ip ? 0 : -1;
+}
+
+uint32_t dns_resolve(const char *hostname) {
+    dns_answer_t ans;
+    return dns_lookup(hostname, &ans) == 0 ? ans.ip : 0;
 }
 
 // ============ TCP Implementation ============
 
-// TCP socket structure
-#define TCP_MAX_SOCKETS 8
-#define TCP_RX_BUF_SIZE 32768  // 32KB - TLS certs can be large
-#define TCP_TX_BUF_SIZE 4096
+// TCP socket structure. Listeners and the connections they accept share
+// the table; buffers are allocated per connection, so slots are cheap.
+#define TCP_MAX_SOCKETS 64
+#define TCP_BACKLOG_MAX 16     // Pending connections per listener
+#define TCP_RX_BUF_SIZE 32768  // Default receive buffer - TLS certs can be large
+#define TCP_TX_BUF_SIZE 16384  // Default send buffer (unacknowledged + unsent)
+#define TCP_BUF_MAX     (512 * 1024)  // Largest buffer tcp_set_bufsize() grants
+#define TCP_MSS         1400   // Segment payload (fits eth0 with room to spare)
+
+// Window scale we offer in every SYN: 65535 << 3 covers TCP_BUF_MAX, so a
+// socket can grow its buffer after the handshake
+#define TCP_WSCALE      3
+
+// TCP options
+#define TCP_OPT_END       0
+#define TCP_OPT_NOP       1
+#define TCP_OPT_MSS       2
+#define TCP_OPT_WSCALE    3
+#define TCP_OPT_SACK_PERM 4
+#define TCP_OPT_SACK      5
+
+// Out-of-order ranges a receiver remembers, SACK blocks a sender keeps
+#define TCP_OOO_MAX     4
+#define TCP_SACK_MAX    4
+
+// Retransmission timeout (Jacobson/Karels), microseconds
+#define TCP_RTO_INIT_US  1000000
+#define TCP_RTO_MIN_US   200000
+#define TCP_RTO_MAX_US   30000000
+#define TCP_MAX_RETRIES  8       // Timeouts in a row before we give up
+
+// Congestion control (NewReno)
+#define TCP_INIT_CWND    10      // Segments
+#define TCP_DUPACK_THRESH 3
+
+// Sequence number comparisons (modulo 2^32)
+#define SEQ_LT(a, b)  ((int32_t)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b) ((int32_t)((a) - (b)) <= 0)
+#define SEQ_GT(a, b)  ((int32_t)((a) - (b)) > 0)
+
+// A run of sequence space [start, end)
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+} tcp_range_t;
 
 typedef struct {
     int state;
@@ -792,95 +1765,584 @@ typedef struct {
     uint16_t remote_port;
 
     // Sequence numbers
-    uint32_t send_seq;      // Next byte we'll send
+    uint32_t send_seq;      // Next byte we'll send (snd_nxt)
     uint32_t send_ack;      // Last ACK we sent (next byte we expect)
     uint32_t recv_seq;      // For tracking incoming data
 
-    // Receive buffer (ring buffer)
-    uint8_t rx_buf[TCP_RX_BUF_SIZE];
-    uint32_t rx_head;       // Write position
+    // Receive buffer (ring): rx_len readable bytes start at rx_tail.
+    // Out-of-order data is written straight to its place past them and
+    // tracked in ooo[] (sorted) until the gap before it fills.
+    uint8_t *rx_buf;
+    uint32_t rx_size;
     uint32_t rx_tail;       // Read position
+    uint32_t rx_len;
+    tcp_range_t ooo[TCP_OOO_MAX];
+    int ooo_count;
+    uint32_t rcv_adv;       // Right edge of the window we last advertised
+
+    // Send buffer (ring): bytes [snd_una, snd_una + tx_len), sent or not.
+    // Bytes stay until ACKed so they can be retransmitted.
+    uint8_t *tx_buf;
+    uint32_t tx_size;
+    uint32_t tx_start;      // Ring index of snd_una
+    uint32_t tx_len;
+    uint32_t snd_una;       // Oldest unacknowledged sequence number
+    uint32_t snd_max;       // Highest sequence number sent so far
+    uint32_t snd_wnd;       // Peer's advertised receive window (unscaled)
+    tcp_range_t sacked[TCP_SACK_MAX];  // What the peer holds past snd_una
+    int sacked_count;
+
+    // Negotiated in the handshake
+    uint16_t mss;           // Largest segment we send
+    uint8_t snd_wscale;     // Shift for the peer's window field
+    uint8_t rcv_wscale;     // Shift for ours
+    uint8_t sack_ok;        // Both ends do SACK
+
+    // Congestion control
+    uint32_t cwnd;
+    uint32_t ssthresh;
+    uint32_t recover;       // snd_max when fast recovery started
+    uint8_t in_recovery;
+    uint8_t dupacks;
+
+    // Round-trip estimate and retransmit timer (microseconds)
+    uint32_t srtt;          // 0 = no sample yet
+    uint32_t rttvar;
+    uint32_t rto;
+    uint32_t rtt_seq;       // Timing the segment that ends here...
+    uint32_t rtt_start;     // ...sent at this time
+    uint8_t rtt_timing;
+    uint8_t rto_armed;
+    uint32_t rto_start;
+    uint8_t retries;        // Timeouts since the last forward progress
 
     // Flags
     uint8_t fin_received;   // Remote sent FIN
+    uint8_t fin_queued;     // Send FIN once the buffered data is out
     uint8_t fin_sent;       // We sent FIN
+    uint8_t loopback;       // Routed over lo
+    uint8_t discard;        // Loopback service - ACK data and drop it
+    uint8_t source;         // Loopback service - send forever, see tcp_output()
+
+    uint32_t iss;           // Our initial sequence number (the SYN's)
+
+    // Passive open: a connection remembers its listener until accepted.
+    // A listener queues finished handshakes (socket indices) for
+    // tcp_accept(); handshakes in progress are the sockets in SYN_RECEIVED.
+    int16_t parent;         // Listener index, -1 once accepted (or active open)
+    uint16_t backlog;       // Listener: handshakes in progress + queued
+    uint8_t accept_q[TCP_BACKLOG_MAX];
+    uint8_t accept_head;
+    uint8_t accept_count;
 } tcp_socket_internal_t;
 
-static tcp_socket_internal_t tcp_sockets[TCP_MAX_SOCKETS];
-static uint16_t tcp_next_port = 49152;  // Ephemeral port range
+// Options seen in a segment
+typedef struct {
+    uint16_t mss;           // 0 = not present
+    int wscale;             // -1 = not present
+    uint8_t sack_perm;
+    tcp_range_t sack[TCP_SACK_MAX];
+    int sack_count;
+} tcp_options_t;
 
-// TCP pseudo-header for checksum
-typedef struct __attribute__((packed)) {
-    uint32_t src_ip;
-    uint32_t dst_ip;
-    uint8_t zero;
-    uint8_t protocol;
-    uint16_t tcp_len;
-} tcp_pseudo_header_t;
+static tcp_socket_internal_t tcp_sockets[TCP_MAX_SOCKETS];
+#define TCP_EPHEMERAL_MIN 49152
+static uint16_t tcp_next_port = TCP_EPHEMERAL_MIN;
+static tcp_stats_t tcp_stats;
 
 // Calculate TCP checksum (includes pseudo-header)
 static uint16_t tcp_checksum(uint32_t src_ip, uint32_t dst_ip,
-                              const tcp_header_t *tcp, const void *data, uint32_t data_len) {
-    uint32_t sum = 0;
+                              const tcp_header_t *tcp, uint32_t hdr_len,
+                              const void *data, uint32_t data_len) {
+    uint32_t sum = ip_pseudo_sum(src_ip, dst_ip, IP_PROTO_TCP, hdr_len + data_len);
+    sum = csum_partial(tcp, hdr_len, sum);
+    sum = csum_partial(data, data_len, sum);
+    return csum_fold(sum);
+}
 
-    // Pseudo-header
-    sum += (src_ip >> 16) & 0xffff;
-    sum += src_ip & 0xffff;
-    sum += (dst_ip >> 16) & 0xffff;
-    sum += dst_ip & 0xffff;
-    sum += htons(IP_PROTO_TCP);
-    sum += htons(sizeof(tcp_header_t) + data_len);
+// Receive window we can offer right now: free ring space. Parked
+// out-of-order data sits inside it, so it doesn't shrink the offer.
+static uint32_t tcp_rx_space(tcp_socket_internal_t *sock) {
+    if (sock->discard) return sock->rx_size;
+    return sock->rx_size - sock->rx_len;
+}
 
-    // TCP header
-    const uint16_t *ptr = (const uint16_t *)tcp;
-    for (int i = 0; i < (int)(sizeof(tcp_header_t) / 2); i++) {
-        sum += ptr[i];
+// Write options for a segment into opt (40 bytes max), returns length
+static uint32_t tcp_build_options(tcp_socket_internal_t *sock, uint8_t flags, uint8_t *opt) {
+    uint32_t n = 0;
+
+    if (flags & TCP_SYN) {
+        opt[n++] = TCP_OPT_MSS;
+        opt[n++] = 4;
+        opt[n++] = TCP_MSS >> 8;
+        opt[n++] = TCP_MSS & 0xff;
+
+        // A SYN+ACK only echoes what the peer offered
+        int reply = (flags & TCP_ACK) != 0;
+        if (!reply || sock->sack_ok) {
+            opt[n++] = TCP_OPT_NOP;
+            opt[n++] = TCP_OPT_NOP;
+            opt[n++] = TCP_OPT_SACK_PERM;
+            opt[n++] = 2;
+        }
+        if (!reply || sock->rcv_wscale) {
+            opt[n++] = TCP_OPT_NOP;
+            opt[n++] = TCP_OPT_WSCALE;
+            opt[n++] = 3;
+            opt[n++] = TCP_WSCALE;
+        }
+        return n;
     }
 
-    // Data
-    ptr = (const uint16_t *)data;
-    while (data_len > 1) {
-        sum += *ptr++;
-        data_len -= 2;
-    }
-    if (data_len == 1) {
-        sum += *(const uint8_t *)ptr;
+    // Tell the sender what we hold past the gap
+    if (sock->sack_ok && sock->ooo_count > 0) {
+        opt[n++] = TCP_OPT_NOP;
+        opt[n++] = TCP_OPT_NOP;
+        opt[n++] = TCP_OPT_SACK;
+        opt[n++] = 2 + 8 * sock->ooo_count;
+        for (int i = 0; i < sock->ooo_count; i++) {
+            uint32_t s = htonl(sock->ooo[i].start);
+            uint32_t e = htonl(sock->ooo[i].end);
+            memcpy(opt + n, &s, 4);
+            memcpy(opt + n + 4, &e, 4);
+            n += 8;
+        }
     }
+    return n;
+}
 
-    // Fold 32-bit sum to 16 bits
-    while (sum >> 16) {
-        sum = (sum & 0xffff) + (sum >> 16);
+// Pull options out of a segment's header
+static void tcp_parse_options(const uint8_t *opt, uint32_t len, tcp_options_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->wscale = -1;
+
+    uint32_t i = 0;
+    while (i < len) {
+        uint8_t kind = opt[i];
+        if (kind == TCP_OPT_END) break;
+        if (kind == TCP_OPT_NOP) { i++; continue; }
+        if (i + 1 >= len) break;
+        uint8_t olen = opt[i + 1];
+        if (olen < 2 || i + olen > len) break;
+
+        if (kind == TCP_OPT_MSS && olen == 4) {
+            out->mss = (opt[i + 2] << 8) | opt[i + 3];
+        } else if (kind == TCP_OPT_WSCALE && olen == 3) {
+            out->wscale = opt[i + 2] > 14 ? 14 : opt[i + 2];
+        } else if (kind == TCP_OPT_SACK_PERM && olen == 2) {
+            out->sack_perm = 1;
+        } else if (kind == TCP_OPT_SACK) {
+            for (uint32_t b = i + 2; b + 8 <= i + olen && out->sack_count < TCP_SACK_MAX; b += 8) {
+                uint32_t s, e;
+                memcpy(&s, opt + b, 4);
+                memcpy(&e, opt + b + 4, 4);
+                out->sack[out->sack_count].start = ntohl(s);
+                out->sack[out->sack_count].end = ntohl(e);
+                out->sack_count++;
+            }
+        }
+        i += olen;
     }
+}
 
-    return ~sum;
+// Apply the peer's SYN options to a socket
+static void tcp_negotiate(tcp_socket_internal_t *sock, const tcp_options_t *opts) {
+    sock->mss = TCP_MSS;
+    if (opts->mss && opts->mss < sock->mss) sock->mss = opts->mss;
+
+    // Scaling only happens if both sides sent the option
+    if (opts->wscale >= 0) {
+        sock->snd_wscale = opts->wscale;
+        sock->rcv_wscale = TCP_WSCALE;
+    } else {
+        sock->snd_wscale = 0;
+        sock->rcv_wscale = 0;
+    }
+    sock->sack_ok = opts->sack_perm;
+    sock->cwnd = TCP_INIT_CWND * sock->mss;
 }
 
-// Send a TCP segment
-static int tcp_send_segment(tcp_socket_internal_t *sock, uint8_t flags,
-                            const void *data, uint32_t len) {
+// Send a TCP segment starting at sequence number seq
+static int tcp_xmit(tcp_socket_internal_t *sock, uint32_t seq, uint8_t flags,
+                    const void *data, uint32_t len) {
     uint8_t pkt[1500];
     tcp_header_t *tcp = (tcp_header_t *)pkt;
 
+    uint32_t opt_len = tcp_build_options(sock, flags, pkt + sizeof(tcp_header_t));
+    while (opt_len & 3) pkt[sizeof(tcp_header_t) + opt_len++] = TCP_OPT_END;
+    uint32_t hdr_len = sizeof(tcp_header_t) + opt_len;
+
+    // Advertise free ring space. The SYN's window is never scaled.
+    uint32_t space = tcp_rx_space(sock);
+    uint32_t wnd;
+    if (flags & TCP_SYN) {
+        wnd = space > 65535 ? 65535 : space;
+    } else {
+        uint32_t max = 65535U << sock->rcv_wscale;
+        if (space > max) space = max;
+        wnd = space >> sock->rcv_wscale;
+        sock->rcv_adv = sock->send_ack + (wnd << sock->rcv_wscale);
+    }
+
     tcp->src_port = htons(sock->local_port);
     tcp->dst_port = htons(sock->remote_port);
-    tcp->seq = htonl(sock->send_seq);
+    tcp->seq = htonl(seq);
     tcp->ack = htonl(sock->send_ack);
-    tcp->data_off = (5 << 4);  // 20 bytes, no options
+    tcp->data_off = (hdr_len / 4) << 4;
     tcp->flags = flags;
-    tcp->window = htons(TCP_RX_BUF_SIZE);
+    tcp->window = htons(wnd);
     tcp->checksum = 0;
     tcp->urgent = 0;
 
     // Copy data
     if (data && len > 0) {
-        memcpy(pkt + sizeof(tcp_header_t), data, len);
+        memcpy(pkt + hdr_len, data, len);
+    }
+
+    tcp_stats.segs_out++;
+
+    // Leave the checksum to the interface if it can, seeded with the
+    // pseudo-header
+    if (net_csum_offload(sock->remote_ip)) {
+        tcp->checksum = csum_fold_raw(ip_pseudo_sum(htonl(sock->local_ip), htonl(sock->remote_ip),
+                                                    IP_PROTO_TCP, hdr_len + len));
+        return ip_output(sock->remote_ip, IP_PROTO_TCP, pkt, hdr_len + len,
+                         offsetof(tcp_header_t, checksum));
     }
 
-    // Calculate checksum
     tcp->checksum = tcp_checksum(htonl(sock->local_ip), htonl(sock->remote_ip),
-                                  tcp, data, len);
+                                  tcp, hdr_len, data, len);
+    return ip_send(sock->remote_ip, IP_PROTO_TCP, pkt, hdr_len + len);
+}
+
+// Send a control segment (or data that isn't buffered) at send_seq
+static int tcp_send_segment(tcp_socket_internal_t *sock, uint8_t flags,
+                            const void *data, uint32_t len) {
+    return tcp_xmit(sock, sock->send_seq, flags, data, len);
+}
+
+// Send len buffered bytes starting at seq (must lie inside the send buffer)
+static int tcp_send_range(tcp_socket_internal_t *sock, uint32_t seq, uint32_t len) {
+    uint8_t seg[TCP_MSS];
+    uint32_t pos = (sock->tx_start + (seq - sock->snd_una)) % sock->tx_size;
+    uint32_t first = sock->tx_size - pos;
+    if (first > len) first = len;
+
+    memcpy(seg, sock->tx_buf + pos, first);
+    memcpy(seg + first, sock->tx_buf, len - first);
+
+    return tcp_xmit(sock, seq, TCP_ACK | TCP_PSH, seg, len);
+}
+
+static void tcp_arm_rto(tcp_socket_internal_t *sock) {
+    sock->rto_armed = 1;
+    sock->rto_start = hal_get_time_us();
+}
+
+// Fold one round-trip sample into srtt/rttvar and recompute the RTO
+static void tcp_rtt_sample(tcp_socket_internal_t *sock, uint32_t rtt) {
+    if (sock->srtt == 0) {
+        sock->srtt = rtt ? rtt : 1;
+        sock->rttvar = rtt / 2;
+    } else {
+        uint32_t err = rtt > sock->srtt ? rtt - sock->srtt : sock->srtt - rtt;
+        sock->rttvar = (3 * sock->rttvar + err) / 4;
+        sock->srtt = (7 * sock->srtt + rtt) / 8;
+        if (sock->srtt == 0) sock->srtt = 1;
+    }
+
+    uint32_t rto = sock->srtt + 4 * sock->rttvar;
+    if (rto < TCP_RTO_MIN_US) rto = TCP_RTO_MIN_US;
+    if (rto > TCP_RTO_MAX_US) rto = TCP_RTO_MAX_US;
+    sock->rto = rto;
+}
+
+// Push out whatever the congestion and receive windows allow: new data
+// first, then the FIN once every byte has gone out
+static void tcp_output(tcp_socket_internal_t *sock) {
+    // The source service's ring holds a fixed pattern, so "refilling" it
+    // is just claiming the bytes ACKs freed up
+    if (sock->source && sock->state == TCP_STATE_ESTABLISHED) {
+        sock->tx_len = sock->tx_size;
+    }
+
+    uint32_t tx_end = sock->snd_una + sock->tx_len;
+    uint32_t wnd = sock->cwnd < sock->snd_wnd ? sock->cwnd : sock->snd_wnd;
+
+    while (SEQ_LT(sock->send_seq, tx_end)) {
+        uint32_t in_flight = sock->send_seq - sock->snd_una;
+        if (in_flight >= wnd) break;
+
+        uint32_t len = tx_end - sock->send_seq;
+        if (len > sock->mss) len = sock->mss;
+        if (len > wnd - in_flight) len = wnd - in_flight;
+
+        // Only time segments sent for the first time (Karn)
+        if (!sock->rtt_timing && !SEQ_LT(sock->send_seq, sock->snd_max)) {
+            sock->rtt_timing = 1;
+            sock->rtt_seq = sock->send_seq + len;
+            sock->rtt_start = hal_get_time_us();
+        }
+
+        if (tcp_send_range(sock, sock->send_seq, len) < 0) break;
+        sock->send_seq += len;
+        if (SEQ_GT(sock->send_seq, sock->snd_max)) sock->snd_max = sock->send_seq;
+        if (!sock->rto_armed) tcp_arm_rto(sock);
+    }
+
+    if (sock->fin_queued && !sock->fin_sent && sock->send_seq == tx_end) {
+        tcp_send_segment(sock, TCP_FIN | TCP_ACK, NULL, 0);
+        sock->send_seq++;
+        sock->snd_max = sock->send_seq;
+        sock->fin_sent = 1;
+        if (!sock->rto_armed) tcp_arm_rto(sock);
+    }
+
+    // Data waiting on a closed window: the timer sends a probe
+    if (sock->tx_len && sock->snd_una == sock->snd_max && !sock->rto_armed) {
+        tcp_arm_rto(sock);
+    }
+}
+
+// Resend the oldest unacknowledged segment (or our FIN). With SACK, stop
+// where the peer's first SACKed block begins - it already has the rest.
+static void tcp_retransmit(tcp_socket_internal_t *sock) {
+    uint32_t len = sock->tx_len;
+    if (len > sock->mss) len = sock->mss;
+    if (sock->sacked_count > 0) {
+        uint32_t hole = sock->sacked[0].start - sock->snd_una;
+        if (hole > 0 && hole < len) len = hole;
+    }
+
+    if (sock->state == TCP_STATE_SYN_RECEIVED) {
+        tcp_xmit(sock, sock->iss, TCP_SYN | TCP_ACK, NULL, 0);
+    } else if (len > 0) {
+        tcp_send_range(sock, sock->snd_una, len);
+    } else if (sock->fin_sent) {
+        tcp_xmit(sock, sock->snd_una, TCP_FIN | TCP_ACK, NULL, 0);
+    }
+    sock->rtt_timing = 0;   // Karn: an ACK now is ambiguous
+    tcp_stats.retransmits++;
+}
+
+// Insert [start, end) into a sorted range list, merging neighbours.
+// Returns 0, or -1 if it didn't fit.
+static int tcp_range_add(tcp_range_t *list, int *count, int max, uint32_t start, uint32_t end) {
+    int i = 0;
+    while (i < *count && SEQ_LT(list[i].end, start)) i++;
+
+    if (i < *count && SEQ_LEQ(list[i].start, end)) {
+        // Overlaps or touches list[i]: grow it, then swallow any it reaches
+        if (SEQ_LT(start, list[i].start)) list[i].start = start;
+        if (SEQ_GT(end, list[i].end)) list[i].end = end;
+        while (i + 1 < *count && SEQ_LEQ(list[i + 1].start, list[i].end)) {
+            if (SEQ_GT(list[i + 1].end, list[i].end)) list[i].end = list[i + 1].end;
+            memmove(&list[i + 1], &list[i + 2], (*count - i - 2) * sizeof(tcp_range_t));
+            (*count)--;
+        }
+        return 0;
+    }
+
+    if (*count >= max) return -1;
+    memmove(&list[i + 1], &list[i], (*count - i) * sizeof(tcp_range_t));
+    list[i].start = start;
+    list[i].end = end;
+    (*count)++;
+    return 0;
+}
+
+// Drop ranges (or parts) below seq
+static void tcp_range_trim(tcp_range_t *list, int *count, uint32_t seq) {
+    int keep = 0;
+    for (int i = 0; i < *count; i++) {
+        if (SEQ_LEQ(list[i].end, seq)) continue;
+        list[keep] = list[i];
+        if (SEQ_LT(list[keep].start, seq)) list[keep].start = seq;
+        keep++;
+    }
+    *count = keep;
+}
+
+// Process an incoming ACK: free acknowledged data, update the RTT
+// estimate and congestion window, and spot duplicate ACKs
+static void tcp_ack(tcp_socket_internal_t *sock, uint32_t ack, uint16_t window,
+                    uint32_t data_len, uint8_t flags, const tcp_options_t *opts) {
+    sock->snd_wnd = (uint32_t)window << sock->snd_wscale;
+
+    // Remember what the peer SACKed so retransmits can skip it
+    if (sock->sack_ok) {
+        for (int i = 0; i < opts->sack_count; i++) {
+            const tcp_range_t *r = &opts->sack[i];
+            if (SEQ_LT(r->start, r->end) && SEQ_GT(r->start, ack) &&
+                SEQ_LEQ(r->end, sock->snd_max)) {
+                tcp_range_add(sock->sacked, &sock->sacked_count, TCP_SACK_MAX, r->start, r->end);
+            }
+        }
+    }
+
+    if (SEQ_GT(ack, sock->snd_una) && SEQ_LEQ(ack, sock->snd_max)) {
+        uint32_t acked = ack - sock->snd_una;
+        uint32_t data_acked = acked < sock->tx_len ? acked : sock->tx_len;
+
+        // Drop acknowledged bytes from the send buffer
+        if (sock->tx_size) sock->tx_start = (sock->tx_start + data_acked) % sock->tx_size;
+        sock->tx_len -= data_acked;
+        sock->snd_una = ack;
+        if (SEQ_LT(sock->send_seq, ack)) sock->send_seq = ack;
+        tcp_range_trim(sock->sacked, &sock->sacked_count, ack);
+
+        if (sock->rtt_timing && SEQ_LEQ(sock->rtt_seq, ack)) {
+            tcp_rtt_sample(sock, hal_get_time_us() - sock->rtt_start);
+            sock->rtt_timing = 0;
+        }
+
+        if (sock->in_recovery) {
+            if (SEQ_LEQ(sock->recover, ack)) {
+                // Everything outstanding at the loss is in - deflate
+                sock->in_recovery = 0;
+                sock->cwnd = sock->ssthresh;
+            } else {
+                // Partial ACK: the next hole is lost too, resend it now
+                tcp_retransmit(sock);
+                sock->cwnd = (acked < sock->cwnd ? sock->cwnd - acked : 0) + sock->mss;
+            }
+        } else if (sock->cwnd < sock->ssthresh) {
+            // Slow start
+            sock->cwnd += acked < sock->mss ? acked : sock->mss;
+        } else {
+            // Congestion avoidance: about one MSS per round trip
+            uint32_t inc = sock->mss * sock->mss / sock->cwnd;
+            sock->cwnd += inc ? inc : 1;
+        }
+
+        sock->dupacks = 0;
+        sock->retries = 0;
+        if (sock->snd_una == sock->snd_max) {
+            sock->rto_armed = 0;
+        } else {
+            tcp_arm_rto(sock);
+        }
+        return;
+    }
+
+    // Duplicate ACK: nothing new acknowledged while we have data out
+    if (ack == sock->snd_una && data_len == 0 &&
+        !(flags & (TCP_SYN | TCP_FIN)) && sock->snd_una != sock->snd_max) {
+        tcp_stats.dup_acks++;
+        sock->dupacks++;
+
+        if (sock->dupacks == TCP_DUPACK_THRESH && !sock->in_recovery) {
+            // Fast retransmit, then fast recovery
+            uint32_t in_flight = sock->snd_max - sock->snd_una;
+            sock->ssthresh = in_flight / 2 > 2 * sock->mss ? in_flight / 2 : 2 * sock->mss;
+            sock->recover = sock->snd_max;
+            sock->in_recovery = 1;
+            tcp_retransmit(sock);
+            tcp_stats.fast_retransmits++;
+            sock->cwnd = sock->ssthresh + TCP_DUPACK_THRESH * sock->mss;
+        } else if (sock->in_recovery) {
+            // Each dup ACK means a segment left the network
+            sock->cwnd += sock->mss;
+        }
+    }
+}
+
+// Copy len bytes into the receive ring, offset bytes past the readable data
+static void tcp_rx_write(tcp_socket_internal_t *sock, uint32_t offset,
+                         const uint8_t *data, uint32_t len) {
+    if (sock->discard || len == 0) return;
+
+    uint32_t pos = (sock->rx_tail + sock->rx_len + offset) % sock->rx_size;
+    uint32_t first = sock->rx_size - pos;
+    if (first > len) first = len;
+    memcpy(sock->rx_buf + pos, data, first);
+    memcpy(sock->rx_buf, data + first, len - first);
+}
+
+// Take a data segment: in-order bytes become readable, bytes past a gap
+// are parked in the ring and remembered in ooo[]. Anything beyond the
+// window we advertised is dropped.
+static void tcp_rx_data(tcp_socket_internal_t *sock, uint32_t seq,
+                        const uint8_t *data, uint32_t len) {
+    // Trim what we already have
+    if (SEQ_LT(seq, sock->send_ack)) {
+        uint32_t dup = sock->send_ack - seq;
+        if (dup >= len) return;
+        seq += dup;
+        data += dup;
+        len -= dup;
+    }
+
+    uint32_t offset = seq - sock->send_ack;
+    uint32_t space = tcp_rx_space(sock);
+    if (offset >= space) return;
+    if (len > space - offset) len = space - offset;
+
+    tcp_rx_write(sock, offset, data, len);
+
+    if (offset > 0) {
+        tcp_range_add(sock->ooo, &sock->ooo_count, TCP_OOO_MAX, seq, seq + len);
+        return;
+    }
+
+    // In order: it's readable, and so is any parked data it now reaches
+    uint32_t end = seq + len;
+    while (sock->ooo_count > 0 && SEQ_LEQ(sock->ooo[0].start, end)) {
+        if (SEQ_GT(sock->ooo[0].end, end)) end = sock->ooo[0].end;
+        sock->ooo_count--;
+        memmove(&sock->ooo[0], &sock->ooo[1], sock->ooo_count * sizeof(tcp_range_t));
+    }
+
+    if (!sock->discard) sock->rx_len += end - sock->send_ack;
+    sock->send_ack = end;
+}
+
+// Retransmit timers - run on every softirq pass. Returns how many are
+// still running.
+static int tcp_timers(void) {
+    uint32_t now = hal_get_time_us();
+    int armed = 0;
+
+    for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
+        tcp_socket_internal_t *sock = &tcp_sockets[i];
+        if (sock->state == TCP_STATE_CLOSED || !sock->rto_armed) continue;
+        armed++;
+        if (now - sock->rto_start < sock->rto) continue;
+
+        if (++sock->retries > TCP_MAX_RETRIES) {
+            printf("[TCP] Connection to %s timed out\n", ip_to_str(sock->remote_ip));
+            sock->state = TCP_STATE_CLOSED;
+            wait_queue_wake(&net_rx_wait_queue);
+            continue;
+        }
 
-    return ip_send(sock->remote_ip, IP_PROTO_TCP, pkt, sizeof(tcp_header_t) + len);
+        if (sock->snd_una != sock->snd_max) {
+            // Timeout: collapse to one segment and go back to snd_una.
+            // The peer may have reneged on what it SACKed, so forget it.
+            uint32_t in_flight = sock->snd_max - sock->snd_una;
+            sock->ssthresh = in_flight / 2 > 2 * sock->mss ? in_flight / 2 : 2 * sock->mss;
+            sock->cwnd = sock->mss;
+            sock->in_recovery = 0;
+            sock->dupacks = 0;
+            sock->sacked_count = 0;
+            tcp_retransmit(sock);
+            tcp_stats.timeouts++;
+
+            // Resend the rest as the window reopens
+            uint32_t resent = sock->tx_len < sock->mss ? sock->tx_len : sock->mss;
+            sock->send_seq = sock->snd_una + (resent ? resent : 1);
+        } else if (sock->tx_len) {
+            // Window probe: one byte past the closed window
+            tcp_send_range(sock, sock->snd_una, 1);
+            sock->send_seq = sock->snd_una + 1;
+            sock->snd_max = sock->send_seq;
+        }
+
+        // Back off
+        sock->rto = sock->rto * 2 > TCP_RTO_MAX_US ? TCP_RTO_MAX_US : sock->rto * 2;
+        tcp_arm_rto(sock);
+    }
+    return armed;
 }
 
 // Find socket by connection tuple
@@ -888,7 +2350,7 @@ static tcp_socket_internal_t *tcp_find_socket(uint32_t remote_ip, uint16_t remot
                                                uint16_t local_port) {
     for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
         tcp_socket_internal_t *s = &tcp_sockets[i];
-        if (s->state != TCP_STATE_CLOSED &&
+        if (s->state != TCP_STATE_CLOSED && s->state != TCP_STATE_LISTEN &&
             s->remote_ip == remote_ip &&
             s->remote_port == remote_port &&
             s->local_port == local_port) {
@@ -898,13 +2360,200 @@ static tcp_socket_internal_t *tcp_find_socket(uint32_t remote_ip, uint16_t remot
     return NULL;
 }
 
+// Find the listener on a local port
+static tcp_socket_internal_t *tcp_find_listener(uint16_t local_port) {
+    for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
+        tcp_socket_internal_t *s = &tcp_sockets[i];
+        if (s->state == TCP_STATE_LISTEN && s->local_port == local_port) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
 // Get socket index
 static int tcp_socket_index(tcp_socket_internal_t *sock) {
     return sock - tcp_sockets;
 }
 
+// Handshakes a listener has in progress
+static int tcp_syn_pending(tcp_socket_internal_t *lsock) {
+    int idx = tcp_socket_index(lsock);
+    int count = 0;
+    for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
+        if (tcp_sockets[i].state == TCP_STATE_SYN_RECEIVED && tcp_sockets[i].parent == idx) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Pick a free ephemeral port
+static uint16_t tcp_ephemeral_port(void) {
+    for (;;) {
+        uint16_t port = tcp_next_port++;
+        if (tcp_next_port < TCP_EPHEMERAL_MIN) tcp_next_port = TCP_EPHEMERAL_MIN;
+
+        int used = 0;
+        for (int i = 0; i < TCP_MAX_SOCKETS && !used; i++) {
+            used = tcp_sockets[i].state != TCP_STATE_CLOSED && tcp_sockets[i].local_port == port;
+        }
+        if (!used) return port;
+    }
+}
+
+static void tcp_free_buffers(tcp_socket_internal_t *sock) {
+    if (sock->rx_buf) free(sock->rx_buf);
+    if (sock->tx_buf) free(sock->tx_buf);
+    sock->rx_buf = NULL;
+    sock->tx_buf = NULL;
+    sock->rx_size = 0;
+    sock->tx_size = 0;
+}
+
+// Claim a closed socket with rx/tx buffers of the given sizes (0 = none),
+// or NULL if all are in use or out of memory
+static tcp_socket_internal_t *tcp_alloc_socket(uint32_t rx_size, uint32_t tx_size) {
+    for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
+        if (tcp_sockets[i].state == TCP_STATE_CLOSED) {
+            tcp_socket_internal_t *sock = &tcp_sockets[i];
+            // Buffers left behind by a reset or timed-out connection
+            tcp_free_buffers(sock);
+            memset(sock, 0, sizeof(*sock));
+
+            if (rx_size) sock->rx_buf = malloc(rx_size);
+            if (tx_size) sock->tx_buf = malloc(tx_size);
+            if ((rx_size && !sock->rx_buf) || (tx_size && !sock->tx_buf)) {
+                tcp_free_buffers(sock);
+                return NULL;
+            }
+            sock->rx_size = rx_size;
+            sock->tx_size = tx_size;
+
+            sock->mss = TCP_MSS;
+            sock->cwnd = TCP_INIT_CWND * TCP_MSS;
+            sock->ssthresh = 0xffffffff;
+            sock->snd_wnd = TCP_MSS;  // Until the peer tells us
+            sock->rto = TCP_RTO_INIT_US;
+            sock->parent = -1;
+            return sock;
+        }
+    }
+    return NULL;
+}
+
+// Sequence numbers are settled once the handshake is done
+static void tcp_start_send(tcp_socket_internal_t *sock, uint16_t window) {
+    sock->snd_una = sock->send_seq;
+    sock->snd_max = sock->send_seq;
+    sock->snd_wnd = window;  // Never scaled in a SYN
+    sock->retries = 0;
+    sock->rto_armed = 0;
+}
+
+// Passive open for the loopback services: discard (port 9) swallows what
+// it's sent, chargen (port 19) streams data until the client closes. With
+// no process to tcp_accept() them, they go straight to ESTABLISHED once the
+// SYN+ACK is out - the handshake's final ACK just arrives as an empty segment.
+static void tcp_service_accept(uint32_t src_ip, uint16_t src_port, uint32_t dst_ip,
+                               uint16_t dst_port, uint32_t seq, uint16_t window,
+                               const tcp_options_t *opts) {
+    // Incoming data is always dropped, so neither needs a receive buffer
+    int source = dst_port == TCP_CHARGEN_PORT;
+    tcp_socket_internal_t *sock = tcp_alloc_socket(0, source ? TCP_TX_BUF_SIZE : 0);
+    if (!sock) return;
+
+    if (source) {
+        // chargen's rotating lines of printable ASCII
+        for (uint32_t i = 0; i < sock->tx_size; i++) {
+            uint32_t col = i % 74;
+            sock->tx_buf[i] = col == 72 ? '\r' : col == 73 ? '\n' : ' ' + (i / 74 + col) % 95;
+        }
+        sock->source = 1;
+    }
+
+    sock->local_ip = dst_ip;
+    sock->remote_ip = src_ip;
+    sock->local_port = dst_port;
+    sock->remote_port = src_port;
+    sock->send_seq = 5000 + (src_port * 4321);  // Simple ISN
+    sock->iss = sock->send_seq;
+    sock->send_ack = seq + 1;
+    sock->recv_seq = seq + 1;
+    sock->loopback = 1;
+    sock->discard = 1;
+    sock->rx_size = TCP_BUF_MAX;  // Window to offer
+    sock->state = TCP_STATE_ESTABLISHED;
+    tcp_negotiate(sock, opts);
+
+    tcp_send_segment(sock, TCP_SYN | TCP_ACK, NULL, 0);
+    sock->send_seq++;
+    tcp_start_send(sock, window);
+    tcp_output(sock);
+}
+
+// A SYN for a listener: start the handshake in a new socket, unless the
+// backlog is full - then drop it and let the client's SYN retry
+static void tcp_listen_syn(tcp_socket_internal_t *lsock, uint32_t src_ip, uint16_t src_port,
+                           uint32_t dst_ip, uint32_t seq, uint16_t window,
+                           const tcp_options_t *opts) {
+    if (tcp_syn_pending(lsock) + lsock->accept_count >= lsock->backlog) return;
+
+    tcp_socket_internal_t *sock = tcp_alloc_socket(TCP_RX_BUF_SIZE, TCP_TX_BUF_SIZE);
+    if (!sock) return;
+
+    sock->local_ip = dst_ip;
+    sock->remote_ip = src_ip;
+    sock->local_port = lsock->local_port;
+    sock->remote_port = src_port;
+    sock->send_seq = 5000 + (src_port * 4321) + hal_get_time_us();  // Simple ISN
+    sock->iss = sock->send_seq;
+    sock->send_ack = seq + 1;
+    sock->recv_seq = seq + 1;
+    sock->loopback = IS_LOOPBACK(src_ip) || src_ip == our_ip;
+    sock->parent = tcp_socket_index(lsock);
+    sock->state = TCP_STATE_SYN_RECEIVED;
+    tcp_negotiate(sock, opts);
+
+    tcp_send_segment(sock, TCP_SYN | TCP_ACK, NULL, 0);
+    sock->send_seq++;
+    tcp_start_send(sock, window);
+
+    // The SYN is outstanding until the final ACK, so the retransmit timer
+    // resends the SYN+ACK if that never comes
+    sock->snd_una = sock->iss;
+    tcp_arm_rto(sock);
+}
+
+// Handshake done: queue the connection for tcp_accept()
+static void tcp_listen_queue(tcp_socket_internal_t *sock) {
+    tcp_socket_internal_t *lsock = &tcp_sockets[sock->parent];
+    uint32_t tail = (lsock->accept_head + lsock->accept_count) % TCP_BACKLOG_MAX;
+    lsock->accept_q[tail] = tcp_socket_index(sock);
+    lsock->accept_count++;
+    wait_queue_wake(&net_rx_wait_queue);
+}
+
+// Refuse a segment nobody wants (RFC 793 reset generation)
+static void tcp_send_reset(uint32_t src_ip, uint16_t src_port, uint32_t dst_ip, uint16_t dst_port,
+                           uint32_t seq, uint32_t ack, uint8_t flags, uint32_t data_len) {
+    tcp_socket_internal_t rst;
+    memset(&rst, 0, sizeof(rst));
+    rst.local_ip = dst_ip;
+    rst.remote_ip = src_ip;
+    rst.local_port = dst_port;
+    rst.remote_port = src_port;
+
+    if (flags & TCP_ACK) {
+        tcp_xmit(&rst, ack, TCP_RST, NULL, 0);
+    } else {
+        rst.send_ack = seq + data_len + ((flags & TCP_SYN) ? 1 : 0) + ((flags & TCP_FIN) ? 1 : 0);
+        tcp_xmit(&rst, 0, TCP_RST | TCP_ACK, NULL, 0);
+    }
+}
+
 // Handle incoming TCP packet
-static void tcp_handle(const uint8_t *pkt, uint32_t len, uint32_t src_ip) {
+static void tcp_handle(const uint8_t *pkt, uint32_t len, uint32_t src_ip, uint32_t dst_ip) {
     if (len < sizeof(tcp_header_t)) return;
 
     const tcp_header_t *tcp = (const tcp_header_t *)pkt;
@@ -913,6 +2562,7 @@ static void tcp_handle(const uint8_t *pkt, uint32_t len, uint32_t src_ip) {
     uint32_t seq = ntohl(tcp->seq);
     uint32_t ack = ntohl(tcp->ack);
     uint8_t flags = tcp->flags;
+    uint16_t window = ntohs(tcp->window);
 
     // Calculate data offset and length
     uint32_t data_off = (tcp->data_off >> 4) * 4;
@@ -921,23 +2571,51 @@ static void tcp_handle(const uint8_t *pkt, uint32_t len, uint32_t src_ip) {
     const uint8_t *data = pkt + data_off;
     uint32_t data_len = len - data_off;
 
+    tcp_options_t opts;
+    tcp_parse_options(pkt + sizeof(tcp_header_t), data_off - sizeof(tcp_header_t), &opts);
+
+    tcp_stats.segs_in++;
+
     // Find matching socket
     tcp_socket_internal_t *sock = tcp_find_socket(src_ip, src_port, dst_port);
     if (!sock) {
+        if ((flags & (TCP_SYN | TCP_ACK | TCP_RST)) == TCP_SYN) {
+            tcp_socket_internal_t *lsock = tcp_find_listener(dst_port);
+            if (lsock) {
+                tcp_listen_syn(lsock, src_ip, src_port, dst_ip, seq, window, &opts);
+                return;
+            }
+            if (IS_LOOPBACK(dst_ip) &&
+                (dst_port == TCP_DISCARD_PORT || dst_port == TCP_CHARGEN_PORT)) {
+                tcp_service_accept(src_ip, src_port, dst_ip, dst_port, seq, window, &opts);
+                return;
+            }
+        }
         // No socket - send RST if not a RST
         if (!(flags & TCP_RST)) {
-            // TODO: send RST
+            tcp_send_reset(src_ip, src_port, dst_ip, dst_port, seq, ack, flags, data_len);
         }
         return;
     }
 
     // Handle RST
     if (flags & TCP_RST) {
-        printf("[TCP] Connection reset by peer\n");
+        // A half-open connection nobody has seen yet goes quietly
+        if (sock->state != TCP_STATE_SYN_RECEIVED) {
+            printf("[TCP] Connection reset by peer\n");
+        }
         sock->state = TCP_STATE_CLOSED;
         return;
     }
 
+    // Peer retransmitted its SYN - our SYN+ACK was lost, send it again
+    if ((flags & (TCP_SYN | TCP_ACK)) == TCP_SYN && sock->state != TCP_STATE_SYN_SENT) {
+        if (seq + 1 == sock->recv_seq) {
+            tcp_xmit(sock, sock->iss, TCP_SYN | TCP_ACK, NULL, 0);
+        }
+        return;
+    }
+
     // State machine
     switch (sock->state) {
         case TCP_STATE_SYN_SENT:
@@ -947,89 +2625,101 @@ static void tcp_handle(const uint8_t *pkt, uint32_t len, uint32_t src_ip) {
                     sock->send_seq = ack;
                     sock->send_ack = seq + 1;
                     sock->recv_seq = seq + 1;
+                    tcp_negotiate(sock, &opts);
+                    tcp_start_send(sock, window);
 
                     // Send ACK
                     tcp_send_segment(sock, TCP_ACK, NULL, 0);
                     sock->state = TCP_STATE_ESTABLISHED;
-                    printf("[TCP] Connection established\n");
+                    if (!sock->loopback) printf("[TCP] Connection established\n");
                 }
             }
             break;
 
+        case TCP_STATE_SYN_RECEIVED:
+            // The handshake's final ACK (data may ride along with it)
+            if (!(flags & TCP_ACK) || ack != sock->iss + 1) break;
+            sock->state = TCP_STATE_ESTABLISHED;
+            tcp_listen_queue(sock);
+            // fall through
+
         case TCP_STATE_ESTABLISHED:
-            // Check if ACK is valid
+            // Free what the peer has received, then send more if it opened up
             if (flags & TCP_ACK) {
-                // Update send_seq if this ACKs new data
-                if (ack > sock->send_seq - 1000 && ack <= sock->send_seq + 10000) {
-                    // Valid ACK range (rough check)
-                }
+                tcp_ack(sock, ack, window, data_len, flags, &opts);
             }
 
-            // Handle incoming data
+            // Handle incoming data. ACK every data segment - a repeated ACK
+            // (with SACK blocks) is how the sender learns about a gap.
             if (data_len > 0) {
-                // Check if this is the next expected segment
-                if (seq == sock->send_ack) {
-                    // Copy data to receive buffer, track how many bytes actually stored
-                    uint32_t bytes_stored = 0;
-                    for (uint32_t i = 0; i < data_len; i++) {
-                        uint32_t next_head = (sock->rx_head + 1) % TCP_RX_BUF_SIZE;
-                        if (next_head == sock->rx_tail) {
-                            // Buffer full - stop here
-                            break;
-                        }
-                        sock->rx_buf[sock->rx_head] = data[i];
-                        sock->rx_head = next_head;
-                        bytes_stored++;
-                    }
-
-                    // CRITICAL: Only ACK bytes we actually stored!
-                    // Otherwise we tell sender we got data that was dropped.
-                    sock->send_ack = seq + bytes_stored;
-
-                    // Send ACK
-                    tcp_send_segment(sock, TCP_ACK, NULL, 0);
-                }
+                tcp_rx_data(sock, seq, data, data_len);
+                tcp_send_segment(sock, TCP_ACK, NULL, 0);
             }
 
-            // Handle FIN
-            if (flags & TCP_FIN) {
+            // Handle FIN (only once everything before it has arrived)
+            if ((flags & TCP_FIN) && seq + data_len == sock->send_ack) {
                 sock->fin_received = 1;
                 sock->send_ack = seq + data_len + 1;
                 tcp_send_segment(sock, TCP_ACK, NULL, 0);
                 sock->state = TCP_STATE_CLOSE_WAIT;
-                printf("[TCP] Received FIN, connection closing\n");
+                if (!sock->loopback) printf("[TCP] Received FIN, connection closing\n");
+
+                if (sock->discard) {
+                    // Nobody calls tcp_close() on a service - close our side
+                    // now. chargen drops what it hasn't sent yet.
+                    if (sock->source && sock->tx_len > sock->snd_max - sock->snd_una) {
+                        sock->tx_len = sock->snd_max - sock->snd_una;
+                    }
+                    sock->fin_queued = 1;
+                    sock->state = TCP_STATE_LAST_ACK;
+                }
             }
+
+            tcp_output(sock);
             break;
 
         case TCP_STATE_FIN_WAIT_1:
+        case TCP_STATE_FIN_WAIT_2:
+            // Our side is closed, but the peer may still be sending
             if (flags & TCP_ACK) {
-                if (flags & TCP_FIN) {
-                    // Simultaneous close
-                    sock->send_ack = seq + 1;
-                    tcp_send_segment(sock, TCP_ACK, NULL, 0);
-                    sock->state = TCP_STATE_TIME_WAIT;
-                } else {
-                    sock->state = TCP_STATE_FIN_WAIT_2;
-                }
+                tcp_ack(sock, ack, window, data_len, flags, &opts);
+            }
+            if (data_len > 0) {
+                tcp_rx_data(sock, seq, data, data_len);
+                tcp_send_segment(sock, TCP_ACK, NULL, 0);
             }
-            break;
 
-        case TCP_STATE_FIN_WAIT_2:
-            if (flags & TCP_FIN) {
-                sock->send_ack = seq + 1;
+            if (sock->fin_sent && sock->snd_una == sock->snd_max) {
+                sock->state = TCP_STATE_FIN_WAIT_2;
+            } else {
+                tcp_output(sock);
+            }
+
+            if (sock->state == TCP_STATE_FIN_WAIT_2 &&
+                (flags & TCP_FIN) && seq + data_len == sock->send_ack) {
+                sock->send_ack++;
                 tcp_send_segment(sock, TCP_ACK, NULL, 0);
                 sock->state = TCP_STATE_TIME_WAIT;
             }
             break;
 
         case TCP_STATE_CLOSE_WAIT:
-            // Waiting for application to close
+            // Waiting for application to close; keep the send side moving
+            if (flags & TCP_ACK) {
+                tcp_ack(sock, ack, window, data_len, flags, &opts);
+                tcp_output(sock);
+            }
             break;
 
         case TCP_STATE_LAST_ACK:
             if (flags & TCP_ACK) {
-                sock->state = TCP_STATE_CLOSED;
-                printf("[TCP] Connection closed\n");
+                tcp_ack(sock, ack, window, data_len, flags, &opts);
+                if (sock->fin_sent && sock->snd_una == sock->snd_max) {
+                    sock->state = TCP_STATE_CLOSED;
+                    if (!sock->loopback) printf("[TCP] Connection closed\n");
+                } else {
+                    tcp_output(sock);
+                }
             }
             break;
 
@@ -1045,61 +2735,62 @@ static void tcp_handle(const uint8_t *pkt, uint32_t len, uint32_t src_ip) {
 
 // Public API
 
+void tcp_get_stats(tcp_stats_t *out) {
+    if (out) memcpy(out, &tcp_stats, sizeof(*out));
+}
+
 tcp_socket_t tcp_connect(uint32_t ip, uint16_t port) {
+    NET_LOCKED();
+
     // Find free socket
-    int idx = -1;
-    for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
-        if (tcp_sockets[i].state == TCP_STATE_CLOSED) {
-            idx = i;
-            break;
-        }
-    }
-    if (idx < 0) {
+    tcp_socket_internal_t *sock = tcp_alloc_socket(TCP_RX_BUF_SIZE, TCP_TX_BUF_SIZE);
+    if (!sock) {
         printf("[TCP] No free sockets\n");
         return -1;
     }
+    int idx = tcp_socket_index(sock);
 
-    tcp_socket_internal_t *sock = &tcp_sockets[idx];
-    memset(sock, 0, sizeof(*sock));
-
-    sock->local_ip = our_ip;
+    sock->local_ip = net_source_ip(ip);
     sock->remote_ip = ip;
-    sock->local_port = tcp_next_port++;
+    sock->local_port = tcp_ephemeral_port();
     sock->remote_port = port;
-    sock->send_seq = 1000 + (tcp_next_port * 1234);  // Simple ISN
+    sock->send_seq = 1000 + (sock->local_port * 1234);  // Simple ISN
+    sock->iss = sock->send_seq;
     sock->send_ack = 0;
+    sock->loopback = IS_LOOPBACK(ip) || ip == our_ip;
     sock->state = TCP_STATE_SYN_SENT;
 
-    // ARP resolve first
-    uint32_t next_hop = ip;
-    if ((ip & NET_NETMASK) != (our_ip & NET_NETMASK)) {
-        next_hop = NET_GATEWAY;
-    }
-
-    if (!arp_lookup(next_hop)) {
-        arp_request(next_hop);
-        for (int i = 0; i < 100 && !arp_lookup(next_hop); i++) {
-            net_poll();
-            for (volatile int j = 0; j < 100000; j++);
-        }
-        if (!arp_lookup(next_hop)) {
-            printf("[TCP] ARP failed for %s\n", ip_to_str(next_hop));
-            sock->state = TCP_STATE_CLOSED;
-            return -1;
-        }
-    }
-
     // Send SYN
-    printf("[TCP] Connecting to %s:%d\n", ip_to_str(ip), port);
+    // Connection chatter stays quiet on lo, where servers and benchmarks
+    // open connections by the thousand
+    if (!sock->loopback) printf("[TCP] Connecting to %s:%d\n", ip_to_str(ip), port);
     if (tcp_send_segment(sock, TCP_SYN, NULL, 0) < 0) {
         sock->state = TCP_STATE_CLOSED;
         return -1;
     }
 
-    // Wait for SYN+ACK (up to 10 seconds)
-    for (int i = 0; i < 1000 && sock->state == TCP_STATE_SYN_SENT; i++) {
-        net_poll();
-        for (volatile int j = 0; j < 100000; j++);
+    // Wait for SYN+ACK (up to 10 seconds), resending the SYN with backoff
+    uint32_t syn_start = hal_get_time_us();
+    uint32_t syn_rto = TCP_RTO_INIT_US;
+    uint64_t deadline = timer_get_ticks() + 1000;
+    for (;;) {
+        uint32_t seq = net_rx_wait_queue.seq;
+        uint64_t now = timer_get_ticks();
+        if (sock->state != TCP_STATE_SYN_SENT || now >= deadline) break;
+
+        uint32_t elapsed = hal_get_time_us() - syn_start;
+        if (elapsed >= syn_rto) {
+            tcp_send_segment(sock, TCP_SYN, NULL, 0);
+            tcp_stats.retransmits++;
+            syn_start = hal_get_time_us();
+            syn_rto *= 2;
+            elapsed = 0;
+        }
+
+        // Sleep until the SYN+ACK is handled or the SYN is due again
+        uint32_t ticks = (syn_rto - elapsed) / 10000 + 1;
+        if (ticks > deadline - now) ticks = (uint32_t)(deadline - now);
+        net_wait(seq, ticks);
     }
 
     if (sock->state != TCP_STATE_ESTABLISHED) {
@@ -1111,49 +2802,146 @@ tcp_socket_t tcp_connect(uint32_t ip, uint16_t port) {
     return idx;
 }
 
+// Move a ring's contents into a bigger buffer, starting at index 0
+static uint8_t *tcp_grow_ring(uint8_t *old, uint32_t old_size, uint32_t start,
+                              uint32_t len, uint32_t new_size) {
+    uint8_t *buf = malloc(new_size);
+    if (!buf) return NULL;
+
+    uint32_t first = old_size - start;
+    if (first > len) first = len;
+    memcpy(buf, old + start, first);
+    memcpy(buf + first, old, len - first);
+    free(old);
+    return buf;
+}
+
+int tcp_set_bufsize(tcp_socket_t sock_id, uint32_t rx_size, uint32_t tx_size) {
+    if (sock_id < 0 || sock_id >= TCP_MAX_SOCKETS) return -1;
+    NET_LOCKED();
+
+    tcp_socket_internal_t *sock = &tcp_sockets[sock_id];
+    if (sock->state == TCP_STATE_CLOSED || sock->discard) return -1;
+
+    if (rx_size > TCP_BUF_MAX) rx_size = TCP_BUF_MAX;
+    if (tx_size > TCP_BUF_MAX) tx_size = TCP_BUF_MAX;
+
+    // Buffers only grow - we can't take back window we've advertised
+    if (rx_size > sock->rx_size) {
+        // Keep parked out-of-order data too: it sits past rx_len
+        uint32_t used = sock->rx_len;
+        if (sock->ooo_count > 0) {
+            used += sock->ooo[sock->ooo_count - 1].end - sock->send_ack;
+        }
+        uint8_t *buf = tcp_grow_ring(sock->rx_buf, sock->rx_size, sock->rx_tail, used, rx_size);
+        if (!buf) return -1;
+        sock->rx_buf = buf;
+        sock->rx_size = rx_size;
+        sock->rx_tail = 0;
+    }
+
+    if (tx_size > sock->tx_size) {
+        uint8_t *buf = tcp_grow_ring(sock->tx_buf, sock->tx_size, sock->tx_start, sock->tx_len, tx_size);
+        if (!buf) return -1;
+        sock->tx_buf = buf;
+        sock->tx_size = tx_size;
+        sock->tx_start = 0;
+    }
+
+    // Let the peer know the window opened
+    if (sock->state == TCP_STATE_ESTABLISHED) {
+        tcp_send_segment(sock, TCP_ACK, NULL, 0);
+    }
+    return 0;
+}
+
+// Wait for ACKs to make room in the send buffer. The softirq runs the
+// retransmit timer meanwhile. Returns -1 if the connection went away or
+// the caller was killed (it has to get out of here to exit).
+static int tcp_wait_send_space(tcp_socket_internal_t *sock) {
+    uint32_t seq = net_rx_wait_queue.seq;
+
+    if (sock->state != TCP_STATE_ESTABLISHED && sock->state != TCP_STATE_CLOSE_WAIT) {
+        return -1;
+    }
+    if (process_killed()) return -1;
+    if (sock->tx_len < sock->tx_size) return 0;
+
+    net_wait(seq, 0);
+    return 0;
+}
+
 int tcp_send(tcp_socket_t sock_id, const void *data, uint32_t len) {
     if (sock_id < 0 || sock_id >= TCP_MAX_SOCKETS) return -1;
+    NET_LOCKED();
 
     tcp_socket_internal_t *sock = &tcp_sockets[sock_id];
     if (sock->state != TCP_STATE_ESTABLISHED) return -1;
 
-    // Send data in chunks (MSS ~1460, use 1400 to be safe)
+    // Copy into the send buffer and let the windows decide what goes out.
+    // Returns once everything is buffered; ACKs and retransmits carry on
+    // in the softirq.
     const uint8_t *ptr = (const uint8_t *)data;
     uint32_t sent = 0;
 
     while (sent < len) {
+        uint32_t space = sock->tx_size - sock->tx_len;
+        if (space == 0) {
+            if (tcp_wait_send_space(sock) < 0) {
+                return sent > 0 ? (int)sent : -1;
+            }
+            continue;
+        }
+
         uint32_t chunk = len - sent;
-        if (chunk > 1400) chunk = 1400;
+        if (chunk > space) chunk = space;
 
-        if (tcp_send_segment(sock, TCP_ACK | TCP_PSH, ptr + sent, chunk) < 0) {
-            return sent > 0 ? (int)sent : -1;
-        }
+        uint32_t pos = (sock->tx_start + sock->tx_len) % sock->tx_size;
+        uint32_t first = sock->tx_size - pos;
+        if (first > chunk) first = chunk;
+        memcpy(sock->tx_buf + pos, ptr + sent, first);
+        memcpy(sock->tx_buf, ptr + sent + first, chunk - first);
 
-        sock->send_seq += chunk;
+        sock->tx_len += chunk;
         sent += chunk;
-
-        // Small delay between segments
-        for (volatile int j = 0; j < 10000; j++);
+        tcp_output(sock);
     }
 
     return (int)sent;
 }
 
+// Drop len bytes the application has read from the receive ring
+static void tcp_rx_consume(tcp_socket_internal_t *sock, uint32_t len) {
+    sock->rx_tail = (sock->rx_tail + len) % sock->rx_size;
+    sock->rx_len -= len;
+
+    // Window update once reading has opened up a useful amount
+    // (at least two segments, or half the buffer)
+    uint32_t edge = sock->send_ack + tcp_rx_space(sock);
+    uint32_t grown = edge - sock->rcv_adv;
+    uint32_t worth = sock->rx_size / 2 < 2 * sock->mss ? sock->rx_size / 2 : 2 * sock->mss;
+    if (sock->state == TCP_STATE_ESTABLISHED && SEQ_GT(edge, sock->rcv_adv) && grown >= worth) {
+        tcp_send_segment(sock, TCP_ACK, NULL, 0);
+    }
+}
+
 int tcp_recv(tcp_socket_t sock_id, void *buf, uint32_t maxlen) {
     if (sock_id < 0 || sock_id >= TCP_MAX_SOCKETS) return -1;
+    NET_LOCKED();
 
     tcp_socket_internal_t *sock = &tcp_sockets[sock_id];
 
-    // Poll for incoming data
-    net_poll();
+    // Anything already raised goes into the ring first
+    net_softirq_flush();
 
     // Check for data in receive buffer
-    uint8_t *dst = (uint8_t *)buf;
-    uint32_t received = 0;
-
-    while (received < maxlen && sock->rx_tail != sock->rx_head) {
-        dst[received++] = sock->rx_buf[sock->rx_tail];
-        sock->rx_tail = (sock->rx_tail + 1) % TCP_RX_BUF_SIZE;
+    uint32_t received = sock->rx_len < maxlen ? sock->rx_len : maxlen;
+    if (received > 0) {
+        uint32_t first = sock->rx_size - sock->rx_tail;
+        if (first > received) first = received;
+        memcpy(buf, sock->rx_buf + sock->rx_tail, first);
+        memcpy((uint8_t *)buf + first, sock->rx_buf, received - first);
+        tcp_rx_consume(sock, received);
     }
 
     // If no data and connection closed, return -1
@@ -1168,38 +2956,171 @@ int tcp_recv(tcp_socket_t sock_id, void *buf, uint32_t maxlen) {
     return (int)received;
 }
 
-void tcp_close(tcp_socket_t sock_id) {
+int tcp_recv_zc(tcp_socket_t sock_id, const void **data) {
+    if (sock_id < 0 || sock_id >= TCP_MAX_SOCKETS || !data) return -1;
+    NET_LOCKED();
+
+    tcp_socket_internal_t *sock = &tcp_sockets[sock_id];
+    net_softirq_flush();
+
+    if (sock->rx_len == 0) {
+        if (sock->state == TCP_STATE_CLOSE_WAIT ||
+            sock->state == TCP_STATE_CLOSED) {
+            return -1;
+        }
+        return 0;
+    }
+
+    // Up to the end of the ring - the rest comes on the next call
+    uint32_t len = sock->rx_size - sock->rx_tail;
+    if (len > sock->rx_len) len = sock->rx_len;
+    *data = sock->rx_buf + sock->rx_tail;
+    return (int)len;
+}
+
+void tcp_recv_done(tcp_socket_t sock_id, uint32_t len) {
     if (sock_id < 0 || sock_id >= TCP_MAX_SOCKETS) return;
+    NET_LOCKED();
 
     tcp_socket_internal_t *sock = &tcp_sockets[sock_id];
+    if (len > sock->rx_len) len = sock->rx_len;
+    if (len > 0) tcp_rx_consume(sock, len);
+}
 
-    if (sock->state == TCP_STATE_ESTABLISHED) {
-        // Send FIN
-        tcp_send_segment(sock, TCP_FIN | TCP_ACK, NULL, 0);
-        sock->send_seq++;
-        sock->fin_sent = 1;
-        sock->state = TCP_STATE_FIN_WAIT_1;
+int tcp_wait_readable(tcp_socket_t sock_id, uint32_t timeout_ms) {
+    if (sock_id < 0 || sock_id >= TCP_MAX_SOCKETS) return 1;
+    NET_LOCKED();
+
+    tcp_socket_internal_t *sock = &tcp_sockets[sock_id];
+    uint64_t deadline = timer_get_ticks() + (timeout_ms + 9) / 10;
+
+    for (;;) {
+        // Snapshot before checking so data handled in between wakes us
+        uint32_t seq = net_rx_wait_queue.seq;
 
-        // Wait for close to complete (up to 5 seconds)
-        for (int i = 0; i < 500 && sock->state != TCP_STATE_CLOSED &&
-                                   sock->state != TCP_STATE_TIME_WAIT; i++) {
-            net_poll();
-            for (volatile int j = 0; j < 100000; j++);
+        if (sock->rx_len > 0 ||
+            sock->state == TCP_STATE_CLOSE_WAIT ||
+            sock->state == TCP_STATE_CLOSED) {
+            return 1;
+        }
+        if (process_killed()) return 0;
+
+        uint32_t ticks = 0;
+        if (timeout_ms) {
+            uint64_t now = timer_get_ticks();
+            if (now >= deadline) return 0;
+            ticks = (uint32_t)(deadline - now);
+        }
+        net_wait(seq, ticks);
+    }
+}
+
+void tcp_close(tcp_socket_t sock_id) {
+    if (sock_id < 0 || sock_id >= TCP_MAX_SOCKETS) return;
+    NET_LOCKED();
+
+    tcp_socket_internal_t *sock = &tcp_sockets[sock_id];
+    uint64_t deadline = timer_get_ticks() + 500;  // Up to 5 seconds
+
+    if (sock->state == TCP_STATE_LISTEN) {
+        // Reset connections nobody accepted, finished or not
+        for (int i = 0; i < TCP_MAX_SOCKETS; i++) {
+            tcp_socket_internal_t *child = &tcp_sockets[i];
+            if (child->state != TCP_STATE_CLOSED && child->parent == sock_id) {
+                tcp_send_segment(child, TCP_RST | TCP_ACK, NULL, 0);
+                child->state = TCP_STATE_CLOSED;
+            }
+        }
+    } else if (sock->state == TCP_STATE_ESTABLISHED) {
+        // Send FIN after whatever is still buffered
+        sock->fin_queued = 1;
+        sock->state = TCP_STATE_FIN_WAIT_1;
+        tcp_output(sock);
+
+        // Wait for close to complete
+        for (;;) {
+            uint32_t seq = net_rx_wait_queue.seq;
+            uint64_t now = timer_get_ticks();
+            if (sock->state == TCP_STATE_CLOSED || sock->state == TCP_STATE_TIME_WAIT ||
+                now >= deadline) {
+                break;
+            }
+            net_wait(seq, (uint32_t)(deadline - now));
         }
     } else if (sock->state == TCP_STATE_CLOSE_WAIT) {
         // Send FIN
-        tcp_send_segment(sock, TCP_FIN | TCP_ACK, NULL, 0);
-        sock->send_seq++;
+        sock->fin_queued = 1;
         sock->state = TCP_STATE_LAST_ACK;
+        tcp_output(sock);
 
         // Wait for ACK
-        for (int i = 0; i < 500 && sock->state != TCP_STATE_CLOSED; i++) {
-            net_poll();
-            for (volatile int j = 0; j < 100000; j++);
+        for (;;) {
+            uint32_t seq = net_rx_wait_queue.seq;
+            uint64_t now = timer_get_ticks();
+            if (sock->state == TCP_STATE_CLOSED || now >= deadline) break;
+            net_wait(seq, (uint32_t)(deadline - now));
         }
     }
 
     sock->state = TCP_STATE_CLOSED;
+    tcp_free_buffers(sock);
+}
+
+tcp_socket_t tcp_listen(uint16_t port, int backlog) {
+    NET_LOCKED();
+
+    if (port == 0 || tcp_find_listener(port)) return -1;
+
+    tcp_socket_internal_t *sock = tcp_alloc_socket(0, 0);
+    if (!sock) {
+        printf("[TCP] No free sockets\n");
+        return -1;
+    }
+
+    if (backlog < 1) backlog = 1;
+    if (backlog > TCP_BACKLOG_MAX) backlog = TCP_BACKLOG_MAX;
+
+    sock->local_port = port;
+    sock->backlog = backlog;
+    sock->state = TCP_STATE_LISTEN;
+    return tcp_socket_index(sock);
+}
+
+tcp_socket_t tcp_accept(tcp_socket_t listener, uint32_t timeout_ms) {
+    if (listener < 0 || listener >= TCP_MAX_SOCKETS) return -1;
+    NET_LOCKED();
+
+    tcp_socket_internal_t *lsock = &tcp_sockets[listener];
+    uint64_t deadline = timer_get_ticks() + (timeout_ms + 9) / 10;
+
+    for (;;) {
+        uint32_t seq = net_rx_wait_queue.seq;
+
+        if (lsock->state != TCP_STATE_LISTEN) return -1;
+
+        while (lsock->accept_count > 0) {
+            int idx = lsock->accept_q[lsock->accept_head];
+            lsock->accept_head = (lsock->accept_head + 1) % TCP_BACKLOG_MAX;
+            lsock->accept_count--;
+
+            // Skip connections reset while they waited here
+            tcp_socket_internal_t *sock = &tcp_sockets[idx];
+            if (sock->parent == listener && sock->state != TCP_STATE_CLOSED &&
+                sock->state != TCP_STATE_SYN_RECEIVED) {
+                sock->parent = -1;
+                return idx;
+            }
+        }
+        if (process_killed()) return -1;
+
+        uint32_t ticks = 0;
+        if (timeout_ms) {
+            uint64_t now = timer_get_ticks();
+            if (now >= deadline) return -1;
+            ticks = (uint32_t)(deadline - now);
+        }
+        net_wait(seq, ticks);
+    }
 }
 
 int tcp_is_connected(tcp_socket_t sock_id) {
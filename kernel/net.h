@@ -77,12 +77,23 @@ typedef struct __attribute__((packed)) {
     uint16_t checksum;
 } udp_header_t;
 
+// ARP neighbor states
+#define ARP_STATE_FREE        0
+#define ARP_STATE_INCOMPLETE  1   // Asked, no answer yet - packets wait in a queue
+#define ARP_STATE_REACHABLE   2   // Heard from it recently
+#define ARP_STATE_STALE       3   // Usable, but check it's still there on next use
+#define ARP_STATE_PROBE       4   // Checking, with unicast requests
+
 // ARP table entry
 typedef struct {
     uint32_t ip;
     uint8_t mac[6];
-    uint8_t valid;
-    uint32_t timestamp;  // For expiry (future)
+    uint8_t state;       // ARP_STATE_*
+    uint8_t probes;      // Requests sent since the last answer
+    uint8_t queued;      // Packets waiting for the MAC
+    int8_t next;         // Next entry in the hash chain, -1 = end
+    uint64_t updated;    // Ticks: last answer, or last request sent
+    uint64_t used;       // Ticks: last packet sent through it
 } arp_entry_t;
 
 // Network configuration (QEMU user-mode defaults)
@@ -91,17 +102,57 @@ typedef struct {
 #define NET_DNS         0x0a000203  // 10.0.2.3
 #define NET_NETMASK     0xffffff00  // 255.255.255.0
 
+// Loopback interface (lo): 127.0.0.0/8 never leaves the machine
+#define NET_LOOPBACK_IP   0x7f000001  // 127.0.0.1
+#define NET_LOOPBACK_MASK 0xff000000  // 255.0.0.0
+
+// Built-in TCP discard service (RFC 863) on lo - accepts and drops data,
+// so TCP can be exercised with no network attached
+#define TCP_DISCARD_PORT  9
+
+// Built-in chargen service (RFC 864) on lo - streams data until the client
+// closes, for measuring the receive path
+#define TCP_CHARGEN_PORT  19
+
+// Interface counters (net_get_if_stats)
+#define NET_IF_LO   0
+#define NET_IF_ETH0 1
+#define NET_IF_COUNT 2
+
+typedef struct {
+    char name[8];
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t rx_packets;
+    uint32_t tx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint32_t tx_dropped;     // No route/neighbor, or lo queue full
+    uint32_t rx_csum_errors; // Dropped for a bad checksum
+    uint32_t rx_pps;         // Packets per second, over the last second
+    uint32_t tx_pps;
+    uint32_t tx_kicks;       // Times the NIC was notified (eth0); tx_packets / tx_kicks = batch size
+} net_if_stats_t;
+
 // Initialize network stack
 void net_init(void);
 
-// Process incoming packets (call from main loop or IRQ)
+// Process incoming packets now. The netsoftirq thread does this whenever
+// packets arrive, so nobody has to.
 void net_poll(void);
 
+// Start the netsoftirq kernel thread (after process_init)
+void net_softirq_start(void);
+
+// Ask the thread to handle received packets. Safe from IRQ handlers.
+void net_softirq_raise(void);
+
 // Send raw ethernet frame
 int eth_send(const uint8_t *dst_mac, uint16_t ethertype, const void *data, uint32_t len);
 
 // ARP functions
 void arp_request(uint32_t ip);
+void arp_announce(void);      // Gratuitous ARP for our address
 const uint8_t *arp_lookup(uint32_t ip);
 
 // IP functions
@@ -112,13 +163,22 @@ uint16_t ip_checksum(const void *data, uint32_t len);
 int icmp_send_echo_request(uint32_t dst_ip, uint16_t id, uint16_t seq, const void *data, uint32_t len);
 
 // Ping interface (blocking, with timeout)
-// Returns round-trip time in ms, or -1 on timeout
+// Returns round-trip time in microseconds, or -1 on timeout
 int net_ping(uint32_t ip, uint16_t seq, uint32_t timeout_ms);
 
 // Get our IP/MAC
 uint32_t net_get_ip(void);
 void net_get_mac(uint8_t *mac);
 
+// Source address we'd use to reach dst_ip (127.x goes out lo)
+uint32_t net_source_ip(uint32_t dst_ip);
+
+// Copy an interface's counters. Returns 0, or -1 if there's no such index.
+int net_get_if_stats(int index, net_if_stats_t *out);
+
+// Testing: drop this many outgoing packets per thousand (0 = off)
+void net_set_loss(uint32_t per_mille);
+
 // Helper: convert IP to string (uses static buffer)
 const char *ip_to_str(uint32_t ip);
 
@@ -141,6 +201,50 @@ void udp_unbind(uint16_t port);
 // Returns IP address, or 0 on failure
 uint32_t dns_resolve(const char *hostname);
 
+// Where a dns_lookup() answer came from
+#define DNS_SRC_LITERAL  0   // The name was an address already
+#define DNS_SRC_HOSTS    1   // /etc/hosts
+#define DNS_SRC_CACHE    2
+#define DNS_SRC_SERVER   3   // Asked NET_DNS just now
+
+// Response codes, plus one for a server that never answered
+#define DNS_RCODE_NOERROR   0
+#define DNS_RCODE_SERVFAIL  2
+#define DNS_RCODE_NXDOMAIN  3
+#define DNS_RCODE_TIMEOUT   (-1)
+
+typedef struct {
+    uint32_t ip;        // 0 if the name doesn't resolve
+    uint32_t ttl;       // Seconds the answer is cached for (0 = not cached)
+    int source;         // DNS_SRC_*
+    int rcode;          // DNS_RCODE_* (failures are cached too)
+} dns_answer_t;
+
+// Resolver counters since boot (dns_get_stats)
+typedef struct {
+    uint32_t lookups;        // Names looked up (addresses don't count)
+    uint32_t hosts_hits;     // Answered from /etc/hosts
+    uint32_t hits;           // Answered from the cache...
+    uint32_t negative_hits;  // ...with a cached failure
+    uint32_t misses;         // Had to wait for the server
+    uint32_t coalesced;      // Joined a query already in flight
+    uint32_t queries;        // Queries sent, retransmits included
+    uint32_t retransmits;
+    uint32_t timeouts;       // The server never answered
+    uint32_t nxdomain;       // The server said there's no such name
+    uint32_t entries;        // Live cache entries right now
+    uint32_t hosts_entries;  // Names loaded from /etc/hosts
+} dns_stats_t;
+
+// dns_resolve() with the details: fills *out either way, returns 0 if the
+// name resolved and -1 if not
+int dns_lookup(const char *hostname, dns_answer_t *out);
+
+// Forget every cached answer and reread /etc/hosts on the next lookup
+void dns_flush(void);
+
+void dns_get_stats(dns_stats_t *out);
+
 // ============ TCP ============
 
 // TCP header
@@ -173,10 +277,22 @@ typedef struct __attribute__((packed)) {
 #define TCP_STATE_CLOSE_WAIT  5
 #define TCP_STATE_LAST_ACK    6
 #define TCP_STATE_TIME_WAIT   7
+#define TCP_STATE_LISTEN      8
+#define TCP_STATE_SYN_RECEIVED 9
 
 // TCP socket handle (opaque)
 typedef int tcp_socket_t;
 
+// TCP counters since boot, over all sockets (tcp_get_stats)
+typedef struct {
+    uint32_t segs_out;
+    uint32_t segs_in;
+    uint32_t retransmits;       // All resends: timeouts, fast retransmit, SYNs
+    uint32_t fast_retransmits;  // Triggered by three duplicate ACKs
+    uint32_t timeouts;          // Retransmit timer expiries
+    uint32_t dup_acks;
+} tcp_stats_t;
+
 // TCP API
 // Returns socket handle (>=0) or -1 on error
 tcp_socket_t tcp_connect(uint32_t ip, uint16_t port);
@@ -189,7 +305,30 @@ int tcp_send(tcp_socket_t sock, const void *data, uint32_t len);
 // Returns bytes received, 0 if no data, -1 on error/closed
 int tcp_recv(tcp_socket_t sock, void *buf, uint32_t maxlen);
 
-// Close socket
+// Zero-copy receive: point *data at the next received bytes, in place in
+// the socket's buffer. Returns how many (0 if none yet, -1 if closed). They
+// stay valid until tcp_recv_done() gives them back, which may be a part.
+int tcp_recv_zc(tcp_socket_t sock, const void **data);
+void tcp_recv_done(tcp_socket_t sock, uint32_t len);
+
+// Block until the socket has data or is closed, or timeout_ms passes
+// (0 = no timeout). Returns 1 if tcp_recv() won't return 0, 0 on timeout.
+int tcp_wait_readable(tcp_socket_t sock, uint32_t timeout_ms);
+
+// Grow a socket's receive/send buffers (0 = leave as is). The receive
+// buffer sets the window we advertise, so bulk transfers want it large.
+// Buffers never shrink. Returns 0 or -1.
+int tcp_set_bufsize(tcp_socket_t sock, uint32_t rx_size, uint32_t tx_size);
+
+// Listen for connections on a local port, with up to backlog (max 16)
+// waiting to be accepted. Returns a listening socket or -1 (port taken).
+tcp_socket_t tcp_listen(uint16_t port, int backlog);
+
+// Take the next connection from a listener, waiting up to timeout_ms
+// (0 = no timeout). Returns the connected socket, or -1 on timeout.
+tcp_socket_t tcp_accept(tcp_socket_t listener, uint32_t timeout_ms);
+
+// Close socket (a listener resets connections it hasn't handed out)
 void tcp_close(tcp_socket_t sock);
 
 // Check if socket is connected
@@ -198,4 +337,7 @@ int tcp_is_connected(tcp_socket_t sock);
 // Get socket state (for debugging)
 int tcp_get_state(tcp_socket_t sock);
 
+// Copy the global TCP counters
+void tcp_get_stats(tcp_stats_t *out);
+
 #endif
@@ -15,6 +15,7 @@
 // Pi: Framebuffer (no serial cable typically)
 extern void uart_putc(char c);
 extern void console_putc(char c);
+extern void console_flush(void);
 
 // Local strlen to avoid circular deps
 static int local_strlen(const char *s) {
@@ -315,6 +316,9 @@ int printf(const char *fmt, ...) {
     }
 
     va_end(args);
+#ifndef PRINTF_UART
+    console_flush();
+#endif
     return count;
 }
 
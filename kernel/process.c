@@ -4,71 +4,105 @@
  * Preemptive multitasking - timer IRQ forces context switches.
  * Programs run in kernel space and call kernel functions directly.
  * No memory protection, but full preemption via timer interrupt.
+ *
+ * All cores schedule from one process table under sched_lock. A process
+ * stays "on_cpu" from the moment a core picks it until that core has saved
+ * its context and left its stack, so no two cores ever run it at once.
+ *
+ * Killing is deferred: process_kill() only marks the victim, and it goes
+ * through process_exit() itself once it's back in its own program code
+ * holding no kernel mutex. Tearing it down mid-call would leave its locks
+ * owned by a dead slot and its disk requests writing into a freed stack.
  */
 
 #include "process.h"
+#include "smp.h"
+#include "spinlock.h"
 #include "elf.h"
 #include "vfs.h"
 #include "memory.h"
 #include "string.h"
 #include "printf.h"
 #include "kapi.h"
+#include "irq.h"
 #include <stddef.h>
 
 // Process table
 static process_t proc_table[MAX_PROCESSES];
-static int current_pid = -1;  // -1 means kernel/shell is running
 static int next_pid = 1;
 
-// Current process pointer - used by IRQ handler for preemption
-// NULL means kernel is running (no process to save to)
-process_t *current_process = NULL;
+// Guards process states, on_cpu flags and each core's current process.
+// Never held across a context switch.
+static spinlock_t sched_lock = SPINLOCK_INIT;
+
+// Serializes program loading (program area regions, reaping exited slots)
+static mutex_t load_mutex = MUTEX_INIT;
+
+// Timer wheel for sleeping processes: slot = wake_tick % TIMER_WHEEL_SLOTS.
+// Sleeps longer than one turn stay in their slot until their tick comes up.
+// Guarded by sched_lock.
+#define TIMER_WHEEL_SLOTS 64
+static process_t *timer_wheel[TIMER_WHEEL_SLOTS];
 
-// Kernel context - saved when switching from kernel to a process
-// This allows us to return to kernel (e.g., desktop running via process_exec)
-// Global (not static) so vectors.S can access it for kernel->process IRQ switches
-cpu_context_t kernel_context;
+// The running process and kernel context are per-core (cpu_t in smp.h):
+// cpu->current is what the IRQ handler saves to, cpu->kernel_context is
+// where a core returns when it has no process to run.
 
-// Program load address - grows upward as we load programs
-// Set dynamically based on heap_end
+// Program area [program_base, program_end) - each process holds one
+// region of it, handed out first-fit and returned when its slot is reaped
 static uint64_t program_base = 0;
-static uint64_t next_load_addr = 0;
 
 // Align to 64KB boundary for cleaner loading
 #define ALIGN_64K(x) (((x) + 0xFFFF) & ~0xFFFFULL)
 
+// Unmapped gap left after each region to catch runaway writes
+#define REGION_GUARD 0x10000
+
 // Program entry point signature
 typedef int (*program_entry_t)(kapi_t *api, int argc, char **argv);
 
 // Forward declarations
 static void process_entry_wrapper(void);
 static void kill_children(int parent_pid);
+static void schedule_locked(void);
+static void timer_unlink(process_t *proc);
+static int at_safe_point(process_t *proc);
+static void redirect_to_exit(process_t *proc);
 
 void process_init(void) {
     // Clear process table
     for (int i = 0; i < MAX_PROCESSES; i++) {
         proc_table[i].state = PROC_STATE_FREE;
         proc_table[i].pid = 0;
+        proc_table[i].on_cpu = 0;
+        proc_table[i].killed = 0;
+        proc_table[i].wait_chan = NULL;
+        proc_table[i].wake_tick = 0;
+        proc_table[i].stack_base = NULL;
+        proc_table[i].region_size = 0;
+        proc_table[i].kthread = 0;
+        proc_table[i].locks_held = 0;
         // Also clear context to prevent garbage
         memset(&proc_table[i].context, 0, sizeof(cpu_context_t));
     }
-    current_pid = -1;
-    current_process = NULL;
     next_pid = 1;
 
     // Programs load right after the heap
     program_base = ALIGN_64K(heap_end);
-    next_load_addr = program_base;
 
     printf("[PROC] Process subsystem initialized (max %d processes)\n", MAX_PROCESSES);
-    printf("[PROC] Program load area: 0x%lx+\n", program_base);
-    printf("[PROC] kernel_context at: 0x%lx\n", (uint64_t)&kernel_context);
+    printf("[PROC] Program load area: 0x%lx - 0x%lx\n", program_base, program_end);
+    printf("[PROC] kernel_context at: 0x%lx\n", (uint64_t)&cpu_this()->kernel_context);
 }
 
-// Find a free slot in the process table
+// Find a free slot in the process table (caller holds sched_lock)
+// A slot whose process just exited stays taken until its core is off the
+// stack, and one that somehow exited holding a mutex is never reused - the
+// mutex still names it as owner
 static int find_free_slot(void) {
     for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (proc_table[i].state == PROC_STATE_FREE) {
+        if (proc_table[i].state == PROC_STATE_FREE && !proc_table[i].on_cpu &&
+            proc_table[i].locks_held == 0) {
             return i;
         }
     }
@@ -76,8 +110,13 @@ static int find_free_slot(void) {
 }
 
 process_t *process_current(void) {
-    if (current_pid < 0) return NULL;
-    return &proc_table[current_pid];
+    // IRQs off so we can't be migrated between finding our core and reading it
+    uint64_t flags;
+    asm volatile("mrs %0, daif" : "=r"(flags));
+    asm volatile("msr daifset, #2" ::: "memory");
+    process_t *proc = cpu_this()->current;
+    asm volatile("msr daif, %0" :: "r"(flags) : "memory");
+    return proc;
 }
 
 process_t *process_get(int pid) {
@@ -89,11 +128,6 @@ process_t *process_get(int pid) {
     return NULL;
 }
 
-// Get pointer to current_process pointer (for assembly IRQ handler)
-process_t **process_get_current_ptr(void) {
-    return &current_process;
-}
-
 int process_count_ready(void) {
     int count = 0;
     for (int i = 0; i < MAX_PROCESSES; i++) {
@@ -124,20 +158,68 @@ int process_get_info(int index, char *name, int name_size, int *state) {
     return 1;
 }
 
-// Create a new process (load the binary but don't start it)
-int process_create(const char *path, int argc, char **argv) {
-    (void)argc;
-    (void)argv;
+// Find the lowest free program area range of `size` bytes (caller holds
+// load_mutex). Regions belong to slots, so the free list is just the gaps
+// between the regions the slots still hold.
+static uint64_t region_alloc(uint64_t size) {
+    uint64_t base = program_base;
+
+    for (;;) {
+        if (base + size > program_end) return 0;
+
+        // Bump past the first region that overlaps the candidate range
+        int moved = 0;
+        for (int i = 0; i < MAX_PROCESSES; i++) {
+            process_t *p = &proc_table[i];
+            if (p->region_size == 0) continue;
+            if (p->region_base < base + size &&
+                base < p->region_base + p->region_size) {
+                base = ALIGN_64K(p->region_base + p->region_size);
+                moved = 1;
+            }
+        }
+        if (!moved) return base;
+    }
+}
 
-    // Find free slot
-    int slot = find_free_slot();
-    if (slot < 0) {
-        printf("[PROC] No free process slots\n");
-        return -1;
+// Release what an exited or killed slot still holds (caller holds
+// load_mutex). process_exit can't free its own stack - it's running on it -
+// so that waits until the slot is off-CPU and the next load sweeps it up.
+static void reap_slot(process_t *proc) {
+    if (proc->stack_base) {
+        free(proc->stack_base);
+        proc->stack_base = NULL;
+    }
+    proc->region_size = 0;
+}
+
+static void reap_exited(void) {
+    uint64_t flags = spin_lock_irqsave(&sched_lock);
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        process_t *p = &proc_table[i];
+        if (p->state == PROC_STATE_FREE && !p->on_cpu &&
+            (p->stack_base || p->region_size)) {
+            reap_slot(p);
+        }
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+// Bytes of program area not held by any slot (stats only, unlocked)
+static uint64_t process_program_free(void) {
+    uint64_t used = 0;
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        used += proc_table[i].region_size;
     }
+    uint64_t total = program_end - program_base;
+    return used < total ? total - used : 0;
+}
 
-    // Look up file
-    vfs_node_t *file = vfs_lookup(path);
+// Load a program into a claimed slot and set up its initial context
+// Caller holds load_mutex; the slot is BLOCKED so no core can run it yet
+static int load_program(process_t *proc, const char *path, int argc, char **argv) {
+    // Our own handle: vfs_lookup()'s node is shared with other cores
+    vfs_node_t *file = vfs_open_handle(path);
     if (!file) {
         printf("[PROC] File not found: %s\n", path);
         return -1;
@@ -145,12 +227,14 @@ int process_create(const char *path, int argc, char **argv) {
 
     if (vfs_is_dir(file)) {
         printf("[PROC] Cannot exec directory: %s\n", path);
+        vfs_close_handle(file);
         return -1;
     }
 
     size_t size = file->size;
     if (size == 0) {
         printf("[PROC] File is empty: %s\n", path);
+        vfs_close_handle(file);
         return -1;
     }
 
@@ -158,10 +242,12 @@ int process_create(const char *path, int argc, char **argv) {
     char *data = malloc(size);
     if (!data) {
         printf("[PROC] Out of memory reading %s\n", path);
+        vfs_close_handle(file);
         return -1;
     }
 
     int bytes = vfs_read(file, data, size, 0);
+    vfs_close_handle(file);
     if (bytes != (int)size) {
         printf("[PROC] Failed to read %s\n", path);
         free(data);
@@ -180,8 +266,15 @@ int process_create(const char *path, int argc, char **argv) {
         return -1;
     }
 
-    // Align load address
-    uint64_t load_addr = ALIGN_64K(next_load_addr);
+    // Find room for it, plus a guard gap before whatever comes next
+    uint64_t region_size = ALIGN_64K(prog_size) + REGION_GUARD;
+    uint64_t load_addr = region_alloc(region_size);
+    if (!load_addr) {
+        printf("[PROC] Out of program memory loading %s (%lu KB, %lu KB free)\n",
+               path, region_size / 1024, process_program_free() / 1024);
+        free(data);
+        return -1;
+    }
 
     // Load the ELF at this address
     elf_load_info_t info;
@@ -193,27 +286,32 @@ int process_create(const char *path, int argc, char **argv) {
 
     free(data);
 
-    // Update next load address for future programs
-    next_load_addr = ALIGN_64K(load_addr + info.load_size + 0x10000);
+    // Hold the region from here on - a failed stack allocation below leaves
+    // it on the slot, and the next load reaps it with the rest
+    proc->region_base = load_addr;
+    proc->region_size = region_size;
 
     // Set up process structure
-    process_t *proc = &proc_table[slot];
-    proc->pid = next_pid++;
     strncpy(proc->name, path, PROCESS_NAME_MAX - 1);
     proc->name[PROCESS_NAME_MAX - 1] = '\0';
-    proc->state = PROC_STATE_READY;
     proc->load_base = info.load_base;
     proc->load_size = info.load_size;
     proc->entry = info.entry;
-    proc->parent_pid = current_pid;
+    process_t *parent = process_current();
+    proc->parent_pid = parent ? parent->pid : -1;
     proc->exit_status = 0;
+    proc->killed = 0;
+    proc->wait_chan = NULL;
+    proc->wait_timed_out = 0;
+    proc->wake_tick = 0;
+    proc->kthread = 0;
+    proc->locks_held = 0;
 
     // Allocate stack
     proc->stack_size = PROCESS_STACK_SIZE;
     proc->stack_base = malloc(proc->stack_size);
     if (!proc->stack_base) {
         printf("[PROC] Failed to allocate stack\n");
-        proc->state = PROC_STATE_FREE;
         return -1;
     }
 
@@ -232,12 +330,115 @@ int process_create(const char *path, int argc, char **argv) {
     proc->context.x[21] = (uint64_t)argc;     // x21 = argc
     proc->context.x[22] = (uint64_t)argv;     // x22 = argv
 
+    return 0;
+}
+
+// Create a new process (load the binary but don't start it)
+int process_create(const char *path, int argc, char **argv) {
+    // Claim a slot - BLOCKED until it's loaded so no core picks it up early
+    uint64_t flags = spin_lock_irqsave(&sched_lock);
+    int slot = find_free_slot();
+    if (slot >= 0) {
+        proc_table[slot].state = PROC_STATE_BLOCKED;
+        proc_table[slot].pid = 0;
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+
+    if (slot < 0) {
+        printf("[PROC] No free process slots\n");
+        return -1;
+    }
+
+    process_t *proc = &proc_table[slot];
+
+    mutex_lock(&load_mutex);
+    reap_slot(proc);
+    reap_exited();
+    int result = load_program(proc, path, argc, argv);
+    mutex_unlock(&load_mutex);
+
+    flags = spin_lock_irqsave(&sched_lock);
+    if (result < 0) {
+        proc->state = PROC_STATE_FREE;
+        spin_unlock_irqrestore(&sched_lock, flags);
+        return -1;
+    }
+    proc->pid = next_pid++;
+    proc->state = PROC_STATE_READY;
+    int pid = proc->pid;
+    spin_unlock_irqrestore(&sched_lock, flags);
+
     // printf("[PROC] Created process '%s' pid=%d at 0x%lx-0x%lx (slot %d)\n",
     //        proc->name, proc->pid, proc->load_base, proc->load_base + proc->load_size, slot);
     // printf("[PROC] Stack at 0x%lx-0x%lx\n",
     //        (uint64_t)proc->stack_base, (uint64_t)proc->stack_base + proc->stack_size);
 
-    return proc->pid;
+    return pid;
+}
+
+// Create a kernel thread. It shares the entry wrapper with programs, so
+// entry is called like main() and just ignores the arguments.
+int process_create_kernel(const char *name, void (*entry)(void)) {
+    // Claim a slot - BLOCKED until it's set up, as in process_create()
+    uint64_t flags = spin_lock_irqsave(&sched_lock);
+    int slot = find_free_slot();
+    if (slot >= 0) {
+        proc_table[slot].state = PROC_STATE_BLOCKED;
+        proc_table[slot].pid = 0;
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+
+    if (slot < 0) {
+        printf("[PROC] No free process slots\n");
+        return -1;
+    }
+
+    process_t *proc = &proc_table[slot];
+
+    mutex_lock(&load_mutex);
+    reap_slot(proc);
+    proc->stack_size = PROCESS_STACK_SIZE;
+    proc->stack_base = malloc(proc->stack_size);
+    mutex_unlock(&load_mutex);
+
+    if (!proc->stack_base) {
+        printf("[PROC] Failed to allocate stack\n");
+        flags = spin_lock_irqsave(&sched_lock);
+        proc->state = PROC_STATE_FREE;
+        spin_unlock_irqrestore(&sched_lock, flags);
+        return -1;
+    }
+
+    strncpy(proc->name, name, PROCESS_NAME_MAX - 1);
+    proc->name[PROCESS_NAME_MAX - 1] = '\0';
+    proc->load_base = 0;
+    proc->load_size = 0;
+    proc->entry = (uint64_t)entry;
+    proc->parent_pid = -1;
+    proc->exit_status = 0;
+    proc->killed = 0;
+    proc->wait_chan = NULL;
+    proc->wait_timed_out = 0;
+    proc->wake_tick = 0;
+    proc->kthread = 1;
+    proc->locks_held = 0;
+
+    uint64_t stack_top = ((uint64_t)proc->stack_base + proc->stack_size) & ~0xFULL;
+    memset(&proc->context, 0, sizeof(cpu_context_t));
+    proc->context.sp = stack_top;
+    proc->context.pc = (uint64_t)process_entry_wrapper;
+    proc->context.pstate = 0x3c5;  // EL1h, IRQs masked until the wrapper
+    proc->context.x[19] = proc->entry;
+    proc->context.x[20] = (uint64_t)&kapi;
+
+    flags = spin_lock_irqsave(&sched_lock);
+    proc->pid = next_pid++;
+    proc->state = PROC_STATE_READY;
+    int pid = proc->pid;
+    spin_unlock_irqrestore(&sched_lock, flags);
+
+    printf("[PROC] Started kernel thread '%s' pid=%d\n", proc->name, pid);
+    return pid;
 }
 
 // Entry wrapper - called when a new process is switched to for the first time
@@ -285,51 +486,64 @@ void process_exit(int status) {
     // Disable IRQs during exit to prevent race with preemption
     asm volatile("msr daifset, #2" ::: "memory");
 
-    if (current_pid < 0) {
+    cpu_t *cpu = cpu_this();
+    int slot = cpu->current_slot;
+    if (slot < 0) {
         printf("[PROC] Exit called with no current process!\n");
         asm volatile("msr daifclr, #2" ::: "memory");
         return;
     }
 
-    int slot = current_pid;
     process_t *proc = &proc_table[slot];
     printf("[PROC] Process '%s' (pid %d) exited with status %d\n",
            proc->name, proc->pid, status);
+    if (proc->locks_held) {
+        printf("[PROC] '%s' exited holding %d kernel locks; slot retired\n",
+               proc->name, proc->locks_held);
+    }
+
+    // Its region goes back to the allocator when the slot is reaped, so
+    // nothing may keep calling into it
+    if (proc->load_size) {
+        kapi_release_hooks(proc->load_base, proc->load_size);
+    }
+
+    spin_lock(&sched_lock);
 
     // Kill all children of this process before exiting
     kill_children(proc->pid);
 
     proc->exit_status = status;
-    proc->state = PROC_STATE_ZOMBIE;
+    proc->killed = 0;
 
     // Free stack - but we're still on it! Don't free yet.
-    // The stack will be freed when the slot is reused.
+    // The stack and program region are reaped by the next process_create.
 
-    // Mark slot as free (simple cleanup for now)
+    // Mark slot as free. on_cpu stays set until we're off this stack,
+    // which keeps the slot from being reused under us.
     proc->state = PROC_STATE_FREE;
 
-    // We're done with this process - switch back to kernel context
+    // We're done with this process - switch back to this core's kernel context
     // This MUST not return - we context switch away
-    current_pid = -1;
-    current_process = NULL;
+    cpu->current = NULL;
+    cpu->current_slot = -1;
+    cpu->release = &proc->on_cpu;
 
-    // Debug: verify kernel_context before switching
-    printf("[PROC] Switching to kernel_context: pc=0x%lx sp=0x%lx pstate=0x%lx\n",
-           kernel_context.pc, kernel_context.sp, kernel_context.pstate);
+    spin_unlock(&sched_lock);
 
     // Sanity check kernel_context
     // Note: kernel code is in flash at 0x0, stack is near 0x5f000000
-    if (kernel_context.pc == 0 || kernel_context.sp == 0) {
+    if (cpu->kernel_context.pc == 0 || cpu->kernel_context.sp == 0) {
         printf("[PROC] ERROR: kernel_context appears corrupted!\n");
         printf("[PROC] This indicates memory corruption during process execution\n");
         while(1);  // Hang instead of crashing
     }
 
-    // Switch directly back to kernel context
-    // This will resume in process_exec_args() or process_schedule()
-    // wherever the kernel was waiting
+    // Switch directly back to kernel context (nothing to save - we're gone)
+    // This will resume in process_exec_args(), process_schedule() or the
+    // secondary idle loop, wherever this core's kernel was waiting
     // IRQs will be re-enabled when kernel re-enables them
-    context_switch(&proc->context, &kernel_context);
+    context_switch(NULL, &cpu->kernel_context);
 
     // Should never reach here
     printf("[PROC] ERROR: process_exit returned!\n");
@@ -338,51 +552,85 @@ void process_exit(int status) {
 
 // Yield - voluntarily give up CPU
 void process_yield(void) {
-    if (current_pid >= 0) {
+    uint64_t flags = spin_lock_irqsave(&sched_lock);
+    cpu_t *cpu = cpu_this();
+    if (cpu->current_slot >= 0) {
         // Mark current process as ready
-        process_t *proc = &proc_table[current_pid];
-        proc->state = PROC_STATE_READY;
+        cpu->current->state = PROC_STATE_READY;
     }
+    spin_unlock_irqrestore(&sched_lock, flags);
+
     // Always try to schedule - even from kernel context
     // This lets programs started via process_exec() yield to spawned children
     process_schedule();
 }
 
+// Next runnable slot after old_slot (round-robin), or -1 (caller holds sched_lock)
+// Skips processes still on another core and ones without a valid context.
+static int pick_next(int old_slot) {
+    int start = (old_slot >= 0) ? old_slot + 1 : 0;
+
+    // A woken kernel thread has deferred device work to do - it goes first.
+    // Not when it's the one yielding, though: it may be waiting on a lock
+    // held by whatever it preempted.
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        process_t *proc = &proc_table[i];
+        if (proc->kthread && proc->state == PROC_STATE_READY &&
+            !proc->on_cpu && i != old_slot) {
+            return i;
+        }
+    }
+
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        int idx = (start + i) % MAX_PROCESSES;
+        process_t *proc = &proc_table[idx];
+        if (proc->state != PROC_STATE_READY) continue;
+        if (proc->on_cpu && idx != old_slot) continue;
+        if (proc->context.sp == 0 || proc->context.pc == 0) continue;
+        return idx;
+    }
+    return -1;
+}
+
 // Simple round-robin scheduler (for voluntary transitions like process_exec)
 void process_schedule(void) {
     // Disable IRQs during scheduling to prevent race with preemption
     asm volatile("msr daifset, #2" ::: "memory");
+    spin_lock(&sched_lock);
+    schedule_locked();
+}
 
-    int old_pid = current_pid;
+// Body of process_schedule. Entered with IRQs off and sched_lock held;
+// returns with both released. A BLOCKED current process stays blocked.
+static void schedule_locked(void) {
+    cpu_t *cpu = cpu_this();
+    int old_pid = cpu->current_slot;
     process_t *old_proc = (old_pid >= 0) ? &proc_table[old_pid] : NULL;
 
     // Find next runnable process (round-robin)
-    int start = (old_pid >= 0) ? old_pid + 1 : 0;
-    int next = -1;
-
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        int idx = (start + i) % MAX_PROCESSES;
-        if (proc_table[idx].state == PROC_STATE_READY) {
-            next = idx;
-            break;
-        }
-    }
+    int next = pick_next(old_pid);
 
     if (next < 0) {
         // No runnable processes
         if (old_pid >= 0 && old_proc->state == PROC_STATE_RUNNING) {
             // Current process still running, keep it
+            spin_unlock(&sched_lock);
             asm volatile("msr daifclr, #2" ::: "memory");  // Re-enable IRQs
             return;
         }
         // Return to kernel (if we were in a process, switch back to kernel)
         if (old_pid >= 0) {
-            current_pid = -1;
-            current_process = NULL;
-            context_switch(&old_proc->context, &kernel_context);
-            // When we return here, IRQs will be re-enabled below
+            cpu->current = NULL;
+            cpu->current_slot = -1;
+            cpu->release = &old_proc->on_cpu;
+            spin_unlock(&sched_lock);
+            context_switch(&old_proc->context, &cpu->kernel_context);
+            // Resumed later (possibly on another core) - carry on
+            asm volatile("msr daifclr, #2" ::: "memory");
+            return;
         }
         // Already in kernel with nothing to run - sleep until next interrupt
+        spin_unlock(&sched_lock);
         asm volatile("msr daifclr, #2" ::: "memory");  // Re-enable IRQs
         asm volatile("wfi");
         return;
@@ -390,6 +638,7 @@ void process_schedule(void) {
 
     if (next == old_pid && old_proc && old_proc->state == PROC_STATE_RUNNING) {
         // Same process and it's running - nothing to switch
+        spin_unlock(&sched_lock);
         asm volatile("msr daifclr, #2" ::: "memory");  // Re-enable IRQs
         return;
     }
@@ -397,6 +646,7 @@ void process_schedule(void) {
     if (next == old_pid && old_proc && old_proc->state == PROC_STATE_READY) {
         // Process yielded but it's the only one - sleep until interrupt
         old_proc->state = PROC_STATE_RUNNING;
+        spin_unlock(&sched_lock);
         asm volatile("msr daifclr, #2" ::: "memory");  // Re-enable IRQs
         asm volatile("wfi");
         return;
@@ -410,13 +660,17 @@ void process_schedule(void) {
     }
 
     new_proc->state = PROC_STATE_RUNNING;
-    current_pid = next;
-    current_process = new_proc;
+    new_proc->on_cpu = 1;
+    cpu->current = new_proc;
+    cpu->current_slot = next;
 
     // Context switch!
-    // If old_pid == -1, we're switching FROM kernel context
+    // If old_pid == -1, we're switching FROM this core's kernel context
+    // (never picked up by another core, so nothing to release)
     // IRQs stay disabled - new process will enable them (entry_wrapper or return path)
-    cpu_context_t *old_ctx = (old_pid >= 0) ? &old_proc->context : &kernel_context;
+    cpu_context_t *old_ctx = (old_pid >= 0) ? &old_proc->context : &cpu->kernel_context;
+    cpu->release = old_proc ? &old_proc->on_cpu : NULL;
+    spin_unlock(&sched_lock);
 
     // Debug: if switching from kernel, verify kernel_context after we return
     int was_kernel = (old_pid < 0);
@@ -425,10 +679,12 @@ void process_schedule(void) {
 
     // We return here when someone switches back to us
     // Verify kernel_context wasn't corrupted during process execution
+    // (kernel contexts never migrate, so cpu_this() is still our core)
     if (was_kernel) {
-        if (kernel_context.pc < 0x40000000 || kernel_context.sp < 0x40000000) {
+        cpu_context_t *kctx = &cpu_this()->kernel_context;
+        if (kctx->pc < 0x40000000 || kctx->sp < 0x40000000) {
             printf("[PROC] WARNING: kernel_context corrupted after process ran!\n");
-            printf("[PROC] pc=0x%lx sp=0x%lx\n", kernel_context.pc, kernel_context.sp);
+            printf("[PROC] pc=0x%lx sp=0x%lx\n", kctx->pc, kctx->sp);
         }
     }
 
@@ -478,71 +734,113 @@ int process_exec(const char *path) {
 }
 
 // Called from IRQ handler for preemptive scheduling
-// Just updates current_process - IRQ handler does the actual context switch
+// Just updates this core's current process - IRQ handler does the actual context switch
 void process_schedule_from_irq(void) {
-    // Check how many processes are ready to run
-    int ready_count = process_count_ready();
+    cpu_t *cpu = cpu_this();
+    spin_lock(&sched_lock);
 
-    // If kernel is running (current_pid == -1), we should switch to ANY ready process
+    int old_slot = cpu->current_slot;
+    process_t *old_proc = (old_slot >= 0) ? &proc_table[old_slot] : NULL;
+
+    // Killed while running here: its context was just saved by the IRQ
+    // handler, so if that's a safe point send it into process_exit on return
+    if (old_proc && old_proc->killed && at_safe_point(old_proc)) {
+        redirect_to_exit(old_proc);
+        spin_unlock(&sched_lock);
+        return;
+    }
+
+    // If kernel is running (no current process), we should switch to ANY ready process
     // If a process is running, we only switch if there's another ready process
-    if (current_pid >= 0 && ready_count <= 1) {
-        return;  // Only one process, no point switching
+    int next = pick_next(old_slot);
+    if (next < 0 || next == old_slot) {
+        spin_unlock(&sched_lock);
+        return;
     }
-    if (current_pid < 0 && ready_count == 0) {
-        return;  // Kernel running, no processes to switch to
+
+    // Mark old process as ready (it was running)
+    if (old_proc && old_proc->state == PROC_STATE_RUNNING) {
+        old_proc->state = PROC_STATE_READY;
     }
 
-    // Find next runnable process (round-robin)
-    int old_slot = current_pid;
-    int start = (old_slot >= 0) ? old_slot + 1 : 0;
+    // Switch to new process
+    process_t *new_proc = &proc_table[next];
+    new_proc->state = PROC_STATE_RUNNING;
+    new_proc->on_cpu = 1;
+    cpu->current = new_proc;
+    cpu->current_slot = next;
 
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        int idx = (start + i) % MAX_PROCESSES;
-        if (proc_table[idx].state == PROC_STATE_READY) {
-            // Found a different process to switch to
-            if (idx != old_slot) {
-                // Safety check: verify process has valid context
-                process_t *new_proc = &proc_table[idx];
-                if (new_proc->context.sp == 0 || new_proc->context.pc == 0) {
-                    continue;  // Skip invalid process
-                }
-
-                // Mark old process as ready (it was running)
-                if (old_slot >= 0 && proc_table[old_slot].state == PROC_STATE_RUNNING) {
-                    proc_table[old_slot].state = PROC_STATE_READY;
-                }
-
-                // Switch to new process
-                proc_table[idx].state = PROC_STATE_RUNNING;
-                current_pid = idx;
-                current_process = new_proc;
-
-                // Memory barrier to ensure current_process is visible to IRQ handler
-                asm volatile("dsb sy" ::: "memory");
-            }
-            return;
-        }
+    // The IRQ return path releases the old process once it's off its stack
+    cpu->release = old_proc ? &old_proc->on_cpu : NULL;
+
+    spin_unlock(&sched_lock);
+
+    // Memory barrier to ensure current_process is visible to IRQ handler
+    asm volatile("dsb sy" ::: "memory");
+}
+
+// Called from a device IRQ handler after waking a kernel thread: switch to
+// it on the way out of the IRQ rather than at the next timeslice. A kernel
+// thread that's already running here isn't interrupted for another.
+void process_preempt_from_irq(void) {
+    process_t *proc = cpu_this()->current;
+    if (proc && proc->kthread) return;
+    process_schedule_from_irq();
+}
+
+// A killed process may go once it's stopped in its own program code with
+// no kernel mutex held: nothing in the kernel is halfway through for it
+// (caller holds sched_lock, process isn't running)
+static int at_safe_point(process_t *proc) {
+    uint64_t pc = proc->context.pc;
+    return proc->locks_held == 0 && proc->load_size != 0 &&
+           pc >= proc->load_base && pc < proc->load_base + proc->load_size;
+}
+
+// Resume a stopped process in process_exit(-1) instead
+static void redirect_to_exit(process_t *proc) {
+    proc->killed = 0;
+    proc->context.pc = (uint64_t)process_exit;
+    proc->context.x[0] = (uint64_t)-1;
+}
+
+// Mark a process killed and get it moving toward a safe point
+// (caller holds sched_lock)
+static void kill_locked(process_t *proc) {
+    proc->killed = 1;
+
+    // Blocked in the kernel: wake it up so it returns to its program.
+    // It may still be on_cpu if its core is saving it right now; it's
+    // READY either way and goes when it next runs.
+    if (proc->state == PROC_STATE_BLOCKED && proc->pid != 0) {
+        timer_unlink(proc);
+        proc->wait_chan = NULL;
+        proc->wait_timed_out = 1;
+        proc->state = PROC_STATE_READY;
+    }
+
+    // Stopped in its own code: it exits as soon as it's scheduled. Otherwise
+    // the tick that finds it there, or its next yield/sleep/wait, does it.
+    if (!proc->on_cpu && at_safe_point(proc)) {
+        redirect_to_exit(proc);
     }
 }
 
-// Kill all children of a process (recursive)
+// Kill all children of a process (recursive, caller holds sched_lock)
 static void kill_children(int parent_pid) {
+    int self = cpu_this()->current_slot;
+
     for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (proc_table[i].state != PROC_STATE_FREE &&
-            proc_table[i].parent_pid == parent_pid) {
+        if (proc_table[i].state != PROC_STATE_FREE && proc_table[i].pid != 0 &&
+            !proc_table[i].kthread && proc_table[i].parent_pid == parent_pid) {
             int child_pid = proc_table[i].pid;
             // First kill grandchildren recursively
             kill_children(child_pid);
             // Then kill this child (skip if it's current process)
-            if (i != current_pid) {
+            if (i != self && !proc_table[i].killed) {
                 printf("[PROC] Killing child '%s' (pid %d, parent %d)\n",
                        proc_table[i].name, child_pid, parent_pid);
-                if (proc_table[i].stack_base) {
-                    free(proc_table[i].stack_base);
-                    proc_table[i].stack_base = NULL;
-                }
-                proc_table[i].state = PROC_STATE_FREE;
-                proc_table[i].pid = 0;
+                kill_locked(&proc_table[i]);
             }
         }
     }
@@ -556,6 +854,8 @@ int process_kill(int pid) {
         return -1;
     }
 
+    uint64_t flags = spin_lock_irqsave(&sched_lock);
+
     // Find the process
     int slot = -1;
     for (int i = 0; i < MAX_PROCESSES; i++) {
@@ -566,14 +866,22 @@ int process_kill(int pid) {
     }
 
     if (slot < 0) {
+        spin_unlock_irqrestore(&sched_lock, flags);
         printf("[PROC] Process %d not found\n", pid);
         return -1;
     }
 
     process_t *proc = &proc_table[slot];
 
+    if (proc->kthread) {
+        spin_unlock_irqrestore(&sched_lock, flags);
+        printf("[PROC] Cannot kill kernel thread '%s'\n", proc->name);
+        return -1;
+    }
+
     // Don't allow killing the current process this way - use exit() instead
-    if (slot == current_pid) {
+    if (slot == cpu_this()->current_slot) {
+        spin_unlock_irqrestore(&sched_lock, flags);
         printf("[PROC] Cannot kill current process (use exit)\n");
         return -1;
     }
@@ -582,16 +890,189 @@ int process_kill(int pid) {
 
     // First kill all children of this process
     kill_children(pid);
+    kill_locked(proc);
 
-    // Free the process memory
-    if (proc->stack_base) {
-        free(proc->stack_base);
-        proc->stack_base = NULL;
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return 0;
+}
+
+int process_killed(void) {
+    process_t *proc = process_current();
+    return proc && proc->killed;
+}
+
+void process_exit_if_killed(uint64_t caller_pc) {
+    process_t *proc = process_current();
+    if (!proc || !proc->killed || proc->locks_held) return;
+    if (caller_pc < proc->load_base || caller_pc >= proc->load_base + proc->load_size) return;
+    process_exit(-1);
+}
+
+// ============ Wait queues and sleep ============
+
+// Timer wheel insert/remove (caller holds sched_lock)
+static void timer_insert(process_t *proc, uint64_t wake_tick) {
+    process_t **head = &timer_wheel[wake_tick % TIMER_WHEEL_SLOTS];
+    proc->wake_tick = wake_tick;
+    proc->timer_prev = NULL;
+    proc->timer_next = *head;
+    if (*head) (*head)->timer_prev = proc;
+    *head = proc;
+}
+
+static void timer_unlink(process_t *proc) {
+    if (!proc->wake_tick) return;
+    if (proc->timer_prev) {
+        proc->timer_prev->timer_next = proc->timer_next;
+    } else {
+        timer_wheel[proc->wake_tick % TIMER_WHEEL_SLOTS] = proc->timer_next;
     }
+    if (proc->timer_next) proc->timer_next->timer_prev = proc->timer_prev;
+    proc->timer_next = proc->timer_prev = NULL;
+    proc->wake_tick = 0;
+}
 
-    // Mark slot as free
-    proc->state = PROC_STATE_FREE;
-    proc->pid = 0;
+int wait_queue_sleep(wait_queue_t *wq, uint32_t seq, uint32_t timeout_ticks) {
+    asm volatile("msr daifset, #2" ::: "memory");
+    spin_lock(&sched_lock);
 
-    return 0;
+    cpu_t *cpu = cpu_this();
+    process_t *proc = cpu->current;
+
+    // Kernel context can't block - let the caller poll again after an interrupt
+    if (!proc) {
+        spin_unlock(&sched_lock);
+        asm volatile("msr daifclr, #2" ::: "memory");
+        asm volatile("wfi");
+        return 0;
+    }
+
+    // Woken between the caller's check and now
+    if (wq && wq->seq != seq) {
+        spin_unlock(&sched_lock);
+        asm volatile("msr daifclr, #2" ::: "memory");
+        return 0;
+    }
+
+    // A killed process is on its way out: don't let it block for long in
+    // case it missed the wakeup process_kill gave it
+    if (proc->killed && (timeout_ticks == 0 || timeout_ticks > 1)) {
+        timeout_ticks = 1;
+    }
+
+    proc->state = PROC_STATE_BLOCKED;
+    proc->wait_chan = wq;
+    proc->wait_timed_out = 0;
+    if (timeout_ticks) {
+        timer_insert(proc, timer_get_ticks() + timeout_ticks);
+    }
+
+    // Switch away; we come back here once woken (maybe on another core)
+    schedule_locked();
+
+    return proc->wait_timed_out ? -1 : 0;
+}
+
+void wait_queue_wake(wait_queue_t *wq) {
+    uint64_t flags = spin_lock_irqsave(&sched_lock);
+    wq->seq++;
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        process_t *proc = &proc_table[i];
+        if (proc->state == PROC_STATE_BLOCKED && proc->wait_chan == wq) {
+            timer_unlink(proc);
+            proc->wait_chan = NULL;
+            proc->state = PROC_STATE_READY;
+        }
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+void wait_queue_wake_one(wait_queue_t *wq) {
+    uint64_t flags = spin_lock_irqsave(&sched_lock);
+    wq->seq++;
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        process_t *proc = &proc_table[i];
+        if (proc->state == PROC_STATE_BLOCKED && proc->wait_chan == wq) {
+            timer_unlink(proc);
+            proc->wait_chan = NULL;
+            proc->state = PROC_STATE_READY;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+void process_sleep_ticks(uint32_t ticks) {
+    if (ticks == 0) ticks = 1;
+    wait_queue_sleep(NULL, 0, ticks);
+}
+
+void process_timer_tick(uint64_t now) {
+    uint32_t slot = now % TIMER_WHEEL_SLOTS;
+    if (!timer_wheel[slot]) return;
+
+    spin_lock(&sched_lock);
+    process_t *proc = timer_wheel[slot];
+    while (proc) {
+        process_t *next = proc->timer_next;
+        if (proc->wake_tick <= now) {
+            timer_unlink(proc);
+            if (proc->state == PROC_STATE_BLOCKED) {
+                proc->wait_chan = NULL;
+                proc->wait_timed_out = 1;
+                proc->state = PROC_STATE_READY;
+            }
+        }
+        proc = next;
+    }
+    spin_unlock(&sched_lock);
+}
+
+// ============ Sleeping locks ============
+
+// A mutex belongs to the running process, or to this core's kernel context
+// when no process is running. The owner may take it again (nested calls).
+// A process's count of held mutexes keeps a kill from tearing it down
+// while it owns one.
+void mutex_lock(mutex_t *m) {
+    process_t *proc = process_current();
+    void *self = proc ? (void *)proc : (void *)cpu_this();
+
+    for (;;) {
+        uint64_t flags = spin_lock_irqsave(&m->lock);
+        if (!m->owner || m->owner == self) {
+            m->owner = self;
+            m->depth++;
+            if (proc) proc->locks_held++;
+            spin_unlock_irqrestore(&m->lock, flags);
+            return;
+        }
+
+        // Read seq under the lock: an unlock after this point changes it, so
+        // the sleep below can't miss the handover
+        uint32_t seq = m->wait.seq;
+        m->waiters++;
+        spin_unlock_irqrestore(&m->lock, flags);
+
+        wait_queue_sleep(&m->wait, seq, 0);
+
+        flags = spin_lock_irqsave(&m->lock);
+        m->waiters--;
+        spin_unlock_irqrestore(&m->lock, flags);
+    }
+}
+
+void mutex_unlock(mutex_t *m) {
+    process_t *proc = process_current();
+    uint64_t flags = spin_lock_irqsave(&m->lock);
+    int wake = 0;
+    if (--m->depth == 0) {
+        m->owner = NULL;
+        wake = m->waiters > 0;
+    }
+    if (proc) proc->locks_held--;
+    spin_unlock_irqrestore(&m->lock, flags);
+
+    // One waiter gets to retry; the rest stay asleep until the next unlock
+    if (wake) wait_queue_wake_one(&m->wait);
 }
@@ -3,6 +3,7 @@
  *
  * Preemptive multitasking - timer IRQ forces context switches.
  * Processes get 200ms time slices (100Hz timer, preempt every 20 ticks).
+ * Every core schedules from the same process table (see smp.h).
  */
 
 #ifndef PROCESS_H
@@ -10,6 +11,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "spinlock.h"   // wait_queue_t
 
 #define PROCESS_NAME_MAX 32
 #define PROCESS_STACK_SIZE 0x100000  // 1MB per process (TLS crypto needs lots of stack)
@@ -56,6 +58,29 @@ typedef struct process {
     // Exit
     int exit_status;
     int parent_pid;           // Who spawned us
+
+    // SMP (keep at the end - vectors.S hardcodes the context offset)
+    volatile int on_cpu;      // Running on a core, or its context is still being saved
+    volatile int killed;      // Kill pending: exits at its next safe point (see process_kill)
+
+    // Blocking waits (BLOCKED with a wait queue and/or a timer wheel entry)
+    void *wait_chan;          // Wait queue we're parked on, NULL for a plain sleep
+    int wait_timed_out;       // Woken by the timer rather than the queue
+    uint64_t wake_tick;       // Timer tick to wake at (0 = no timeout)
+    struct process *timer_next;
+    struct process *timer_prev;
+
+    // Program area region, held until the slot is reaped (0 size = none)
+    uint64_t region_base;
+    uint64_t region_size;
+
+    // Kernel thread: runs a kernel function, has no program image, can't be
+    // killed, and is picked ahead of ordinary processes when it wakes
+    int kthread;
+
+    // Kernel mutexes held right now (a killed process isn't torn down
+    // while it holds any, and its slot isn't reused)
+    int locks_held;
 } process_t;
 
 // Initialize process subsystem
@@ -64,6 +89,10 @@ void process_init(void);
 // Create a new process from ELF path (does NOT start it yet)
 int process_create(const char *path, int argc, char **argv);
 
+// Create and start a kernel thread running entry() on its own stack.
+// entry shouldn't return; if it does, the thread exits.
+int process_create_kernel(const char *name, void (*entry)(void));
+
 // Start a created process (makes it ready to run)
 int process_start(int pid);
 
@@ -78,16 +107,14 @@ void process_exit(int status);
 process_t *process_current(void);
 process_t *process_get(int pid);
 
-// Current running process (NULL if kernel)
-extern process_t *current_process;
-
-// Get pointer to current_process pointer (for assembly IRQ handler)
-process_t **process_get_current_ptr(void);
+// Current running process on this core (NULL if kernel)
+#define current_process (process_current())
 
 // Scheduling
 void process_yield(void);              // Give up CPU voluntarily
 void process_schedule(void);           // Pick next process to run
 void process_schedule_from_irq(void);  // Called from timer IRQ for preemption
+void process_preempt_from_irq(void);   // Device IRQ woke a kernel thread: run it now
 int process_count_ready(void);         // Count runnable processes
 
 // Context switch (implemented in assembly)
@@ -98,7 +125,35 @@ void context_switch(cpu_context_t *old_ctx, cpu_context_t *new_ctx);
 int process_get_info(int index, char *name, int name_size, int *state);
 
 // Kill a process by PID
-// Returns 0 on success, -1 if not found or cannot kill
+// Returns 0 on success, -1 if not found or cannot kill. The process goes
+// at its next safe point: stopped in its own program code with no kernel
+// mutex held, or entering the kernel through yield/sleep/wait from there.
+// Until then it keeps its slot and whatever it holds; a blocked victim is
+// woken so it can get there.
 int process_kill(int pid);
 
+// Current process has a kill pending (long kernel waits give up on it)
+int process_killed(void);
+
+// Exit now if the current process has a kill pending and caller_pc (where
+// the kernel was entered from) is in its own program code
+void process_exit_if_killed(uint64_t caller_pc);
+
+// Block until wq is woken or timeout_ticks pass (0 = no timeout).
+// Returns 0 when woken (or seq was already stale), -1 on timeout.
+// Without a current process (kernel context) it just waits for an interrupt.
+int wait_queue_sleep(wait_queue_t *wq, uint32_t seq, uint32_t timeout_ticks);
+
+// Wake every process blocked on wq. Safe from IRQ handlers.
+void wait_queue_wake(wait_queue_t *wq);
+
+// Wake just one of them (for handing over a lock). Safe from IRQ handlers.
+void wait_queue_wake_one(wait_queue_t *wq);
+
+// Block the current process for a number of timer ticks
+void process_sleep_ticks(uint32_t ticks);
+
+// Timer wheel - CPU 0 calls this on every tick to wake expired sleepers
+void process_timer_tick(uint64_t now);
+
 #endif
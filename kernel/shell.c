@@ -141,6 +141,7 @@ void shell_run(void) {
             int c = keyboard_getc();
             if (c < 0) {
                 // No input - sleep until next interrupt
+                console_flush();
                 asm volatile("wfi");
                 continue;
             }
@@ -232,6 +233,7 @@ void shell_run(void) {
                         console_set_color(COLOR_WHITE, COLOR_BLACK);
 
                         // Wait for key
+                        console_flush();
                         int c;
                         while ((c = keyboard_getc()) < 0) {
                             asm volatile("wfi");
@@ -0,0 +1,112 @@
+/*
+ * VibeOS Multi-core Support
+ *
+ * Secondary cores wait in the boot code until we hand them a stack:
+ *   - QEMU (-bios, no firmware): every core enters _start; the secondaries
+ *     spin on smp_boot_stack[] in boot.S and are woken with SEV.
+ *   - Pi: the firmware armstub parks them on its spin table; the HAL writes
+ *     secondary_entry into their release slot.
+ * Each core then sets up its own interrupt controller interface and timer
+ * and runs the scheduler from its idle loop.
+ */
+
+#include "smp.h"
+#include "process.h"
+#include "memory.h"
+#include "printf.h"
+#include "string.h"
+#include "hal/hal.h"
+#include <stddef.h>
+
+_Static_assert(offsetof(cpu_t, kernel_context) == 0, "vectors.S expects kernel_context first");
+_Static_assert(offsetof(cpu_t, current) == CPU_CURRENT_OFFSET, "vectors.S cpu_t layout");
+_Static_assert(offsetof(cpu_t, release) == CPU_RELEASE_OFFSET, "vectors.S cpu_t layout");
+
+cpu_t cpus[MAX_CPUS];
+
+// Read by parked cores with caches off, so each entry gets cleaned to RAM
+volatile uint64_t smp_boot_stack[MAX_CPUS];
+
+static int cpus_online = 1;
+
+// How long to wait for a core to check in before giving up on it
+#define SMP_START_TIMEOUT_US 100000
+
+void smp_init(void) {
+    memset(cpus, 0, sizeof(cpus));
+    for (int i = 0; i < MAX_CPUS; i++) {
+        cpus[i].id = i;
+        cpus[i].current_slot = -1;
+    }
+    cpus[0].online = 1;
+    asm volatile("msr tpidr_el1, %0" :: "r"(&cpus[0]));
+}
+
+// Push a line out to the point of coherency (a no-op in effect on QEMU)
+static void clean_dcache_line(volatile void *addr) {
+    asm volatile("dc civac, %0" :: "r"(addr) : "memory");
+    asm volatile("dsb sy" ::: "memory");
+}
+
+void smp_start_secondaries(void) {
+    for (int i = 1; i < MAX_CPUS; i++) {
+        uint8_t *stack = malloc(SMP_STACK_SIZE);
+        if (!stack) {
+            printf("[SMP] No memory for CPU %d stack\n", i);
+            break;
+        }
+
+        smp_boot_stack[i] = ((uint64_t)stack + SMP_STACK_SIZE) & ~0xFULL;
+        clean_dcache_line(&smp_boot_stack[i]);
+        hal_cpu_start(i);
+
+        uint32_t start = hal_get_time_us();
+        while (!cpus[i].online && hal_get_time_us() - start < SMP_START_TIMEOUT_US) {
+            asm volatile("yield");
+        }
+
+        if (!cpus[i].online) {
+            // No such core (QEMU without -smp) - the rest won't exist either
+            smp_boot_stack[i] = 0;
+            clean_dcache_line(&smp_boot_stack[i]);
+            free(stack);
+            break;
+        }
+        cpus_online++;
+    }
+
+    printf("[SMP] %d CPU%s online\n", cpus_online, cpus_online == 1 ? "" : "s");
+}
+
+int smp_cpu_count(void) {
+    return cpus_online;
+}
+
+void smp_get_cpu_ticks(uint64_t *idle, uint64_t *total) {
+    uint64_t i = 0, t = 0;
+    for (int c = 0; c < MAX_CPUS; c++) {
+        if (!cpus[c].online) continue;
+        i += cpus[c].idle_ticks;
+        t += cpus[c].ticks;
+    }
+    if (idle) *idle = i;
+    if (total) *total = t;
+}
+
+void secondary_main(int cpu) {
+    cpu_t *c = &cpus[cpu];
+    asm volatile("msr tpidr_el1, %0" :: "r"(c));
+
+    hal_irq_init_secondary();
+    hal_timer_init_secondary();
+
+    asm volatile("dsb sy" ::: "memory");
+    c->online = 1;
+
+    hal_irq_enable();
+
+    // Idle loop: run whatever is ready, sleep in process_schedule otherwise
+    for (;;) {
+        process_schedule();
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * VibeOS Multi-core Support
+ *
+ * Every core runs the same scheduler over the shared process table.
+ * Per-core state lives in a cpu_t, found through TPIDR_EL1.
+ */
+
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include "process.h"
+
+#define MAX_CPUS 4
+#define SMP_STACK_SIZE 0x10000  // 64KB idle/IRQ stack per secondary core
+
+typedef struct cpu {
+    // Kernel context - saved when this core switches from kernel to a process.
+    // On CPU 0 that's the kernel main loop; on the others, the idle loop.
+    // MUST be first: vectors.S uses the cpu_t pointer as the context pointer.
+    cpu_context_t kernel_context;
+
+    // Running process (NULL = kernel). Offset used by vectors.S.
+    process_t *current;
+
+    // on_cpu flag of the process this core just switched away from. The
+    // context switch clears it once the old stack is no longer in use, so
+    // another core can't resume the process while we're still on its stack.
+    volatile int *release;
+
+    int id;
+    int current_slot;          // proc_table index of current, -1 = kernel
+    volatile int online;
+    uint64_t ticks;            // Local timer ticks (drives the timeslice)
+    uint64_t idle_ticks;       // Ticks that found no process running (sysmon)
+} cpu_t;
+
+// Offsets used by vectors.S and context.S
+#define CPU_CURRENT_OFFSET 0x320
+#define CPU_RELEASE_OFFSET 0x328
+
+extern cpu_t cpus[MAX_CPUS];
+
+// Stack tops published to parked secondaries (read by boot code)
+extern volatile uint64_t smp_boot_stack[MAX_CPUS];
+
+static inline cpu_t *cpu_this(void) {
+    cpu_t *c;
+    asm volatile("mrs %0, tpidr_el1" : "=r"(c));
+    return c;
+}
+
+static inline int smp_cpu_id(void) {
+    uint64_t mpidr;
+    asm volatile("mrs %0, mpidr_el1" : "=r"(mpidr));
+    return (int)(mpidr & 0xFF);
+}
+
+// Set up CPU 0's per-core state. Must run first thing in kernel_main.
+void smp_init(void);
+
+// Release the secondary cores (after IRQ and timer init)
+void smp_start_secondaries(void);
+
+// Number of cores running the scheduler
+int smp_cpu_count(void);
+
+// Timer ticks summed over online cores: total, and those spent idle
+void smp_get_cpu_ticks(uint64_t *idle, uint64_t *total);
+
+// C entry point for secondary cores (from boot code)
+void secondary_main(int cpu);
+
+#endif
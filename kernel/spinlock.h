@@ -0,0 +1,100 @@
+/*
+ * VibeOS Spinlocks
+ *
+ * Masking IRQs only keeps the local core out of a critical section; with
+ * several cores running, shared state needs a real lock as well.
+ *
+ * spin_lock_irqsave() is the usual form: it masks IRQs first so an
+ * interrupt handler on the same core can't deadlock against its own lock.
+ * Spinlocks must never be held across process_yield() or a context switch.
+ *
+ * Sleeping locks (mutex_t) are for long operations such as disk I/O: a
+ * waiter blocks on the mutex's wait queue instead of spinning. See process.c.
+ */
+
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+
+typedef struct {
+    volatile uint32_t locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+
+static inline void spin_lock(spinlock_t *lock) {
+    uint32_t tmp, one = 1;
+    asm volatile(
+        "   sevl\n"
+        "1: wfe\n"
+        "2: ldaxr   %w0, [%1]\n"
+        "   cbnz    %w0, 1b\n"
+        "   stxr    %w0, %w2, [%1]\n"
+        "   cbnz    %w0, 2b\n"
+        : "=&r"(tmp)
+        : "r"(&lock->locked), "r"(one)
+        : "memory");
+}
+
+// Returns 1 if the lock was taken
+static inline int spin_trylock(spinlock_t *lock) {
+    uint32_t tmp, one = 1;
+    asm volatile(
+        "1: ldaxr   %w0, [%1]\n"
+        "   cbnz    %w0, 2f\n"
+        "   stxr    %w0, %w2, [%1]\n"
+        "   cbnz    %w0, 1b\n"
+        "2:\n"
+        : "=&r"(tmp)
+        : "r"(&lock->locked), "r"(one)
+        : "memory");
+    return tmp == 0;
+}
+
+static inline void spin_unlock(spinlock_t *lock) {
+    // Store-release clears the exclusive monitor and wakes WFE waiters
+    asm volatile("stlr wzr, [%0]" :: "r"(&lock->locked) : "memory");
+}
+
+// Mask IRQs, then take the lock. Returns the previous DAIF.
+static inline uint64_t spin_lock_irqsave(spinlock_t *lock) {
+    uint64_t flags;
+    asm volatile("mrs %0, daif" : "=r"(flags));
+    asm volatile("msr daifset, #2" ::: "memory");
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags) {
+    spin_unlock(lock);
+    asm volatile("msr daif, %0" :: "r"(flags) : "memory");
+}
+
+// Wait queue: processes block on it until someone calls wait_queue_wake().
+// seq counts wakeups. A waiter reads seq, checks its condition, then passes
+// the seq it read to wait_queue_sleep(), which returns at once if a wakeup
+// slipped in between - so a wakeup is never lost.
+typedef struct {
+    volatile uint32_t seq;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { 0 }
+
+// Sleeping lock (mutex_lock/mutex_unlock live in process.c). The holder may
+// lock it again; it's released when every lock has been matched by an unlock.
+// Contended callers sleep on wait until the holder lets go.
+typedef struct {
+    spinlock_t lock;
+    void *volatile owner;
+    int depth;
+    int waiters;
+    wait_queue_t wait;
+} mutex_t;
+
+#define MUTEX_INIT { SPINLOCK_INIT, 0, 0, 0, WAIT_QUEUE_INIT }
+
+void mutex_lock(mutex_t *m);
+void mutex_unlock(mutex_t *m);
+
+#endif
@@ -174,6 +174,11 @@ void tls_init_lib(void) {
 }
 
 int tls_connect(uint32_t ip, uint16_t port, const char *hostname) {
+    return tls_connect_bufsize(ip, port, hostname, 0, 0);
+}
+
+int tls_connect_bufsize(uint32_t ip, uint16_t port, const char *hostname,
+                        uint32_t rx_size, uint32_t tx_size) {
     if (!tls_initialized) tls_init_lib();
 
     // Find free slot
@@ -187,6 +192,10 @@ int tls_connect(uint32_t ip, uint16_t port, const char *hostname) {
     int tcp = tcp_connect(ip, port);
     if (tcp < 0) return -1;
 
+    // Size the socket before the handshake so the certificate chain
+    // already has the bigger window
+    if (rx_size || tx_size) tcp_set_bufsize(tcp, rx_size, tx_size);
+
     // Create TLS context
     struct TLSContext *ctx = tls_create_context(0, TLS_V12);
     if (!ctx) { tcp_close(tcp); return -1; }
@@ -415,6 +424,13 @@ void tls_close(int sock) {
     memset(s, 0, sizeof(*s));
 }
 
+int tls_set_bufsize(int sock, uint32_t rx_size, uint32_t tx_size) {
+    if (sock < 0 || sock >= MAX_TLS_SOCKETS) return -1;
+    tls_socket_internal_t *s = &tls_sockets[sock];
+    if (!s->ctx || s->closed) return -1;
+    return tcp_set_bufsize(s->tcp_sock, rx_size, tx_size);
+}
+
 int tls_is_connected(int sock) {
     if (sock < 0 || sock >= MAX_TLS_SOCKETS) return 0;
     tls_socket_internal_t *s = &tls_sockets[sock];
@@ -20,6 +20,11 @@ void tls_init_lib(void);
 // Returns: socket handle (>=0) or -1 on error
 int tls_connect(uint32_t ip, uint16_t port, const char *hostname);
 
+// Same, growing the TCP socket's buffers (see tcp_set_bufsize) before the
+// handshake starts
+int tls_connect_bufsize(uint32_t ip, uint16_t port, const char *hostname,
+                        uint32_t rx_size, uint32_t tx_size);
+
 // Send data over TLS connection
 // Returns: bytes sent, or -1 on error
 int tls_send(int sock, const void *data, uint32_t len);
@@ -28,6 +33,9 @@ int tls_send(int sock, const void *data, uint32_t len);
 // Returns: bytes received, 0 if no data yet, -1 on error/closed
 int tls_recv(int sock, void *buf, uint32_t maxlen);
 
+// Grow the underlying TCP socket's buffers (see tcp_set_bufsize)
+int tls_set_bufsize(int sock, uint32_t rx_size, uint32_t tx_size);
+
 // Close TLS connection
 void tls_close(int sock);
 
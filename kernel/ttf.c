@@ -2,6 +2,11 @@
  * VibeOS TrueType Font Renderer
  *
  * Uses stb_truetype to render TTF fonts loaded from disk.
+ *
+ * The glyph and run caches are shared by every process, so the public
+ * calls hold ttf_mutex while they look up, rasterize or evict.
+ * ttf_get_glyph() hands out a copy of the glyph, since another process
+ * may evict its atlas page as soon as the lock is dropped.
  */
 
 #include "ttf.h"
@@ -9,6 +14,9 @@
 #include "memory.h"
 #include "string.h"
 #include "printf.h"
+#include "spinlock.h"
+#include "process.h"
+#include "smp.h"
 
 // Configure stb_truetype for our environment
 #define STBTT_STATIC
@@ -31,23 +39,81 @@
 // Font file path
 #define FONT_PATH "/fonts/Roboto/Roboto-Regular.ttf"
 
-// Maximum cached glyphs per size/style combo
-#define MAX_CACHED_GLYPHS 128
+// Sizes are rasterized exactly, anywhere in this range
+#define TTF_MIN_SIZE  4
+#define TTF_MAX_SIZE  128
+
+// Glyph cache. Entries are found by hashing (codepoint, size, style) and
+// come from a fixed pool. Their bitmaps are packed end to end into atlas
+// pages, each holding one size, so a glyph costs no malloc of its own.
+// When the pool or the page budget runs out, the page used least recently
+// is dropped along with every glyph on it.
+#define GLYPH_SLOTS       4096
+#define GLYPH_HASH_BITS   11
+#define GLYPH_HASH_SIZE   (1 << GLYPH_HASH_BITS)
+#define ATLAS_PAGE_BYTES  16384
+#define ATLAS_MAX_PAGES   64      // 1MB of bitmaps
+
+// Sizes in use at once, each with its scale and vertical metrics
+#define MAX_SIZES  16
+
+// Run cache: widths of whole strings, for layout that measures the same
+// words and lines over and over. Direct mapped; longer runs aren't kept.
+#define RUN_SLOTS    512
+#define RUN_MAX_LEN  96
+
+// Italic slant: one pixel right for every 5 rows up (about 12 degrees)
+#define ITALIC_SLANT  5
+
+// Kerning between printable ASCII pairs, in font units, looked up once
+#define KERN_FIRST    32
+#define KERN_COUNT    95
+#define KERN_UNKNOWN  (-32768)
+
+typedef struct glyph_entry {
+    uint32_t key;                   // Codepoint, size and style, see glyph_key()
+    uint8_t page;                   // Atlas page holding the bitmap
+    struct glyph_entry *next;       // Hash chain, or free list
+    struct glyph_entry *page_next;  // Other glyphs on the same page
+    ttf_glyph_t glyph;
+} glyph_entry_t;
 
-// Cache entry
 typedef struct {
-    int codepoint;
-    int style;
-    ttf_glyph_t glyph;
-} glyph_cache_entry_t;
+    uint8_t *pixels;
+    uint32_t capacity;
+    uint32_t used;          // Bytes handed out, front to back
+    int size;               // Pixel size of every glyph here, 0 = free page
+    uint32_t last_used;     // LRU clock when a glyph on it was last returned
+    glyph_entry_t *glyphs;
+} atlas_page_t;
 
-// Per-size cache
 typedef struct {
-    int size;
+    int size;               // 0 = unused
     float scale;
-    glyph_cache_entry_t entries[MAX_CACHED_GLYPHS];
-    int count;
-} size_cache_t;
+    int ascent, descent, line_gap;
+    int open_page;          // Page new glyphs of this size go to, -1 = none
+    uint32_t last_used;
+} size_info_t;
+
+// A caller's copy of the last glyph it got. Callers are processes, or a
+// core's kernel context, so there's always an entry for each.
+#define GLYPH_COPIES  (MAX_PROCESSES + MAX_CPUS)
+
+typedef struct {
+    void *owner;            // process_t or cpu_t, NULL = unused
+    ttf_glyph_t glyph;
+    uint8_t *bitmap;
+    uint32_t capacity;
+} glyph_copy_t;
+
+typedef struct {
+    uint32_t hash;
+    uint16_t size;
+    uint8_t style;
+    uint8_t len;            // 0 = empty slot
+    int width;
+    char text[RUN_MAX_LEN];
+} run_entry_t;
 
 // Global state
 static uint8_t *font_data = NULL;
@@ -55,50 +121,171 @@ static int font_data_size = 0;
 static stbtt_fontinfo font_info;
 static int ttf_ready = 0;
 
-// Caches for different sizes (must cover all sizes used by browser)
-#define NUM_SIZE_CACHES 8
-static size_cache_t size_caches[NUM_SIZE_CACHES];
-static int size_cache_sizes[NUM_SIZE_CACHES] = {
-    FONT_SIZE_SMALL,   // 12
-    14,                // browser small
-    FONT_SIZE_NORMAL,  // 16
-    18,                // browser h4
-    20,                // browser h3
-    FONT_SIZE_LARGE,   // 24
-    28,                // browser h1
-    FONT_SIZE_XLARGE   // 32
-};
-
-// Temporary buffer for italic shearing
-static uint8_t *temp_bitmap = NULL;
-static int temp_bitmap_size = 0;
-
-static size_cache_t *get_size_cache(int size) {
-    // First try exact match
-    for (int i = 0; i < NUM_SIZE_CACHES; i++) {
-        if (size_caches[i].size == size) {
-            return &size_caches[i];
+static glyph_entry_t glyph_pool[GLYPH_SLOTS];
+static glyph_entry_t *glyph_hash[GLYPH_HASH_SIZE];
+static glyph_entry_t *glyph_free;
+static atlas_page_t pages[ATLAS_MAX_PAGES];
+static size_info_t sizes[MAX_SIZES];
+static run_entry_t runs[RUN_SLOTS];
+static uint32_t lru_clock;
+
+static int16_t ascii_advance[128];          // Font units
+static int16_t ascii_kern[KERN_COUNT * KERN_COUNT];
+
+static ttf_stats_t stats;
+static mutex_t ttf_mutex = MUTEX_INIT;
+static glyph_copy_t glyph_copies[GLYPH_COPIES];
+
+static int clamp_size(int size) {
+    if (size < TTF_MIN_SIZE) return TTF_MIN_SIZE;
+    if (size > TTF_MAX_SIZE) return TTF_MAX_SIZE;
+    return size;
+}
+
+// Scale and metrics for a size, set up the first time it's asked for.
+// Only the record is recycled when all are in use - the glyphs stay cached.
+static size_info_t *get_size(int size) {
+    size = clamp_size(size);
+
+    size_info_t *victim = &sizes[0];
+    for (int i = 0; i < MAX_SIZES; i++) {
+        if (sizes[i].size == size) {
+            sizes[i].last_used = lru_clock;
+            return &sizes[i];
+        }
+        if (sizes[i].size == 0) {
+            if (victim->size != 0) victim = &sizes[i];
+        } else if (victim->size != 0 && sizes[i].last_used < victim->last_used) {
+            victim = &sizes[i];
         }
     }
-    // Find closest size
-    int best = 0;
-    int best_diff = 1000;
-    for (int i = 0; i < NUM_SIZE_CACHES; i++) {
-        int diff = size_caches[i].size - size;
-        if (diff < 0) diff = -diff;
-        if (diff < best_diff) {
-            best_diff = diff;
+
+    int a, d, lg;
+    stbtt_GetFontVMetrics(&font_info, &a, &d, &lg);
+
+    victim->size = size;
+    victim->scale = stbtt_ScaleForPixelHeight(&font_info, (float)size);
+    victim->ascent = (int)(a * victim->scale);
+    victim->descent = (int)(d * victim->scale);  // Note: descent is typically negative
+    victim->line_gap = (int)(lg * victim->scale);
+    victim->open_page = -1;
+    victim->last_used = lru_clock;
+    return victim;
+}
+
+// Codepoints fit in 21 bits, sizes in 8 and styles in 2
+static uint32_t glyph_key(int codepoint, int size, int style) {
+    if (codepoint < 0 || codepoint > 0x10FFFF) codepoint = 0;
+    return (uint32_t)codepoint | ((uint32_t)size << 21) | ((uint32_t)(style & 3) << 29);
+}
+
+static uint32_t glyph_bucket(uint32_t key) {
+    return (key * 2654435761u) >> (32 - GLYPH_HASH_BITS);
+}
+
+// Drop a page and every glyph on it. The buffer is kept for the next page
+// unless it was sized for one oversized glyph.
+static void evict_page(int p) {
+    atlas_page_t *page = &pages[p];
+
+    for (glyph_entry_t *e = page->glyphs; e; ) {
+        glyph_entry_t *next = e->page_next;
+        glyph_entry_t **link = &glyph_hash[glyph_bucket(e->key)];
+        while (*link != e) link = &(*link)->next;
+        *link = e->next;
+
+        e->next = glyph_free;
+        glyph_free = e;
+        stats.glyphs--;
+        e = next;
+    }
+
+    if (page->capacity != ATLAS_PAGE_BYTES) {
+        free(page->pixels);
+        stats.pages--;
+        stats.page_bytes -= page->capacity;
+        page->pixels = NULL;
+        page->capacity = 0;
+    }
+    page->glyphs = NULL;
+    page->used = 0;
+    page->size = 0;
+    stats.page_evictions++;
+}
+
+static int lru_page(void) {
+    int best = -1;
+    for (int i = 0; i < ATLAS_MAX_PAGES; i++) {
+        if (pages[i].size && (best < 0 || pages[i].last_used < pages[best].last_used)) {
             best = i;
         }
     }
-    return &size_caches[best];
+    return best;
+}
+
+static glyph_entry_t *alloc_entry(void) {
+    if (!glyph_free) {
+        int p = lru_page();
+        if (p < 0) return NULL;
+        evict_page(p);
+    }
+    glyph_entry_t *e = glyph_free;
+    glyph_free = e->next;
+    return e;
+}
+
+// A page of this size with room for bytes more, opening a new one if the
+// current page is full
+static int page_for(size_info_t *si, uint32_t bytes) {
+    int p = si->open_page;
+    if (p >= 0 && pages[p].size == si->size && pages[p].capacity - pages[p].used >= bytes) {
+        return p;
+    }
+
+    uint32_t capacity = bytes > ATLAS_PAGE_BYTES ? bytes : ATLAS_PAGE_BYTES;
+
+    // A free page whose buffer fits, then any free page, then the LRU one
+    p = -1;
+    for (int i = 0; i < ATLAS_MAX_PAGES; i++) {
+        if (pages[i].size) continue;
+        if (pages[i].pixels && pages[i].capacity >= capacity) {
+            p = i;
+            break;
+        }
+        if (p < 0) p = i;
+    }
+    if (p < 0) {
+        p = lru_page();
+        evict_page(p);
+    }
+
+    atlas_page_t *page = &pages[p];
+    if (!page->pixels || page->capacity < capacity) {
+        if (page->pixels) {
+            free(page->pixels);
+            stats.pages--;
+            stats.page_bytes -= page->capacity;
+        }
+        page->pixels = malloc(capacity);
+        page->capacity = page->pixels ? capacity : 0;
+        if (!page->pixels) return -1;
+        stats.pages++;
+        stats.page_bytes += capacity;
+    }
+
+    page->size = si->size;
+    page->used = 0;
+    page->glyphs = NULL;
+    page->last_used = lru_clock;
+    si->open_page = p;
+    return p;
 }
 
 int ttf_init(void) {
     if (ttf_ready) return 0;
 
     // Open font file
-    vfs_node_t *font_file = vfs_lookup(FONT_PATH);
+    vfs_node_t *font_file = vfs_open_handle(FONT_PATH);
     if (!font_file) {
         printf("TTF: Failed to open %s\n", FONT_PATH);
         return -1;
@@ -108,6 +295,7 @@ int ttf_init(void) {
     font_data_size = font_file->size;
     if (font_data_size <= 0) {
         printf("TTF: Invalid font file size\n");
+        vfs_close_handle(font_file);
         return -1;
     }
 
@@ -115,11 +303,13 @@ int ttf_init(void) {
     font_data = malloc(font_data_size);
     if (!font_data) {
         printf("TTF: Failed to allocate %d bytes for font\n", font_data_size);
+        vfs_close_handle(font_file);
         return -1;
     }
 
     // Read font data
     int bytes_read = vfs_read(font_file, (char *)font_data, font_data_size, 0);
+    vfs_close_handle(font_file);
     if (bytes_read != font_data_size) {
         printf("TTF: Failed to read font file (got %d, expected %d)\n", bytes_read, font_data_size);
         free(font_data);
@@ -136,18 +326,15 @@ int ttf_init(void) {
         return -1;
     }
 
-    // Initialize size caches
-    for (int i = 0; i < NUM_SIZE_CACHES; i++) {
-        size_caches[i].size = size_cache_sizes[i];
-        size_caches[i].scale = stbtt_ScaleForPixelHeight(&font_info, (float)size_cache_sizes[i]);
-        size_caches[i].count = 0;
+    // ASCII advances are needed for every measurement, so look them up now
+    for (int cp = 0; cp < 128; cp++) {
+        int advance, lsb;
+        stbtt_GetCodepointHMetrics(&font_info, cp, &advance, &lsb);
+        ascii_advance[cp] = advance;
     }
 
-    // Allocate temp bitmap for transformations (max glyph size)
-    temp_bitmap_size = FONT_SIZE_XLARGE * FONT_SIZE_XLARGE * 2;
-    temp_bitmap = malloc(temp_bitmap_size);
-
     ttf_ready = 1;
+    ttf_flush();
     printf("TTF: Loaded %s (%d bytes)\n", FONT_PATH, font_data_size);
     return 0;
 }
@@ -156,6 +343,40 @@ int ttf_is_ready(void) {
     return ttf_ready;
 }
 
+void ttf_flush(void) {
+    mutex_lock(&ttf_mutex);
+    for (int i = 0; i < ATLAS_MAX_PAGES; i++) {
+        if (pages[i].pixels) free(pages[i].pixels);
+        pages[i].pixels = NULL;
+        pages[i].capacity = 0;
+        pages[i].size = 0;
+        pages[i].glyphs = NULL;
+    }
+    for (int i = 0; i < GLYPH_HASH_SIZE; i++) {
+        glyph_hash[i] = NULL;
+    }
+    glyph_free = NULL;
+    for (int i = GLYPH_SLOTS - 1; i >= 0; i--) {
+        glyph_pool[i].next = glyph_free;
+        glyph_free = &glyph_pool[i];
+    }
+    for (int i = 0; i < MAX_SIZES; i++) {
+        sizes[i].size = 0;
+    }
+    for (int i = 0; i < RUN_SLOTS; i++) {
+        runs[i].len = 0;
+    }
+    for (int i = 0; i < KERN_COUNT * KERN_COUNT; i++) {
+        ascii_kern[i] = KERN_UNKNOWN;
+    }
+
+    stats.glyphs = 0;
+    stats.pages = 0;
+    stats.page_bytes = 0;
+    stats.runs = 0;
+    mutex_unlock(&ttf_mutex);
+}
+
 // Apply faux bold (draw shifted copy)
 // stride = row stride in bytes, content_w = actual content width
 static void apply_bold(uint8_t *bitmap, int stride, int content_w, int h) {
@@ -171,158 +392,147 @@ static void apply_bold(uint8_t *bitmap, int stride, int content_w, int h) {
     }
 }
 
-// Apply faux italic (shear transform)
+// Apply faux italic (shear transform), in place
 // stride = row stride in bytes, content_w = actual content width to shear
-static void apply_italic(uint8_t *bitmap, int stride, int content_w, int h, int *new_w) {
-    if (!temp_bitmap) return;
-
-    // Shear amount: ~0.2 (about 12 degrees)
-    float shear = 0.2f;
-    int max_shift = (int)((h - 1) * shear) + 1;
-    int out_w = content_w + max_shift;
-
-    // Make sure output fits in allocated space
-    if (out_w > stride) out_w = stride;
-    if (stride * h > temp_bitmap_size) return;
-
-    // Clear temp
-    memset(temp_bitmap, 0, stride * h);
-
-    // Shear: each row shifts right based on distance from bottom
+static void apply_italic(uint8_t *bitmap, int stride, int content_w, int h) {
+    // Each row shifts right by its distance from the bottom
     for (int y = 0; y < h; y++) {
-        int shift = (int)((h - 1 - y) * shear);
-        for (int x = 0; x < content_w; x++) {
-            int dst_x = x + shift;
-            if (dst_x < stride) {
-                temp_bitmap[y * stride + dst_x] = bitmap[y * stride + x];
-            }
-        }
+        int shift = (h - 1 - y) / ITALIC_SLANT;
+        if (shift == 0) continue;
+        uint8_t *row = bitmap + y * stride;
+        memmove(row + shift, row, content_w);
+        memset(row, 0, shift);
     }
-
-    // Copy back (same size as input)
-    memcpy(bitmap, temp_bitmap, stride * h);
-    *new_w = out_w;
 }
 
-ttf_glyph_t *ttf_get_glyph(int codepoint, int size, int style) {
-    if (!ttf_ready) return NULL;
+// Rasterize a glyph straight into its atlas page
+static glyph_entry_t *render_glyph(uint32_t key, int codepoint, size_info_t *si, int style) {
+    int index = stbtt_FindGlyphIndex(&font_info, codepoint);
 
-    // Find appropriate size cache
-    size_cache_t *cache = get_size_cache(size);
-
-    // Check if already cached
-    for (int i = 0; i < cache->count; i++) {
-        if (cache->entries[i].codepoint == codepoint &&
-            cache->entries[i].style == style) {
-            return &cache->entries[i].glyph;
-        }
-    }
+    int x0, y0, x1, y1;
+    stbtt_GetGlyphBitmapBox(&font_info, index, si->scale, si->scale, &x0, &y0, &x1, &y1);
+    int w = x1 - x0;
+    int h = y1 - y0;
+    if (w <= 0 || h <= 0) w = h = 0;  // Nothing to draw, e.g. a space
 
-    // Need to render
-    if (cache->count >= MAX_CACHED_GLYPHS) {
-        // Cache full, evict all entries and free their bitmaps
-        for (int i = 0; i < MAX_CACHED_GLYPHS; i++) {
-            if (cache->entries[i].glyph.bitmap) {
-                free(cache->entries[i].glyph.bitmap);
-                cache->entries[i].glyph.bitmap = NULL;
-            }
-        }
-        cache->count = 0;
+    // Styled glyphs need room to grow to the right
+    int extra_w = 0;
+    if (h && (style & FONT_STYLE_ITALIC)) extra_w += (h - 1) / ITALIC_SLANT + 1;
+    if (h && (style & FONT_STYLE_BOLD)) extra_w += 1;
+    int stride = w + extra_w;
+    uint32_t bytes = (uint32_t)stride * h;
+
+    glyph_entry_t *e = alloc_entry();
+    if (!e) return NULL;
+    int p = page_for(si, bytes);
+    if (p < 0) {
+        e->next = glyph_free;
+        glyph_free = e;
+        return NULL;
     }
+    atlas_page_t *page = &pages[p];
 
-    glyph_cache_entry_t *entry = &cache->entries[cache->count];
-    entry->codepoint = codepoint;
-    entry->style = style;
+    uint8_t *bitmap = page->pixels + page->used;
+    page->used += bytes;
 
-    // Render glyph
-    int w, h, xoff, yoff;
-    uint8_t *bmp = stbtt_GetCodepointBitmap(
-        &font_info, 0, cache->scale,
-        codepoint, &w, &h, &xoff, &yoff
-    );
-
-    if (!bmp) {
-        // No glyph for this codepoint
-        entry->glyph.bitmap = NULL;
-        entry->glyph.width = 0;
-        entry->glyph.height = 0;
-        entry->glyph.xoff = 0;
-        entry->glyph.yoff = 0;
-        entry->glyph.advance = size / 2;  // Default advance
-        cache->count++;
-        return &entry->glyph;
+    if (bytes) {
+        memset(bitmap, 0, bytes);
+        stbtt_MakeGlyphBitmap(&font_info, bitmap, w, h, stride, si->scale, si->scale, index);
     }
 
-    // Get advance width
     int advance, lsb;
-    stbtt_GetCodepointHMetrics(&font_info, codepoint, &advance, &lsb);
+    stbtt_GetGlyphHMetrics(&font_info, index, &advance, &lsb);
 
-    // For normal style, just copy the bitmap as-is
-    if (style == FONT_STYLE_NORMAL) {
-        entry->glyph.bitmap = malloc(w * h);
-        if (!entry->glyph.bitmap) {
-            stbtt_FreeBitmap(bmp, NULL);
-            return NULL;
-        }
-        memcpy(entry->glyph.bitmap, bmp, w * h);
-        stbtt_FreeBitmap(bmp, NULL);
+    e->key = key;
+    e->page = p;
+    e->glyph.bitmap = bytes ? bitmap : NULL;
+    e->glyph.width = stride;  // Always the row stride, styled or not
+    e->glyph.height = h;
+    e->glyph.xoff = x0;
+    e->glyph.yoff = y0;
+    e->glyph.advance = (int)(advance * si->scale);
 
-        entry->glyph.width = w;
-        entry->glyph.height = h;
-        entry->glyph.xoff = xoff;
-        entry->glyph.yoff = yoff;
-        entry->glyph.advance = (int)(advance * cache->scale);
-
-        cache->count++;
-        return &entry->glyph;
-    }
+    // Apply styling
+    int content_w = w;  // Track actual content width as we apply styles
 
-    // For styled text, allocate extra space
-    int extra_w = 0;
-    if (style & FONT_STYLE_ITALIC) {
-        extra_w = (int)(h * 0.2f) + 2;
-    }
     if (style & FONT_STYLE_BOLD) {
-        extra_w += 1;
+        if (bytes) apply_bold(bitmap, stride, content_w, h);
+        content_w += 1;  // Bold adds 1 pixel width
+        e->glyph.advance += 1;
     }
-
-    int alloc_w = w + extra_w;
-    entry->glyph.bitmap = malloc(alloc_w * h);
-    if (!entry->glyph.bitmap) {
-        stbtt_FreeBitmap(bmp, NULL);
-        return NULL;
+    if (bytes && (style & FONT_STYLE_ITALIC)) {
+        apply_italic(bitmap, stride, content_w, h);
     }
 
-    // Copy with new stride
-    memset(entry->glyph.bitmap, 0, alloc_w * h);
-    for (int row = 0; row < h; row++) {
-        memcpy(entry->glyph.bitmap + row * alloc_w, bmp + row * w, w);
+    uint32_t b = glyph_bucket(key);
+    e->next = glyph_hash[b];
+    glyph_hash[b] = e;
+    e->page_next = page->glyphs;
+    page->glyphs = e;
+    stats.glyphs++;
+    return e;
+}
+
+static ttf_glyph_t *get_glyph(int codepoint, int size, int style) {
+    size = clamp_size(size);
+    uint32_t key = glyph_key(codepoint, size, style);
+    lru_clock++;
+
+    for (glyph_entry_t *e = glyph_hash[glyph_bucket(key)]; e; e = e->next) {
+        if (e->key == key) {
+            pages[e->page].last_used = lru_clock;
+            stats.glyph_hits++;
+            return &e->glyph;
+        }
     }
-    stbtt_FreeBitmap(bmp, NULL);
 
-    entry->glyph.width = alloc_w;  // Use allocated width as the stride
-    entry->glyph.height = h;
-    entry->glyph.xoff = xoff;
-    entry->glyph.yoff = yoff;
-    entry->glyph.advance = (int)(advance * cache->scale);
+    stats.glyph_misses++;
+    glyph_entry_t *e = render_glyph(key, key & 0x1FFFFF, get_size(size), style);
+    return e ? &e->glyph : NULL;
+}
 
-    // Apply styling
-    int content_w = w;  // Track actual content width as we apply styles
+// Copy a cached glyph into the caller's own buffer (caller holds ttf_mutex)
+static ttf_glyph_t *copy_out(const ttf_glyph_t *g) {
+    process_t *proc = process_current();
+    void *self = proc ? (void *)proc : (void *)cpu_this();
 
-    if (style & FONT_STYLE_BOLD) {
-        apply_bold(entry->glyph.bitmap, alloc_w, content_w, h);
-        content_w += 1;  // Bold adds 1 pixel width
-        entry->glyph.advance += 1;
+    glyph_copy_t *c = NULL;
+    for (int i = 0; i < GLYPH_COPIES; i++) {
+        if (glyph_copies[i].owner == self) {
+            c = &glyph_copies[i];
+            break;
+        }
+        if (!c && !glyph_copies[i].owner) c = &glyph_copies[i];
+    }
+    if (!c) return NULL;
+    c->owner = self;
+
+    uint32_t bytes = (uint32_t)g->width * g->height;
+    if (bytes > c->capacity) {
+        uint32_t capacity = (bytes + 1023) & ~1023u;
+        uint8_t *bitmap = malloc(capacity);
+        if (!bitmap) return NULL;
+        if (c->bitmap) free(c->bitmap);
+        c->bitmap = bitmap;
+        c->capacity = capacity;
     }
 
-    if (style & FONT_STYLE_ITALIC) {
-        int new_w = alloc_w;
-        apply_italic(entry->glyph.bitmap, alloc_w, content_w, h, &new_w);
-        entry->glyph.width = new_w;
+    c->glyph = *g;
+    if (g->bitmap) {
+        memcpy(c->bitmap, g->bitmap, bytes);
+        c->glyph.bitmap = c->bitmap;
     }
+    return &c->glyph;
+}
+
+ttf_glyph_t *ttf_get_glyph(int codepoint, int size, int style) {
+    if (!ttf_ready) return NULL;
 
-    cache->count++;
-    return &entry->glyph;
+    mutex_lock(&ttf_mutex);
+    ttf_glyph_t *g = get_glyph(codepoint, size, style);
+    if (g) g = copy_out(g);
+    mutex_unlock(&ttf_mutex);
+    return g;
 }
 
 void ttf_get_metrics(int size, int *ascent, int *descent, int *line_gap) {
@@ -333,30 +543,151 @@ void ttf_get_metrics(int size, int *ascent, int *descent, int *line_gap) {
         return;
     }
 
-    size_cache_t *cache = get_size_cache(size);
+    mutex_lock(&ttf_mutex);
+    size_info_t *si = get_size(size);
+    *ascent = si->ascent;
+    *descent = si->descent;
+    *line_gap = si->line_gap;
+    mutex_unlock(&ttf_mutex);
+}
 
-    int a, d, lg;
-    stbtt_GetFontVMetrics(&font_info, &a, &d, &lg);
+static int advance_units(int codepoint) {
+    if (codepoint >= 0 && codepoint < 128) return ascii_advance[codepoint];
 
-    *ascent = (int)(a * cache->scale);
-    *descent = (int)(d * cache->scale);  // Note: descent is typically negative
-    *line_gap = (int)(lg * cache->scale);
+    int advance, lsb;
+    stbtt_GetCodepointHMetrics(&font_info, codepoint, &advance, &lsb);
+    return advance;
 }
 
-int ttf_get_advance(int codepoint, int size) {
-    if (!ttf_ready) return size / 2;
+static int kern_units(int cp1, int cp2) {
+    unsigned a = cp1 - KERN_FIRST, b = cp2 - KERN_FIRST;
+    if (a >= KERN_COUNT || b >= KERN_COUNT) {
+        return stbtt_GetCodepointKernAdvance(&font_info, cp1, cp2);
+    }
 
-    size_cache_t *cache = get_size_cache(size);
+    int16_t *k = &ascii_kern[a * KERN_COUNT + b];
+    if (*k == KERN_UNKNOWN) *k = stbtt_GetCodepointKernAdvance(&font_info, cp1, cp2);
+    return *k;
+}
 
-    int advance, lsb;
-    stbtt_GetCodepointHMetrics(&font_info, codepoint, &advance, &lsb);
-    return (int)(advance * cache->scale);
+int ttf_get_advance(int codepoint, int size) {
+    if (!ttf_ready) return size / 2;
+    mutex_lock(&ttf_mutex);
+    int advance = (int)(advance_units(codepoint) * get_size(size)->scale);
+    mutex_unlock(&ttf_mutex);
+    return advance;
 }
 
 int ttf_get_kerning(int cp1, int cp2, int size) {
     if (!ttf_ready) return 0;
+    mutex_lock(&ttf_mutex);
+    int kern = (int)(kern_units(cp1, cp2) * get_size(size)->scale);
+    mutex_unlock(&ttf_mutex);
+    return kern;
+}
+
+// Next codepoint of a UTF-8 string. Stray bytes come through as Latin-1.
+static int utf8_next(const unsigned char **p, const unsigned char *end) {
+    const unsigned char *s = *p;
+    int c = *s++;
+    int more = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+
+    if (more && end - s >= more) {
+        int cp = c & (0x3F >> more);
+        int i;
+        for (i = 0; i < more && (s[i] & 0xC0) == 0x80; i++) {
+            cp = (cp << 6) | (s[i] & 0x3F);
+        }
+        if (i == more) {
+            *p = s + more;
+            return cp;
+        }
+    }
+    *p = s;
+    return c;
+}
+
+static int measure_run(const char *text, int len, size_info_t *si, int style) {
+    const unsigned char *p = (const unsigned char *)text, *end = p + len;
+    int width = 0;
+    int prev = 0;
+
+    // Same sum gfx_draw_ttf_string() advances by
+    while (p < end) {
+        int cp = utf8_next(&p, end);
+        if (prev) width += (int)(kern_units(prev, cp) * si->scale);
+        width += (int)(advance_units(cp) * si->scale);
+        if (style & FONT_STYLE_BOLD) width += 1;
+        prev = cp;
+    }
+    return width;
+}
+
+// Caller holds ttf_mutex
+static int measure(const char *text, int len, int size, int style) {
+    size = clamp_size(size);
+    style &= FONT_STYLE_BOLD | FONT_STYLE_ITALIC;
+    lru_clock++;
 
-    size_cache_t *cache = get_size_cache(size);
-    int kern = stbtt_GetCodepointKernAdvance(&font_info, cp1, cp2);
-    return (int)(kern * cache->scale);
+    if (len > RUN_MAX_LEN) {
+        stats.run_misses++;
+        return measure_run(text, len, get_size(size), style);
+    }
+
+    // FNV-1a over the text, then the size and style
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    }
+    hash = (hash ^ (uint32_t)(size << 2 | style)) * 16777619u;
+
+    run_entry_t *r = &runs[(hash ^ (hash >> 16)) & (RUN_SLOTS - 1)];
+    if (r->len == len && r->hash == hash && r->size == size &&
+        r->style == style && memcmp(r->text, text, len) == 0) {
+        stats.run_hits++;
+        return r->width;
+    }
+
+    stats.run_misses++;
+    int width = measure_run(text, len, get_size(size), style);
+    if (r->len == 0) stats.runs++;
+    r->hash = hash;
+    r->size = size;
+    r->style = style;
+    r->len = len;
+    r->width = width;
+    memcpy(r->text, text, len);
+    return width;
+}
+
+int ttf_measure(const char *text, int len, int size, int style) {
+    if (len < 0) len = strlen(text);
+    if (len == 0) return 0;
+
+    if (!ttf_ready) {
+        // As many advances as ttf_get_advance() would have given
+        const unsigned char *p = (const unsigned char *)text, *end = p + len;
+        int n = 0;
+        while (p < end) {
+            utf8_next(&p, end);
+            n++;
+        }
+        return n * (size / 2);
+    }
+
+    mutex_lock(&ttf_mutex);
+    int width = measure(text, len, size, style);
+    mutex_unlock(&ttf_mutex);
+    return width;
+}
+
+void ttf_get_stats(ttf_stats_t *out) {
+    mutex_lock(&ttf_mutex);
+    *out = stats;
+    int n = 0;
+    for (int i = 0; i < MAX_SIZES; i++) {
+        if (sizes[i].size) n++;
+    }
+    mutex_unlock(&ttf_mutex);
+    out->sizes = n;
 }
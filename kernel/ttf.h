@@ -31,6 +31,20 @@ typedef struct {
     int advance;         // How much to advance cursor after this glyph
 } ttf_glyph_t;
 
+// Font cache counters (ttf_get_stats)
+typedef struct {
+    uint32_t glyph_hits;      // ttf_get_glyph() answered from the cache
+    uint32_t glyph_misses;    // ...or had to rasterize
+    uint32_t glyphs;          // Glyphs cached right now
+    uint32_t pages;           // Atlas pages allocated
+    uint32_t page_bytes;      // ...and their total size
+    uint32_t page_evictions;  // Pages dropped to make room
+    uint32_t sizes;           // Pixel sizes with metrics set up
+    uint32_t run_hits;        // ttf_measure() answered from the run cache
+    uint32_t run_misses;
+    uint32_t runs;            // Runs cached right now
+} ttf_stats_t;
+
 // Initialize TTF system - call after FAT32 is ready
 // Returns 0 on success, -1 on failure
 int ttf_init(void);
@@ -38,9 +52,10 @@ int ttf_init(void);
 // Check if TTF system is initialized
 int ttf_is_ready(void);
 
-// Get a rendered glyph
+// Get a rendered glyph, at exactly size pixels (4 to 128)
 // Returns pointer to glyph info, or NULL on failure
-// The bitmap data is cached internally - do not free it
+// The glyph is the calling process's own copy - do not free it. It stays
+// valid until that process calls ttf_get_glyph() again.
 ttf_glyph_t *ttf_get_glyph(int codepoint, int size, int style);
 
 // Get font metrics for a given size
@@ -52,4 +67,14 @@ int ttf_get_advance(int codepoint, int size);
 // Get kerning between two characters
 int ttf_get_kerning(int cp1, int cp2, int size);
 
+// Width of a UTF-8 string, advances plus kerning, as gfx_draw_ttf_string()
+// would draw it. len < 0 means up to the NUL. Repeated strings of up to 96
+// bytes come from a cache.
+int ttf_measure(const char *text, int len, int size, int style);
+
+// Drop every cached glyph and run
+void ttf_flush(void);
+
+void ttf_get_stats(ttf_stats_t *out);
+
 #endif
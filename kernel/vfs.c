@@ -10,6 +10,7 @@
 #include "string.h"
 #include "memory.h"
 #include "printf.h"
+#include "spinlock.h"
 
 // Current working directory path
 static char cwd_path[VFS_MAX_PATH] = "/";
@@ -22,6 +23,21 @@ static vfs_node_t inodes[VFS_MAX_INODES];
 static int inode_count = 0;
 static vfs_node_t *mem_root = NULL;
 
+// Public entry points run one caller at a time: they share cwd_path, the
+// in-memory inode table and vfs_lookup()'s node. Recursive, so vfs_get_cwd()
+// -> vfs_lookup() and friends can nest.
+static mutex_t vfs_mutex = MUTEX_INIT;
+
+static void vfs_unlock(int *scope) {
+    (void)scope;
+    mutex_unlock(&vfs_mutex);
+}
+
+// Hold vfs_mutex until the enclosing function returns
+#define VFS_LOCKED() \
+    mutex_lock(&vfs_mutex); \
+    int vfs_scope __attribute__((cleanup(vfs_unlock), unused)) = 0
+
 // Allocate a new in-memory inode
 static vfs_node_t *alloc_inode(void) {
     if (inode_count >= VFS_MAX_INODES) {
@@ -185,11 +201,13 @@ void vfs_init(void) {
 }
 
 // Resolve a path to a node (returns static/cached node - do NOT free)
-// For FAT32, returns a static temp node
+// For FAT32, returns a static temp node that the next lookup on any core
+// overwrites - use vfs_open_handle() to hold on to a file across other calls
 // For in-memory, returns the actual node
 vfs_node_t *vfs_lookup(const char *path) {
     static vfs_node_t temp_node;
     static char stored_path[VFS_MAX_PATH];
+    VFS_LOCKED();
     char fullpath[VFS_MAX_PATH];
 
     // Build full path
@@ -275,6 +293,7 @@ vfs_node_t *vfs_lookup(const char *path) {
 // Open a file handle (allocates - caller must free with vfs_close_handle)
 // This is for kapi->open, NOT for internal kernel lookups
 vfs_node_t *vfs_open_handle(const char *path) {
+    VFS_LOCKED();
     // First do a lookup to check if file exists and get info
     vfs_node_t *temp = vfs_lookup(path);
     if (!temp) return NULL;
@@ -294,12 +313,29 @@ vfs_node_t *vfs_open_handle(const char *path) {
         node->data = path_copy;
     }
 
+    // FAT32 files get a real open-file object with a cached cluster cursor
+    node->fs_handle = NULL;
+    if (use_fat32 && node->type == VFS_FILE && node->data) {
+        fat32_file_t *fh = malloc(sizeof(fat32_file_t));
+        if (fh && fat32_open((const char *)node->data, fh) == 0) {
+            node->fs_handle = fh;
+        } else if (fh) {
+            free(fh);
+        }
+    }
+
     return node;
 }
 
 // Close/free a handle returned by vfs_open_handle
+// Data writes stay in the block cache (the age flush picks them up); closing
+// a FAT32 handle is where they are pushed out.
 void vfs_close_handle(vfs_node_t *node) {
     if (!node) return;
+    if (node->fs_handle) {
+        free(node->fs_handle);
+        fat32_sync();
+    }
     if (node->data) free(node->data);
     free(node);
 }
@@ -309,10 +345,12 @@ vfs_node_t *vfs_get_root(void) {
 }
 
 vfs_node_t *vfs_get_cwd(void) {
+    VFS_LOCKED();
     return vfs_lookup(cwd_path);
 }
 
 int vfs_set_cwd(const char *path) {
+    VFS_LOCKED();
     char fullpath[VFS_MAX_PATH];
 
     if (!path || !path[0]) {
@@ -380,6 +418,7 @@ int vfs_set_cwd(const char *path) {
 }
 
 int vfs_get_cwd_path(char *buf, size_t size) {
+    VFS_LOCKED();
     if (!buf || size == 0) return -1;
     strncpy(buf, cwd_path, size - 1);
     buf[size - 1] = '\0';
@@ -412,6 +451,7 @@ static void readdir_callback(const char *name, int is_dir, uint32_t size, void *
 }
 
 int vfs_readdir(vfs_node_t *dir, int index, char *name, size_t name_size, uint8_t *type) {
+    VFS_LOCKED();
     if (!dir || dir->type != VFS_DIRECTORY || !name) {
         return -1;
     }
@@ -448,6 +488,7 @@ int vfs_readdir(vfs_node_t *dir, int index, char *name, size_t name_size, uint8_
 }
 
 vfs_node_t *vfs_mkdir(const char *path) {
+    VFS_LOCKED();
     if (use_fat32) {
         // Build full path
         char fullpath[VFS_MAX_PATH];
@@ -462,7 +503,9 @@ vfs_node_t *vfs_mkdir(const char *path) {
             }
         }
 
-        if (fat32_mkdir(fullpath) < 0) {
+        int result = fat32_mkdir(fullpath);
+        fat32_sync();
+        if (result < 0) {
             return NULL;
         }
         return vfs_lookup(path);
@@ -507,6 +550,7 @@ vfs_node_t *vfs_mkdir(const char *path) {
 }
 
 vfs_node_t *vfs_create(const char *path) {
+    VFS_LOCKED();
     if (use_fat32) {
         // Build full path
         char fullpath[VFS_MAX_PATH];
@@ -521,7 +565,9 @@ vfs_node_t *vfs_create(const char *path) {
             }
         }
 
-        if (fat32_create_file(fullpath) < 0) {
+        int result = fat32_create_file(fullpath);
+        fat32_sync();
+        if (result < 0) {
             return NULL;
         }
         return vfs_lookup(path);
@@ -566,11 +612,17 @@ vfs_node_t *vfs_create(const char *path) {
 }
 
 int vfs_read(vfs_node_t *file, char *buf, size_t size, size_t offset) {
+    VFS_LOCKED();
     if (!file || file->type != VFS_FILE || !buf) {
         return -1;
     }
 
     if (use_fat32) {
+        // Open handles continue from their cached cluster cursor
+        if (file->fs_handle) {
+            return fat32_read_at((fat32_file_t *)file->fs_handle, buf, size, offset);
+        }
+
         // Get path from node
         const char *filepath = (const char *)file->data;
         if (!filepath) return -1;
@@ -591,6 +643,7 @@ int vfs_read(vfs_node_t *file, char *buf, size_t size, size_t offset) {
 }
 
 int vfs_write(vfs_node_t *file, const char *buf, size_t size) {
+    VFS_LOCKED();
     if (!file || file->type != VFS_FILE) {
         return -1;
     }
@@ -600,7 +653,9 @@ int vfs_write(vfs_node_t *file, const char *buf, size_t size) {
         const char *filepath = (const char *)file->data;
         if (!filepath) return -1;
 
-        return fat32_write_file(filepath, buf, size);
+        int result = fat32_write_file(filepath, buf, size);
+        if (result >= 0) file->size = size;
+        return result;
     }
 
     // In-memory write
@@ -621,38 +676,68 @@ int vfs_write(vfs_node_t *file, const char *buf, size_t size) {
     return (int)size;
 }
 
-int vfs_append(vfs_node_t *file, const char *buf, size_t size) {
+// Positional FAT32 write through the node's open-file state, or through a
+// temporary one for nodes that came from vfs_lookup/vfs_create
+// append != 0 ignores offset and writes at the current end of file
+static int fat32_node_write(vfs_node_t *file, const char *buf, size_t size,
+                            size_t offset, int append) {
+    fat32_file_t tmp;
+    fat32_file_t *fh = (fat32_file_t *)file->fs_handle;
+
+    if (!fh) {
+        const char *filepath = (const char *)file->data;
+        if (!filepath || fat32_open(filepath, &tmp) < 0) return -1;
+        fh = &tmp;
+    }
+
+    int result = append ? fat32_append(fh, buf, size)
+                        : fat32_write_at(fh, buf, size, offset);
+    if (result >= 0) file->size = fh->size;
+    return result;
+}
+
+int vfs_pwrite(vfs_node_t *file, const char *buf, size_t size, size_t offset) {
+    VFS_LOCKED();
     if (!file || file->type != VFS_FILE) {
         return -1;
     }
 
     if (use_fat32) {
-        // Get path from node
-        const char *filepath = (const char *)file->data;
-        if (!filepath) return -1;
-
-        // For append, we need to read existing content, add new data, and write back
-        int file_size = fat32_file_size(filepath);
-        if (file_size < 0) file_size = 0;
+        return fat32_node_write(file, buf, size, offset, 0);
+    }
 
-        char *new_buf = malloc(file_size + size);
-        if (!new_buf) return -1;
+    // In-memory write, growing (and zero-filling any gap) as needed
+    size_t end = offset + size;
+    if (end > file->capacity) {
+        size_t new_cap = end + 64;
+        char *new_data = malloc(new_cap);
+        if (!new_data) return -1;
 
-        // Read existing content
-        if (file_size > 0) {
-            if (fat32_read_file(filepath, new_buf, file_size) < 0) {
-                free(new_buf);
-                return -1;
-            }
+        if (file->data) {
+            memcpy(new_data, file->data, file->size);
+            free(file->data);
         }
+        file->data = new_data;
+        file->capacity = new_cap;
+    }
+
+    if (offset > file->size) {
+        memset(file->data + file->size, 0, offset - file->size);
+    }
+    memcpy(file->data + offset, buf, size);
+    if (end > file->size) file->size = end;
+    return (int)size;
+}
 
-        // Append new data
-        memcpy(new_buf + file_size, buf, size);
+int vfs_append(vfs_node_t *file, const char *buf, size_t size) {
+    VFS_LOCKED();
+    if (!file || file->type != VFS_FILE) {
+        return -1;
+    }
 
-        // Write back
-        int result = fat32_write_file(filepath, new_buf, file_size + size);
-        free(new_buf);
-        return result >= 0 ? (int)size : -1;
+    if (use_fat32) {
+        // Extends the cluster chain in place - the existing data isn't touched
+        return fat32_node_write(file, buf, size, 0, 1);
     }
 
     size_t new_size = file->size + size;
@@ -690,10 +775,13 @@ static void build_fullpath(const char *path, char *fullpath) {
 }
 
 int vfs_delete(const char *path) {
+    VFS_LOCKED();
     if (use_fat32) {
         char fullpath[VFS_MAX_PATH];
         build_fullpath(path, fullpath);
-        return fat32_delete(fullpath);
+        int result = fat32_delete(fullpath);
+        fat32_sync();
+        return result;
     }
 
     // In-memory delete
@@ -760,10 +848,13 @@ int vfs_delete(const char *path) {
 }
 
 int vfs_delete_dir(const char *path) {
+    VFS_LOCKED();
     if (use_fat32) {
         char fullpath[VFS_MAX_PATH];
         build_fullpath(path, fullpath);
-        return fat32_delete_dir(fullpath);
+        int result = fat32_delete_dir(fullpath);
+        fat32_sync();
+        return result;
     }
 
     // In-memory delete directory
@@ -830,10 +921,13 @@ int vfs_delete_dir(const char *path) {
 }
 
 int vfs_delete_recursive(const char *path) {
+    VFS_LOCKED();
     if (use_fat32) {
         char fullpath[VFS_MAX_PATH];
         build_fullpath(path, fullpath);
-        return fat32_delete_recursive(fullpath);
+        int result = fat32_delete_recursive(fullpath);
+        fat32_sync();
+        return result;
     }
 
     // In-memory recursive delete - for now just try delete_dir (doesn't recurse)
@@ -849,6 +943,7 @@ int vfs_delete_recursive(const char *path) {
 }
 
 int vfs_rename(const char *path, const char *newname) {
+    VFS_LOCKED();
     if (use_fat32) {
         // Build full path for old file
         char fullpath[VFS_MAX_PATH];
@@ -869,7 +964,9 @@ int vfs_rename(const char *path, const char *newname) {
             if (*p == '/') basename = p + 1;
         }
 
-        return fat32_rename(fullpath, basename);
+        int result = fat32_rename(fullpath, basename);
+        fat32_sync();
+        return result;
     }
 
     // In-memory rename
@@ -39,6 +39,9 @@ typedef struct vfs_node {
 
     // Tree structure
     struct vfs_node *parent;
+
+    // Backing filesystem open-file state (handles only, NULL otherwise)
+    void *fs_handle;
 } vfs_node_t;
 
 // Initialize the filesystem
@@ -62,6 +65,7 @@ vfs_node_t *vfs_create(const char *path);
 int vfs_read(vfs_node_t *file, char *buf, size_t size, size_t offset);
 int vfs_write(vfs_node_t *file, const char *buf, size_t size);
 int vfs_append(vfs_node_t *file, const char *buf, size_t size);
+int vfs_pwrite(vfs_node_t *file, const char *buf, size_t size, size_t offset);  // Write at offset, extends file
 
 // Delete file
 int vfs_delete(const char *path);
@@ -3,9 +3,17 @@
  *
  * Implements virtio-blk for block device access on QEMU virt machine.
  * Based on virtio 1.0 spec (modern mode).
+ *
+ * Up to MAX_REQS requests can be in flight at once, each a scatter-gather
+ * descriptor chain taken from a free list. Completions are collected by the
+ * virtio IRQ, which wakes blk_wait; callers waiting on one sleep there (or
+ * in wfi from kernel context) instead of spinning. Before interrupts are
+ * enabled at boot the used ring is polled.
  */
 
 #include "virtio_blk.h"
+#include "process.h"
+#include "spinlock.h"
 #include "printf.h"
 #include "string.h"
 
@@ -102,17 +110,42 @@ static virtq_desc_t *desc = NULL;
 static virtq_avail_t *avail = NULL;
 static virtq_used_t *used = NULL;
 static uint64_t device_capacity = 0;
+static int blk_device_index = -1;
+
+// Virtio IRQ base (same as other virtio devices)
+#define VIRTIO_IRQ_BASE 48
 
-#define QUEUE_SIZE 16
+#define QUEUE_SIZE 128
+#define MAX_REQS   32     // Requests in flight at once
 #define DESC_F_NEXT  1
 #define DESC_F_WRITE 2
 
-// Statically allocated memory for virtqueue (4KB aligned)
-static uint8_t queue_mem[4096] __attribute__((aligned(4096)));
+// Give up on a request after 5s (IRQ mode) or this many polls (boot)
+#define REQ_TIMEOUT_TICKS 500
+#define REQ_TIMEOUT_SPINS 10000000
 
-// Request header and status buffers
-static virtio_blk_req_t req_header __attribute__((aligned(16)));
-static uint8_t req_status __attribute__((aligned(16)));
+// Statically allocated memory for virtqueue (4KB aligned)
+// desc at 0, avail at 2048, used at 4096
+static uint8_t queue_mem[8192] __attribute__((aligned(4096)));
+static uint16_t queue_num = 0;
+
+// Descriptor free list (linked through desc[].next)
+static uint16_t free_head = 0;
+static uint16_t num_free = 0;
+static uint16_t last_used_idx = 0;
+
+// Per-request header and status (one slot per in-flight request)
+typedef struct {
+    virtio_blk_req_t header;
+    volatile uint8_t status;
+    volatile uint8_t done;      // Set when the device hands the chain back
+    uint8_t in_use;
+    uint8_t abandoned;          // Waiter timed out or died; free the slot on completion
+    int owner;                  // pid that queued it, 0 for kernel context
+} blk_slot_t;
+
+static blk_slot_t slots[MAX_REQS] __attribute__((aligned(16)));
+static uint8_t desc_slot[QUEUE_SIZE];   // Head descriptor -> slot
 
 // Memory barriers for device communication
 static inline void mb(void) {
@@ -131,6 +164,25 @@ static inline void write32(volatile uint32_t *addr, uint32_t val) {
     mb();
 }
 
+// Guards the rings, descriptor free list and request slots against the
+// IRQ handler and against callers on other cores
+static spinlock_t blk_lock = SPINLOCK_INIT;
+
+// Woken when requests complete or a slot is released. Waiters read seq
+// under blk_lock before checking their slot, so no wakeup is lost.
+static wait_queue_t blk_wait = WAIT_QUEUE_INIT;
+
+// Mask IRQs and take the queue lock, returning the previous DAIF
+static inline uint64_t irq_save(void) {
+    return spin_lock_irqsave(&blk_lock);
+}
+
+static inline void irq_restore(uint64_t daif) {
+    spin_unlock_irqrestore(&blk_lock, daif);
+}
+
+#define DAIF_IRQ_MASKED (1 << 7)
+
 static volatile uint32_t *find_virtio_blk(void) {
     for (int i = 0; i < 32; i++) {
         volatile uint32_t *base = (volatile uint32_t *)(VIRTIO_MMIO_BASE + i * VIRTIO_MMIO_STRIDE);
@@ -139,6 +191,7 @@ static volatile uint32_t *find_virtio_blk(void) {
         uint32_t device_id = read32(base + VIRTIO_MMIO_DEVICE_ID/4);
 
         if (magic == 0x74726976 && device_id == VIRTIO_DEV_BLK) {
+            blk_device_index = i;
             return base;
         }
     }
@@ -188,17 +241,26 @@ int virtio_blk_init(void) {
     // Setup virtqueue 0
     write32(blk_base + VIRTIO_MMIO_QUEUE_SEL/4, 0);
     uint32_t max_queue = read32(blk_base + VIRTIO_MMIO_QUEUE_NUM_MAX/4);
-    if (max_queue < QUEUE_SIZE) {
+    if (max_queue < 4) {
         printf("[BLK] Queue too small\n");
         return -1;
     }
+    queue_num = max_queue < QUEUE_SIZE ? max_queue : QUEUE_SIZE;
 
-    write32(blk_base + VIRTIO_MMIO_QUEUE_NUM/4, QUEUE_SIZE);
+    write32(blk_base + VIRTIO_MMIO_QUEUE_NUM/4, queue_num);
 
     // Setup queue memory
     desc = (virtq_desc_t *)queue_mem;
     avail = (virtq_avail_t *)(queue_mem + QUEUE_SIZE * sizeof(virtq_desc_t));
-    used = (virtq_used_t *)(queue_mem + 2048);
+    used = (virtq_used_t *)(queue_mem + 4096);
+
+    // All descriptors start on the free list
+    for (uint16_t i = 0; i < queue_num; i++) {
+        desc[i].next = i + 1;
+    }
+    free_head = 0;
+    num_free = queue_num;
+    last_used_idx = 0;
 
     uint64_t desc_addr = (uint64_t)desc;
     uint64_t avail_addr = (uint64_t)avail;
@@ -224,87 +286,301 @@ int virtio_blk_init(void) {
         return -1;
     }
 
-    printf("[BLK] Ready (%d MB)\n", (uint32_t)(device_capacity / 2048));
+    printf("[BLK] Ready (%d MB, queue %d)\n", (uint32_t)(device_capacity / 2048), queue_num);
     return 0;
 }
 
-// Perform a block request (read or write)
-static int do_request(uint32_t type, uint64_t sector, uint32_t count, void *buf) {
-    if (!blk_base) return -1;
-    if (sector + count > device_capacity) return -1;
+// Return a completed chain to the free list
+static void free_chain(uint16_t head) {
+    uint16_t i = head;
+    uint16_t n = 1;
+    while (desc[i].flags & DESC_F_NEXT) {
+        i = desc[i].next;
+        n++;
+    }
+    desc[i].next = free_head;
+    free_head = head;
+    num_free += n;
+}
 
-    // Setup request header
-    req_header.type = type;
-    req_header.reserved = 0;
-    req_header.sector = sector;
+// Collect finished requests from the used ring and wake their waiters
+// (queue locked)
+static void reap_used(void) {
+    int reaped = 0;
+    while (last_used_idx != *(volatile uint16_t *)&used->idx) {
+        mb();
+        uint16_t head = (uint16_t)used->ring[last_used_idx % queue_num].id;
+        blk_slot_t *slot = &slots[desc_slot[head]];
+
+        free_chain(head);
+        slot->done = 1;
+        if (slot->abandoned) {
+            slot->abandoned = 0;
+            slot->in_use = 0;
+        }
+        last_used_idx++;
+        reaped = 1;
+    }
+    if (reaped) wait_queue_wake(&blk_wait);
+}
+
+// Slots whose owner has gone are released here rather than leaked: done
+// ones at once, in-flight ones when the device hands them back (queue locked)
+static void reclaim_orphans(void) {
+    for (int i = 0; i < MAX_REQS; i++) {
+        blk_slot_t *slot = &slots[i];
+        if (!slot->in_use || slot->abandoned || slot->owner <= 0) continue;
+        if (process_get(slot->owner)) continue;
+        if (slot->done) {
+            slot->in_use = 0;
+        } else {
+            slot->abandoned = 1;
+        }
+    }
+}
+
+static uint16_t alloc_desc(void) {
+    uint16_t d = free_head;
+    free_head = desc[d].next;
+    num_free--;
+    return d;
+}
+
+// queue_request() result when there is no room right now
+#define QUEUE_FULL (-2)
+
+// Put one request on the available ring (device is not notified yet)
+// Returns slot index, QUEUE_FULL, or -1 on a bad request
+static int queue_request(int write, const hal_blk_req_t *req) {
+    if (req->nsegs <= 0 || req->nsegs + 2 > queue_num) return -1;
+
+    uint64_t count = 0;
+    for (int i = 0; i < req->nsegs; i++) count += req->segs[i].count;
+    if (req->sector + count > device_capacity) return -1;
 
-    // Clear status
-    req_status = 0xff;
+    uint64_t flags = irq_save();
+    reclaim_orphans();
 
-    // Setup descriptor chain:
-    // desc[0]: request header (device reads)
-    // desc[1]: data buffer (device reads or writes depending on request type)
-    // desc[2]: status byte (device writes)
+    int s = -1;
+    if (num_free >= req->nsegs + 2) {
+        for (int i = 0; i < MAX_REQS; i++) {
+            if (!slots[i].in_use) {
+                s = i;
+                break;
+            }
+        }
+    }
+    if (s < 0) {
+        irq_restore(flags);
+        return QUEUE_FULL;
+    }
 
-    desc[0].addr = (uint64_t)&req_header;
-    desc[0].len = sizeof(virtio_blk_req_t);
-    desc[0].flags = DESC_F_NEXT;
-    desc[0].next = 1;
+    blk_slot_t *slot = &slots[s];
+    slot->in_use = 1;
+    slot->done = 0;
+    slot->abandoned = 0;
+    process_t *owner = current_process;
+    slot->owner = owner ? owner->pid : 0;
+    slot->status = 0xff;
+    slot->header.type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    slot->header.reserved = 0;
+    slot->header.sector = req->sector;
+
+    // Descriptor chain:
+    // header (device reads), data segments (device reads or writes), status (device writes)
+    uint16_t head = alloc_desc();
+    desc[head].addr = (uint64_t)&slot->header;
+    desc[head].len = sizeof(virtio_blk_req_t);
+    desc[head].flags = DESC_F_NEXT;
+
+    uint16_t prev = head;
+    for (int i = 0; i < req->nsegs; i++) {
+        uint16_t d = alloc_desc();
+        desc[prev].next = d;
+        desc[d].addr = (uint64_t)req->segs[i].buf;
+        desc[d].len = req->segs[i].count * 512;
+        desc[d].flags = DESC_F_NEXT | (write ? 0 : DESC_F_WRITE);
+        prev = d;
+    }
 
-    desc[1].addr = (uint64_t)buf;
-    desc[1].len = count * 512;
-    desc[1].flags = DESC_F_NEXT | (type == VIRTIO_BLK_T_IN ? DESC_F_WRITE : 0);
-    desc[1].next = 2;
+    uint16_t d = alloc_desc();
+    desc[prev].next = d;
+    desc[d].addr = (uint64_t)&slot->status;
+    desc[d].len = 1;
+    desc[d].flags = DESC_F_WRITE;
+    desc[d].next = 0;
 
-    desc[2].addr = (uint64_t)&req_status;
-    desc[2].len = 1;
-    desc[2].flags = DESC_F_WRITE;
-    desc[2].next = 0;
+    desc_slot[head] = s;
 
     // Add to available ring
     mb();
-    uint16_t old_used_idx = used->idx;
-    uint16_t avail_slot = avail->idx % QUEUE_SIZE;
-    avail->ring[avail_slot] = 0;  // First descriptor in chain
+    avail->ring[avail->idx % queue_num] = head;
     mb();
     avail->idx++;
     mb();
 
-    // Notify device
+    irq_restore(flags);
+    return s;
+}
+
+// Notify device
+static void kick(void) {
     write32(blk_base + VIRTIO_MMIO_QUEUE_NOTIFY/4, 0);
+}
 
-    // Poll for completion - wait for used->idx to change
-    int timeout = 10000000;
-    while (used->idx == old_used_idx && timeout > 0) {
-        mb();
-        timeout--;
+// Give up the CPU until something happens on the queue, or for at most
+// ticks. Called with the queue locked (flags = DAIF saved by irq_save) and
+// seq = blk_wait.seq read under the lock; unlocks.
+// Returns 1 if interrupts are off and the caller has to poll instead.
+static int blk_sleep(uint64_t flags, uint32_t seq, uint32_t ticks) {
+    if (flags & DAIF_IRQ_MASKED) {
+        // Interrupts not running yet (boot) - poll the used ring
+        irq_restore(flags);
+        return 1;
     }
+    if (current_process) {
+        // Block until the IRQ handler reaps a completion
+        irq_restore(flags);
+        wait_queue_sleep(&blk_wait, seq, ticks);
+    } else {
+        // Kernel context: sleep until an interrupt (wfi wakes on a pending
+        // IRQ even while masked, so the completion can't slip past us).
+        // Drop the lock first so other cores can still queue requests.
+        spin_unlock(&blk_lock);
+        asm volatile("wfi");
+        asm volatile("msr daif, %0" :: "r"(flags) : "memory");
+    }
+    return 0;
+}
+
+// Wait for a queued request to finish and release its slot
+static int wait_request(int s) {
+    blk_slot_t *slot = &slots[s];
+    uint64_t start = hal_timer_get_ticks();
+    uint32_t spins = 0;
+
+    for (;;) {
+        uint64_t flags = irq_save();
+        uint32_t seq = blk_wait.seq;
+        reap_used();
+        if (slot->done) {
+            irq_restore(flags);
+            break;
+        }
+        uint64_t waited = hal_timer_get_ticks() - start;
+        uint32_t left = waited < REQ_TIMEOUT_TICKS ? REQ_TIMEOUT_TICKS - waited : 1;
+        if (blk_sleep(flags, seq, left)) {
+            if (++spins < REQ_TIMEOUT_SPINS) continue;
+        } else if (hal_timer_get_ticks() - start < REQ_TIMEOUT_TICKS) {
+            continue;
+        }
 
-    if (timeout == 0) {
         printf("[BLK] Request timed out!\n");
+        flags = irq_save();
+        if (slot->done) {
+            slot->in_use = 0;
+        } else {
+            slot->abandoned = 1;
+        }
+        irq_restore(flags);
         return -1;
     }
 
-    // Ack interrupt
-    write32(blk_base + VIRTIO_MMIO_INTERRUPT_ACK/4, read32(blk_base + VIRTIO_MMIO_INTERRUPT_STATUS/4));
+    mb();
+    uint8_t status = slot->status;
+
+    // Someone may be waiting for a free slot
+    uint64_t flags = irq_save();
+    slot->in_use = 0;
+    irq_restore(flags);
+    wait_queue_wake(&blk_wait);
 
-    // Check status
-    if (req_status != VIRTIO_BLK_S_OK) {
-        printf("[BLK] Request failed with status %d\n", req_status);
+    if (status != VIRTIO_BLK_S_OK) {
+        printf("[BLK] Request failed with status %d\n", status);
         return -1;
     }
-
     return 0;
 }
 
+int virtio_blk_rw_batch(int write, const hal_blk_req_t *reqs, int n) {
+    if (!blk_base) return -1;
+
+    // Slots we have in flight, oldest first
+    int pending[MAX_REQS];
+    int first = 0;
+    int npending = 0;
+    int need_kick = 0;
+    int result = 0;
+    int i = 0;
+
+    while (i < n || npending > 0) {
+        if (i < n) {
+            int s = queue_request(write, &reqs[i]);
+            if (s >= 0) {
+                pending[(first + npending) % MAX_REQS] = s;
+                npending++;
+                need_kick = 1;
+                i++;
+                continue;
+            }
+            if (s != QUEUE_FULL) {
+                result = -1;
+                i++;
+                continue;
+            }
+            // Queue full - retire something before trying again
+        }
+
+        if (need_kick) {
+            kick();
+            need_kick = 0;
+        }
+
+        if (npending > 0) {
+            if (wait_request(pending[first]) < 0) result = -1;
+            first = (first + 1) % MAX_REQS;
+            npending--;
+        } else {
+            // Every slot belongs to another caller's requests
+            uint64_t flags = irq_save();
+            uint32_t seq = blk_wait.seq;
+            reap_used();
+            blk_sleep(flags, seq, 1);
+        }
+    }
+
+    return result;
+}
+
 int virtio_blk_read(uint64_t sector, uint32_t count, void *buf) {
-    return do_request(VIRTIO_BLK_T_IN, sector, count, buf);
+    hal_blk_seg_t seg = { buf, count };
+    hal_blk_req_t req = { sector, &seg, 1 };
+    return virtio_blk_rw_batch(0, &req, 1);
 }
 
 int virtio_blk_write(uint64_t sector, uint32_t count, const void *buf) {
-    return do_request(VIRTIO_BLK_T_OUT, sector, count, (void *)buf);
+    hal_blk_seg_t seg = { (void *)buf, count };
+    hal_blk_req_t req = { sector, &seg, 1 };
+    return virtio_blk_rw_batch(1, &req, 1);
 }
 
 uint64_t virtio_blk_get_capacity(void) {
     return device_capacity;
 }
+
+uint32_t virtio_blk_get_irq(void) {
+    if (blk_device_index < 0) return 0;
+    return VIRTIO_IRQ_BASE + blk_device_index;
+}
+
+void virtio_blk_irq_handler(void) {
+    if (!blk_base) return;
+
+    write32(blk_base + VIRTIO_MMIO_INTERRUPT_ACK/4,
+            read32(blk_base + VIRTIO_MMIO_INTERRUPT_STATUS/4));
+
+    // Mark finished requests and wake their waiters
+    spin_lock(&blk_lock);
+    reap_used();
+    spin_unlock(&blk_lock);
+}
@@ -9,6 +9,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "hal/hal.h"
 
 // Initialize the virtio-blk device
 int virtio_blk_init(void);
@@ -27,7 +28,19 @@ int virtio_blk_read(uint64_t sector, uint32_t count, void *buf);
 // Returns 0 on success, -1 on error
 int virtio_blk_write(uint64_t sector, uint32_t count, const void *buf);
 
+// Run a batch of scatter-gather requests, keeping as many in flight as the
+// queue allows. Waiting callers yield until the completion IRQ.
+// write: 0 = read into segments, 1 = write from them
+// Returns 0 if every request succeeded, -1 otherwise
+int virtio_blk_rw_batch(int write, const hal_blk_req_t *reqs, int n);
+
 // Get the total number of sectors on the device
 uint64_t virtio_blk_get_capacity(void);
 
+// IRQ handler (collects completed requests)
+void virtio_blk_irq_handler(void);
+
+// Get the block device's IRQ number
+uint32_t virtio_blk_get_irq(void);
+
 #endif
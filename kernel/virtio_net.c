@@ -6,6 +6,7 @@
  */
 
 #include "virtio_net.h"
+#include "net.h"
 #include "printf.h"
 #include "string.h"
 
@@ -48,7 +49,14 @@
 #define VIRTIO_DEV_NET  1
 
 // Virtio net feature bits
+#define VIRTIO_NET_F_CSUM       (1 << 0)   // Device fills in checksums we leave partial
+#define VIRTIO_NET_F_GUEST_CSUM (1 << 1)   // Device may hand us checked (or partial) packets
 #define VIRTIO_NET_F_MAC        (1 << 5)   // Device has given MAC address
+#define VIRTIO_NET_F_MRG_RXBUF  (1 << 15)  // Device may spread a packet over several RX buffers
+
+// Virtio net header flags
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM  1     // Checksum from csum_start still to be done
+#define VIRTIO_NET_HDR_F_DATA_VALID  2     // Device already checked the checksum
 
 // Virtio net header (prepended to every packet)
 typedef struct __attribute__((packed)) {
@@ -58,9 +66,14 @@ typedef struct __attribute__((packed)) {
     uint16_t gso_size;
     uint16_t csum_start;
     uint16_t csum_offset;
-    // uint16_t num_buffers;  // Only present if VIRTIO_NET_F_MRG_RXBUF
+    uint16_t num_buffers;  // Only present if VIRTIO_NET_F_MRG_RXBUF
 } virtio_net_hdr_t;
 
+// Ring flags: the device doesn't want kicks right now / we don't want
+// interrupts for this queue
+#define VIRTQ_USED_F_NO_NOTIFY      1
+#define VIRTQ_AVAIL_F_NO_INTERRUPT  1
+
 // Virtqueue structures
 typedef struct __attribute__((packed)) {
     uint64_t addr;
@@ -93,43 +106,70 @@ static int net_device_index = -1;
 // MAC address
 static uint8_t mac_addr[6];
 
+// Features we negotiated
+static uint32_t net_features = 0;
+
+// Bytes of virtio_net_hdr_t in front of every frame: num_buffers is only
+// there with MRG_RXBUF
+static uint32_t net_hdr_len = sizeof(virtio_net_hdr_t) - 2;
+
+// Ring sizes we'd like; a device offering less gets its maximum
+#define RX_QUEUE_SIZE 128
+#define TX_QUEUE_SIZE 64
+#define DESC_F_NEXT  1
+#define DESC_F_WRITE 2
+
+// Every buffer holds a header and a whole frame, so packets only span
+// buffers if the device decides to split them
+#define NET_BUF_SIZE 2048
+
+// Kick the device once this many frames are waiting (or the ring is
+// full), without waiting for virtio_net_kick()
+#define TX_BATCH 32
+
 // Receive queue (queue 0)
 static virtq_desc_t *rx_desc = NULL;
 static virtq_avail_t *rx_avail = NULL;
 static virtq_used_t *rx_used = NULL;
+static uint16_t rx_size = 0;
 static uint16_t rx_last_used_idx = 0;
-
-// Transmit queue (queue 1)
+static uint16_t rx_avail_idx = 0;       // Our copy of rx_avail->idx
+static int rx_kick_pending = 0;         // Buffers returned since the last kick
+
+// The frame virtio_net_rx_peek() handed out: how many buffers it took up
+// (0 = none out), and where it is - in place, or gathered into
+// rx_merge_buf when the device spread it over several
+static uint16_t rx_cur_bufs = 0;
+static const uint8_t *rx_cur_frame = NULL;
+static int rx_cur_len = 0;
+static uint8_t rx_cur_flags = 0;
+static uint8_t rx_merge_buf[NET_MTU];
+
+// Transmit queue (queue 1). Descriptor i always points at tx_buffers[i];
+// the free ones are stacked in tx_free. Sent buffers are only taken back
+// from the used ring when the stack runs dry.
 static virtq_desc_t *tx_desc = NULL;
 static virtq_avail_t *tx_avail = NULL;
 static virtq_used_t *tx_used = NULL;
+static uint16_t tx_size = 0;
+static uint16_t tx_last_used_idx = 0;
+static uint16_t tx_avail_idx = 0;       // Our copy of tx_avail->idx
+static uint16_t tx_kicked_idx = 0;      // tx_avail_idx at the last kick
+static uint16_t tx_free[TX_QUEUE_SIZE];
+static int tx_free_count = 0;
 
-#define QUEUE_SIZE 16
-#define DESC_F_NEXT  1
-#define DESC_F_WRITE 2
+static virtio_net_stats_t drv_stats;
 
 // Virtio IRQ base (same as other virtio devices)
 #define VIRTIO_IRQ_BASE 48
 
-// Queue memory (4KB aligned)
-static uint8_t rx_queue_mem[4096] __attribute__((aligned(4096)));
-static uint8_t tx_queue_mem[4096] __attribute__((aligned(4096)));
-
-// Receive buffers: virtio header + ethernet frame
-typedef struct __attribute__((aligned(16))) {
-    virtio_net_hdr_t hdr;
-    uint8_t data[NET_MTU];
-} rx_buffer_t;
+// Queue memory (4KB aligned): descriptors and the available ring in the
+// first page, the used ring in the second
+static uint8_t rx_queue_mem[8192] __attribute__((aligned(4096)));
+static uint8_t tx_queue_mem[8192] __attribute__((aligned(4096)));
 
-static rx_buffer_t rx_buffers[QUEUE_SIZE] __attribute__((aligned(16)));
-
-// Transmit buffer (single, reused)
-typedef struct __attribute__((aligned(16))) {
-    virtio_net_hdr_t hdr;
-    uint8_t data[NET_MTU];
-} tx_buffer_t;
-
-static tx_buffer_t tx_buffer __attribute__((aligned(16)));
+static uint8_t rx_buffers[RX_QUEUE_SIZE][NET_BUF_SIZE] __attribute__((aligned(64)));
+static uint8_t tx_buffers[TX_QUEUE_SIZE][NET_BUF_SIZE] __attribute__((aligned(64)));
 
 // Memory barriers for device communication
 static inline void mb(void) {
@@ -164,23 +204,26 @@ static volatile uint32_t *find_virtio_net(void) {
     return NULL;
 }
 
-// Setup a virtqueue
-static int setup_queue(int queue_idx, uint8_t *queue_mem,
-                       virtq_desc_t **desc_out, virtq_avail_t **avail_out, virtq_used_t **used_out) {
+// Setup a virtqueue of up to want entries. Returns the size it got, 0 on error.
+static uint16_t setup_queue(int queue_idx, uint8_t *queue_mem, uint16_t want,
+                            virtq_desc_t **desc_out, virtq_avail_t **avail_out, virtq_used_t **used_out) {
     write32(net_base + VIRTIO_MMIO_QUEUE_SEL/4, queue_idx);
 
+    // Ring arithmetic wants a power of two
     uint32_t max_queue = read32(net_base + VIRTIO_MMIO_QUEUE_NUM_MAX/4);
-    if (max_queue < QUEUE_SIZE) {
+    uint16_t size = want;
+    while (size > max_queue) size /= 2;
+    if (size < 8) {
         printf("[NET] Queue %d too small (max=%d)\n", queue_idx, max_queue);
-        return -1;
+        return 0;
     }
 
-    write32(net_base + VIRTIO_MMIO_QUEUE_NUM/4, QUEUE_SIZE);
+    write32(net_base + VIRTIO_MMIO_QUEUE_NUM/4, size);
 
     // Setup queue memory layout
     *desc_out = (virtq_desc_t *)queue_mem;
-    *avail_out = (virtq_avail_t *)(queue_mem + QUEUE_SIZE * sizeof(virtq_desc_t));
-    *used_out = (virtq_used_t *)(queue_mem + 2048);
+    *avail_out = (virtq_avail_t *)(queue_mem + size * sizeof(virtq_desc_t));
+    *used_out = (virtq_used_t *)(queue_mem + 4096);
 
     uint64_t desc_addr = (uint64_t)*desc_out;
     uint64_t avail_addr = (uint64_t)*avail_out;
@@ -198,7 +241,7 @@ static int setup_queue(int queue_idx, uint8_t *queue_mem,
 
     write32(net_base + VIRTIO_MMIO_QUEUE_READY/4, 1);
 
-    return 0;
+    return size;
 }
 
 int virtio_net_init(void) {
@@ -230,9 +273,16 @@ int virtio_net_init(void) {
     uint32_t features = read32(net_base + VIRTIO_MMIO_DEVICE_FEATURES/4);
     printf("[NET] Device features: 0x%x\n", features);
 
-    // Accept MAC feature only (don't need checksums, GSO, etc)
+    // Take the MAC, checksum offload both ways and mergeable receive
+    // buffers if the device has them. No GSO - segments are never bigger
+    // than a frame.
+    net_features = VIRTIO_NET_F_MAC |
+                   (features & (VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM |
+                                VIRTIO_NET_F_MRG_RXBUF));
+    net_hdr_len = (net_features & VIRTIO_NET_F_MRG_RXBUF) ?
+                  sizeof(virtio_net_hdr_t) : sizeof(virtio_net_hdr_t) - 2;
     write32(net_base + VIRTIO_MMIO_DRIVER_FEATURES_SEL/4, 0);
-    write32(net_base + VIRTIO_MMIO_DRIVER_FEATURES/4, VIRTIO_NET_F_MAC);
+    write32(net_base + VIRTIO_MMIO_DRIVER_FEATURES/4, net_features);
 
     write32(net_base + VIRTIO_MMIO_STATUS/4,
             VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_FEATURES_OK);
@@ -251,27 +301,47 @@ int virtio_net_init(void) {
     printf("[NET] MAC: %02x:%02x:%02x:%02x:%02x:%02x\n",
            mac_addr[0], mac_addr[1], mac_addr[2],
            mac_addr[3], mac_addr[4], mac_addr[5]);
+    printf("[NET] Checksum offload: tx %s, rx %s; mergeable rx buffers %s\n",
+           (net_features & VIRTIO_NET_F_CSUM) ? "on" : "off",
+           (net_features & VIRTIO_NET_F_GUEST_CSUM) ? "on" : "off",
+           (net_features & VIRTIO_NET_F_MRG_RXBUF) ? "on" : "off");
 
     // Setup receive queue (queue 0)
-    if (setup_queue(0, rx_queue_mem, &rx_desc, &rx_avail, &rx_used) < 0) {
+    rx_size = setup_queue(0, rx_queue_mem, RX_QUEUE_SIZE, &rx_desc, &rx_avail, &rx_used);
+    if (!rx_size) {
         return -1;
     }
 
     // Setup transmit queue (queue 1)
-    if (setup_queue(1, tx_queue_mem, &tx_desc, &tx_avail, &tx_used) < 0) {
+    tx_size = setup_queue(1, tx_queue_mem, TX_QUEUE_SIZE, &tx_desc, &tx_avail, &tx_used);
+    if (!tx_size) {
         return -1;
     }
+    printf("[NET] Queues: %d rx, %d tx buffers\n", rx_size, tx_size);
 
     // Pre-populate receive queue with buffers
-    for (int i = 0; i < QUEUE_SIZE; i++) {
-        rx_desc[i].addr = (uint64_t)&rx_buffers[i];
-        rx_desc[i].len = sizeof(rx_buffer_t);
+    for (int i = 0; i < rx_size; i++) {
+        rx_desc[i].addr = (uint64_t)rx_buffers[i];
+        rx_desc[i].len = NET_BUF_SIZE;
         rx_desc[i].flags = DESC_F_WRITE;  // Device writes to this buffer
         rx_desc[i].next = 0;
 
         rx_avail->ring[i] = i;
     }
-    rx_avail->idx = QUEUE_SIZE;
+    rx_avail_idx = rx_size;
+    rx_avail->idx = rx_avail_idx;
+
+    // Transmit descriptors are fixed too. Sent buffers are reclaimed by
+    // polling, so no interrupts for them.
+    for (int i = 0; i < tx_size; i++) {
+        tx_desc[i].addr = (uint64_t)tx_buffers[i];
+        tx_desc[i].len = 0;
+        tx_desc[i].flags = 0;  // Device reads from this buffer
+        tx_desc[i].next = 0;
+        tx_free[i] = tx_size - 1 - i;
+    }
+    tx_free_count = tx_size;
+    tx_avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
     mb();
 
     // Set driver OK
@@ -286,7 +356,6 @@ int virtio_net_init(void) {
     }
 
     // Notify device that receive buffers are available
-    write32(net_base + VIRTIO_MMIO_QUEUE_SEL/4, 0);
     write32(net_base + VIRTIO_MMIO_QUEUE_NOTIFY/4, 0);
 
     printf("[NET] Ready\n");
@@ -299,53 +368,93 @@ void virtio_net_get_mac(uint8_t *mac) {
     }
 }
 
-int virtio_net_send(const void *data, uint32_t len) {
-    if (!net_base) return -1;
-    if (len > NET_MTU) return -1;
-
-    // Prepare virtio header (all zeros - no offloads)
-    memset(&tx_buffer.hdr, 0, sizeof(virtio_net_hdr_t));
+int virtio_net_csum_offload(void) {
+    return (net_features & VIRTIO_NET_F_CSUM) != 0;
+}
 
-    // Copy data
-    memcpy(tx_buffer.data, data, len);
+int virtio_net_send(const void *data, uint32_t len) {
+    return virtio_net_sendv(data, len, NULL, 0, 0, 0);
+}
 
-    // Setup descriptor chain: header + data in one buffer
-    tx_desc[0].addr = (uint64_t)&tx_buffer;
-    tx_desc[0].len = sizeof(virtio_net_hdr_t) + len;
-    tx_desc[0].flags = 0;  // Device reads from this buffer
-    tx_desc[0].next = 0;
+int virtio_net_send_csum(const void *data, uint32_t len, uint16_t csum_start, uint16_t csum_offset) {
+    return virtio_net_sendv(data, len, NULL, 0, csum_start, csum_offset);
+}
 
-    // Add to available ring
-    mb();
-    uint16_t avail_idx = tx_avail->idx % QUEUE_SIZE;
-    tx_avail->ring[avail_idx] = 0;
-    mb();
-    tx_avail->idx++;
+// Take back the buffers the device has finished sending
+static void tx_reclaim(void) {
     mb();
+    while (tx_last_used_idx != tx_used->idx) {
+        uint32_t id = tx_used->ring[tx_last_used_idx % tx_size].id;
+        tx_free[tx_free_count++] = id;
+        tx_last_used_idx++;
+    }
+}
 
-    // Save used index for polling
-    uint16_t old_used = tx_used->idx;
+void virtio_net_kick(void) {
+    if (!net_base) return;
 
-    // Notify device (select queue 1 first)
-    write32(net_base + VIRTIO_MMIO_QUEUE_SEL/4, 1);
-    write32(net_base + VIRTIO_MMIO_QUEUE_NOTIFY/4, 1);
+    // The flags are the device's to set: read them only after our index
+    // updates are visible
+    mb();
+    if (tx_avail_idx != tx_kicked_idx) {
+        tx_kicked_idx = tx_avail_idx;
+        if (!(tx_used->flags & VIRTQ_USED_F_NO_NOTIFY)) {
+            write32(net_base + VIRTIO_MMIO_QUEUE_NOTIFY/4, 1);
+            drv_stats.tx_kicks++;
+        }
+    }
+    if (rx_kick_pending) {
+        rx_kick_pending = 0;
+        if (!(rx_used->flags & VIRTQ_USED_F_NO_NOTIFY)) {
+            write32(net_base + VIRTIO_MMIO_QUEUE_NOTIFY/4, 0);
+        }
+    }
+}
 
-    // Poll for completion
-    int timeout = 1000000;
-    while (tx_used->idx == old_used && timeout > 0) {
-        mb();
-        timeout--;
+int virtio_net_sendv(const void *head, uint32_t head_len, const void *data, uint32_t len,
+                     uint16_t csum_start, uint16_t csum_offset) {
+    if (!net_base) return -1;
+    if (head_len + len > NET_MTU) return -1;
+
+    if (!tx_free_count) tx_reclaim();
+    if (!tx_free_count) {
+        // Ring full: make sure the device is working on it, then wait
+        drv_stats.tx_ring_full++;
+        virtio_net_kick();
+        int timeout = 1000000;
+        while (!tx_free_count && --timeout > 0) tx_reclaim();
+        if (!tx_free_count) {
+            printf("[NET] TX timeout\n");
+            return -1;
+        }
     }
 
-    if (timeout == 0) {
-        printf("[NET] TX timeout\n");
-        return -1;
+    uint16_t id = tx_free[--tx_free_count];
+    uint8_t *buf = tx_buffers[id];
+
+    // Prepare virtio header: no GSO, and a checksum for the device to
+    // finish if the caller left one partial
+    virtio_net_hdr_t *hdr = (virtio_net_hdr_t *)buf;
+    memset(hdr, 0, net_hdr_len);
+    if (csum_offset && (net_features & VIRTIO_NET_F_CSUM)) {
+        hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        hdr->csum_start = csum_start;
+        hdr->csum_offset = csum_offset;
     }
 
-    // Ack interrupt
-    write32(net_base + VIRTIO_MMIO_INTERRUPT_ACK/4,
-            read32(net_base + VIRTIO_MMIO_INTERRUPT_STATUS/4));
+    // Copy the frame in, straight from its two parts
+    memcpy(buf + net_hdr_len, head, head_len);
+    if (len) memcpy(buf + net_hdr_len + head_len, data, len);
+    tx_desc[id].len = net_hdr_len + head_len + len;
 
+    // Add to available ring; the device hears about it on the next kick
+    tx_avail->ring[tx_avail_idx % tx_size] = id;
+    tx_avail_idx++;
+    mb();
+    tx_avail->idx = tx_avail_idx;
+    drv_stats.tx_frames++;
+
+    if ((uint16_t)(tx_avail_idx - tx_kicked_idx) >= TX_BATCH || !tx_free_count) virtio_net_kick();
     return 0;
 }
 
@@ -355,59 +464,125 @@ int virtio_net_has_packet(void) {
     return rx_used->idx != rx_last_used_idx;
 }
 
-int virtio_net_recv(void *buf, uint32_t maxlen) {
+int virtio_net_rx_peek(const uint8_t **frame) {
     if (!net_base) return -1;
 
+    // Still holding the last one
+    if (rx_cur_bufs) {
+        *frame = rx_cur_frame;
+        return rx_cur_len;
+    }
+
     mb();
-    if (rx_used->idx == rx_last_used_idx) {
+    uint16_t ready = rx_used->idx - rx_last_used_idx;
+    if (ready == 0) {
         return 0;  // No packet
     }
 
-    // Get the completed descriptor
-    uint16_t used_idx = rx_last_used_idx % QUEUE_SIZE;
-    uint32_t desc_idx = rx_used->ring[used_idx].id;
-    uint32_t total_len = rx_used->ring[used_idx].len;
+    // Get the completed descriptor, skip the virtio header
+    virtq_used_elem_t *elem = &rx_used->ring[rx_last_used_idx % rx_size];
+    const uint8_t *buf = rx_buffers[elem->id];
+    const virtio_net_hdr_t *hdr = (const virtio_net_hdr_t *)buf;
+    uint32_t total_len = elem->len;
+    if (total_len < net_hdr_len) total_len = net_hdr_len;
+    if (total_len > NET_BUF_SIZE) total_len = NET_BUF_SIZE;
+
+    uint16_t nbufs = 1;
+    if (net_features & VIRTIO_NET_F_MRG_RXBUF) {
+        nbufs = hdr->num_buffers ? hdr->num_buffers : 1;
+        if (nbufs > ready) return 0;  // The rest isn't in yet
+    }
+
+    rx_cur_bufs = nbufs;
+    rx_cur_flags = hdr->flags;
+    rx_cur_frame = buf + net_hdr_len;
+    rx_cur_len = total_len - net_hdr_len;
+
+    if (nbufs > 1) {
+        // Spread over several buffers: gather it up. Only the first has
+        // a header.
+        drv_stats.rx_merged++;
+        uint32_t n = rx_cur_len < NET_MTU ? rx_cur_len : NET_MTU;
+        memcpy(rx_merge_buf, rx_cur_frame, n);
+        for (uint16_t i = 1; i < nbufs; i++) {
+            elem = &rx_used->ring[(uint16_t)(rx_last_used_idx + i) % rx_size];
+            uint32_t part = elem->len;
+            if (part > NET_BUF_SIZE) part = NET_BUF_SIZE;
+            if (part > NET_MTU - n) part = NET_MTU - n;
+            memcpy(rx_merge_buf + n, rx_buffers[elem->id], part);
+            n += part;
+        }
+        rx_cur_frame = rx_merge_buf;
+        rx_cur_len = n;
+    }
 
-    rx_last_used_idx++;
+    drv_stats.rx_frames++;
+    *frame = rx_cur_frame;
+    return rx_cur_len;
+}
 
-    // Skip virtio header, copy ethernet frame
-    rx_buffer_t *rxbuf = &rx_buffers[desc_idx];
-    uint32_t frame_len = total_len - sizeof(virtio_net_hdr_t);
+int virtio_net_rx_csum_ok(void) {
+    if (!net_base || !(net_features & VIRTIO_NET_F_GUEST_CSUM)) return 0;
+    if (!rx_cur_bufs) return 0;
 
-    if (frame_len > maxlen) {
-        frame_len = maxlen;
-    }
+    // Partial means it came from the host side unchecksummed, never
+    // having crossed a wire - as good as checked
+    return (rx_cur_flags &
+            (VIRTIO_NET_HDR_F_DATA_VALID | VIRTIO_NET_HDR_F_NEEDS_CSUM)) != 0;
+}
 
-    memcpy(buf, rxbuf->data, frame_len);
+void virtio_net_rx_release(void) {
+    if (!net_base || !rx_cur_bufs) return;
 
-    // Re-add buffer to available ring
-    uint16_t avail_idx = rx_avail->idx % QUEUE_SIZE;
-    rx_avail->ring[avail_idx] = desc_idx;
-    mb();
-    rx_avail->idx++;
+    // Re-add the frame's buffers to the available ring. The device hears
+    // about them on the next kick, once per batch.
+    for (uint16_t i = 0; i < rx_cur_bufs; i++) {
+        uint32_t desc_idx = rx_used->ring[rx_last_used_idx % rx_size].id;
+        rx_last_used_idx++;
+        rx_avail->ring[rx_avail_idx % rx_size] = desc_idx;
+        rx_avail_idx++;
+    }
+    rx_cur_bufs = 0;
     mb();
+    rx_avail->idx = rx_avail_idx;
+    rx_kick_pending = 1;
+}
 
-    // Notify device
-    write32(net_base + VIRTIO_MMIO_QUEUE_SEL/4, 0);
-    write32(net_base + VIRTIO_MMIO_QUEUE_NOTIFY/4, 0);
+int virtio_net_recv(void *buf, uint32_t maxlen) {
+    const uint8_t *frame;
+    int frame_len = virtio_net_rx_peek(&frame);
+    if (frame_len <= 0) return frame_len;
 
-    // Ack interrupt
-    write32(net_base + VIRTIO_MMIO_INTERRUPT_ACK/4,
-            read32(net_base + VIRTIO_MMIO_INTERRUPT_STATUS/4));
+    if ((uint32_t)frame_len > maxlen) {
+        frame_len = maxlen;
+    }
+    memcpy(buf, frame, frame_len);
+    virtio_net_rx_release();
+    virtio_net_kick();
 
     return frame_len;
 }
 
+void virtio_net_get_stats(virtio_net_stats_t *out) {
+    memcpy(out, &drv_stats, sizeof(*out));
+}
+
 uint32_t virtio_net_get_irq(void) {
     if (net_device_index < 0) return 0;
     return VIRTIO_IRQ_BASE + net_device_index;
 }
 
+wait_queue_t net_rx_wait_queue = WAIT_QUEUE_INIT;
+
 void virtio_net_irq_handler(void) {
     if (!net_base) return;
 
     // Just ack the interrupt - don't consume packets here!
-    // Packets will be processed by net_poll() in the network stack.
+    // The stack's softirq thread handles them, and gets this core as soon
+    // as the IRQ returns.
     write32(net_base + VIRTIO_MMIO_INTERRUPT_ACK/4,
             read32(net_base + VIRTIO_MMIO_INTERRUPT_STATUS/4));
+
+    net_softirq_raise();
+    process_preempt_from_irq();
 }
@@ -9,10 +9,20 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "process.h"
 
 // Maximum ethernet frame size (without virtio header)
 #define NET_MTU 1514
 
+// Driver counters since boot
+typedef struct {
+    uint32_t tx_frames;
+    uint32_t tx_kicks;       // Times the device was notified - frames/kicks is the batch size
+    uint32_t tx_ring_full;   // Sends that had to wait for the device to free a buffer
+    uint32_t rx_frames;
+    uint32_t rx_merged;      // Frames the device spread over several buffers
+} virtio_net_stats_t;
+
 // Initialize the virtio-net device
 // Returns 0 on success, -1 on error
 int virtio_net_init(void);
@@ -24,20 +34,58 @@ void virtio_net_get_mac(uint8_t *mac);
 // data: pointer to ethernet frame (dst mac, src mac, ethertype, payload)
 // len: length of frame in bytes
 // Returns 0 on success, -1 on error
+//
+// Frames are queued, not sent: the device is told about them in batches,
+// every TX_BATCH frames or at virtio_net_kick(), whichever comes first
 int virtio_net_send(const void *data, uint32_t len);
 
+// Same, with the frame in two pieces (say, a header and its payload),
+// copied straight into the ring. csum_start/csum_offset as below.
+int virtio_net_sendv(const void *head, uint32_t head_len, const void *data, uint32_t len,
+                     uint16_t csum_start, uint16_t csum_offset);
+
+// Notify the device of frames sent and receive buffers released since the
+// last kick. The stack calls it when it's done with a batch of work.
+void virtio_net_kick(void);
+
+// Send a frame whose TCP/UDP checksum is left for the device: the field
+// at csum_start + csum_offset holds the folded pseudo-header sum, and the
+// device adds in everything from csum_start on. Only with offload on.
+int virtio_net_send_csum(const void *data, uint32_t len, uint16_t csum_start, uint16_t csum_offset);
+
+// Whether the device negotiated transmit checksum offload
+int virtio_net_csum_offload(void);
+
 // Receive a raw ethernet frame (polling)
 // buf: buffer to receive into
 // maxlen: maximum bytes to receive
 // Returns number of bytes received, 0 if no packet, -1 on error
 int virtio_net_recv(void *buf, uint32_t maxlen);
 
+// Receive a frame without copying it: *frame points into the device's
+// receive buffer, which stays ours until virtio_net_rx_release() hands it
+// back. Returns the frame length, 0 if no packet, -1 on error.
+int virtio_net_rx_peek(const uint8_t **frame);
+
+// Whether the device vouched for the checksums of the frame from
+// virtio_net_rx_peek() (receive checksum offload)
+int virtio_net_rx_csum_ok(void);
+
+// Return the frame from virtio_net_rx_peek() to the device (at the next
+// virtio_net_kick())
+void virtio_net_rx_release(void);
+
+void virtio_net_get_stats(virtio_net_stats_t *out);
+
 // Check if a packet is available
 int virtio_net_has_packet(void);
 
 // IRQ handler (called from irq.c)
 void virtio_net_irq_handler(void);
 
+// Woken by the stack's softirq after it has handled received packets
+extern wait_queue_t net_rx_wait_queue;
+
 // Get the network device's IRQ number
 uint32_t virtio_net_get_irq(void);
 
@@ -15,6 +15,7 @@
 #include "virtio_sound.h"
 #include "printf.h"
 #include "string.h"
+#include "spinlock.h"
 
 // Virtio MMIO registers
 #define VIRTIO_MMIO_BASE        0x0a000000
@@ -247,6 +248,24 @@ static int async_paused = 0;
 static uint8_t async_channels = 2;
 static uint32_t async_sample_rate = 44100;
 
+// Streaming playback: caller-owned PCM buffers played back to back.
+// stream_head/stream_tail are free-running counters; slot = counter % SIZE.
+// The queue is filled by a process and drained by the timer IRQ on CPU 0.
+#define STREAM_QUEUE_SIZE 8
+
+typedef struct {
+    const uint8_t *data;
+    uint32_t bytes;
+} stream_buf_t;
+
+static stream_buf_t stream_queue[STREAM_QUEUE_SIZE];
+static uint32_t stream_head = 0;    // Buffers retired (fully played)
+static uint32_t stream_tail = 0;    // Buffers queued
+static uint32_t stream_offset = 0;  // Bytes of the head buffer submitted
+static uint32_t stream_in_flight = 0;  // Bytes of the chunk with the device (0: none)
+static int stream_mode = 0;
+static spinlock_t stream_lock = SPINLOCK_INIT;
+
 // Memory barriers for device communication
 static inline void mb(void) {
     asm volatile("dsb sy" ::: "memory");
@@ -849,10 +868,16 @@ int virtio_sound_play_wav(const void *data, uint32_t size) {
 
 void virtio_sound_stop(void) {
     if (!snd_base) return;
+    uint64_t flags = spin_lock_irqsave(&stream_lock);
     playing = 0;
     async_playing = 0;
     async_paused = 0;
     async_pcm_data = NULL;
+    stream_mode = 0;
+    stream_head = stream_tail = 0;
+    stream_offset = 0;
+    stream_in_flight = 0;
+    spin_unlock_irqrestore(&stream_lock, flags);
     stop_stream();
 }
 
@@ -861,17 +886,28 @@ void virtio_sound_pause(void) {
     if (!snd_base) return;
     if (!async_playing) return;  // Nothing to pause
 
-    // Stop the stream but keep state
-    stop_stream();
+    // Stop feeding first so the pump can't submit behind our back
+    uint64_t flags = spin_lock_irqsave(&stream_lock);
     async_playing = 0;
     async_paused = 1;
     playing = 0;
+    // Stopping drops the chunk the device had: don't wait for it, and play
+    // it again on resume
+    if (stream_in_flight) {
+        stream_offset -= stream_in_flight;
+        playback_position -= stream_in_flight / (async_channels * sizeof(int16_t));
+        stream_in_flight = 0;
+    }
+    spin_unlock_irqrestore(&stream_lock, flags);
+
+    // Stop the stream but keep state
+    stop_stream();
 }
 
 // Resume paused playback
 int virtio_sound_resume(void) {
     if (!snd_base) return -1;
-    if (!async_paused || !async_pcm_data) return -1;  // Nothing to resume
+    if (!async_paused || (!async_pcm_data && !stream_mode)) return -1;  // Nothing to resume
 
     int rate_idx = hz_to_rate_index(async_sample_rate);
     if (rate_idx < 0) return -1;
@@ -992,6 +1028,7 @@ int virtio_sound_play_pcm_async(const int16_t *data, uint32_t samples, uint8_t c
     }
 
     // Store async state
+    stream_mode = 0;
     async_pcm_data = (const uint8_t *)data;
     async_pcm_bytes = samples * channels * sizeof(int16_t);
     async_pcm_offset = 0;
@@ -1008,8 +1045,107 @@ int virtio_sound_play_pcm_async(const int16_t *data, uint32_t samples, uint8_t c
     return 0;
 }
 
+// Start a streaming playback with an empty queue - returns immediately
+int virtio_sound_stream_start(uint8_t channels, uint32_t sample_rate) {
+    if (!snd_base) return -1;
+
+    if (async_playing || async_paused) {
+        virtio_sound_stop();
+    }
+
+    int rate_idx = hz_to_rate_index(sample_rate);
+    if (rate_idx < 0) {
+        printf("[SND] Unsupported sample rate: %d\n", sample_rate);
+        return -1;
+    }
+
+    if (configure_stream(channels, VIRTIO_SND_PCM_FMT_S16, rate_idx) < 0 ||
+        prepare_stream() < 0 || start_stream() < 0) {
+        return -1;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&stream_lock);
+    stream_head = stream_tail = 0;
+    stream_offset = 0;
+    stream_in_flight = 0;
+    stream_mode = 1;
+    async_pcm_data = NULL;
+    async_playing = 1;
+    async_paused = 0;
+    async_channels = channels;
+    async_sample_rate = sample_rate;
+    playing = 1;
+    playback_position = 0;
+    spin_unlock_irqrestore(&stream_lock, flags);
+
+    return 0;
+}
+
+// Append a buffer to the stream. It must stay valid until it is retired.
+int virtio_sound_stream_queue(const int16_t *data, uint32_t samples) {
+    if (!snd_base || !stream_mode || samples == 0) return -1;
+
+    uint64_t flags = spin_lock_irqsave(&stream_lock);
+    if (stream_tail - stream_head >= STREAM_QUEUE_SIZE) {
+        spin_unlock_irqrestore(&stream_lock, flags);
+        return -1;  // Queue full
+    }
+    stream_buf_t *buf = &stream_queue[stream_tail % STREAM_QUEUE_SIZE];
+    buf->data = (const uint8_t *)data;
+    buf->bytes = samples * async_channels * sizeof(int16_t);
+    stream_tail++;
+    spin_unlock_irqrestore(&stream_lock, flags);
+
+    // Start feeding now rather than on the next timer tick
+    virtio_sound_pump();
+    return 0;
+}
+
+uint32_t virtio_sound_stream_retired(void) {
+    return stream_head;
+}
+
+// Feed the stream: retire the head buffer once its last chunk completes,
+// then submit the next chunk. An empty queue just lets the device underrun.
+static void stream_pump(void) {
+    uint64_t flags = spin_lock_irqsave(&stream_lock);
+
+    if (!async_playing) goto out;
+
+    if (stream_in_flight) {
+        if (!async_submit_ready()) goto out;  // Previous chunk still processing
+        stream_in_flight = 0;
+    }
+
+    if (stream_head != stream_tail &&
+        stream_offset >= stream_queue[stream_head % STREAM_QUEUE_SIZE].bytes) {
+        stream_head++;
+        stream_offset = 0;
+    }
+
+    if (stream_head == stream_tail) goto out;  // Underrun - wait for the player
+
+    stream_buf_t *buf = &stream_queue[stream_head % STREAM_QUEUE_SIZE];
+    uint32_t chunk_size = 4096;  // Match period_bytes
+    uint32_t remaining = buf->bytes - stream_offset;
+    uint32_t to_send = (remaining < chunk_size) ? remaining : chunk_size;
+
+    submit_audio_async(buf->data + stream_offset, to_send);
+    stream_offset += to_send;
+    stream_in_flight = to_send;
+    playback_position += to_send / (async_channels * sizeof(int16_t));
+
+out:
+    spin_unlock_irqrestore(&stream_lock, flags);
+}
+
 // Called periodically (e.g., from timer) to feed more audio data
 void virtio_sound_pump(void) {
+    if (stream_mode) {
+        stream_pump();
+        return;
+    }
+
     if (!async_playing || !async_pcm_data) return;
 
     // Check if device is ready for more data
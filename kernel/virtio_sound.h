@@ -63,4 +63,18 @@ int virtio_sound_play_pcm_async(const int16_t *data, uint32_t samples, uint8_t c
 // Pump audio data - call periodically (e.g., from timer) to feed audio
 void virtio_sound_pump(void);
 
+// Streaming playback - PCM buffers queued by the caller play back to back,
+// so a decoder only has to stay a few buffers ahead
+// Start an empty stream (stops any current playback)
+// Returns 0 on success, -1 on failure
+int virtio_sound_stream_start(uint8_t channels, uint32_t sample_rate);
+
+// Queue a buffer of S16LE samples (samples per channel, format from stream_start)
+// The buffer must remain valid until it has been retired!
+// Returns 0 on success, -1 if the queue is full or no stream is running
+int virtio_sound_stream_queue(const int16_t *data, uint32_t samples);
+
+// Number of queued buffers that have finished playing since stream_start
+uint32_t virtio_sound_stream_retired(void);
+
 #endif // VIRTIO_SOUND_H
@@ -5,6 +5,7 @@
 #include "py/obj.h"
 #include "py/objstr.h"
 #include "vibe.h"
+#include "gfx.h"
 
 // External reference to kernel API
 extern kapi_t *mp_vibeos_api;
@@ -473,6 +474,15 @@ static mp_obj_t mod_vibe_window_size(mp_obj_t wid_obj) {
 }
 static MP_DEFINE_CONST_FUN_OBJ_1(mod_vibe_window_size_obj, mod_vibe_window_size);
 
+// Drawing context over a window's buffer; 0 if there's no such window
+static int window_gfx(int wid, gfx_ctx_t *ctx) {
+    int bw, bh;
+    uint32_t *buf = mp_vibeos_api->window_get_buffer(wid, &bw, &bh);
+    if (!buf) return 0;
+    gfx_init(ctx, buf, bw, bh, mp_vibeos_api->font_data);
+    return 1;
+}
+
 // vibe.window_fill_rect(wid, x, y, w, h, color)
 static mp_obj_t mod_vibe_window_fill_rect(size_t n_args, const mp_obj_t *args) {
     int wid = mp_obj_get_int(args[0]);
@@ -482,22 +492,9 @@ static mp_obj_t mod_vibe_window_fill_rect(size_t n_args, const mp_obj_t *args) {
     int h = mp_obj_get_int(args[4]);
     uint32_t color = mp_obj_get_int(args[5]);
 
-    int bw, bh;
-    uint32_t *buf = mp_vibeos_api->window_get_buffer(wid, &bw, &bh);
-    if (!buf) return mp_const_none;
-
-    // Clip to bounds
-    if (x < 0) { w += x; x = 0; }
-    if (y < 0) { h += y; y = 0; }
-    if (x + w > bw) w = bw - x;
-    if (y + h > bh) h = bh - y;
-    if (w <= 0 || h <= 0) return mp_const_none;
-
-    for (int py = y; py < y + h; py++) {
-        for (int px = x; px < x + w; px++) {
-            buf[py * bw + px] = color;
-        }
-    }
+    gfx_ctx_t ctx;
+    if (!window_gfx(wid, &ctx)) return mp_const_none;
+    gfx_fill_rect(&ctx, x, y, w, h, color);
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_vibe_window_fill_rect_obj, 6, 6, mod_vibe_window_fill_rect);
@@ -509,13 +506,9 @@ static mp_obj_t mod_vibe_window_put_pixel(size_t n_args, const mp_obj_t *args) {
     int y = mp_obj_get_int(args[2]);
     uint32_t color = mp_obj_get_int(args[3]);
 
-    int bw, bh;
-    uint32_t *buf = mp_vibeos_api->window_get_buffer(wid, &bw, &bh);
-    if (!buf) return mp_const_none;
-
-    if (x >= 0 && x < bw && y >= 0 && y < bh) {
-        buf[y * bw + x] = color;
-    }
+    gfx_ctx_t ctx;
+    if (!window_gfx(wid, &ctx)) return mp_const_none;
+    gfx_put_pixel(&ctx, x, y, color);
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_vibe_window_put_pixel_obj, 4, 4, mod_vibe_window_put_pixel);
@@ -529,23 +522,9 @@ static mp_obj_t mod_vibe_window_draw_char(size_t n_args, const mp_obj_t *args) {
     uint32_t fg = mp_obj_get_int(args[4]);
     uint32_t bg = mp_obj_get_int(args[5]);
 
-    int bw, bh;
-    uint32_t *buf = mp_vibeos_api->window_get_buffer(wid, &bw, &bh);
-    if (!buf) return mp_const_none;
-
-    const uint8_t *font = mp_vibeos_api->font_data;
-    const uint8_t *glyph = &font[(unsigned char)c * 16];
-
-    for (int row = 0; row < 16; row++) {
-        for (int col = 0; col < 8; col++) {
-            uint32_t color = (glyph[row] & (0x80 >> col)) ? fg : bg;
-            int px = x + col;
-            int py = y + row;
-            if (px >= 0 && px < bw && py >= 0 && py < bh) {
-                buf[py * bw + px] = color;
-            }
-        }
-    }
+    gfx_ctx_t ctx;
+    if (!window_gfx(wid, &ctx)) return mp_const_none;
+    gfx_draw_char(&ctx, x, y, (char)c, fg, bg);
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_vibe_window_draw_char_obj, 6, 6, mod_vibe_window_draw_char);
@@ -559,28 +538,9 @@ static mp_obj_t mod_vibe_window_draw_string(size_t n_args, const mp_obj_t *args)
     uint32_t fg = mp_obj_get_int(args[4]);
     uint32_t bg = mp_obj_get_int(args[5]);
 
-    int bw, bh;
-    uint32_t *buf = mp_vibeos_api->window_get_buffer(wid, &bw, &bh);
-    if (!buf) return mp_const_none;
-
-    const uint8_t *font = mp_vibeos_api->font_data;
-    int cx = x;
-
-    while (*s) {
-        const uint8_t *glyph = &font[(unsigned char)*s * 16];
-        for (int row = 0; row < 16; row++) {
-            for (int col = 0; col < 8; col++) {
-                uint32_t color = (glyph[row] & (0x80 >> col)) ? fg : bg;
-                int px = cx + col;
-                int py = y + row;
-                if (px >= 0 && px < bw && py >= 0 && py < bh) {
-                    buf[py * bw + px] = color;
-                }
-            }
-        }
-        cx += 8;
-        s++;
-    }
+    gfx_ctx_t ctx;
+    if (!window_gfx(wid, &ctx)) return mp_const_none;
+    gfx_draw_string(&ctx, x, y, s, fg, bg);
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_vibe_window_draw_string_obj, 6, 6, mod_vibe_window_draw_string);
@@ -594,24 +554,10 @@ static mp_obj_t mod_vibe_window_draw_rect(size_t n_args, const mp_obj_t *args) {
     int h = mp_obj_get_int(args[4]);
     uint32_t color = mp_obj_get_int(args[5]);
 
-    int bw, bh;
-    uint32_t *buf = mp_vibeos_api->window_get_buffer(wid, &bw, &bh);
-    if (!buf) return mp_const_none;
-
-    // Draw horizontal lines (top and bottom)
-    for (int px = x; px < x + w; px++) {
-        if (px >= 0 && px < bw) {
-            if (y >= 0 && y < bh) buf[y * bw + px] = color;
-            if (y + h - 1 >= 0 && y + h - 1 < bh) buf[(y + h - 1) * bw + px] = color;
-        }
-    }
-    // Draw vertical lines (left and right)
-    for (int py = y; py < y + h; py++) {
-        if (py >= 0 && py < bh) {
-            if (x >= 0 && x < bw) buf[py * bw + x] = color;
-            if (x + w - 1 >= 0 && x + w - 1 < bw) buf[py * bw + x + w - 1] = color;
-        }
-    }
+    gfx_ctx_t ctx;
+    if (!window_gfx(wid, &ctx)) return mp_const_none;
+    if (w <= 0 || h <= 0) return mp_const_none;
+    gfx_draw_rect(&ctx, x, y, w, h, color);
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_vibe_window_draw_rect_obj, 6, 6, mod_vibe_window_draw_rect);
@@ -624,18 +570,9 @@ static mp_obj_t mod_vibe_window_draw_hline(size_t n_args, const mp_obj_t *args)
     int w = mp_obj_get_int(args[3]);
     uint32_t color = mp_obj_get_int(args[4]);
 
-    int bw, bh;
-    uint32_t *buf = mp_vibeos_api->window_get_buffer(wid, &bw, &bh);
-    if (!buf) return mp_const_none;
-
-    if (y < 0 || y >= bh) return mp_const_none;
-    if (x < 0) { w += x; x = 0; }
-    if (x + w > bw) w = bw - x;
-    if (w <= 0) return mp_const_none;
-
-    for (int px = x; px < x + w; px++) {
-        buf[y * bw + px] = color;
-    }
+    gfx_ctx_t ctx;
+    if (!window_gfx(wid, &ctx)) return mp_const_none;
+    gfx_draw_hline(&ctx, x, y, w, color);
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_vibe_window_draw_hline_obj, 5, 5, mod_vibe_window_draw_hline);
@@ -708,6 +645,17 @@ static mp_obj_t mod_vibe_ttf_get_kerning(mp_obj_t cp1_obj, mp_obj_t cp2_obj, mp_
 }
 static MP_DEFINE_CONST_FUN_OBJ_3(mod_vibe_ttf_get_kerning_obj, mod_vibe_ttf_get_kerning);
 
+// vibe.ttf_measure(text, size[, style]) -> int
+// Width of the whole string with kerning; the kernel caches repeated runs
+static mp_obj_t mod_vibe_ttf_measure(size_t n_args, const mp_obj_t *args) {
+    size_t len;
+    const char *text = mp_obj_str_get_data(args[0], &len);
+    int size = mp_obj_get_int(args[1]);
+    int style = n_args > 2 ? mp_obj_get_int(args[2]) : 0;
+    return mp_obj_new_int(mp_vibeos_api->ttf_measure(text, len, size, style));
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_vibe_ttf_measure_obj, 2, 3, mod_vibe_ttf_measure);
+
 // vibe.window_draw_glyph(wid, x, y, bitmap, w, h, fg, bg)
 // Draws a TTF glyph bitmap with alpha blending
 static mp_obj_t mod_vibe_window_draw_glyph(size_t n_args, const mp_obj_t *args) {
@@ -724,36 +672,35 @@ static mp_obj_t mod_vibe_window_draw_glyph(size_t n_args, const mp_obj_t *args)
     uint32_t fg = mp_obj_get_int(args[6]);
     uint32_t bg = mp_obj_get_int(args[7]);
 
-    int bw, bh;
-    uint32_t *buf = mp_vibeos_api->window_get_buffer(wid, &bw, &bh);
-    if (!buf) return mp_const_none;
-
-    // Extract RGB components
-    uint8_t fg_r = (fg >> 16) & 0xFF;
-    uint8_t fg_g = (fg >> 8) & 0xFF;
-    uint8_t fg_b = fg & 0xFF;
-    uint8_t bg_r = (bg >> 16) & 0xFF;
-    uint8_t bg_g = (bg >> 8) & 0xFF;
-    uint8_t bg_b = bg & 0xFF;
-
-    for (int row = 0; row < gh; row++) {
-        for (int col = 0; col < gw; col++) {
-            int px = x + col;
-            int py = y + row;
-            if (px >= 0 && px < bw && py >= 0 && py < bh) {
-                uint8_t alpha = bitmap[row * gw + col];
-                // Blend: result = fg * alpha + bg * (255 - alpha)
-                uint8_t r = (fg_r * alpha + bg_r * (255 - alpha)) / 255;
-                uint8_t g = (fg_g * alpha + bg_g * (255 - alpha)) / 255;
-                uint8_t b = (fg_b * alpha + bg_b * (255 - alpha)) / 255;
-                buf[py * bw + px] = (r << 16) | (g << 8) | b;
-            }
-        }
-    }
+    gfx_ctx_t ctx;
+    if (!window_gfx(wid, &ctx)) return mp_const_none;
+    if (gw <= 0 || gh <= 0 || bufinfo.len < (size_t)gw * gh) return mp_const_none;
+
+    // Same blend as TTF text drawn from C
+    ttf_glyph_t glyph = { (uint8_t *)bitmap, gw, gh, 0, 0, 0 };
+    gfx_draw_ttf_glyph(&ctx, x, y, &glyph, fg, bg);
     return mp_const_none;
 }
 static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_vibe_window_draw_glyph_obj, 8, 8, mod_vibe_window_draw_glyph);
 
+// vibe.window_draw_ttf_string(wid, x, y, text, size, style, fg, bg) -> width
+// Draws glyphs straight from the kernel's cache, baseline at y + ascent
+static mp_obj_t mod_vibe_window_draw_ttf_string(size_t n_args, const mp_obj_t *args) {
+    int wid = mp_obj_get_int(args[0]);
+    int x = mp_obj_get_int(args[1]);
+    int y = mp_obj_get_int(args[2]);
+    const char *text = mp_obj_str_get_str(args[3]);
+    int size = mp_obj_get_int(args[4]);
+    int style = mp_obj_get_int(args[5]);
+    uint32_t fg = mp_obj_get_int(args[6]);
+    uint32_t bg = mp_obj_get_int(args[7]);
+
+    gfx_ctx_t ctx;
+    if (!window_gfx(wid, &ctx)) return mp_obj_new_int(0);
+    return mp_obj_new_int(gfx_draw_ttf_string(&ctx, mp_vibeos_api, x, y, text, size, style, fg, bg));
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_vibe_window_draw_ttf_string_obj, 8, 8, mod_vibe_window_draw_ttf_string);
+
 // ============================================================================
 // Sound
 // ============================================================================
@@ -818,7 +765,7 @@ static MP_DEFINE_CONST_FUN_OBJ_1(mod_vibe_dns_resolve_obj, mod_vibe_dns_resolve)
 static mp_obj_t mod_vibe_ping(size_t n_args, const mp_obj_t *args) {
     uint32_t ip = mp_obj_get_int(args[0]);
     uint32_t timeout = n_args > 1 ? mp_obj_get_int(args[1]) : 1000;
-    return mp_obj_new_bool(mp_vibeos_api->net_ping(ip, 1, timeout) == 0);
+    return mp_obj_new_bool(mp_vibeos_api->net_ping(ip, 1, timeout) >= 0);
 }
 static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_vibe_ping_obj, 1, 2, mod_vibe_ping);
 
@@ -863,14 +810,46 @@ static mp_obj_t mod_vibe_tcp_close(mp_obj_t sock_obj) {
 }
 static MP_DEFINE_CONST_FUN_OBJ_1(mod_vibe_tcp_close_obj, mod_vibe_tcp_close);
 
-// vibe.tls_connect(ip, port, hostname) -> socket or -1
-static mp_obj_t mod_vibe_tls_connect(mp_obj_t ip_obj, mp_obj_t port_obj, mp_obj_t host_obj) {
-    uint32_t ip = mp_obj_get_int(ip_obj);
-    uint16_t port = mp_obj_get_int(port_obj);
-    const char *host = mp_obj_str_get_str(host_obj);
+// vibe.tcp_listen(port, backlog=4) -> listening socket or -1
+static mp_obj_t mod_vibe_tcp_listen(size_t n_args, const mp_obj_t *args) {
+    if (!mp_vibeos_api->tcp_listen) return mp_obj_new_int(-1);
+    uint16_t port = mp_obj_get_int(args[0]);
+    int backlog = n_args > 1 ? mp_obj_get_int(args[1]) : 4;
+    return mp_obj_new_int(mp_vibeos_api->tcp_listen(port, backlog));
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_vibe_tcp_listen_obj, 1, 2, mod_vibe_tcp_listen);
+
+// vibe.tcp_accept(listener, timeout_ms=0) -> socket or -1 (0 = wait forever)
+static mp_obj_t mod_vibe_tcp_accept(size_t n_args, const mp_obj_t *args) {
+    if (!mp_vibeos_api->tcp_accept) return mp_obj_new_int(-1);
+    int listener = mp_obj_get_int(args[0]);
+    uint32_t timeout = n_args > 1 ? mp_obj_get_int(args[1]) : 0;
+    return mp_obj_new_int(mp_vibeos_api->tcp_accept(listener, timeout));
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_vibe_tcp_accept_obj, 1, 2, mod_vibe_tcp_accept);
+
+// vibe.tcp_set_bufsize(sock, rx_size, tx_size) -> True if resized
+static mp_obj_t mod_vibe_tcp_set_bufsize(mp_obj_t sock_obj, mp_obj_t rx_obj, mp_obj_t tx_obj) {
+    if (!mp_vibeos_api->tcp_set_bufsize) return mp_const_false;
+    int r = mp_vibeos_api->tcp_set_bufsize(mp_obj_get_int(sock_obj),
+                                           mp_obj_get_int(rx_obj), mp_obj_get_int(tx_obj));
+    return mp_obj_new_bool(r == 0);
+}
+static MP_DEFINE_CONST_FUN_OBJ_3(mod_vibe_tcp_set_bufsize_obj, mod_vibe_tcp_set_bufsize);
+
+// vibe.tls_connect(ip, port, hostname, rx_size=0) -> socket or -1
+// rx_size grows the receive buffer before the handshake
+static mp_obj_t mod_vibe_tls_connect(size_t n_args, const mp_obj_t *args) {
+    uint32_t ip = mp_obj_get_int(args[0]);
+    uint16_t port = mp_obj_get_int(args[1]);
+    const char *host = mp_obj_str_get_str(args[2]);
+    uint32_t rx_size = n_args > 3 ? mp_obj_get_int(args[3]) : 0;
+    if (rx_size && mp_vibeos_api->tls_connect_bufsize) {
+        return mp_obj_new_int(mp_vibeos_api->tls_connect_bufsize(ip, port, host, rx_size, 0));
+    }
     return mp_obj_new_int(mp_vibeos_api->tls_connect(ip, port, host));
 }
-static MP_DEFINE_CONST_FUN_OBJ_3(mod_vibe_tls_connect_obj, mod_vibe_tls_connect);
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_vibe_tls_connect_obj, 3, 4, mod_vibe_tls_connect);
 
 // vibe.tls_send(sock, data) -> bytes sent
 static mp_obj_t mod_vibe_tls_send(mp_obj_t sock_obj, mp_obj_t data_obj) {
@@ -905,6 +884,15 @@ static mp_obj_t mod_vibe_tls_close(mp_obj_t sock_obj) {
 }
 static MP_DEFINE_CONST_FUN_OBJ_1(mod_vibe_tls_close_obj, mod_vibe_tls_close);
 
+// vibe.tls_set_bufsize(sock, rx_size, tx_size) -> True if resized
+static mp_obj_t mod_vibe_tls_set_bufsize(mp_obj_t sock_obj, mp_obj_t rx_obj, mp_obj_t tx_obj) {
+    if (!mp_vibeos_api->tls_set_bufsize) return mp_const_false;
+    int r = mp_vibeos_api->tls_set_bufsize(mp_obj_get_int(sock_obj),
+                                           mp_obj_get_int(rx_obj), mp_obj_get_int(tx_obj));
+    return mp_obj_new_bool(r == 0);
+}
+static MP_DEFINE_CONST_FUN_OBJ_3(mod_vibe_tls_set_bufsize_obj, mod_vibe_tls_set_bufsize);
+
 // vibe.get_ip() -> int
 static mp_obj_t mod_vibe_get_ip(void) {
     return mp_obj_new_int(mp_vibeos_api->net_get_ip());
@@ -1080,6 +1068,7 @@ static const mp_rom_map_elem_t mp_module_vibe_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_window_draw_rect), MP_ROM_PTR(&mod_vibe_window_draw_rect_obj) },
     { MP_ROM_QSTR(MP_QSTR_window_draw_hline), MP_ROM_PTR(&mod_vibe_window_draw_hline_obj) },
     { MP_ROM_QSTR(MP_QSTR_window_draw_glyph), MP_ROM_PTR(&mod_vibe_window_draw_glyph_obj) },
+    { MP_ROM_QSTR(MP_QSTR_window_draw_ttf_string), MP_ROM_PTR(&mod_vibe_window_draw_ttf_string_obj) },
 
     // TTF Font Rendering
     { MP_ROM_QSTR(MP_QSTR_ttf_is_ready), MP_ROM_PTR(&mod_vibe_ttf_is_ready_obj) },
@@ -1087,6 +1076,7 @@ static const mp_rom_map_elem_t mp_module_vibe_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_ttf_get_metrics), MP_ROM_PTR(&mod_vibe_ttf_get_metrics_obj) },
     { MP_ROM_QSTR(MP_QSTR_ttf_get_advance), MP_ROM_PTR(&mod_vibe_ttf_get_advance_obj) },
     { MP_ROM_QSTR(MP_QSTR_ttf_get_kerning), MP_ROM_PTR(&mod_vibe_ttf_get_kerning_obj) },
+    { MP_ROM_QSTR(MP_QSTR_ttf_measure), MP_ROM_PTR(&mod_vibe_ttf_measure_obj) },
 
     // TTF style constants
     { MP_ROM_QSTR(MP_QSTR_TTF_NORMAL), MP_ROM_INT(0) },
@@ -1107,10 +1097,14 @@ static const mp_rom_map_elem_t mp_module_vibe_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_tcp_send), MP_ROM_PTR(&mod_vibe_tcp_send_obj) },
     { MP_ROM_QSTR(MP_QSTR_tcp_recv), MP_ROM_PTR(&mod_vibe_tcp_recv_obj) },
     { MP_ROM_QSTR(MP_QSTR_tcp_close), MP_ROM_PTR(&mod_vibe_tcp_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR_tcp_set_bufsize), MP_ROM_PTR(&mod_vibe_tcp_set_bufsize_obj) },
+    { MP_ROM_QSTR(MP_QSTR_tcp_listen), MP_ROM_PTR(&mod_vibe_tcp_listen_obj) },
+    { MP_ROM_QSTR(MP_QSTR_tcp_accept), MP_ROM_PTR(&mod_vibe_tcp_accept_obj) },
     { MP_ROM_QSTR(MP_QSTR_tls_connect), MP_ROM_PTR(&mod_vibe_tls_connect_obj) },
     { MP_ROM_QSTR(MP_QSTR_tls_send), MP_ROM_PTR(&mod_vibe_tls_send_obj) },
     { MP_ROM_QSTR(MP_QSTR_tls_recv), MP_ROM_PTR(&mod_vibe_tls_recv_obj) },
     { MP_ROM_QSTR(MP_QSTR_tls_close), MP_ROM_PTR(&mod_vibe_tls_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR_tls_set_bufsize), MP_ROM_PTR(&mod_vibe_tls_set_bufsize_obj) },
     { MP_ROM_QSTR(MP_QSTR_get_ip), MP_ROM_PTR(&mod_vibe_get_ip_obj) },
 
     // System info
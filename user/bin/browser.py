@@ -147,8 +147,10 @@ def fetch_url(url):
     if ip == 0:
         return (0, "DNS lookup failed for " + str(host))
 
+    # Big receive window: pages and cert chains arrive in fewer round trips.
+    # TLS sizes it before the handshake so the cert chain gets it too.
     if scheme == 'https':
-        sock = vibe.tls_connect(ip, port, host)
+        sock = vibe.tls_connect(ip, port, host, 262144)
         send_fn = vibe.tls_send
         recv_fn = vibe.tls_recv
         close_fn = vibe.tls_close
@@ -161,6 +163,10 @@ def fetch_url(url):
     if sock < 0:
         return (0, "Connection failed to " + host)
 
+    # Plain TCP can only grow it once connected, before the request goes out
+    if scheme != 'https':
+        vibe.tcp_set_bufsize(sock, 262144, 0)
+
     request = "GET " + path + " HTTP/1.0\r\n"
     request += "Host: " + host + "\r\n"
     request += "User-Agent: VibeOS Browser/1.0\r\n"
@@ -386,16 +392,8 @@ class TextBlock:
         self.h = 0
 
 def measure_text(text, font_size):
-    """Measure text width using TTF metrics"""
-    width = 0
-    prev_cp = 0
-    for ch in text:
-        cp = ord(ch)
-        width += vibe.ttf_get_advance(cp, font_size)
-        if prev_cp:
-            width += vibe.ttf_get_kerning(prev_cp, cp, font_size)
-        prev_cp = cp
-    return width
+    """Measure text width using TTF metrics (the kernel caches repeats)"""
+    return vibe.ttf_measure(text, font_size)
 
 def find_element(root, tag):
     """Find first element with given tag"""
@@ -699,25 +697,8 @@ def render(wid, blocks, scroll_y, content_y, content_h, win_w, win_h):
                 vibe.window_draw_hline(wid, block.x, by + ascent + 2, block.w, LINK_COLOR)
 
 def render_text(wid, x, y, text, font_size, style, fg):
-    """Render text with TTF font"""
-    if not vibe.ttf_is_ready():
-        vibe.window_draw_string(wid, x, y, text, fg, WHITE)
-        return
-
-    ascent, descent, line_gap = vibe.ttf_get_metrics(font_size)
-    baseline_y = y + ascent
-
-    for ch in text:
-        cp = ord(ch)
-        glyph = vibe.ttf_get_glyph(cp, font_size, style)
-        if glyph and glyph['bitmap']:
-            vibe.window_draw_glyph(
-                wid,
-                x + glyph['xoff'], baseline_y + glyph['yoff'],
-                glyph['bitmap'], glyph['width'], glyph['height'],
-                fg, WHITE
-            )
-        x += vibe.ttf_get_advance(cp, font_size)
+    """Render text with TTF font (falls back to the bitmap font)"""
+    vibe.window_draw_ttf_string(wid, x, y, text, font_size, style, fg, WHITE)
 
 # ============================================================================
 # Browser Class
@@ -41,14 +41,18 @@ int main(kapi_t *k, int argc, char **argv) {
             continue;
         }
 
-        // Read and print file contents
-        char buf[256];
+        // Read and print file contents, a block per write
+        static char buf[4096];
         size_t offset = 0;
         int bytes;
 
         while ((bytes = k->read(file, buf, sizeof(buf) - 1, offset)) > 0) {
-            buf[bytes] = '\0';
-            out_puts(buf);
+            if (k->stdio_write) {
+                k->stdio_write(buf, bytes);
+            } else {
+                buf[bytes] = '\0';
+                out_puts(buf);
+            }
             offset += bytes;
         }
     }
@@ -0,0 +1,135 @@
+/*
+ * conbench - text output speed of the console or terminal
+ *
+ * Usage: conbench [-k kilobytes] [-c]
+ *   Writes kilobytes (default 1024) of 80-column text lines to standard
+ *   output, the way cat of a big file does, and reports characters per
+ *   second. Lines go out 4KB at a time, through stdio_write when the
+ *   terminal provides it; -c sends them one character per call instead,
+ *   the way programs printing with putc do.
+ */
+
+#include "../lib/vibe.h"
+
+static kapi_t *api;
+
+#define DEFAULT_KB  1024
+#define LINE_LEN    80      // Including the newline
+#define BLOCK_LINES 51      // 4080 bytes
+
+static char block[BLOCK_LINES * LINE_LEN + 1];
+
+static void out_puts(const char *s) {
+    if (api->stdio_puts) api->stdio_puts(s);
+    else api->puts(s);
+}
+
+static void out_putc(char c) {
+    if (api->stdio_putc) api->stdio_putc(c);
+    else api->putc(c);
+}
+
+static void out_write(const char *buf, uint32_t len) {
+    if (api->stdio_write) api->stdio_write(buf, len);
+    else out_puts(buf);  // block is NUL-terminated
+}
+
+static void print_num(unsigned long n) {
+    char buf[24];
+    int i = 0;
+
+    if (n == 0) {
+        out_putc('0');
+        return;
+    }
+
+    while (n > 0) {
+        buf[i++] = '0' + (n % 10);
+        n /= 10;
+    }
+
+    while (i > 0) {
+        out_putc(buf[--i]);
+    }
+}
+
+static int parse_num(const char *s) {
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s - '0');
+        s++;
+    }
+    return n;
+}
+
+// Hexdump-looking lines, numbered so consecutive blocks differ a little
+static void fill_block(unsigned long first_line) {
+    static const char hex[] = "0123456789abcdef";
+
+    for (int l = 0; l < BLOCK_LINES; l++) {
+        char *p = &block[l * LINE_LEN];
+        unsigned long n = (first_line + l) * 16;
+        for (int i = 7; i >= 0; i--) {
+            p[i] = hex[n & 15];
+            n >>= 4;
+        }
+        p[8] = ':';
+        for (int i = 9; i < LINE_LEN - 1; i++) {
+            p[i] = (i % 3 == 0) ? ' ' : hex[(i * 7 + l) & 15];
+        }
+        p[LINE_LEN - 1] = '\n';
+    }
+    block[BLOCK_LINES * LINE_LEN] = '\0';
+}
+
+int main(kapi_t *k, int argc, char **argv) {
+    api = k;
+
+    int kb = DEFAULT_KB;
+    int per_char = 0;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'k' && i + 1 < argc) {
+            kb = parse_num(argv[++i]);
+        } else if (argv[i][0] == '-' && argv[i][1] == 'c') {
+            per_char = 1;
+        } else {
+            out_puts("Usage: conbench [-k kilobytes] [-c]\n");
+            return 1;
+        }
+    }
+    if (kb < 1) kb = DEFAULT_KB;
+
+    if (!k->get_time_us) {
+        out_puts("conbench: kernel has no timer\n");
+        return 1;
+    }
+
+    unsigned long target = (unsigned long)kb * 1024;
+    unsigned long written = 0;
+    unsigned long line = 0;
+    uint32_t us = 0;
+
+    while (written < target) {
+        fill_block(line);
+        line += BLOCK_LINES;
+
+        uint32_t start = k->get_time_us();
+        if (per_char) {
+            for (const char *p = block; *p; p++) out_putc(*p);
+        } else {
+            out_write(block, BLOCK_LINES * LINE_LEN);
+        }
+        us += k->get_time_us() - start;
+        written += BLOCK_LINES * LINE_LEN;
+    }
+
+    if (us == 0) us = 1;
+    out_puts("\nconbench: ");
+    print_num(written);
+    out_puts(" bytes in ");
+    print_num(us / 1000);
+    out_puts(" ms, ");
+    print_num((unsigned long)((uint64_t)written * 1000000 / us));
+    out_puts(per_char ? " chars/s, one per call\n" : " chars/s, 4KB per call\n");
+    return 0;
+}
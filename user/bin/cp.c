@@ -56,35 +56,39 @@ static int copy_file(const char *src, const char *dst) {
         return -1;
     }
 
-    // Create destination file
-    void *dst_file = api->create(dst);
+    // Create destination file, then open it so writes keep a cluster cursor
+    void *dst_file = api->create(dst) ? api->open(dst) : 0;
     if (!dst_file) {
+        api->close(src_file);
         out_puts("cp: cannot create '");
         out_puts(dst);
         out_puts("'\n");
         return -1;
     }
 
-    // Copy content in chunks
+    // create() leaves an existing file as is - truncate it first
+    api->write(dst_file, "", 0);
+
+    // Copy content in chunks, each written at its offset
     char buf[4096];
     size_t offset = 0;
     int bytes;
+    int status = 0;
 
     while ((bytes = api->read(src_file, buf, sizeof(buf), offset)) > 0) {
-        // Write to destination (write appends, so no offset needed)
-        // But our write() always appends, so we need to truncate first
-        // Actually, create() makes empty file, so this should work
-        if (offset == 0) {
-            // First write - file is empty from create()
-            api->write(dst_file, buf, bytes);
-        } else {
-            // Subsequent writes - append
-            api->write(dst_file, buf, bytes);
+        if (api->pwrite(dst_file, buf, bytes, offset) != bytes) {
+            out_puts("cp: write error on '");
+            out_puts(dst);
+            out_puts("'\n");
+            status = -1;
+            break;
         }
         offset += bytes;
     }
 
-    return 0;
+    api->close(dst_file);
+    api->close(src_file);
+    return status;
 }
 
 // Recursive directory copy
@@ -0,0 +1,166 @@
+/*
+ * csumbench - Internet checksum speed, word loop vs NEON
+ *
+ * Usage: csumbench [-n MB]
+ *   Sums MB megabytes (default 64) through the kernel's csum_partial()
+ *   and its plain 16-bit word loop at a few buffer sizes - a bare header,
+ *   a full TCP segment, and buffers that do and don't fit in cache - and
+ *   reports CPU cycles per KB for each, checking that both agree.
+ */
+
+#include "../lib/vibe.h"
+
+static kapi_t *api;
+static volatile uint32_t sink;  // Keeps the loops from being optimized out
+
+#define DEFAULT_MB  64
+#define MAX_SIZE    (1024 * 1024)
+
+static const uint32_t sizes[] = { 40, 1460, 16384, MAX_SIZE };
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+typedef uint32_t (*csum_fn_t)(const void *data, uint32_t len, uint32_t sum);
+
+static void out_puts(const char *s) {
+    if (api->stdio_puts) api->stdio_puts(s);
+    else api->puts(s);
+}
+
+static void out_putc(char c) {
+    if (api->stdio_putc) api->stdio_putc(c);
+    else api->putc(c);
+}
+
+static void print_num(unsigned long n) {
+    char buf[24];
+    int i = 0;
+
+    if (n == 0) {
+        out_putc('0');
+        return;
+    }
+
+    while (n > 0) {
+        buf[i++] = '0' + (n % 10);
+        n /= 10;
+    }
+
+    while (i > 0) {
+        out_putc(buf[--i]);
+    }
+}
+
+// Right-align n in a field of width characters
+static void print_padded(unsigned long n, int width) {
+    int digits = 1;
+    for (unsigned long t = n; t >= 10; t /= 10) digits++;
+    while (digits++ < width) out_putc(' ');
+    print_num(n);
+}
+
+static int parse_num(const char *s) {
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s - '0');
+        s++;
+    }
+    return n;
+}
+
+// Cycles per KB summing total bytes in size-byte calls
+static unsigned long run(csum_fn_t fn, const uint8_t *buf, uint32_t size,
+                         unsigned long total, uint32_t mhz) {
+    unsigned long calls = total / size;
+    if (calls == 0) calls = 1;
+
+    uint32_t sum = 0;
+    uint32_t start = api->get_time_us();
+    for (unsigned long i = 0; i < calls; i++) {
+        sum += fn(buf, size, 0);
+    }
+    uint32_t us = api->get_time_us() - start;
+    sink = sum;
+
+    unsigned long kb = calls * size / 1024;
+    if (kb == 0) kb = 1;
+    return (unsigned long)((uint64_t)us * mhz / kb);
+}
+
+int main(kapi_t *k, int argc, char **argv) {
+    api = k;
+
+    int mb = DEFAULT_MB;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'n' && i + 1 < argc) {
+            mb = parse_num(argv[++i]);
+        } else {
+            out_puts("Usage: csumbench [-n MB]\n");
+            return 1;
+        }
+    }
+    if (mb < 1) mb = DEFAULT_MB;
+
+    if (!k->csum_partial || !k->get_time_us || !k->get_cpu_freq_mhz) {
+        out_puts("csumbench: kernel has no csum_partial\n");
+        return 1;
+    }
+
+    uint32_t mhz = k->get_cpu_freq_mhz();
+    if (!mhz) {
+        out_puts("csumbench: unknown CPU frequency\n");
+        return 1;
+    }
+
+    // One extra byte so the odd-offset check below stays in bounds
+    uint8_t *buf = k->malloc(MAX_SIZE + 1);
+    if (!buf) {
+        out_puts("csumbench: out of memory\n");
+        return 1;
+    }
+    uint32_t seed = 12345;
+    for (int i = 0; i < MAX_SIZE + 1; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+
+    // Both must give the same folded sum, odd lengths and offsets included
+    for (uint32_t len = 0; len < 300; len++) {
+        uint32_t a = k->csum_partial(buf + (len & 1), len, len);
+        uint32_t b = k->csum_partial_scalar(buf + (len & 1), len, len);
+        a = (a & 0xffff) + (a >> 16); a = (a & 0xffff) + (a >> 16);
+        b = (b & 0xffff) + (b >> 16); b = (b & 0xffff) + (b >> 16);
+        if (a != b) {
+            out_puts("csumbench: NEON and scalar sums differ at length ");
+            print_num(len);
+            out_putc('\n');
+            k->free(buf);
+            return 1;
+        }
+    }
+
+    unsigned long total = (unsigned long)mb * 1024 * 1024;
+    out_puts("csumbench: ");
+    print_num(mb);
+    out_puts(" MB per run at ");
+    print_num(mhz);
+    out_puts(" MHz\n\n");
+    out_puts("    size  scalar cyc/KB    NEON cyc/KB  speedup\n");
+
+    for (uint32_t i = 0; i < NUM_SIZES; i++) {
+        unsigned long scalar = run(k->csum_partial_scalar, buf, sizes[i], total, mhz);
+        unsigned long neon = run(k->csum_partial, buf, sizes[i], total, mhz);
+
+        print_padded(sizes[i], 8);
+        print_padded(scalar, 15);
+        print_padded(neon, 15);
+        out_puts("    ");
+        unsigned long x10 = neon ? scalar * 10 / neon : 0;
+        print_padded(x10 / 10, 3);
+        out_putc('.');
+        print_num(x10 % 10);
+        out_puts("x\n");
+    }
+
+    k->free(buf);
+    return 0;
+}
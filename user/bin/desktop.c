@@ -61,6 +61,9 @@ static int SCREEN_HEIGHT;
 #define MAX_WINDOWS 16
 #define MAX_TITLE_LEN 32
 
+// Longest the main loop sleeps with nothing to do (menu bar clock refresh)
+#define DESKTOP_IDLE_MS 500
+
 // Event structure
 typedef struct {
     int type;
@@ -87,6 +90,7 @@ typedef struct {
     win_event_t events[32];
     int event_head;
     int event_tail;
+    wait_queue_t event_wq;  // Woken on push_event (window_wait_event sleeps here)
 } window_t;
 
 // Dock icon
@@ -136,6 +140,12 @@ static int classic_mode = 0;
 static int needs_redraw = 1;        // Full redraw needed
 static int cursor_moved = 0;        // Just cursor position changed
 
+// Frame statistics overlay (toggled from the Apple menu)
+static int show_frame_stats = 0;
+static uint32_t stat_frame_us = 0;  // Compose + present time of the last frame
+static uint32_t stat_fill_px = 0;   // Pixels recomposed in the last frame
+static int stat_rects = 0;          // Rects recomposed in the last frame
+
 // Cursor background save (for cursor-only updates)
 static uint32_t cursor_save[16 * 16];
 static int cursor_save_x = -100, cursor_save_y = -100;
@@ -174,10 +184,12 @@ typedef struct {
 #define ACTION_CUT            5
 #define ACTION_COPY           6
 #define ACTION_PASTE          7
+#define ACTION_FRAME_STATS    8
 
 // Apple menu items
 static const menu_item_t apple_menu[] = {
     { "About This Computer", ACTION_ABOUT },
+    { "Frame Stats", ACTION_FRAME_STATS },
     { NULL, 0 },  // separator
     { "Quit Desktop", ACTION_QUIT },
     { NULL, -1 }  // end marker
@@ -200,6 +212,7 @@ static const menu_item_t edit_menu[] = {
 
 // Forward declarations
 static void draw_desktop(void);
+static void draw_frame_stats(void);
 static void draw_window(int wid);
 static void draw_dock(void);
 static void draw_menu_bar(void);
@@ -207,9 +220,126 @@ static void flip_buffer(void);
 static void draw_about_dialog(void);
 static void draw_circle_filled(int cx, int cy, int r, uint32_t color);
 
+// The main loop sleeps on the input queue when idle. Changes made by other
+// processes (window create/invalidate) kick it so they get composited.
+static inline void wake_desktop(void) {
+    if (api->wait_queue_wake && api->input_wait_queue) {
+        api->wait_queue_wake(api->input_wait_queue);
+    }
+}
+
 // Request a full screen redraw
 static inline void request_redraw(void) {
     needs_redraw = 1;
+    wake_desktop();
+}
+
+// ============ Damage Tracking ============
+
+// Screen rectangles that changed since the last frame. Only these are
+// recomposed (back to front, clipped) and copied to the framebuffer.
+// Apps add to the list through window_invalidate from their own process,
+// possibly on another core, so it is guarded by damage_lock.
+#define MAX_DAMAGE 16
+#define DAMAGE_MERGE_SLACK (64 * 64)  // Extra pixels we'll repaint to save a rect
+
+typedef struct {
+    int x, y, w, h;
+} rect_t;
+
+static rect_t damage[MAX_DAMAGE];
+static int damage_count = 0;
+static volatile int damage_lock = 0;
+
+// With hardware page flipping we draw into the page that was shown one
+// frame ago, so it also needs last frame's damage repaired
+static rect_t prev_damage[MAX_DAMAGE];
+static int prev_damage_count = 0;
+
+static void damage_lock_acquire(void) {
+    while (__atomic_test_and_set(&damage_lock, __ATOMIC_ACQUIRE)) {
+        api->yield();
+    }
+}
+
+static void damage_lock_release(void) {
+    __atomic_clear(&damage_lock, __ATOMIC_RELEASE);
+}
+
+static inline int rect_area(const rect_t *r) {
+    return r->w * r->h;
+}
+
+static rect_t rect_union(const rect_t *a, const rect_t *b) {
+    rect_t u;
+    int x1 = a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w;
+    int y1 = a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h;
+    u.x = a->x < b->x ? a->x : b->x;
+    u.y = a->y < b->y ? a->y : b->y;
+    u.w = x1 - u.x;
+    u.h = y1 - u.y;
+    return u;
+}
+
+// Add a rectangle to a damage list, merging it with any rect it overlaps
+// or nearly touches. Returns the new count.
+static int damage_list_add(rect_t *list, int count, int x, int y, int w, int h) {
+    // Clip to screen
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > SCREEN_WIDTH) w = SCREEN_WIDTH - x;
+    if (y + h > SCREEN_HEIGHT) h = SCREEN_HEIGHT - y;
+    if (w <= 0 || h <= 0) return count;
+
+    rect_t r = { x, y, w, h };
+
+    // Merging can make the result overlap another rect, so rescan
+    int merged = 1;
+    while (merged) {
+        merged = 0;
+        for (int i = 0; i < count; i++) {
+            rect_t u = rect_union(&list[i], &r);
+            if (rect_area(&u) <= rect_area(&list[i]) + rect_area(&r) + DAMAGE_MERGE_SLACK) {
+                r = u;
+                list[i] = list[--count];
+                merged = 1;
+                break;
+            }
+        }
+    }
+
+    if (count == MAX_DAMAGE) {
+        // Out of slots - collapse everything into one bounding rect
+        for (int i = 0; i < count; i++) {
+            r = rect_union(&r, &list[i]);
+        }
+        count = 0;
+    }
+    list[count++] = r;
+    return count;
+}
+
+// Mark part of the screen as needing a redraw
+static void damage_add(int x, int y, int w, int h) {
+    damage_lock_acquire();
+    damage_count = damage_list_add(damage, damage_count, x, y, w, h);
+    damage_lock_release();
+}
+
+// Padding around a window covered by its drop shadow
+#define WINDOW_SHADOW_PAD (SHADOW_BLUR + SHADOW_OFFSET)
+
+// Mark a window's whole footprint (frame, content and shadow) as damaged
+static void damage_window(int wid) {
+    window_t *w = &windows[wid];
+    damage_add(w->x - WINDOW_SHADOW_PAD, w->y - WINDOW_SHADOW_PAD,
+               w->w + 2 * WINDOW_SHADOW_PAD, w->h + 2 * WINDOW_SHADOW_PAD);
+}
+
+// Does a rectangle overlap the area currently being redrawn?
+static inline int clip_overlaps(int x, int y, int w, int h) {
+    return x < gfx.clip_x1 && x + w > gfx.clip_x0 &&
+           y < gfx.clip_y1 && y + h > gfx.clip_y0;
 }
 
 // About dialog state (declared here so draw_desktop can see it)
@@ -250,8 +380,10 @@ static void draw_vibeos_logo(int x, int y) {
 static void draw_icon_bitmap(int x, int y, const unsigned char *bitmap, uint32_t bg_color) {
     uint32_t fg = COLOR_BLACK;
 
-    // Fast path: icon fully visible (no bounds checking per pixel)
-    if (x >= 0 && y >= 0 && x + 32 <= SCREEN_WIDTH && y + 32 <= SCREEN_HEIGHT) {
+    if (!clip_overlaps(x, y, 32, 32)) return;
+
+    // Fast path: icon fully inside the clip (no bounds checking per pixel)
+    if (x >= gfx.clip_x0 && y >= gfx.clip_y0 && x + 32 <= gfx.clip_x1 && y + 32 <= gfx.clip_y1) {
         for (int py = 0; py < 32; py++) {
             uint32_t *row = &backbuffer[(y + py) * SCREEN_WIDTH + x];
             const unsigned char *src = &bitmap[py * 32];
@@ -298,8 +430,13 @@ static void bring_to_front(int wid) {
         window_order[i] = window_order[i - 1];
     }
     window_order[0] = wid;
+
+    // Only the raised window and the one losing focus (title bar) change
+    if (focused_window >= 0 && focused_window != wid && windows[focused_window].active) {
+        damage_window(focused_window);
+    }
     focused_window = wid;
-    request_redraw();
+    damage_window(wid);
 }
 
 static int window_at_point(int x, int y) {
@@ -329,6 +466,8 @@ static void push_event(int wid, int event_type, int data1, int data2, int data3)
     w->events[w->event_tail].data2 = data2;
     w->events[w->event_tail].data3 = data3;
     w->event_tail = next;
+
+    if (api->wait_queue_wake) api->wait_queue_wake(&w->event_wq);
 }
 
 // ============ Window API (registered in kapi) ============
@@ -347,6 +486,7 @@ static int wm_window_create(int x, int y, int w, int h, const char *title) {
     win->pid = 0;  // TODO: get current process
     win->event_head = 0;
     win->event_tail = 0;
+    win->event_wq.seq = 0;
     win->minimized = 0;
     win->maximized = 0;
     win->restore_x = x;
@@ -401,6 +541,9 @@ static void wm_window_destroy(int wid) {
     }
     win->active = 0;
 
+    // Don't leave the owner asleep on a window that's gone
+    if (api->wait_queue_wake) api->wait_queue_wake(&win->event_wq);
+
     // Remove from z-order
     int pos = -1;
     for (int i = 0; i < window_count; i++) {
@@ -446,10 +589,40 @@ static int wm_window_poll_event(int wid, int *event_type, int *data1, int *data2
     return 1;
 }
 
+// Block until the window has an event (1) or timeout_ms passes (0)
+static int wm_window_wait_event(int wid, uint32_t timeout_ms) {
+    if (wid < 0 || wid >= MAX_WINDOWS || !windows[wid].active) return 1;
+    window_t *win = &windows[wid];
+
+    uint32_t seq = win->event_wq.seq;
+    if (win->event_head != win->event_tail) return 1;
+    api->wait_queue_sleep(&win->event_wq, seq, timeout_ms);
+    return !win->active || win->event_head != win->event_tail;
+}
+
+// Invalidate part of a window's content area (content coordinates)
+static void wm_window_invalidate_rect(int wid, int x, int y, int w, int h) {
+    if (wid < 0 || wid >= MAX_WINDOWS || !windows[wid].active) return;
+    window_t *win = &windows[wid];
+    if (win->minimized) return;
+
+    // Clip to the content area (same geometry draw_window() uses)
+    int content_w = win->w - 2;
+    int content_h = win->h - TITLE_BAR_HEIGHT - (classic_mode ? 1 : CORNER_RADIUS) - 1;
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > content_w) w = content_w - x;
+    if (y + h > content_h) h = content_h - y;
+    if (w <= 0 || h <= 0) return;
+
+    win->dirty = 1;
+    damage_add(win->x + 1 + x, win->y + TITLE_BAR_HEIGHT + 1 + y, w, h);
+    wake_desktop();
+}
+
 static void wm_window_invalidate(int wid) {
     if (wid < 0 || wid >= MAX_WINDOWS || !windows[wid].active) return;
-    windows[wid].dirty = 1;
-    request_redraw();
+    wm_window_invalidate_rect(wid, 0, 0, windows[wid].w, windows[wid].h);
 }
 
 static void wm_window_set_title(int wid, const char *title) {
@@ -461,7 +634,9 @@ static void wm_window_set_title(int wid, const char *title) {
     }
     win->title[i] = '\0';
     win->dirty = 1;
-    request_redraw();
+    if (!win->minimized) {
+        damage_add(win->x, win->y, win->w, TITLE_BAR_HEIGHT);
+    }
 }
 
 // ============ Dock ============
@@ -539,6 +714,8 @@ static void draw_dock_icon(dock_icon_t *icon, int icon_idx, int highlight) {
 static int minimized_count = 0;
 
 static void draw_dock(void) {
+    if (!clip_overlaps(0, SCREEN_HEIGHT - DOCK_HEIGHT, SCREEN_WIDTH, DOCK_HEIGHT)) return;
+
     // Use cached dock pill dimensions
     if (classic_mode) {
         // Classic flat mode: simple rectangle, no shadow
@@ -792,6 +969,8 @@ static void draw_dropdown_menu(int menu_x, const menu_item_t *items) {
 }
 
 static void draw_menu_bar(void) {
+    if (!clip_overlaps(0, 0, SCREEN_WIDTH, MENU_BAR_HEIGHT)) return;
+
     // Background
     if (classic_mode) {
         bb_fill_rect(0, 0, SCREEN_WIDTH, MENU_BAR_HEIGHT, COLOR_MENU_BG);
@@ -921,6 +1100,12 @@ static void draw_window(int wid) {
     // Don't draw minimized windows
     if (w->minimized) return;
 
+    // Skip windows outside the area being redrawn
+    if (!clip_overlaps(w->x - WINDOW_SHADOW_PAD, w->y - WINDOW_SHADOW_PAD,
+                       w->w + 2 * WINDOW_SHADOW_PAD, w->h + 2 * WINDOW_SHADOW_PAD)) {
+        return;
+    }
+
     int is_focused = (wid == focused_window);
 
     if (classic_mode) {
@@ -1000,38 +1185,24 @@ static void draw_window(int wid) {
     if (content_h < 1) content_h = 1;
     if (content_w < 1) content_w = 1;
 
-    // Check if window is fully on screen (no clipping needed)
-    int fully_visible = (content_x >= 0) &&
-                        (content_x + content_w <= SCREEN_WIDTH) &&
-                        (content_y >= 0) &&
-                        (content_y + content_h <= SCREEN_HEIGHT);
-
-    if (fully_visible && api->dma_available && api->dma_available() && content_w > 0 && content_h > 0) {
-        // Use DMA 2D copy for fast rectangular blit
-        uint32_t *dst = &backbuffer[content_y * SCREEN_WIDTH + content_x];
-        uint32_t dst_pitch = SCREEN_WIDTH * sizeof(uint32_t);
-        uint32_t *src = w->buffer;
-        uint32_t src_pitch = w->w * sizeof(uint32_t);
-        uint32_t copy_bytes = content_w * sizeof(uint32_t);
-
-        api->dma_copy_2d(dst, dst_pitch, src, src_pitch, copy_bytes, content_h);
-    } else {
-        // Fallback: row-wise copy with clipping
-        for (int py = 0; py < content_h; py++) {
-            int screen_y = content_y + py;
-            if (screen_y >= SCREEN_HEIGHT) break;
-
-            int dst_offset = screen_y * SCREEN_WIDTH + content_x;
-            int src_offset = py * w->w;
-
-            // Clip width to screen bounds
-            int copy_w = content_w;
-            if (content_x + copy_w > SCREEN_WIDTH) {
-                copy_w = SCREEN_WIDTH - content_x;
-            }
-            if (copy_w > 0) {
-                // Use 64-bit copy for entire row
-                memcpy64(&backbuffer[dst_offset], &w->buffer[src_offset], copy_w * sizeof(uint32_t));
+    // Clip the content rect to the area being redrawn
+    int copy_x = content_x, copy_y = content_y;
+    int copy_w = content_w, copy_h = content_h;
+    if (gfx_clip_rect(&gfx, &copy_x, &copy_y, &copy_w, &copy_h)) {
+        uint32_t *dst = &backbuffer[copy_y * SCREEN_WIDTH + copy_x];
+        uint32_t *src = &w->buffer[(copy_y - content_y) * w->w + (copy_x - content_x)];
+
+        if (api->dma_available && api->dma_available()) {
+            // Use DMA 2D copy for fast rectangular blit
+            api->dma_copy_2d(dst, SCREEN_WIDTH * sizeof(uint32_t),
+                             src, w->w * sizeof(uint32_t),
+                             copy_w * sizeof(uint32_t), copy_h);
+        } else {
+            // Row-wise 64-bit copy
+            for (int py = 0; py < copy_h; py++) {
+                memcpy64(dst, src, copy_w * sizeof(uint32_t));
+                dst += SCREEN_WIDTH;
+                src += w->w;
             }
         }
     }
@@ -1193,6 +1364,42 @@ static void draw_desktop(void) {
     if (show_about_dialog) {
         draw_about_dialog();
     }
+
+    if (show_frame_stats) {
+        draw_frame_stats();
+    }
+}
+
+// Recompose a list of screen rects into the backbuffer
+static void compose_rects(const rect_t *rects, int count) {
+    for (int i = 0; i < count; i++) {
+        gfx_set_clip(&gfx, rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+        draw_desktop();
+    }
+    gfx_reset_clip(&gfx);
+}
+
+// Copy a list of rects from the backbuffer to the visible framebuffer
+static void present_rects(const rect_t *rects, int count) {
+    uint32_t pitch = SCREEN_WIDTH * sizeof(uint32_t);
+    int use_dma = api->dma_available && api->dma_available();
+
+    for (int i = 0; i < count; i++) {
+        const rect_t *r = &rects[i];
+        uint32_t *dst = api->fb_base + r->y * SCREEN_WIDTH + r->x;
+        uint32_t *src = backbuffer + r->y * SCREEN_WIDTH + r->x;
+
+        if (use_dma) {
+            // DMA 2D copy - hardware accelerated (Pi)
+            api->dma_copy_2d(dst, pitch, src, pitch, r->w * sizeof(uint32_t), r->h);
+        } else {
+            for (int py = 0; py < r->h; py++) {
+                memcpy64(dst, src, r->w * sizeof(uint32_t));
+                dst += SCREEN_WIDTH;
+                src += SCREEN_WIDTH;
+            }
+        }
+    }
 }
 
 static void flip_buffer(void) {
@@ -1214,6 +1421,161 @@ static void flip_buffer(void) {
     }
 }
 
+// ============ Frame Stats Overlay ============
+
+#define STATS_W 176
+#define STATS_H 60
+#define STATS_X (SCREEN_WIDTH - STATS_W - 8)
+#define STATS_Y (MENU_BAR_HEIGHT + 8)
+
+static char *stats_append_str(char *p, const char *s) {
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+static char *stats_append_num(char *p, unsigned long n) {
+    char num[12];
+    int ni = 0;
+    if (n == 0) num[ni++] = '0';
+    else { while (n > 0) { num[ni++] = '0' + (n % 10); n /= 10; } }
+    while (ni > 0) *p++ = num[--ni];
+    return p;
+}
+
+static void draw_frame_stats(void) {
+    char line[32];
+    char *p;
+    uint32_t screen_px = (uint32_t)SCREEN_WIDTH * SCREEN_HEIGHT;
+
+    bb_fill_rect(STATS_X, STATS_Y, STATS_W, STATS_H, COLOR_MENU_TEXT);
+
+    // Last frame's compose + present time
+    p = stats_append_str(line, "Frame: ");
+    p = stats_append_num(p, stat_frame_us);
+    p = stats_append_str(p, " us");
+    *p = '\0';
+    bb_draw_string(STATS_X + 8, STATS_Y + 4, line, COLOR_WHITE, COLOR_MENU_TEXT);
+
+    // Pixels recomposed, and as a share of the screen
+    p = stats_append_str(line, "Fill:  ");
+    p = stats_append_num(p, stat_fill_px / 1000);
+    p = stats_append_str(p, "K px ");
+    p = stats_append_num(p, screen_px ? (unsigned long)stat_fill_px * 100 / screen_px : 0);
+    p = stats_append_str(p, "%");
+    *p = '\0';
+    bb_draw_string(STATS_X + 8, STATS_Y + 22, line, COLOR_WHITE, COLOR_MENU_TEXT);
+
+    p = stats_append_str(line, "Rects: ");
+    p = stats_append_num(p, stat_rects);
+    *p = '\0';
+    bb_draw_string(STATS_X + 8, STATS_Y + 40, line, COLOR_WHITE, COLOR_MENU_TEXT);
+}
+
+static void frame_stats_record(uint32_t start_us, uint32_t fill_px, int rects) {
+    stat_frame_us = api->get_time_us ? api->get_time_us() - start_us : 0;
+    stat_fill_px = fill_px;
+    stat_rects = rects;
+}
+
+// ============ Frame Composition ============
+
+// Repaint and present the whole screen
+static void redraw_full(void) {
+    uint32_t start = api->get_time_us ? api->get_time_us() : 0;
+
+    // Everything gets repainted, so pending damage is covered
+    damage_lock_acquire();
+    damage_count = 0;
+    damage_lock_release();
+
+    draw_desktop();
+    // Save cursor background BEFORE drawing cursor (so we save the clean background)
+    save_cursor_bg(backbuffer, mouse_x, mouse_y);
+    draw_cursor(mouse_x, mouse_y);
+    flip_buffer();
+
+    // The other hardware page is now stale everywhere
+    prev_damage[0].x = 0;
+    prev_damage[0].y = 0;
+    prev_damage[0].w = SCREEN_WIDTH;
+    prev_damage[0].h = SCREEN_HEIGHT;
+    prev_damage_count = 1;
+
+    frame_stats_record(start, (uint32_t)SCREEN_WIDTH * SCREEN_HEIGHT, 1);
+}
+
+// Repaint and present only the damaged rects
+static void redraw_damage(void) {
+    rect_t rects[MAX_DAMAGE];
+    int count;
+    uint32_t start = api->get_time_us ? api->get_time_us() : 0;
+
+    // Take the pending list; apps may keep adding while we draw
+    damage_lock_acquire();
+    count = damage_count;
+    for (int i = 0; i < count; i++) {
+        rects[i] = damage[i];
+    }
+    damage_count = 0;
+    damage_lock_release();
+
+    // The cursor is redrawn every frame: repair where it was, draw where it is
+    if (cursor_save_valid) {
+        count = damage_list_add(rects, count, cursor_save_x, cursor_save_y, 16, 16);
+    }
+    count = damage_list_add(rects, count, mouse_x, mouse_y, 16, 16);
+    if (show_frame_stats) {
+        count = damage_list_add(rects, count, STATS_X, STATS_Y, STATS_W, STATS_H);
+    }
+
+    // What has to be repainted in the buffer we're drawing into
+    rect_t paint[MAX_DAMAGE];
+    int paint_count = count;
+    for (int i = 0; i < count; i++) {
+        paint[i] = rects[i];
+    }
+    if (use_hw_double_buffer) {
+        for (int i = 0; i < prev_damage_count; i++) {
+            paint_count = damage_list_add(paint, paint_count, prev_damage[i].x, prev_damage[i].y,
+                                          prev_damage[i].w, prev_damage[i].h);
+        }
+    }
+
+    compose_rects(paint, paint_count);
+    save_cursor_bg(backbuffer, mouse_x, mouse_y);
+    draw_cursor(mouse_x, mouse_y);
+
+    if (use_hw_double_buffer) {
+        flip_buffer();
+        for (int i = 0; i < count; i++) {
+            prev_damage[i] = rects[i];
+        }
+        prev_damage_count = count;
+    } else {
+        present_rects(rects, count);
+    }
+
+    uint32_t fill = 0;
+    for (int i = 0; i < paint_count; i++) {
+        fill += rect_area(&paint[i]);
+    }
+    frame_stats_record(start, fill, paint_count);
+}
+
+// Keep the menu bar clock current without waiting for other redraws
+static void clock_tick(void) {
+    unsigned long now = api->get_uptime_ticks();
+    if (now - last_datetime_update < 100) return;
+
+    char old_time[8];
+    strcpy(old_time, cached_time);
+    update_datetime_cache();
+    last_datetime_update = now;
+    if (strcmp(old_time, cached_time) != 0) {
+        damage_add(SCREEN_WIDTH - 200, 0, 200, MENU_BAR_HEIGHT);
+    }
+}
+
 // ============ Input Handling ============
 
 #define ABOUT_W 320
@@ -1365,6 +1727,10 @@ static void do_menu_action(int action) {
                 push_event(focused_window, WIN_EVENT_CLOSE, 0, 0, 0);
             }
             break;
+        case ACTION_FRAME_STATS:
+            show_frame_stats = !show_frame_stats;
+            damage_add(STATS_X, STATS_Y, STATS_W, STATS_H);
+            break;
         case ACTION_CUT:
         case ACTION_COPY:
         case ACTION_PASTE:
@@ -1707,6 +2073,7 @@ static void handle_mouse_release(int x, int y) {
 static void handle_mouse_move(int x, int y) {
     if (dragging_window >= 0) {
         window_t *w = &windows[dragging_window];
+        damage_window(dragging_window);  // Where it was
         w->x = x - drag_offset_x;
         w->y = y - drag_offset_y;
 
@@ -1716,7 +2083,7 @@ static void handle_mouse_move(int x, int y) {
         if (w->x + w->w > SCREEN_WIDTH) w->x = SCREEN_WIDTH - w->w;
         if (w->y + w->h > SCREEN_HEIGHT - DOCK_HEIGHT)
             w->y = SCREEN_HEIGHT - DOCK_HEIGHT - w->h;
-        request_redraw();
+        damage_window(dragging_window);  // Where it is now
         return;  // Don't send move events while dragging
     }
 
@@ -1736,9 +2103,10 @@ static void handle_mouse_move(int x, int y) {
         if (w->y + new_h > SCREEN_HEIGHT - DOCK_HEIGHT)
             new_h = SCREEN_HEIGHT - DOCK_HEIGHT - w->y;
 
+        damage_window(resizing_window);
         w->w = new_w;
         w->h = new_h;
-        request_redraw();
+        damage_window(resizing_window);
         return;  // Don't send move events while resizing
     }
 
@@ -1785,6 +2153,10 @@ static void register_window_api(void) {
     api->window_poll_event = wm_window_poll_event;
     api->window_invalidate = wm_window_invalidate;
     api->window_set_title = wm_window_set_title;
+    api->window_invalidate_rect = wm_window_invalidate_rect;
+    if (api->wait_queue_sleep) {
+        api->window_wait_event = wm_window_wait_event;
+    }
 }
 
 int main(kapi_t *kapi, int argc, char **argv) {
@@ -1841,6 +2213,9 @@ int main(kapi_t *kapi, int argc, char **argv) {
 
     // Main loop
     while (running) {
+        // Snapshot before reading input, so input arriving mid-frame wakes us
+        uint32_t input_seq = api->input_wait_queue ? api->input_wait_queue->seq : 0;
+
         // Poll mouse
         api->mouse_poll();
         api->mouse_get_pos(&mouse_x, &mouse_y);
@@ -1875,9 +2250,9 @@ int main(kapi_t *kapi, int argc, char **argv) {
         // Handle keyboard
         handle_keyboard();
 
-        // Dock hover change requires full redraw (icon highlight changes)
+        // Dock hover change only repaints the dock (icon highlight changes)
         if (dock_hover_changed) {
-            needs_redraw = 1;
+            damage_add(0, SCREEN_HEIGHT - DOCK_HEIGHT, SCREEN_WIDTH, DOCK_HEIGHT);
         }
 
         // Menu open requires full redraw on cursor move (hover highlighting)
@@ -1895,15 +2270,16 @@ int main(kapi_t *kapi, int argc, char **argv) {
             needs_redraw = 1;
         }
 
+        clock_tick();
+
         // Decide what to redraw
         if (needs_redraw) {
             // Full redraw needed
-            draw_desktop();
-            // Save cursor background BEFORE drawing cursor (so we save the clean background)
-            save_cursor_bg(backbuffer, mouse_x, mouse_y);
-            draw_cursor(mouse_x, mouse_y);
-            flip_buffer();
             needs_redraw = 0;
+            redraw_full();
+        } else if (damage_count > 0) {
+            // Recompose just the changed rects
+            redraw_damage();
         } else if (cursor_moved) {
             // Only cursor moved - update cursor directly on visible buffer
             // This is MUCH faster than a full redraw
@@ -1914,8 +2290,14 @@ int main(kapi_t *kapi, int argc, char **argv) {
         mouse_prev_y = mouse_y;
         mouse_prev_buttons = mouse_buttons;
 
-        // Yield to other processes (kernel WFIs if nothing else to run)
-        api->yield();
+        // Nothing left to draw: sleep until input or another process
+        // changes a window. The timeout keeps the menu bar clock ticking.
+        if (api->wait_queue_sleep && api->input_wait_queue &&
+            !needs_redraw && damage_count == 0) {
+            api->wait_queue_sleep(api->input_wait_queue, input_seq, DESKTOP_IDLE_MS);
+        } else {
+            api->yield();
+        }
     }
 
     // Cleanup - clear screen to black and restore console (use DMA if available)
@@ -0,0 +1,221 @@
+/*
+ * dig - look up a host name and show where the answer came from
+ *
+ * Usage: dig [-f] [-s] [-n count] [name]
+ *   Resolves name through the kernel's resolver and prints the address,
+ *   how long it stays cached, whether it came from /etc/hosts, the cache
+ *   or the DNS server, and how long the lookup took. -n repeats it count
+ *   times and reports the average, which after the first is the cost of
+ *   a cache hit. -f flushes the cache first, -s prints the resolver's
+ *   counters afterwards (or on their own, with no name).
+ */
+
+#include "../lib/vibe.h"
+
+static kapi_t *api;
+
+static void out_puts(const char *s) {
+    if (api->stdio_puts) api->stdio_puts(s);
+    else api->puts(s);
+}
+
+static void out_putc(char c) {
+    if (api->stdio_putc) api->stdio_putc(c);
+    else api->putc(c);
+}
+
+static void print_num(unsigned long n) {
+    char buf[24];
+    int i = 0;
+
+    if (n == 0) {
+        out_putc('0');
+        return;
+    }
+
+    while (n > 0) {
+        buf[i++] = '0' + (n % 10);
+        n /= 10;
+    }
+
+    while (i > 0) {
+        out_putc(buf[--i]);
+    }
+}
+
+static int parse_num(const char *s) {
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s - '0');
+        s++;
+    }
+    return n;
+}
+
+static void print_ip(uint32_t ip) {
+    print_num((ip >> 24) & 0xff);
+    out_putc('.');
+    print_num((ip >> 16) & 0xff);
+    out_putc('.');
+    print_num((ip >> 8) & 0xff);
+    out_putc('.');
+    print_num(ip & 0xff);
+}
+
+static const char *source_name(int source) {
+    switch (source) {
+        case DNS_SRC_LITERAL: return "literal";
+        case DNS_SRC_HOSTS:   return "/etc/hosts";
+        case DNS_SRC_CACHE:   return "cache";
+        default:              return "server";
+    }
+}
+
+static const char *rcode_name(int rcode) {
+    switch (rcode) {
+        case DNS_RCODE_NOERROR:  return "NOERROR";
+        case DNS_RCODE_SERVFAIL: return "SERVFAIL";
+        case DNS_RCODE_NXDOMAIN: return "NXDOMAIN";
+        case DNS_RCODE_TIMEOUT:  return "TIMEOUT";
+        default:                 return "ERROR";
+    }
+}
+
+static void print_stat(const char *name, uint32_t value) {
+    out_puts(name);
+    print_num(value);
+    out_putc('\n');
+}
+
+static void print_stats(void) {
+    dns_stats_t st;
+    api->dns_get_stats(&st);
+
+    out_puts(";; RESOLVER\n");
+    print_stat("lookups        ", st.lookups);
+    print_stat("hosts hits     ", st.hosts_hits);
+    print_stat("cache hits     ", st.hits);
+    print_stat("  negative     ", st.negative_hits);
+    print_stat("misses         ", st.misses);
+    print_stat("coalesced      ", st.coalesced);
+    print_stat("queries sent   ", st.queries);
+    print_stat("retransmits    ", st.retransmits);
+    print_stat("timeouts       ", st.timeouts);
+    print_stat("nxdomain       ", st.nxdomain);
+    print_stat("cache entries  ", st.entries);
+    print_stat("hosts entries  ", st.hosts_entries);
+}
+
+int main(kapi_t *k, int argc, char **argv) {
+    api = k;
+
+    int count = 1;
+    int flush = 0;
+    int stats = 0;
+    const char *name = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'f') {
+            flush = 1;
+        } else if (argv[i][0] == '-' && argv[i][1] == 's') {
+            stats = 1;
+        } else if (argv[i][0] == '-' && argv[i][1] == 'n' && i + 1 < argc) {
+            count = parse_num(argv[++i]);
+        } else if (argv[i][0] != '-' && !name) {
+            name = argv[i];
+        } else {
+            name = NULL;
+            stats = 0;
+            flush = 0;
+            break;
+        }
+    }
+    if (count < 1) count = 1;
+
+    if (!name && !stats && !flush) {
+        out_puts("Usage: dig [-f] [-s] [-n count] [name]\n");
+        return 1;
+    }
+
+    if (!k->dns_lookup || !k->get_time_us) {
+        out_puts("dig: kernel has no DNS cache\n");
+        return 1;
+    }
+
+    if (flush) {
+        k->dns_flush();
+        out_puts(";; cache flushed\n");
+    }
+
+    int ok = 1;
+    if (name) {
+        dns_answer_t ans;
+        uint32_t t0 = k->get_time_us();
+        int r = k->dns_lookup(name, &ans);
+        uint32_t first_us = k->get_time_us() - t0;
+
+        out_puts(";; QUESTION\n");
+        out_puts(name);
+        out_puts(".\tIN A\n\n");
+
+        out_puts(";; ANSWER: ");
+        out_puts(rcode_name(ans.rcode));
+        out_putc('\n');
+        if (r == 0) {
+            out_puts(name);
+            out_puts(".\t");
+            print_num(ans.ttl);
+            out_puts("\tIN A\t");
+            print_ip(ans.ip);
+            out_putc('\n');
+        }
+        out_putc('\n');
+
+        out_puts(";; From ");
+        out_puts(source_name(ans.source));
+        if (ans.source == DNS_SRC_CACHE && r != 0) out_puts(" (negative)");
+        out_puts(" in ");
+        print_num(first_us);
+        out_puts(" us\n");
+        ok = (r == 0);
+
+        // Once it's been asked, the rest come from the cache
+        if (count > 1) {
+            uint32_t min = 0xffffffff, max = 0;
+            uint32_t start = k->get_time_us();
+            for (int i = 1; i < count; i++) {
+                uint32_t t = k->get_time_us();
+                k->dns_lookup(name, &ans);
+                t = k->get_time_us() - t;
+                if (t < min) min = t;
+                if (t > max) max = t;
+            }
+            uint32_t us = k->get_time_us() - start;
+            unsigned long avg_ns = (unsigned long)us * 1000 / (count - 1);
+
+            out_puts(";; ");
+            print_num(count - 1);
+            out_puts(" more from ");
+            out_puts(source_name(ans.source));
+            out_puts(": ");
+            print_num(min);
+            out_puts(" / ");
+            print_num(avg_ns / 1000);
+            out_putc('.');
+            uint32_t frac = avg_ns % 1000;
+            out_putc('0' + frac / 100);
+            out_putc('0' + (frac / 10) % 10);
+            out_putc('0' + frac % 10);
+            out_puts(" / ");
+            print_num(max);
+            out_puts(" us (min / avg / max)\n");
+        }
+    }
+
+    if (stats) {
+        if (name) out_putc('\n');
+        print_stats();
+    }
+
+    return ok ? 0 : 1;
+}
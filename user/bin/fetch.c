@@ -284,8 +284,13 @@ static int http_get(url_t *url, char *response, int max_response, http_response_
 
         if (n < 0) break;  // Connection closed
         if (n == 0) {
-            k->net_poll();
-            k->sleep_ms(10);
+            if (!url->use_tls && k->tcp_wait_readable) {
+                // Sleeps until a packet arrives (or 10ms pass)
+                k->tcp_wait_readable(sock, 10);
+            } else {
+                k->net_poll();
+                k->sleep_ms(10);
+            }
             timeout++;
             continue;
         }
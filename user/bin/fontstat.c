@@ -0,0 +1,162 @@
+/*
+ * fontstat - TrueType glyph and run cache counters
+ *
+ * Usage: fontstat [-f] [-b]
+ *   Prints how often ttf_get_glyph() and ttf_measure() were answered from
+ *   the kernel's caches, and how much memory the glyph atlas holds. -f
+ *   flushes both caches first. -b flushes them and lays out a paragraph
+ *   at the browser's text sizes twice, measuring every word and fetching
+ *   every glyph, to show the cost of a cold cache against a warm one.
+ */
+
+#include "../lib/vibe.h"
+
+static kapi_t *api;
+
+static void out_puts(const char *s) {
+    if (api->stdio_puts) api->stdio_puts(s);
+    else api->puts(s);
+}
+
+static void out_putc(char c) {
+    if (api->stdio_putc) api->stdio_putc(c);
+    else api->putc(c);
+}
+
+static void print_num(unsigned long n) {
+    char buf[24];
+    int i = 0;
+
+    if (n == 0) {
+        out_putc('0');
+        return;
+    }
+
+    while (n > 0) {
+        buf[i++] = '0' + (n % 10);
+        n /= 10;
+    }
+
+    while (i > 0) {
+        out_putc(buf[--i]);
+    }
+}
+
+static void print_stat(const char *name, uint32_t value) {
+    out_puts(name);
+    print_num(value);
+    out_putc('\n');
+}
+
+// "  97.5% hit rate" for hits out of hits + misses
+static void print_rate(const char *name, uint32_t hits, uint32_t misses) {
+    unsigned long total = (unsigned long)hits + misses;
+    unsigned long tenths = total ? (unsigned long)hits * 1000 / total : 0;
+
+    out_puts(name);
+    print_num(tenths / 10);
+    out_putc('.');
+    out_putc('0' + tenths % 10);
+    out_puts("%\n");
+}
+
+static void print_stats(void) {
+    ttf_stats_t st;
+    api->ttf_get_stats(&st);
+
+    out_puts("Glyph cache\n");
+    print_stat("  hits         ", st.glyph_hits);
+    print_stat("  misses       ", st.glyph_misses);
+    print_rate("  hit rate     ", st.glyph_hits, st.glyph_misses);
+    print_stat("  glyphs       ", st.glyphs);
+    print_stat("  sizes        ", st.sizes);
+    out_puts("  atlas        ");
+    print_num(st.pages);
+    out_puts(" pages, ");
+    print_num(st.page_bytes / 1024);
+    out_puts(" KB\n");
+    print_stat("  evictions    ", st.page_evictions);
+
+    out_puts("Run cache\n");
+    print_stat("  hits         ", st.run_hits);
+    print_stat("  misses       ", st.run_misses);
+    print_rate("  hit rate     ", st.run_hits, st.run_misses);
+    print_stat("  runs         ", st.runs);
+}
+
+static const char *paragraph =
+    "VibeOS is a hobby operating system for 64-bit ARM. It boots on QEMU "
+    "and on the Raspberry Pi, runs a windowed desktop with a terminal, a "
+    "text editor and a web browser, and speaks TCP, TLS and HTTP. Programs "
+    "are plain ELF files that get a table of kernel functions when they "
+    "start, so there are no system calls to learn: just call the function.";
+
+// Browser body, small, h4, h3, h1
+static const int sizes[] = { 16, 14, 18, 20, 28 };
+#define NUM_SIZES (int)(sizeof(sizes) / sizeof(sizes[0]))
+
+// Measure each word and fetch each glyph, the way a layout pass does
+static uint32_t layout_pass(void) {
+    uint32_t start = api->get_time_us();
+
+    for (int i = 0; i < NUM_SIZES; i++) {
+        for (int style = 0; style < 2; style++) {
+            const char *s = paragraph;
+            while (*s) {
+                int len = 0;
+                while (s[len] && s[len] != ' ') len++;
+                api->ttf_measure(s, len, sizes[i], style);
+                for (int j = 0; j < len; j++) {
+                    api->ttf_get_glyph((unsigned char)s[j], sizes[i], style);
+                }
+                s += len;
+                while (*s == ' ') s++;
+            }
+        }
+    }
+
+    return api->get_time_us() - start;
+}
+
+int main(kapi_t *k, int argc, char **argv) {
+    api = k;
+
+    int flush = 0;
+    int bench = 0;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'f') {
+            flush = 1;
+        } else if (argv[i][0] == '-' && argv[i][1] == 'b') {
+            bench = 1;
+        } else {
+            out_puts("Usage: fontstat [-f] [-b]\n");
+            return 1;
+        }
+    }
+
+    if (!k->ttf_get_stats || !k->ttf_is_ready()) {
+        out_puts("fontstat: no TrueType font loaded\n");
+        return 1;
+    }
+
+    if (flush || bench) {
+        k->ttf_flush();
+        out_puts("Caches flushed\n");
+    }
+
+    if (bench) {
+        uint32_t cold = layout_pass();
+        uint32_t warm = layout_pass();
+
+        out_puts("Layout of ");
+        print_num(NUM_SIZES);
+        out_puts(" sizes x 2 styles: cold ");
+        print_num(cold);
+        out_puts(" us, warm ");
+        print_num(warm);
+        out_puts(" us\n");
+    }
+
+    print_stats();
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * fsbench - filesystem streaming benchmark
+ *
+ * Usage: fsbench [-n MB] [file]
+ *   Creates a test file of MB megabytes (default 64) if needed by appending
+ *   4KB chunks (the pattern loggers and editors use), then:
+ *     1. streams it through read() in 4KB chunks (the pattern cp/grep/wc use)
+ *     2. copies it with /bin/cp
+ *   and reports elapsed time and throughput for each.
+ */
+
+#include "../lib/vibe.h"
+
+static kapi_t *api;
+
+#define DEFAULT_MB   64
+#define CHUNK_SIZE   4096
+
+static void out_puts(const char *s) {
+    if (api->stdio_puts) api->stdio_puts(s);
+    else api->puts(s);
+}
+
+static void out_putc(char c) {
+    if (api->stdio_putc) api->stdio_putc(c);
+    else api->putc(c);
+}
+
+static void print_num(unsigned long n) {
+    char buf[24];
+    int i = 0;
+
+    if (n == 0) {
+        out_putc('0');
+        return;
+    }
+
+    while (n > 0) {
+        buf[i++] = '0' + (n % 10);
+        n /= 10;
+    }
+
+    while (i > 0) {
+        out_putc(buf[--i]);
+    }
+}
+
+static int parse_num(const char *s) {
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s - '0');
+        s++;
+    }
+    return n;
+}
+
+// Print "<ticks*10> ms, <KB/s> KB/s"
+static void report(unsigned long bytes, unsigned long ticks) {
+    if (ticks == 0) ticks = 1;
+    print_num(ticks * 10);
+    out_puts(" ms, ");
+    print_num((bytes / 1024) * 100 / ticks);
+    out_puts(" KB/s\n");
+}
+
+// Create the test file (bytes long) filled with a repeating pattern
+static int make_test_file(const char *path, unsigned long bytes) {
+    char *chunk = api->malloc(CHUNK_SIZE);
+    if (!chunk) {
+        out_puts("fsbench: out of memory creating test file\n");
+        return -1;
+    }
+
+    void *f = api->create(path) ? api->open(path) : 0;
+    if (!f) {
+        api->free(chunk);
+        out_puts("fsbench: cannot create ");
+        out_puts(path);
+        out_putc('\n');
+        return -1;
+    }
+    api->write(f, "", 0);  // Truncate a stale file of the wrong size
+
+    unsigned long written = 0;
+    unsigned long start = api->get_uptime_ticks();
+    while (written < bytes) {
+        unsigned long n = bytes - written;
+        if (n > CHUNK_SIZE) n = CHUNK_SIZE;
+        for (unsigned long i = 0; i < n; i++) {
+            chunk[i] = (char)('a' + ((written + i) % 26));
+        }
+        if (api->append(f, chunk, n) != (int)n) break;
+        written += n;
+    }
+    unsigned long ticks = api->get_uptime_ticks() - start;
+    api->close(f);
+    api->free(chunk);
+
+    if (written != bytes) {
+        out_puts("fsbench: write failed\n");
+        return -1;
+    }
+
+    out_puts("append ");
+    print_num(written);
+    out_puts(" bytes: ");
+    report(written, ticks);
+    return 0;
+}
+
+int main(kapi_t *k, int argc, char **argv) {
+    api = k;
+
+    int mb = DEFAULT_MB;
+    const char *path = "/tmp/fsbench.dat";
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'n' && i + 1 < argc) {
+            mb = parse_num(argv[++i]);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (mb <= 0) mb = DEFAULT_MB;
+
+    unsigned long bytes = (unsigned long)mb * 1024 * 1024;
+
+    // Reuse an existing file of the right size, otherwise (re)create it
+    void *f = k->open(path);
+    if (!f || k->is_dir(f) || (unsigned long)k->file_size(f) != bytes) {
+        if (f) k->close(f);
+        k->mkdir("/tmp");
+        out_puts("fsbench: creating ");
+        print_num(mb);
+        out_puts("MB test file ");
+        out_puts(path);
+        out_putc('\n');
+        if (make_test_file(path, bytes) < 0) return 1;
+        f = k->open(path);
+        if (!f) return 1;
+    }
+
+    // 1. Stream through read() in small sequential chunks
+    char *buf = k->malloc(CHUNK_SIZE);
+    if (!buf) {
+        out_puts("fsbench: out of memory\n");
+        return 1;
+    }
+
+    unsigned long total = 0;
+    unsigned long start = k->get_uptime_ticks();
+    int rd;
+    while ((rd = k->read(f, buf, CHUNK_SIZE, total)) > 0) {
+        total += rd;
+    }
+    unsigned long ticks = k->get_uptime_ticks() - start;
+    k->close(f);
+    k->free(buf);
+
+    out_puts("read  ");
+    print_num(total);
+    out_puts(" bytes: ");
+    report(total, ticks);
+
+    // 2. Copy with /bin/cp (same loop, plus the write side)
+    char dst[256];
+    strncpy_safe(dst, path, sizeof(dst) - 5);
+    strcat(dst, ".cp");
+    k->delete(dst);
+
+    char *cp_argv[3] = { "/bin/cp", (char *)path, dst };
+    start = k->get_uptime_ticks();
+    int status = k->exec_args("/bin/cp", 3, cp_argv);
+    ticks = k->get_uptime_ticks() - start;
+
+    if (status != 0) {
+        out_puts("fsbench: cp failed\n");
+    } else {
+        out_puts("cp    ");
+        print_num(bytes);
+        out_puts(" bytes: ");
+        report(bytes, ticks);
+    }
+    k->delete(dst);
+
+    return 0;
+}
@@ -0,0 +1,299 @@
+/*
+ * gfxbench - gfx.h drawing speed, plain C spans vs NEON
+ *
+ * Usage: gfxbench [-n passes]
+ *   Draws each primitive over a 640x480 off-screen buffer passes times
+ *   (default 20) - solid and alpha fills, 8x16 text, antialiased glyph
+ *   coverage, both gradients and two blurs - once through the scalar kernels
+ *   and once through the ones gfx.h normally uses, checks that both drew
+ *   the same pixels, and reports megapixels per second for each.
+ */
+
+#include "../lib/vibe.h"
+#include "../lib/gfx.h"
+
+static kapi_t *api;
+static volatile uint32_t sink;  // Keeps the loops from being optimized out
+
+#define BENCH_W         640
+#define BENCH_H         480
+#define DEFAULT_PASSES  20
+#define GLYPH_W         12
+#define GLYPH_H         16
+
+static uint8_t coverage[GLYPH_W * GLYPH_H];  // A made-up antialiased glyph
+
+static void out_puts(const char *s) {
+    if (api->stdio_puts) api->stdio_puts(s);
+    else api->puts(s);
+}
+
+static void out_putc(char c) {
+    if (api->stdio_putc) api->stdio_putc(c);
+    else api->putc(c);
+}
+
+static void print_num(unsigned long n) {
+    char buf[24];
+    int i = 0;
+
+    if (n == 0) {
+        out_putc('0');
+        return;
+    }
+
+    while (n > 0) {
+        buf[i++] = '0' + (n % 10);
+        n /= 10;
+    }
+
+    while (i > 0) {
+        out_putc(buf[--i]);
+    }
+}
+
+// Right-align n in a field of width characters
+static void print_padded(unsigned long n, int width) {
+    int digits = 1;
+    for (unsigned long t = n; t >= 10; t /= 10) digits++;
+    while (digits++ < width) out_putc(' ');
+    print_num(n);
+}
+
+// Tenths as "12.3", right-aligned
+static void print_tenths(unsigned long tenths, int width) {
+    print_padded(tenths / 10, width - 2);
+    out_putc('.');
+    out_putc('0' + tenths % 10);
+}
+
+static int parse_num(const char *s) {
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s - '0');
+        s++;
+    }
+    return n;
+}
+
+// Each primitive draws one full pass over the buffer, through the scalar
+// kernels or the usual ones, and returns how many pixels it touched
+
+static unsigned long draw_fill(gfx_ctx_t *ctx, int scalar, int pass) {
+    uint32_t color = 0x336699 + pass;
+    for (int y = 0; y < ctx->height; y++) {
+        uint32_t *row = &ctx->buffer[y * ctx->width];
+        if (scalar) gfx_span_fill_scalar(row, ctx->width, color);
+        else gfx_span_fill(row, ctx->width, color);
+    }
+    return (unsigned long)ctx->width * ctx->height;
+}
+
+static unsigned long draw_alpha(gfx_ctx_t *ctx, int scalar, int pass) {
+    uint32_t color = 0xC08040;
+    uint8_t alpha = 96 + pass;
+    for (int y = 0; y < ctx->height; y++) {
+        uint32_t *row = &ctx->buffer[y * ctx->width];
+        if (scalar) gfx_span_blend_scalar(row, ctx->width, color, alpha);
+        else gfx_span_blend(row, ctx->width, color, alpha);
+    }
+    return (unsigned long)ctx->width * ctx->height;
+}
+
+// A screen of 8x16 text, as the terminal draws it
+static unsigned long draw_text(gfx_ctx_t *ctx, int scalar, int pass) {
+    int cols = ctx->width / 8, rows = ctx->height / 16;
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            unsigned char ch = 33 + (r * cols + c + pass) % 94;
+            const uint8_t *glyph = &ctx->font[ch * 16];
+            uint32_t *dst = &ctx->buffer[r * 16 * ctx->width + c * 8];
+            for (int y = 0; y < 16; y++, dst += ctx->width) {
+                if (scalar) gfx_span_bits_scalar(dst, glyph[y], 0, 8, 0xFFFFFF, 0x000000);
+                else gfx_span_bits(dst, glyph[y], 0, 8, 0xFFFFFF, 0x000000);
+            }
+        }
+    }
+    return (unsigned long)cols * 8 * rows * 16;
+}
+
+// A screen of antialiased glyphs, as TTF text draws them
+static unsigned long draw_coverage(gfx_ctx_t *ctx, int scalar, int pass) {
+    uint32_t fg = 0x202020 + pass, bg = 0xF0F0F0;
+    int cols = ctx->width / GLYPH_W, rows = ctx->height / GLYPH_H;
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            uint32_t *dst = &ctx->buffer[r * GLYPH_H * ctx->width + c * GLYPH_W];
+            const uint8_t *cov = coverage;
+            for (int y = 0; y < GLYPH_H; y++, dst += ctx->width, cov += GLYPH_W) {
+                if (scalar) gfx_span_coverage_scalar(dst, cov, GLYPH_W, fg, bg);
+                else gfx_span_coverage(dst, cov, GLYPH_W, fg, bg);
+            }
+        }
+    }
+    return (unsigned long)cols * GLYPH_W * rows * GLYPH_H;
+}
+
+static unsigned long draw_gradient_h(gfx_ctx_t *ctx, int scalar, int pass) {
+    uint32_t left = 0x102030 + pass, right = 0xF0E0D0;
+    uint32_t *first = ctx->buffer;
+    if (scalar) gfx_span_gradient_scalar(first, ctx->width, left, right, 0, ctx->width - 1);
+    else gfx_span_gradient(first, ctx->width, left, right, 0, ctx->width - 1);
+    for (int y = 1; y < ctx->height; y++) {
+        if (scalar) gfx_span_copy_scalar(first + y * ctx->width, first, ctx->width);
+        else gfx_span_copy(first + y * ctx->width, first, ctx->width);
+    }
+    return (unsigned long)ctx->width * ctx->height;
+}
+
+static unsigned long draw_gradient_v(gfx_ctx_t *ctx, int scalar, int pass) {
+    uint32_t top = 0x4060A0 + pass, bottom = 0x102040;
+    for (int y = 0; y < ctx->height; y++) {
+        uint32_t color;
+        gfx_span_gradient_scalar(&color, 1, top, bottom, y, ctx->height - 1);
+        uint32_t *row = &ctx->buffer[y * ctx->width];
+        if (scalar) gfx_span_fill_scalar(row, ctx->width, color);
+        else gfx_span_fill(row, ctx->width, color);
+    }
+    return (unsigned long)ctx->width * ctx->height;
+}
+
+// Frosted glass: a small radius at full size, a big one shrunk 4x
+static unsigned long draw_blur(gfx_ctx_t *ctx, int scalar, int pass) {
+    (void)pass;
+    if (scalar) gfx_blur_region_scaled_scalar(ctx, 0, 0, ctx->width, ctx->height, 4, 1);
+    else gfx_blur_region_scaled(ctx, 0, 0, ctx->width, ctx->height, 4, 1);
+    return (unsigned long)ctx->width * ctx->height;
+}
+
+static unsigned long draw_blur_scaled(gfx_ctx_t *ctx, int scalar, int pass) {
+    (void)pass;
+    if (scalar) gfx_blur_region_scaled_scalar(ctx, 0, 0, ctx->width, ctx->height, 16, 4);
+    else gfx_blur_region_scaled(ctx, 0, 0, ctx->width, ctx->height, 16, 4);
+    return (unsigned long)ctx->width * ctx->height;
+}
+
+typedef unsigned long (*draw_fn_t)(gfx_ctx_t *ctx, int scalar, int pass);
+
+static const struct {
+    const char *name;
+    draw_fn_t draw;
+} prims[] = {
+    { "fill       ", draw_fill },
+    { "alpha fill ", draw_alpha },
+    { "text 8x16  ", draw_text },
+    { "coverage   ", draw_coverage },
+    { "gradient h ", draw_gradient_h },
+    { "gradient v ", draw_gradient_v },
+    { "blur r=4   ", draw_blur },
+    { "blur r=16/4", draw_blur_scaled },
+};
+#define NUM_PRIMS (sizeof(prims) / sizeof(prims[0]))
+
+// Tenths of a megapixel per second over passes passes
+static unsigned long run(draw_fn_t draw, gfx_ctx_t *ctx, int scalar, int passes) {
+    unsigned long pixels = 0;
+    uint32_t start = api->get_time_us();
+    for (int i = 0; i < passes; i++) {
+        pixels += draw(ctx, scalar, i);
+    }
+    uint32_t us = api->get_time_us() - start;
+    sink = ctx->buffer[ctx->width * ctx->height / 2];
+
+    if (us == 0) us = 1;
+    return pixels * 10 / us;
+}
+
+int main(kapi_t *k, int argc, char **argv) {
+    api = k;
+
+    int passes = DEFAULT_PASSES;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'n' && i + 1 < argc) {
+            passes = parse_num(argv[++i]);
+        } else {
+            out_puts("Usage: gfxbench [-n passes]\n");
+            return 1;
+        }
+    }
+    if (passes < 1) passes = DEFAULT_PASSES;
+
+    if (!k->get_time_us || !k->font_data) {
+        out_puts("gfxbench: kernel has no timer or font\n");
+        return 1;
+    }
+
+    uint32_t *a = k->malloc(BENCH_W * BENCH_H * sizeof(uint32_t));
+    uint32_t *b = k->malloc(BENCH_W * BENCH_H * sizeof(uint32_t));
+    if (!a || !b) {
+        out_puts("gfxbench: out of memory\n");
+        if (a) k->free(a);
+        if (b) k->free(b);
+        return 1;
+    }
+
+    // A round blob, soft at the edges, with some fully clear and fully
+    // solid pixels like a real glyph has
+    for (int y = 0; y < GLYPH_H; y++) {
+        for (int x = 0; x < GLYPH_W; x++) {
+            int dx = 2 * x - GLYPH_W + 1, dy = 2 * y - GLYPH_H + 1;
+            int d = dx * dx + dy * dy;
+            int v = 255 - (d - 40) * 2;
+            coverage[y * GLYPH_W + x] = v < 0 ? 0 : v > 255 ? 255 : v;
+        }
+    }
+
+    gfx_ctx_t ca, cb;
+    gfx_init(&ca, a, BENCH_W, BENCH_H, k->font_data);
+    gfx_init(&cb, b, BENCH_W, BENCH_H, k->font_data);
+
+    // Both ways must draw the same thing, starting from the same pixels
+    uint32_t seed = 12345;
+    for (int i = 0; i < BENCH_W * BENCH_H; i++) {
+        seed = seed * 1103515245 + 12345;
+        a[i] = b[i] = seed >> 8;
+    }
+    for (uint32_t p = 0; p < NUM_PRIMS; p++) {
+        prims[p].draw(&ca, 1, 3);
+        prims[p].draw(&cb, 0, 3);
+        for (int i = 0; i < BENCH_W * BENCH_H; i++) {
+            if (a[i] != b[i]) {
+                out_puts("gfxbench: scalar and NEON differ in ");
+                out_puts(prims[p].name);
+                out_putc('\n');
+                k->free(a);
+                k->free(b);
+                return 1;
+            }
+        }
+    }
+
+    out_puts("gfxbench: ");
+    print_num(BENCH_W);
+    out_putc('x');
+    print_num(BENCH_H);
+    out_puts(", ");
+    print_num(passes);
+    out_puts(" passes");
+#ifndef __ARM_NEON
+    out_puts(" (built without NEON)");
+#endif
+    out_puts("\n\n");
+    out_puts("  primitive    scalar Mpix/s   NEON Mpix/s  speedup\n");
+
+    for (uint32_t p = 0; p < NUM_PRIMS; p++) {
+        unsigned long scalar = run(prims[p].draw, &ca, 1, passes);
+        unsigned long fast = run(prims[p].draw, &ca, 0, passes);
+
+        out_puts("  ");
+        out_puts(prims[p].name);
+        print_tenths(scalar, 15);
+        print_tenths(fast, 14);
+        print_tenths(scalar ? fast * 10 / scalar : 0, 8);
+        out_puts("x\n");
+    }
+
+    k->free(a);
+    k->free(b);
+    return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * httpbench - HTTP requests per second over the loopback interface
+ *
+ * Usage: httpbench [-n requests] [-p port] [path]
+ *   Starts /bin/httpd on port 8080 for exactly the requests it will make,
+ *   then fetches path (default /status) from 127.0.0.1 that many times
+ *   (default 200), one connection each, and reports requests per second
+ *   and per-request latency. -p uses a server that's already running on
+ *   that port instead of starting one.
+ */
+
+#include "../lib/vibe.h"
+
+static kapi_t *api;
+
+#define DEFAULT_REQUESTS 200
+#define DEFAULT_PORT     8080
+#define RECV_BUF         4096
+
+static void out_puts(const char *s) {
+    if (api->stdio_puts) api->stdio_puts(s);
+    else api->puts(s);
+}
+
+static void out_putc(char c) {
+    if (api->stdio_putc) api->stdio_putc(c);
+    else api->putc(c);
+}
+
+static void print_num(unsigned long n) {
+    char buf[24];
+    int i = 0;
+
+    if (n == 0) {
+        out_putc('0');
+        return;
+    }
+
+    while (n > 0) {
+        buf[i++] = '0' + (n % 10);
+        n /= 10;
+    }
+
+    while (i > 0) {
+        out_putc(buf[--i]);
+    }
+}
+
+static void num_to_str(unsigned long n, char *buf) {
+    char tmp[24];
+    int i = 0;
+    do {
+        tmp[i++] = '0' + (n % 10);
+        n /= 10;
+    } while (n > 0);
+
+    int j = 0;
+    while (i > 0) buf[j++] = tmp[--i];
+    buf[j] = '\0';
+}
+
+static int parse_num(const char *s) {
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s - '0');
+        s++;
+    }
+    return n;
+}
+
+// One request on a fresh connection. Returns response bytes, -1 on failure.
+static long fetch(int port, const char *request, char *buf) {
+    int sock = api->tcp_connect(MAKE_IP(127, 0, 0, 1), port);
+    if (sock < 0) return -1;
+
+    api->tcp_send(sock, request, strlen(request));
+
+    // The server closes when it's done
+    long total = 0;
+    for (;;) {
+        if (!api->tcp_wait_readable(sock, 5000)) {
+            total = -1;
+            break;
+        }
+        int n = api->tcp_recv(sock, buf, RECV_BUF);
+        if (n < 0) break;
+        total += n;
+    }
+
+    api->tcp_close(sock);
+    return total;
+}
+
+int main(kapi_t *k, int argc, char **argv) {
+    api = k;
+
+    int requests = DEFAULT_REQUESTS;
+    int port = DEFAULT_PORT;
+    int external = 0;
+    const char *path = "/status";
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'n' && i + 1 < argc) {
+            requests = parse_num(argv[++i]);
+        } else if (argv[i][0] == '-' && argv[i][1] == 'p' && i + 1 < argc) {
+            port = parse_num(argv[++i]);
+            external = 1;
+        } else if (argv[i][0] == '/') {
+            path = argv[i];
+        } else {
+            out_puts("Usage: httpbench [-n requests] [-p port] [path]\n");
+            return 1;
+        }
+    }
+    if (requests < 1) requests = DEFAULT_REQUESTS;
+
+    if (!k->tcp_listen || !k->tcp_wait_readable || !k->get_time_us) {
+        out_puts("httpbench: kernel has no tcp_listen\n");
+        return 1;
+    }
+
+    if (!external) {
+        char port_str[24], count_str[24];
+        num_to_str(port, port_str);
+        num_to_str(requests, count_str);
+
+        char *args[] = { "/bin/httpd", "-p", port_str, "-n", count_str };
+        if (k->spawn_args("/bin/httpd", 5, args) <= 0) {
+            out_puts("httpbench: can't start /bin/httpd\n");
+            return 1;
+        }
+        // Give it a moment to start listening
+        k->sleep_ms(200);
+    }
+
+    char *buf = k->malloc(RECV_BUF);
+    if (!buf) {
+        out_puts("httpbench: out of memory\n");
+        return 1;
+    }
+
+    char request[300];
+    strcpy(request, "GET ");
+    strncpy_safe(request + 4, path, 256);
+    strcat(request, " HTTP/1.0\r\nHost: 127.0.0.1\r\n\r\n");
+
+    out_puts("httpbench: ");
+    print_num(requests);
+    out_puts(" x GET ");
+    out_puts(path);
+    out_puts(" from 127.0.0.1:");
+    print_num(port);
+    out_putc('\n');
+
+    unsigned long bytes = 0;
+    uint32_t lat_min = 0xffffffff, lat_max = 0;
+    int done = 0;
+    uint32_t start = k->get_time_us();
+
+    for (int i = 0; i < requests; i++) {
+        uint32_t t0 = k->get_time_us();
+        long n = fetch(port, request, buf);
+        uint32_t lat = k->get_time_us() - t0;
+        if (n < 0) {
+            out_puts("httpbench: request ");
+            print_num(i + 1);
+            out_puts(" failed\n");
+            break;
+        }
+        bytes += n;
+        done++;
+        if (lat < lat_min) lat_min = lat;
+        if (lat > lat_max) lat_max = lat;
+    }
+
+    uint32_t us = k->get_time_us() - start;
+    k->free(buf);
+    if (us == 0) us = 1;
+
+    out_puts("Requests:   ");
+    print_num(done);
+    out_puts(" in ");
+    print_num(us / 1000);
+    out_puts(" ms, ");
+    print_num(bytes / 1024);
+    out_puts(" KB\n");
+
+    if (done) {
+        out_puts("Rate:       ");
+        print_num((unsigned long)((uint64_t)done * 1000000 / us));
+        out_puts(" req/s\n");
+
+        out_puts("Latency:    ");
+        print_num(lat_min);
+        out_puts(" / ");
+        print_num(us / done);
+        out_puts(" / ");
+        print_num(lat_max);
+        out_puts(" us (min / avg / max)\n");
+    }
+
+    return done == requests ? 0 : 1;
+}
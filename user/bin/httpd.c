@@ -0,0 +1,308 @@
+/*
+ * httpd - minimal HTTP/1.0 file server
+ *
+ * Usage: httpd [-p port] [-r root] [-n count]
+ *   Serves files under root (default /) on port (default 80), one request
+ *   per connection. Directories get index.html if there is one, otherwise
+ *   a listing. /status reports uptime, memory and TCP counters as plain
+ *   text. -n exits after count requests (httpbench uses it); otherwise
+ *   press q to stop.
+ */
+
+#include "../lib/vibe.h"
+
+static kapi_t *api;
+
+#define DEFAULT_PORT  80
+#define MAX_REQUEST   1024
+#define MAX_PATH      256
+#define FILE_CHUNK    4096
+
+static void out_puts(const char *s) {
+    if (api->stdio_puts) api->stdio_puts(s);
+    else api->puts(s);
+}
+
+static int parse_num(const char *s) {
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s - '0');
+        s++;
+    }
+    return n;
+}
+
+static void num_to_str(unsigned long n, char *buf) {
+    char tmp[24];
+    int i = 0;
+    do {
+        tmp[i++] = '0' + (n % 10);
+        n /= 10;
+    } while (n > 0);
+
+    int j = 0;
+    while (i > 0) buf[j++] = tmp[--i];
+    buf[j] = '\0';
+}
+
+static void send_str(int sock, const char *s) {
+    api->tcp_send(sock, s, strlen(s));
+}
+
+// Append "name value\n" to a status report
+static void add_stat(char *out, const char *name, unsigned long value) {
+    char num[24];
+    num_to_str(value, num);
+    strcat(out, name);
+    strcat(out, " ");
+    strcat(out, num);
+    strcat(out, "\n");
+}
+
+// Every tcp_send() goes out as its own segment, so the header is built
+// up first and sent in one piece
+static void send_header(int sock, const char *status, const char *type, long length) {
+    char hdr[256];
+    strcpy(hdr, "HTTP/1.0 ");
+    strcat(hdr, status);
+    strcat(hdr, "\r\nServer: VibeOS httpd\r\nConnection: close\r\nContent-Type: ");
+    strcat(hdr, type);
+    if (length >= 0) {
+        char num[24];
+        num_to_str(length, num);
+        strcat(hdr, "\r\nContent-Length: ");
+        strcat(hdr, num);
+    }
+    strcat(hdr, "\r\n\r\n");
+    send_str(sock, hdr);
+}
+
+static int has_dotdot(const char *s) {
+    for (; *s; s++) {
+        if (s[0] == '.' && s[1] == '.') return 1;
+    }
+    return 0;
+}
+
+static void send_error(int sock, const char *status) {
+    send_header(sock, status, "text/plain", strlen(status) + 1);
+    send_str(sock, status);
+    send_str(sock, "\n");
+}
+
+static int ends_with(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+static const char *content_type(const char *path) {
+    if (ends_with(path, ".html") || ends_with(path, ".htm")) return "text/html";
+    if (ends_with(path, ".css")) return "text/css";
+    if (ends_with(path, ".js")) return "application/javascript";
+    if (ends_with(path, ".png")) return "image/png";
+    if (ends_with(path, ".jpg") || ends_with(path, ".jpeg")) return "image/jpeg";
+    if (ends_with(path, ".gif")) return "image/gif";
+    if (ends_with(path, ".txt") || ends_with(path, ".md") || ends_with(path, ".py") ||
+        ends_with(path, ".c") || ends_with(path, ".h")) return "text/plain";
+    return "application/octet-stream";
+}
+
+static void serve_status(int sock, char *buf) {
+    buf[0] = '\0';
+    add_stat(buf, "uptime_s", api->get_uptime_ticks() / 100);
+    add_stat(buf, "mem_used", api->get_mem_used());
+    add_stat(buf, "mem_free", api->get_mem_free());
+
+    if (api->tcp_get_stats) {
+        tcp_stats_t st;
+        api->tcp_get_stats(&st);
+        add_stat(buf, "tcp_segs_in", st.segs_in);
+        add_stat(buf, "tcp_segs_out", st.segs_out);
+        add_stat(buf, "tcp_retransmits", st.retransmits);
+    }
+
+    send_header(sock, "200 OK", "text/plain", strlen(buf));
+    send_str(sock, buf);
+}
+
+static void serve_listing(int sock, void *dir, const char *url) {
+    send_header(sock, "200 OK", "text/html", -1);
+    send_str(sock, "<html><body><h1>Index of ");
+    send_str(sock, url);
+    send_str(sock, "</h1><ul>\n");
+
+    char name[MAX_PATH];
+    char line[MAX_PATH * 3 + 32];
+    uint8_t type;
+    for (int i = 0; api->readdir(dir, i, name, sizeof(name), &type) >= 0; i++) {
+        strcpy(line, "<li><a href=\"");
+        strcat(line, url);
+        if (!ends_with(url, "/")) strcat(line, "/");
+        strcat(line, name);
+        strcat(line, type == 2 ? "/\">" : "\">");
+        strcat(line, name);
+        strcat(line, type == 2 ? "/</a>\n" : "</a>\n");
+        send_str(sock, line);
+    }
+    send_str(sock, "</ul></body></html>\n");
+}
+
+static void serve_file(int sock, void *file, const char *path, char *buf) {
+    int size = api->file_size(file);
+    send_header(sock, "200 OK", content_type(path), size);
+
+    size_t offset = 0;
+    int n;
+    while ((n = api->read(file, buf, FILE_CHUNK, offset)) > 0) {
+        if (api->tcp_send(sock, buf, n) < 0) break;
+        offset += n;
+    }
+}
+
+// Read the request head (up to the blank line) into req
+static int read_request(int sock, char *req) {
+    int len = 0;
+    while (len < MAX_REQUEST - 1) {
+        if (api->tcp_wait_readable && !api->tcp_wait_readable(sock, 5000)) return -1;
+        int n = api->tcp_recv(sock, req + len, MAX_REQUEST - 1 - len);
+        if (n < 0) return -1;
+        len += n;
+        req[len] = '\0';
+        for (int i = 3; i < len; i++) {
+            if (req[i - 3] == '\r' && req[i - 2] == '\n' && req[i - 1] == '\r' && req[i] == '\n') {
+                return len;
+            }
+        }
+    }
+    return len;
+}
+
+static void handle(int sock, const char *root, char *buf) {
+    char req[MAX_REQUEST];
+    if (read_request(sock, req) <= 0) return;
+
+    // "GET /path HTTP/1.x"
+    int is_head = strncmp(req, "HEAD ", 5) == 0;
+    if (strncmp(req, "GET ", 4) != 0 && !is_head) {
+        send_error(sock, "501 Not Implemented");
+        return;
+    }
+
+    char url[MAX_PATH];
+    const char *p = req + (is_head ? 5 : 4);
+    int n = 0;
+    while (*p && *p != ' ' && *p != '?' && n < MAX_PATH - 1) url[n++] = *p++;
+    url[n] = '\0';
+
+    if (url[0] != '/' || has_dotdot(url)) {
+        send_error(sock, "400 Bad Request");
+        return;
+    }
+    if (strcmp(url, "/status") == 0) {
+        serve_status(sock, buf);
+        return;
+    }
+
+    char path[MAX_PATH * 2];
+    strcpy(path, root);
+    if (ends_with(path, "/")) path[strlen(path) - 1] = '\0';
+    strcat(path, url);
+
+    void *node = api->open(path[0] ? path : "/");
+    if (!node) {
+        send_error(sock, "404 Not Found");
+        return;
+    }
+
+    if (api->is_dir(node)) {
+        char index[MAX_PATH * 2 + 16];
+        strcpy(index, path);
+        if (!ends_with(index, "/")) strcat(index, "/");
+        strcat(index, "index.html");
+        void *file = api->open(index);
+        if (file && !api->is_dir(file)) {
+            if (is_head) send_header(sock, "200 OK", "text/html", api->file_size(file));
+            else serve_file(sock, file, index, buf);
+        } else if (is_head) {
+            send_header(sock, "200 OK", "text/html", -1);
+        } else {
+            serve_listing(sock, node, url);
+        }
+        return;
+    }
+
+    if (is_head) {
+        send_header(sock, "200 OK", content_type(path), api->file_size(node));
+    } else {
+        serve_file(sock, node, path, buf);
+    }
+}
+
+int main(kapi_t *k, int argc, char **argv) {
+    api = k;
+
+    int port = DEFAULT_PORT;
+    const char *root = "/";
+    int count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'p' && i + 1 < argc) {
+            port = parse_num(argv[++i]);
+        } else if (argv[i][0] == '-' && argv[i][1] == 'r' && i + 1 < argc) {
+            root = argv[++i];
+        } else if (argv[i][0] == '-' && argv[i][1] == 'n' && i + 1 < argc) {
+            count = parse_num(argv[++i]);
+        } else {
+            out_puts("Usage: httpd [-p port] [-r root] [-n count]\n");
+            return 1;
+        }
+    }
+
+    if (!k->tcp_listen || !k->tcp_accept) {
+        out_puts("httpd: kernel has no tcp_listen\n");
+        return 1;
+    }
+
+    int listener = k->tcp_listen(port, 8);
+    if (listener < 0) {
+        out_puts("httpd: can't listen on that port\n");
+        return 1;
+    }
+
+    char *buf = k->malloc(FILE_CHUNK);
+    if (!buf) {
+        out_puts("httpd: out of memory\n");
+        k->tcp_close(listener);
+        return 1;
+    }
+
+    char num[24];
+    num_to_str(port, num);
+    out_puts("httpd: serving ");
+    out_puts(root);
+    out_puts(" on port ");
+    out_puts(num);
+    out_puts(count ? "\n" : " (q to quit)\n");
+
+    int served = 0;
+    while (!count || served < count) {
+        // Wake up now and then to check for q
+        int sock = k->tcp_accept(listener, count ? 0 : 500);
+        if (sock < 0) {
+            if (!count && vibe_has_key(k) && vibe_getc(k) == 'q') break;
+            continue;
+        }
+        handle(sock, root, buf);
+        k->tcp_close(sock);
+        served++;
+    }
+
+    k->tcp_close(listener);
+    k->free(buf);
+
+    num_to_str(served, num);
+    out_puts("httpd: served ");
+    out_puts(num);
+    out_puts(" requests\n");
+    return 0;
+}
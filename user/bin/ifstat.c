@@ -0,0 +1,138 @@
+/*
+ * ifstat - network interface counters and packet rates
+ *
+ * Usage: ifstat [-w seconds]
+ *   Prints each interface's address, packet and byte counts, drops, and
+ *   packets per second in each direction. For eth0 it also shows how many
+ *   frames go to the NIC per notification. -w then prints the rates once a
+ *   second for that many seconds (q stops early).
+ */
+
+#include "../lib/vibe.h"
+
+static kapi_t *api;
+
+static void out_puts(const char *s) {
+    if (api->stdio_puts) api->stdio_puts(s);
+    else api->puts(s);
+}
+
+static void out_putc(char c) {
+    if (api->stdio_putc) api->stdio_putc(c);
+    else api->putc(c);
+}
+
+static void print_num(unsigned long n) {
+    char buf[24];
+    int i = 0;
+
+    if (n == 0) {
+        out_putc('0');
+        return;
+    }
+
+    while (n > 0) {
+        buf[i++] = '0' + (n % 10);
+        n /= 10;
+    }
+
+    while (i > 0) {
+        out_putc(buf[--i]);
+    }
+}
+
+static int parse_num(const char *s) {
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s - '0');
+        s++;
+    }
+    return n;
+}
+
+static void print_ip(uint32_t ip) {
+    print_num((ip >> 24) & 0xff);
+    out_putc('.');
+    print_num((ip >> 16) & 0xff);
+    out_putc('.');
+    print_num((ip >> 8) & 0xff);
+    out_putc('.');
+    print_num(ip & 0xff);
+}
+
+static void print_iface(int index, const net_if_stats_t *st) {
+    out_puts(st->name);
+    out_puts(": ");
+    print_ip(st->ip);
+    out_putc('\n');
+
+    out_puts("  RX ");
+    print_num(st->rx_packets);
+    out_puts(" packets, ");
+    print_num((unsigned long)(st->rx_bytes / 1024));
+    out_puts(" KB, ");
+    print_num(st->rx_pps);
+    out_puts(" pps, ");
+    print_num(st->rx_csum_errors);
+    out_puts(" bad checksums\n");
+
+    out_puts("  TX ");
+    print_num(st->tx_packets);
+    out_puts(" packets, ");
+    print_num((unsigned long)(st->tx_bytes / 1024));
+    out_puts(" KB, ");
+    print_num(st->tx_pps);
+    out_puts(" pps, ");
+    print_num(st->tx_dropped);
+    out_puts(" dropped\n");
+
+    if (index == NET_IF_ETH0 && st->tx_kicks) {
+        out_puts("  ");
+        print_num(st->tx_kicks);
+        out_puts(" NIC notifications, ");
+        print_num(st->tx_packets / st->tx_kicks);
+        out_puts(" frames each\n");
+    }
+}
+
+int main(kapi_t *k, int argc, char **argv) {
+    api = k;
+
+    int watch = 0;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'w' && i + 1 < argc) {
+            watch = parse_num(argv[++i]);
+        } else {
+            out_puts("Usage: ifstat [-w seconds]\n");
+            return 1;
+        }
+    }
+
+    if (!k->net_get_if_stats) {
+        out_puts("ifstat: kernel has no interface counters\n");
+        return 1;
+    }
+
+    net_if_stats_t st;
+    for (int i = 0; k->net_get_if_stats(i, &st) == 0; i++) {
+        print_iface(i, &st);
+    }
+
+    for (int s = 0; s < watch; s++) {
+        if (vibe_has_key(k) && vibe_getc(k) == 'q') break;
+        k->sleep_ms(1000);
+
+        for (int i = 0; k->net_get_if_stats(i, &st) == 0; i++) {
+            out_puts(i ? "  " : "");
+            out_puts(st.name);
+            out_puts(" rx ");
+            print_num(st.rx_pps);
+            out_puts(" tx ");
+            print_num(st.tx_pps);
+            out_puts(" pps");
+        }
+        out_putc('\n');
+    }
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * mallocbench - heap allocator benchmark
+ *
+ * Usage: mallocbench [-n ops]
+ *   Runs three allocation patterns through kapi malloc/free and reports
+ *   operations per second for each (one malloc or one free = one op):
+ *     1. small fixed:  malloc(32)/free pairs (list nodes, strings)
+ *     2. small mixed:  1024 live objects of 16B-2KB, randomly replaced
+ *     3. large mixed:  64 live buffers of 4KB-256KB, randomly replaced
+ *   Then reports fragmentation: how much of the free heap is usable as one
+ *   allocation while the small mixed working set is still live.
+ */
+
+#include "../lib/vibe.h"
+
+static kapi_t *api;
+
+#define DEFAULT_OPS  200000
+#define SMALL_LIVE   1024
+#define LARGE_LIVE   64
+
+static void *slots[SMALL_LIVE];
+
+static void out_puts(const char *s) {
+    if (api->stdio_puts) api->stdio_puts(s);
+    else api->puts(s);
+}
+
+static void out_putc(char c) {
+    if (api->stdio_putc) api->stdio_putc(c);
+    else api->putc(c);
+}
+
+static void print_num(unsigned long n) {
+    char buf[24];
+    int i = 0;
+
+    if (n == 0) {
+        out_putc('0');
+        return;
+    }
+
+    while (n > 0) {
+        buf[i++] = '0' + (n % 10);
+        n /= 10;
+    }
+
+    while (i > 0) {
+        out_putc(buf[--i]);
+    }
+}
+
+static int parse_num(const char *s) {
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s - '0');
+        s++;
+    }
+    return n;
+}
+
+// Small LCG so runs are repeatable
+static unsigned long rng_state = 12345;
+
+static unsigned long rng(void) {
+    rng_state = rng_state * 1103515245 + 12345;
+    return (rng_state >> 16) & 0x7FFF;
+}
+
+// Print "<ops> ops in <ticks*10> ms, <ops/sec> ops/sec"
+static void report(const char *name, unsigned long ops, unsigned long ticks) {
+    if (ticks == 0) ticks = 1;
+    out_puts(name);
+    print_num(ops);
+    out_puts(" ops in ");
+    print_num(ticks * 10);
+    out_puts(" ms, ");
+    print_num(ops * 100 / ticks);
+    out_puts(" ops/sec\n");
+}
+
+// Random replacement over a live set; returns ops done, or -1 on OOM
+static long churn(int live, unsigned long ops, unsigned long min, unsigned long max) {
+    unsigned long done = 0;
+
+    for (int i = 0; i < live; i++) {
+        slots[i] = api->malloc(min + rng() * rng() % (max - min + 1));
+        if (!slots[i]) return -1;
+        done++;
+    }
+
+    while (done < ops) {
+        int i = rng() % live;
+        api->free(slots[i]);
+        slots[i] = api->malloc(min + rng() * rng() % (max - min + 1));
+        if (!slots[i]) return -1;
+        done += 2;
+    }
+
+    return (long)done;
+}
+
+static void release(int live) {
+    for (int i = 0; i < live; i++) {
+        api->free(slots[i]);
+        slots[i] = 0;
+    }
+}
+
+int main(kapi_t *k, int argc, char **argv) {
+    api = k;
+
+    unsigned long ops = DEFAULT_OPS;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'n' && i + 1 < argc) {
+            ops = parse_num(argv[++i]);
+        }
+    }
+    if (ops < 1000) ops = DEFAULT_OPS;
+
+    // 1. Same-size pairs
+    unsigned long start = k->get_uptime_ticks();
+    for (unsigned long i = 0; i < ops; i += 2) {
+        void *p = k->malloc(32);
+        if (!p) {
+            out_puts("mallocbench: out of memory\n");
+            return 1;
+        }
+        k->free(p);
+    }
+    report("small fixed: ", ops, k->get_uptime_ticks() - start);
+
+    // 2. Mixed small sizes with a live working set
+    start = k->get_uptime_ticks();
+    long done = churn(SMALL_LIVE, ops, 16, 2048);
+    unsigned long ticks = k->get_uptime_ticks() - start;
+    if (done < 0) {
+        out_puts("mallocbench: out of memory\n");
+        release(SMALL_LIVE);
+        return 1;
+    }
+    report("small mixed: ", done, ticks);
+
+    // Fragmentation with the small working set still allocated
+    size_t free_bytes = k->get_mem_free();
+    size_t largest = k->get_mem_largest_free ? k->get_mem_largest_free() : free_bytes;
+    out_puts("heap free:   ");
+    print_num(free_bytes / 1024);
+    out_puts(" KB, largest block ");
+    print_num(largest / 1024);
+    out_puts(" KB, fragmentation ");
+    print_num(free_bytes ? 100 - (unsigned long)(largest / (free_bytes / 100 + 1)) : 0);
+    out_puts("%\n");
+    release(SMALL_LIVE);
+
+    // 3. Mixed large buffers
+    start = k->get_uptime_ticks();
+    done = churn(LARGE_LIVE, ops / 10, 4096, 256 * 1024);
+    ticks = k->get_uptime_ticks() - start;
+    release(LARGE_LIVE);
+    if (done < 0) {
+        out_puts("mallocbench: out of memory\n");
+        return 1;
+    }
+    report("large mixed: ", done, ticks);
+
+    return 0;
+}
@@ -65,6 +65,7 @@ static int volume = 80;  // 0-100
 
 // Decoded audio buffer (kept for async playback)
 static int16_t *pcm_buffer = NULL;
+static uint32_t pcm_buffer_bytes = 0;  // WAV only; MP3s stream
 static uint32_t pcm_samples = 0;
 static uint32_t pcm_sample_rate = 44100;
 static uint32_t playback_start_tick = 0;
@@ -108,27 +109,87 @@ static int dirty_progress = 1;
 // Track last displayed time to avoid unnecessary progress redraws
 static int last_displayed_second = -1;
 
-// File loading state
-static uint8_t *load_mp3_data = NULL;
-static int load_file_size = 0;
-static int load_file_offset = 0;
-static void *load_file_handle = NULL;
-
-// Decode state
-static mp3dec_t load_mp3d;
-static const uint8_t *load_decode_ptr = NULL;
-static int load_decode_remaining = 0;
-static uint32_t load_total_samples = 0;
-static int load_channels = 0;
-static int16_t *load_out_ptr = NULL;
-static uint32_t load_decoded_samples = 0;
-
-// Chunk sizes for non-blocking operations
-#define FILE_CHUNK_SIZE     (32 * 1024)   // 32KB per file read chunk
-#define DECODE_FRAMES_PER_YIELD  20        // Decode 20 MP3 frames per yield
+// ============ Streaming MP3 State ============
+//
+// MP3s are never loaded whole. The file is read through the VFS into a small
+// input window, decoded a few frames ahead into a ring of PCM buffers, and
+// each full buffer is queued with sound_stream_queue(). The main loop tops
+// the ring up on every pass, so only STREAM_BUFS buffers of PCM exist at once.
+
+#define STREAM_IN_SIZE      (32 * 1024)  // Input window (file bytes)
+#define STREAM_IN_LOW       (16 * 1024)  // Refill below this (minimp3 wants ~16KB to sync)
+#define STREAM_BUFS         4            // PCM ring buffers
+#define STREAM_BUF_SAMPLES  8192         // Stereo samples per buffer (~190ms at 44.1kHz)
+#define DECODE_FRAMES_PER_YIELD 20       // Decode at most 20 MP3 frames per main loop pass
+#define SEEK_STRIDE         16           // Frames per seek index entry
+#define SEEK_PRIME_FRAMES   2            // Frames decoded and dropped after a seek (bit reservoir)
+#define SCAN_BYTES_PER_YIELD (32 * 1024) // Seek index scanner budget per main loop pass
+
+// A window onto the file: buf[pos..len) are bytes not yet consumed
+typedef struct {
+    uint8_t *buf;
+    int pos, len;
+    uint32_t file_pos;   // File offset of buf[len] (next byte to read)
+} mp3_window_t;
+
+typedef struct {
+    int active;
+    void *file;
+    uint32_t file_size;
+    int hz;
+    int spf;                       // Samples per frame
+    int eof;                       // Decoder reached end of file
+
+    // Decoder
+    mp3_window_t in;
+    mp3dec_t dec;
+    uint32_t frame_index;          // Frames decoded (or skipped) so far
+    int16_t frame_pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];  // Last frame, always stereo
+    int frame_samples, frame_used;
+
+    // PCM ring (buffer i lives in bufs[i % STREAM_BUFS])
+    int16_t *bufs[STREAM_BUFS];
+    int fill;                      // Stereo samples in the buffer being filled
+    uint32_t queued;               // Buffers handed to the kernel since stream start
+
+    // Seek index: file offset of every SEEK_STRIDE'th frame, built in the background
+    mp3_window_t scan;
+    mp3dec_t scan_dec;
+    uint32_t *seek_offsets;
+    int seek_count, seek_cap;
+    uint32_t scan_frames;
+    int scan_done;
+} mp3_stream_t;
+
+static mp3_stream_t stream;
+
+// Playback stats shown in the controls area
+static uint32_t stat_request_us = 0;       // When play was requested
+static uint32_t stat_first_sample_us = 0;  // Play request to first buffer queued
+static uint32_t stat_mem_bytes = 0;        // Player buffers currently allocated
+static uint32_t stat_mem_peak = 0;         // Peak of the above for this track
 
 // ============ Drawing Helpers ============
 
+// Append to a fixed-size line buffer (callers size it for the worst case)
+static int append_str(char *buf, int pos, const char *s) {
+    while (*s) buf[pos++] = *s++;
+    buf[pos] = 0;
+    return pos;
+}
+
+static int append_num(char *buf, int pos, uint32_t n) {
+    char tmp[12];
+    int i = 0;
+    do {
+        tmp[i++] = '0' + (n % 10);
+        n /= 10;
+    } while (n > 0);
+    while (i > 0) buf[pos++] = tmp[--i];
+    buf[pos] = 0;
+    return pos;
+}
+
 #define fill_rect(x, y, w, h, c)     gfx_fill_rect(&gfx, x, y, w, h, c)
 #define draw_char(x, y, ch, fg, bg)  gfx_draw_char(&gfx, x, y, ch, fg, bg)
 #define draw_string(x, y, s, fg, bg) gfx_draw_string(&gfx, x, y, s, fg, bg)
@@ -451,6 +512,17 @@ static void draw_controls(void) {
     draw_rect(vol_x, y + 28, 70, 10, BLACK);
     int vol_fill = (volume * 66) / 100;
     fill_rect(vol_x + 2, y + 30, vol_fill, 6, BLACK);
+
+    // Playback stats: "First sample 12 ms  Peak mem 160 KB"
+    if (playing_track >= 0 && stat_request_us == 0) {
+        char line[48];
+        int n = append_str(line, 0, "First sample ");
+        n = append_num(line, n, stat_first_sample_us / 1000);
+        n = append_str(line, n, " ms  Peak mem ");
+        n = append_num(line, n, stat_mem_peak / 1024);
+        append_str(line, n, " KB");
+        draw_string(prog_x, y + 64, line, GRAY, WHITE);
+    }
 }
 
 // Draw only the progress bar area (dirty rectangle optimization)
@@ -711,173 +783,390 @@ static void load_tracks(int album_idx) {
 
 // ============ Playback ============
 
-static int play_track(int track_idx) {
-    if (track_idx < 0 || track_idx >= track_count) return -1;
+static uint32_t now_us(void) {
+    return api->get_time_us ? api->get_time_us() : 0;
+}
 
-    // Stop current playback
-    if (is_playing) {
-        api->sound_stop();
-        is_playing = 0;
+// Playback buffer accounting (for the peak memory readout)
+static void *player_alloc(uint32_t size) {
+    void *p = api->malloc(size);
+    if (p) {
+        stat_mem_bytes += size;
+        if (stat_mem_bytes > stat_mem_peak) stat_mem_peak = stat_mem_bytes;
     }
+    return p;
+}
 
-    // Free old buffer
-    if (pcm_buffer) {
-        api->free(pcm_buffer);
-        pcm_buffer = NULL;
+static void player_free(void *p, uint32_t size) {
+    if (!p) return;
+    api->free(p);
+    stat_mem_bytes -= size;
+}
+
+// ============ MP3 Streaming ============
+
+// Top up a window from the file once it runs low
+static void window_refill(mp3_window_t *w) {
+    if (w->len - w->pos >= STREAM_IN_LOW || w->file_pos >= stream.file_size) return;
+
+    // Slide the unread tail to the front (forward copy, regions may overlap)
+    int keep = w->len - w->pos;
+    for (int i = 0; i < keep; i++) {
+        w->buf[i] = w->buf[w->pos + i];
+    }
+    w->pos = 0;
+    w->len = keep;
+
+    while (w->len < STREAM_IN_SIZE && w->file_pos < stream.file_size) {
+        int n = api->read(stream.file, (char *)w->buf + w->len,
+                          STREAM_IN_SIZE - w->len, w->file_pos);
+        if (n <= 0) {
+            w->file_pos = stream.file_size;  // Treat read errors as end of file
+            break;
+        }
+        w->len += n;
+        w->file_pos += n;
     }
+}
 
-    is_loading = 1;
-    load_state = LOAD_STATE_LOADING_FILE;
-    draw_all();
-    api->yield();
+// File offset of the next unconsumed byte
+static uint32_t window_offset(mp3_window_t *w) {
+    return w->file_pos - (w->len - w->pos);
+}
+
+static void window_seek(mp3_window_t *w, uint32_t offset) {
+    w->pos = 0;
+    w->len = 0;
+    w->file_pos = offset;
+    window_refill(w);
+}
+
+// Decode the next frame into stream.frame_pcm (as stereo).
+// skip: only parse the header (no PCM, no bit reservoir update).
+// Returns samples per channel, or 0 at end of file.
+static int stream_next_frame(int skip) {
+    mp3dec_frame_info_t info;
+    int16_t raw[MINIMP3_MAX_SAMPLES_PER_FRAME];
+
+    for (;;) {
+        window_refill(&stream.in);
+        int avail = stream.in.len - stream.in.pos;
+        if (avail <= 0) return 0;
+
+        info.hz = 0;
+        int samples = mp3dec_decode_frame(&stream.dec, stream.in.buf + stream.in.pos, avail,
+                                          skip ? NULL : raw, &info);
+        if (info.frame_bytes == 0) return 0;  // Nothing decodable left
+        stream.in.pos += info.frame_bytes;
+        if (info.hz == 0) continue;           // Skipped junk, no frame
+
+        stream.frame_index++;
+        if (samples <= 0) continue;           // Frame without enough bit reservoir
+        if (skip) return samples;
+
+        if (info.channels == 1) {
+            for (int i = samples - 1; i >= 0; i--) {
+                stream.frame_pcm[i * 2] = raw[i];
+                stream.frame_pcm[i * 2 + 1] = raw[i];
+            }
+        } else {
+            memcpy(stream.frame_pcm, raw, samples * 2 * sizeof(int16_t));
+        }
+        stream.frame_samples = samples;
+        stream.frame_used = 0;
+        return samples;
+    }
+}
+
+// Hand the buffer being filled to the sound driver
+static int stream_queue_fill(void) {
+    if (stream.fill == 0) return 0;
+    if (api->sound_stream_queue(stream.bufs[stream.queued % STREAM_BUFS], stream.fill) < 0) {
+        return -1;  // Stream was stopped under us; keep the data
+    }
+    if (stat_request_us) {
+        stat_first_sample_us = now_us() - stat_request_us;
+        stat_request_us = 0;
+        dirty_controls = 1;
+    }
+    stream.queued++;
+    stream.fill = 0;
+    return 0;
+}
+
+// Decode ahead until the ring is full, the file ends or max_frames are done
+static void stream_fill(int max_frames) {
+    uint32_t retired = api->sound_stream_retired();
+
+    while (!stream.eof && stream.queued - retired < STREAM_BUFS) {
+        if (stream.frame_used == stream.frame_samples) {
+            if (max_frames-- <= 0) return;
+            if (!stream_next_frame(0)) {
+                stream.eof = 1;
+                stream_queue_fill();  // Flush the partial last buffer
+                return;
+            }
+        }
+
+        int16_t *buf = stream.bufs[stream.queued % STREAM_BUFS];
+        int n = stream.frame_samples - stream.frame_used;
+        if (n > STREAM_BUF_SAMPLES - stream.fill) n = STREAM_BUF_SAMPLES - stream.fill;
+        memcpy(&buf[stream.fill * 2], &stream.frame_pcm[stream.frame_used * 2],
+               n * 2 * sizeof(int16_t));
+        stream.fill += n;
+        stream.frame_used += n;
+
+        if (stream.fill == STREAM_BUF_SAMPLES && stream_queue_fill() < 0) {
+            return;
+        }
+    }
+}
+
+// Record every SEEK_STRIDE'th frame offset; also gives the exact duration
+static void stream_scan(uint32_t max_bytes) {
+    mp3dec_frame_info_t info;
+    uint32_t start = window_offset(&stream.scan);
+
+    while (!stream.scan_done && window_offset(&stream.scan) - start < max_bytes) {
+        window_refill(&stream.scan);
+        int avail = stream.scan.len - stream.scan.pos;
+        if (avail <= 0) {
+            stream.scan_done = 1;
+            break;
+        }
+
+        info.hz = 0;
+        mp3dec_decode_frame(&stream.scan_dec, stream.scan.buf + stream.scan.pos, avail, NULL, &info);
+        if (info.frame_bytes == 0) {
+            stream.scan_done = 1;
+            break;
+        }
+        if (info.hz != 0) {
+            if (stream.scan_frames % SEEK_STRIDE == 0) {
+                if (stream.seek_count == stream.seek_cap) {
+                    // Grow the index
+                    int cap = stream.seek_cap * 2;
+                    uint32_t *grown = player_alloc(cap * sizeof(uint32_t));
+                    if (!grown) {
+                        stream.scan_done = 1;  // Seeking stays limited to what we have
+                        break;
+                    }
+                    memcpy(grown, stream.seek_offsets, stream.seek_count * sizeof(uint32_t));
+                    player_free(stream.seek_offsets, stream.seek_cap * sizeof(uint32_t));
+                    stream.seek_offsets = grown;
+                    stream.seek_cap = cap;
+                }
+                stream.seek_offsets[stream.seek_count++] =
+                    window_offset(&stream.scan) + info.frame_offset;
+            }
+            stream.scan_frames++;
+        }
+        stream.scan.pos += info.frame_bytes;
+    }
 
-    // Load file
-    void *file = api->open(tracks[track_idx].path);
+    if (stream.scan_done && stream.scan_frames > 0) {
+        pcm_samples = stream.scan_frames * stream.spf;  // Exact duration
+        dirty_controls = 1;
+    }
+}
+
+static void stream_close(void) {
+    if (!stream.active) return;
+    stream.active = 0;
+    for (int i = 0; i < STREAM_BUFS; i++) {
+        player_free(stream.bufs[i], STREAM_BUF_SAMPLES * 2 * sizeof(int16_t));
+        stream.bufs[i] = NULL;
+    }
+    player_free(stream.in.buf, STREAM_IN_SIZE);
+    player_free(stream.scan.buf, STREAM_IN_SIZE);
+    player_free(stream.seek_offsets, stream.seek_cap * sizeof(uint32_t));
+    stream.in.buf = NULL;
+    stream.scan.buf = NULL;
+    stream.seek_offsets = NULL;
+    api->close(stream.file);
+    stream.file = NULL;
+}
+
+// Restart the sound stream and decode from frame `target`
+static int stream_restart_at(uint32_t target) {
+    // Start from the nearest indexed frame a little before the target, so
+    // the frames we drop refill the bit reservoir
+    uint32_t prime_from = target > SEEK_PRIME_FRAMES ? target - SEEK_PRIME_FRAMES : 0;
+    uint32_t entry = prime_from / SEEK_STRIDE;
+    if (entry >= (uint32_t)stream.seek_count) entry = stream.seek_count ? stream.seek_count - 1 : 0;
+
+    mp3dec_init(&stream.dec);
+    if (stream.seek_count) {
+        window_seek(&stream.in, stream.seek_offsets[entry]);
+        stream.frame_index = entry * SEEK_STRIDE;
+    } else {
+        window_seek(&stream.in, 0);
+        stream.frame_index = 0;
+    }
+    stream.frame_samples = 0;
+    stream.frame_used = 0;
+    stream.fill = 0;
+    stream.queued = 0;
+    stream.eof = 0;
+
+    // Walk headers up to the priming frames, then decode and drop those
+    while (stream.frame_index < prime_from) {
+        if (!stream_next_frame(1)) break;
+    }
+    while (stream.frame_index < target) {
+        if (!stream_next_frame(0)) break;
+    }
+    stream.frame_samples = 0;
+    stream.frame_used = 0;
+
+    if (api->sound_stream_start(2, stream.hz) < 0) return -1;
+
+    // Get one buffer out right away; the main loop decodes the rest
+    stream_fill(STREAM_BUF_SAMPLES / stream.spf + 1);
+    if (stream.queued == 0) stream_queue_fill();
+    return 0;
+}
+
+// Open an MP3 and start streaming it
+static int stream_open(const char *path) {
+    stat_request_us = now_us();
+    stat_mem_peak = stat_mem_bytes;
+
+    void *file = api->open(path);
     if (!file) {
-        is_loading = 0;
-        load_state = LOAD_STATE_IDLE;
         show_error("Cannot open file");
         return -1;
     }
-
     int size = api->file_size(file);
     if (size <= 0) {
-        is_loading = 0;
-        load_state = LOAD_STATE_IDLE;
+        api->close(file);
         show_error("Empty file");
         return -1;
     }
 
-    uint8_t *mp3_data = api->malloc(size);
-    if (!mp3_data) {
-        is_loading = 0;
-        load_state = LOAD_STATE_IDLE;
-        show_error("Out of memory (file too large)");
-        return -1;
+    memset(&stream, 0, sizeof(stream));
+    stream.file = file;
+    stream.file_size = size;
+    stream.active = 1;
+
+    stream.in.buf = player_alloc(STREAM_IN_SIZE);
+    stream.scan.buf = player_alloc(STREAM_IN_SIZE);
+    stream.seek_cap = 256;
+    stream.seek_offsets = player_alloc(stream.seek_cap * sizeof(uint32_t));
+    int ok = stream.in.buf && stream.scan.buf && stream.seek_offsets;
+    for (int i = 0; i < STREAM_BUFS; i++) {
+        stream.bufs[i] = player_alloc(STREAM_BUF_SAMPLES * 2 * sizeof(int16_t));
+        if (!stream.bufs[i]) ok = 0;
     }
-
-    int offset = 0;
-    while (offset < size) {
-        int n = api->read(file, (char *)mp3_data + offset, size - offset, offset);
-        if (n <= 0) break;
-        offset += n;
+    if (!ok) {
+        stream_close();
+        show_error("Out of memory");
+        return -1;
     }
 
-    // Switch to decoding state
-    load_state = LOAD_STATE_DECODING;
-    draw_all();
-    api->yield();
+    mp3dec_init(&stream.dec);
+    mp3dec_init(&stream.scan_dec);
+    window_seek(&stream.in, 0);
+    window_seek(&stream.scan, 0);
 
-    // Single-pass decode with pre-allocated buffer
-    // For 10MB MP3 @ 128kbps stereo: ~50 min = ~530MB PCM
-    // Ratio ~53:1, but 320kbps would be ~21:1. Use 15x for safety.
-    uint32_t max_pcm_bytes = (uint32_t)size * 15;
-    pcm_buffer = api->malloc(max_pcm_bytes);
-    if (!pcm_buffer) {
-        api->free(mp3_data);
-        is_loading = 0;
-        load_state = LOAD_STATE_IDLE;
-        show_error("Out of memory (song too long)");
+    // First frame gives the format; estimate the length from its bitrate
+    // until the scanner has counted every frame
+    mp3dec_frame_info_t info;
+    info.hz = 0;
+    int avail = stream.in.len - stream.in.pos;
+    int spf = avail > 0 ? mp3dec_decode_frame(&stream.dec, stream.in.buf, avail, NULL, &info) : 0;
+    if (spf <= 0 || info.hz == 0) {
+        stream_close();
+        show_error("Invalid MP3 format");
         return -1;
     }
+    stream.hz = info.hz;
+    stream.spf = spf;
+    pcm_sample_rate = info.hz;
+    pcm_samples = 0;
+    if (info.bitrate_kbps > 0) {
+        uint32_t total_ms = (uint64_t)(size - info.frame_offset) * 8 / info.bitrate_kbps;
+        pcm_samples = (uint64_t)total_ms * info.hz / 1000;
+    }
 
-    mp3dec_t mp3d;
-    mp3dec_init(&mp3d);
-    mp3dec_frame_info_t info;
-    int16_t temp_pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
-
-    const uint8_t *ptr = mp3_data;
-    int remaining = size;
-    int16_t *out_ptr = pcm_buffer;
-    uint32_t decoded_samples = 0;
-    int channels = 0;
-
-    while (remaining > 0) {
-        int samples = mp3dec_decode_frame(&mp3d, ptr, remaining, temp_pcm, &info);
-        if (info.frame_bytes == 0) break;
-        if (samples > 0) {
-            if (channels == 0) {
-                channels = info.channels;
-                pcm_sample_rate = info.hz;
-            }
-            decoded_samples += samples;
-            if (channels == 1) {
-                for (int i = 0; i < samples; i++) {
-                    *out_ptr++ = temp_pcm[i];
-                    *out_ptr++ = temp_pcm[i];
-                }
-            } else {
-                for (int i = 0; i < samples * 2; i++) {
-                    *out_ptr++ = temp_pcm[i];
-                }
-            }
-        }
-        ptr += info.frame_bytes;
-        remaining -= info.frame_bytes;
+    if (stream_restart_at(0) < 0) {
+        stream_close();
+        show_error("Sound device busy");
+        return -1;
     }
+    return 0;
+}
 
-    api->free(mp3_data);
+// Jump to a position (milliseconds) by frame index
+static void stream_seek_ms(uint32_t ms) {
+    if (!stream.active) return;
+    uint32_t target = (uint64_t)ms * stream.hz / 1000 / stream.spf;
 
-    if (decoded_samples == 0 || channels == 0) {
-        api->free(pcm_buffer);
-        pcm_buffer = NULL;
-        is_loading = 0;
-        load_state = LOAD_STATE_IDLE;
-        show_error("Invalid MP3 format");
-        return -1;
+    // Seeking past what the scanner has indexed: index up to there first
+    while (!stream.scan_done && target / SEEK_STRIDE >= (uint32_t)stream.seek_count) {
+        stream_scan(SCAN_BYTES_PER_YIELD);
     }
 
-    // Use actual decoded sample count for accurate duration
-    pcm_samples = decoded_samples;
-    playing_track = track_idx;
+    if (stream_restart_at(target) < 0) return;
     is_playing = 1;
-    is_loading = 0;
-    load_state = LOAD_STATE_IDLE;
-    playback_start_tick = api->get_uptime_ticks ? api->get_uptime_ticks() : 0;
+    playback_start_tick = (api->get_uptime_ticks ? api->get_uptime_ticks() : 0) -
+                          (uint64_t)target * stream.spf * 100 / stream.hz;
     pause_elapsed_ms = 0;
+    last_displayed_second = -1;
+    dirty_controls = 1;
+}
 
-    api->sound_play_pcm_async(pcm_buffer, pcm_samples, 2, pcm_sample_rate);
+// Main loop hook: keep the ring full, grow the seek index, notice the end
+static void stream_service(void) {
+    if (!stream.active) return;
 
-    return 0;
-}
+    stream_fill(DECODE_FRAMES_PER_YIELD);
+    if (!stream.scan_done) {
+        stream_scan(SCAN_BYTES_PER_YIELD);
+    }
 
-// Check file extension (case insensitive)
-static int ends_with(const char *str, const char *suffix) {
-    int str_len = 0, suf_len = 0;
-    while (str[str_len]) str_len++;
-    while (suffix[suf_len]) suf_len++;
-    if (suf_len > str_len) return 0;
-    for (int i = 0; i < suf_len; i++) {
-        char a = str[str_len - suf_len + i];
-        char b = suffix[i];
-        // Lowercase
-        if (a >= 'A' && a <= 'Z') a += 32;
-        if (b >= 'A' && b <= 'Z') b += 32;
-        if (a != b) return 0;
+    // Everything decoded and played: end the stream so the player moves on
+    if (stream.eof && stream.fill == 0 && is_playing &&
+        api->sound_stream_retired() == stream.queued) {
+        api->sound_stop();
     }
-    return 1;
 }
 
-// Play a file directly by path (MP3 or WAV)
-static int play_file(const char *path) {
-    // Stop current playback
-    if (is_playing) {
+
+// Stop whatever is playing and release its buffers
+static void stop_playback(void) {
+    if (is_playing || stream.active) {
         api->sound_stop();
         is_playing = 0;
     }
-
-    // Free old buffer
+    stream_close();
     if (pcm_buffer) {
-        api->free(pcm_buffer);
+        player_free(pcm_buffer, pcm_buffer_bytes);
         pcm_buffer = NULL;
+        pcm_buffer_bytes = 0;
     }
+}
+
+// Start streaming an MP3; playback begins as soon as one buffer is decoded
+static int play_mp3(const char *path) {
+    if (stream_open(path) < 0) return -1;
+    is_playing = 1;
+    playback_start_tick = api->get_uptime_ticks ? api->get_uptime_ticks() : 0;
+    pause_elapsed_ms = 0;
+    last_displayed_second = -1;
+    return 0;
+}
+
+// WAV files are uncompressed, so they are still loaded whole
+static int play_wav(const char *path) {
+    stat_request_us = now_us();
+    stat_mem_peak = stat_mem_bytes;
 
     is_loading = 1;
     load_state = LOAD_STATE_LOADING_FILE;
     draw_all();
     api->yield();
 
-    // Load file
     void *file = api->open(path);
     if (!file) {
         is_loading = 0;
@@ -894,7 +1183,7 @@ static int play_file(const char *path) {
         return -1;
     }
 
-    uint8_t *file_data = api->malloc(size);
+    uint8_t *file_data = player_alloc(size);
     if (!file_data) {
         is_loading = 0;
         load_state = LOAD_STATE_IDLE;
@@ -909,168 +1198,104 @@ static int play_file(const char *path) {
         offset += n;
     }
 
-    // Check file type and decode
-    if (ends_with(path, ".wav")) {
-        // WAV file - parse header and extract PCM
-        load_state = LOAD_STATE_DECODING;
-        draw_all();
-        api->yield();
-
-        // Basic WAV header parsing
-        if (size < 44) {
-            api->free(file_data);
-            is_loading = 0;
-            load_state = LOAD_STATE_IDLE;
-            show_error("Invalid WAV file");
-            return -1;
-        }
+    load_state = LOAD_STATE_DECODING;
+    draw_all();
+    api->yield();
 
-        // Check RIFF header
-        if (file_data[0] != 'R' || file_data[1] != 'I' ||
-            file_data[2] != 'F' || file_data[3] != 'F') {
-            api->free(file_data);
-            is_loading = 0;
-            load_state = LOAD_STATE_IDLE;
-            show_error("Not a WAV file");
-            return -1;
-        }
+    // Basic WAV header parsing
+    if (size < 44) {
+        player_free(file_data, size);
+        is_loading = 0;
+        load_state = LOAD_STATE_IDLE;
+        show_error("Invalid WAV file");
+        return -1;
+    }
 
-        // Find fmt chunk
-        int channels = file_data[22] | (file_data[23] << 8);
-        int sample_rate = file_data[24] | (file_data[25] << 8) |
-                         (file_data[26] << 16) | (file_data[27] << 24);
-        int bits_per_sample = file_data[34] | (file_data[35] << 8);
+    // Check RIFF header
+    if (file_data[0] != 'R' || file_data[1] != 'I' ||
+        file_data[2] != 'F' || file_data[3] != 'F') {
+        player_free(file_data, size);
+        is_loading = 0;
+        load_state = LOAD_STATE_IDLE;
+        show_error("Not a WAV file");
+        return -1;
+    }
 
-        if (bits_per_sample != 16) {
-            api->free(file_data);
-            is_loading = 0;
-            load_state = LOAD_STATE_IDLE;
-            show_error("Only 16-bit WAV supported");
-            return -1;
-        }
+    // Find fmt chunk
+    int channels = file_data[22] | (file_data[23] << 8);
+    int sample_rate = file_data[24] | (file_data[25] << 8) |
+                     (file_data[26] << 16) | (file_data[27] << 24);
+    int bits_per_sample = file_data[34] | (file_data[35] << 8);
 
-        // Find data chunk (starts at offset 44 for standard WAV)
-        int data_offset = 44;
-        int data_size = size - 44;
-
-        // Search for "data" marker if needed
-        for (int i = 36; i < size - 8; i++) {
-            if (file_data[i] == 'd' && file_data[i+1] == 'a' &&
-                file_data[i+2] == 't' && file_data[i+3] == 'a') {
-                data_size = file_data[i+4] | (file_data[i+5] << 8) |
-                           (file_data[i+6] << 16) | (file_data[i+7] << 24);
-                data_offset = i + 8;
-                break;
-            }
-        }
+    if (bits_per_sample != 16) {
+        player_free(file_data, size);
+        is_loading = 0;
+        load_state = LOAD_STATE_IDLE;
+        show_error("Only 16-bit WAV supported");
+        return -1;
+    }
 
-        int num_samples = data_size / (channels * 2);  // 16-bit = 2 bytes
-
-        // Convert to stereo if mono
-        if (channels == 1) {
-            pcm_buffer = api->malloc(num_samples * 4);  // 2 channels * 2 bytes
-            if (!pcm_buffer) {
-                api->free(file_data);
-                is_loading = 0;
-                load_state = LOAD_STATE_IDLE;
-                show_error("Out of memory");
-                return -1;
-            }
-            int16_t *src = (int16_t *)(file_data + data_offset);
-            int16_t *dst = pcm_buffer;
-            for (int i = 0; i < num_samples; i++) {
-                dst[i * 2] = src[i];
-                dst[i * 2 + 1] = src[i];
-            }
-        } else {
-            // Already stereo, just copy
-            pcm_buffer = api->malloc(data_size);
-            if (!pcm_buffer) {
-                api->free(file_data);
-                is_loading = 0;
-                load_state = LOAD_STATE_IDLE;
-                show_error("Out of memory");
-                return -1;
-            }
-            // Manual copy
-            int16_t *src = (int16_t *)(file_data + data_offset);
-            int16_t *dst = pcm_buffer;
-            for (int i = 0; i < num_samples * 2; i++) {
-                dst[i] = src[i];
-            }
+    // Find data chunk (starts at offset 44 for standard WAV)
+    int data_offset = 44;
+    int data_size = size - 44;
+
+    // Search for "data" marker if needed
+    for (int i = 36; i < size - 8; i++) {
+        if (file_data[i] == 'd' && file_data[i+1] == 'a' &&
+            file_data[i+2] == 't' && file_data[i+3] == 'a') {
+            data_size = file_data[i+4] | (file_data[i+5] << 8) |
+                       (file_data[i+6] << 16) | (file_data[i+7] << 24);
+            data_offset = i + 8;
+            break;
         }
+    }
 
-        api->free(file_data);
-        pcm_samples = num_samples;
-        pcm_sample_rate = sample_rate;
-
-    } else {
-        // Assume MP3
-        load_state = LOAD_STATE_DECODING;
-        draw_all();
-        api->yield();
+    int num_samples = data_size / (channels * 2);  // 16-bit = 2 bytes
 
-        uint32_t max_pcm_bytes = (uint32_t)size * 15;
-        pcm_buffer = api->malloc(max_pcm_bytes);
+    // Convert to stereo if mono
+    if (channels == 1) {
+        pcm_buffer_bytes = num_samples * 4;  // 2 channels * 2 bytes
+        pcm_buffer = player_alloc(pcm_buffer_bytes);
         if (!pcm_buffer) {
-            api->free(file_data);
+            player_free(file_data, size);
             is_loading = 0;
             load_state = LOAD_STATE_IDLE;
             show_error("Out of memory");
             return -1;
         }
-
-        mp3dec_t mp3d;
-        mp3dec_init(&mp3d);
-        mp3dec_frame_info_t info;
-        int16_t temp_pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
-
-        const uint8_t *ptr = file_data;
-        int remaining = size;
-        int16_t *out_ptr = pcm_buffer;
-        uint32_t decoded_samples = 0;
-        int channels = 0;
-
-        while (remaining > 0) {
-            int samples = mp3dec_decode_frame(&mp3d, ptr, remaining, temp_pcm, &info);
-            if (info.frame_bytes == 0) break;
-            if (samples > 0) {
-                if (channels == 0) {
-                    channels = info.channels;
-                    pcm_sample_rate = info.hz;
-                }
-                decoded_samples += samples;
-                if (channels == 1) {
-                    for (int i = 0; i < samples; i++) {
-                        *out_ptr++ = temp_pcm[i];
-                        *out_ptr++ = temp_pcm[i];
-                    }
-                } else {
-                    for (int i = 0; i < samples * 2; i++) {
-                        *out_ptr++ = temp_pcm[i];
-                    }
-                }
-            }
-            ptr += info.frame_bytes;
-            remaining -= info.frame_bytes;
+        int16_t *src = (int16_t *)(file_data + data_offset);
+        int16_t *dst = pcm_buffer;
+        for (int i = 0; i < num_samples; i++) {
+            dst[i * 2] = src[i];
+            dst[i * 2 + 1] = src[i];
         }
-
-        api->free(file_data);
-
-        if (decoded_samples == 0 || channels == 0) {
-            api->free(pcm_buffer);
-            pcm_buffer = NULL;
+    } else {
+        // Already stereo, just copy
+        pcm_buffer_bytes = data_size;
+        pcm_buffer = player_alloc(pcm_buffer_bytes);
+        if (!pcm_buffer) {
+            player_free(file_data, size);
             is_loading = 0;
             load_state = LOAD_STATE_IDLE;
-            show_error("Invalid audio format");
+            show_error("Out of memory");
             return -1;
         }
-
-        pcm_samples = decoded_samples;
+        // Manual copy
+        int16_t *src = (int16_t *)(file_data + data_offset);
+        int16_t *dst = pcm_buffer;
+        for (int i = 0; i < num_samples * 2; i++) {
+            dst[i] = src[i];
+        }
     }
 
-    // Start playback
-    playing_track = 0;  // Use 0 to indicate "something is playing"
+    player_free(file_data, size);
+    pcm_samples = num_samples;
+    pcm_sample_rate = sample_rate;
+
+    player_free(file_data, size);
+    pcm_samples = num_samples;
+    pcm_sample_rate = sample_rate;
+
     is_playing = 1;
     is_loading = 0;
     load_state = LOAD_STATE_IDLE;
@@ -1078,7 +1303,50 @@ static int play_file(const char *path) {
     pause_elapsed_ms = 0;
 
     api->sound_play_pcm_async(pcm_buffer, pcm_samples, 2, pcm_sample_rate);
+    stat_first_sample_us = now_us() - stat_request_us;
+    stat_request_us = 0;
+
+    return 0;
+}
+
+// Check file extension (case insensitive)
+static int ends_with(const char *str, const char *suffix) {
+    int str_len = 0, suf_len = 0;
+    while (str[str_len]) str_len++;
+    while (suffix[suf_len]) suf_len++;
+    if (suf_len > str_len) return 0;
+    for (int i = 0; i < suf_len; i++) {
+        char a = str[str_len - suf_len + i];
+        char b = suffix[i];
+        // Lowercase
+        if (a >= 'A' && a <= 'Z') a += 32;
+        if (b >= 'A' && b <= 'Z') b += 32;
+        if (a != b) return 0;
+    }
+    return 1;
+}
+
+static int play_track(int track_idx) {
+    if (track_idx < 0 || track_idx >= track_count) return -1;
+
+    stop_playback();
+
+    int ret = ends_with(tracks[track_idx].path, ".wav") ?
+              play_wav(tracks[track_idx].path) : play_mp3(tracks[track_idx].path);
+    if (ret < 0) return -1;
+
+    playing_track = track_idx;
+    return 0;
+}
+
+// Play a file directly by path (MP3 or WAV)
+static int play_file(const char *path) {
+    stop_playback();
 
+    int ret = ends_with(path, ".wav") ? play_wav(path) : play_mp3(path);  // Else assume MP3
+    if (ret < 0) return -1;
+
+    playing_track = 0;  // Use 0 to indicate "something is playing"
     return 0;
 }
 
@@ -1110,6 +1378,9 @@ static void toggle_play_pause(void) {
             playback_start_tick = now - (pause_elapsed_ms / 10);
             api->sound_resume();
             is_playing = 1;
+        } else if (stream.active) {
+            // Fallback: restart the stream from the beginning
+            stream_seek_ms(0);
         } else {
             // Fallback: restart from beginning
             playback_start_tick = api->get_uptime_ticks ? api->get_uptime_ticks() : 0;
@@ -1163,6 +1434,16 @@ static void handle_click(int mx, int my) {
             return;
         }
 
+        // Progress bar: seek (streamed MP3s reposition by frame index)
+        int prog_x = 8, prog_w = win_w - 100;
+        int prog_y = ctrl_y + 42;
+        if (stream.active && pcm_samples > 0 && mx >= prog_x + 40 && mx < prog_x + prog_w - 40 &&
+            my >= prog_y && my < prog_y + 16) {
+            uint32_t total_ms = ((uint64_t)pcm_samples * 1000) / pcm_sample_rate;
+            stream_seek_ms((uint64_t)total_ms * (mx - prog_x - 40) / (prog_w - 80));
+            return;
+        }
+
         // Volume bar (not shown in single file mode compact view)
         if (!single_file_mode) {
             int vol_x = win_w - 80;
@@ -1375,6 +1656,9 @@ int main(kapi_t *k, int argc, char **argv) {
             }
         }
 
+        // Keep the stream decoded ahead of the device
+        stream_service();
+
         // Check if playback finished
         if (is_playing && api->sound_is_playing && !api->sound_is_playing()) {
             if (single_file_mode) {
@@ -1401,12 +1685,7 @@ int main(kapi_t *k, int argc, char **argv) {
         api->yield();
     }
 
-    if (is_playing) {
-        api->sound_stop();
-    }
-    if (pcm_buffer) {
-        api->free(pcm_buffer);
-    }
+    stop_playback();
     api->window_destroy(window_id);
 
     return 0;
@@ -0,0 +1,259 @@
+/*
+ * netbench - TCP throughput over the loopback interface
+ *
+ * Usage: netbench [-r | -z] [-n MB] [-c chunk] [-l loss]
+ *   Connects to the kernel's discard service on 127.0.0.1:9, pushes MB
+ *   megabytes (default 16) through tcp_send() in chunk-byte writes (default
+ *   8192), and reports throughput, TCP segments per second and the CPU time
+ *   each segment costs. Nothing touches the NIC, so it runs offline and
+ *   measures the stack itself: checksums, copies and the state machine.
+ *
+ *   -r receives instead, from the chargen service on 127.0.0.1:19, reading
+ *   with tcp_recv() into a chunk-byte buffer. -z receives with
+ *   tcp_recv_zc(), looking at the data where it lies.
+ *
+ *   -l drops that many packets per thousand (both directions) for the run,
+ *   to measure throughput under loss and how it was recovered.
+ */
+
+#include "../lib/vibe.h"
+
+static kapi_t *api;
+static volatile unsigned long sink;  // Keeps the receive loops honest
+
+#define DEFAULT_MB     16
+#define DEFAULT_CHUNK  8192
+#define MAX_CHUNK      65536
+#define DISCARD_PORT   9
+#define CHARGEN_PORT   19
+
+static void out_puts(const char *s) {
+    if (api->stdio_puts) api->stdio_puts(s);
+    else api->puts(s);
+}
+
+static void out_putc(char c) {
+    if (api->stdio_putc) api->stdio_putc(c);
+    else api->putc(c);
+}
+
+static void print_num(unsigned long n) {
+    char buf[24];
+    int i = 0;
+
+    if (n == 0) {
+        out_putc('0');
+        return;
+    }
+
+    while (n > 0) {
+        buf[i++] = '0' + (n % 10);
+        n /= 10;
+    }
+
+    while (i > 0) {
+        out_putc(buf[--i]);
+    }
+}
+
+static int parse_num(const char *s) {
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s - '0');
+        s++;
+    }
+    return n;
+}
+
+// Segments that went through lo so far (each direction counts once)
+static unsigned long lo_segments(void) {
+    net_if_stats_t st;
+    if (!api->net_get_if_stats || api->net_get_if_stats(NET_IF_LO, &st) < 0) {
+        return 0;
+    }
+    return st.rx_packets;
+}
+
+int main(kapi_t *k, int argc, char **argv) {
+    api = k;
+
+    int mb = DEFAULT_MB;
+    int chunk = DEFAULT_CHUNK;
+    int loss = 0;
+    int recv_mode = 0;   // 0 = send, 1 = tcp_recv, 2 = tcp_recv_zc
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'r') {
+            recv_mode = 1;
+        } else if (argv[i][0] == '-' && argv[i][1] == 'z') {
+            recv_mode = 2;
+        } else if (argv[i][0] == '-' && argv[i][1] == 'n' && i + 1 < argc) {
+            mb = parse_num(argv[++i]);
+        } else if (argv[i][0] == '-' && argv[i][1] == 'c' && i + 1 < argc) {
+            chunk = parse_num(argv[++i]);
+        } else if (argv[i][0] == '-' && argv[i][1] == 'l' && i + 1 < argc) {
+            loss = parse_num(argv[++i]);
+        } else {
+            out_puts("Usage: netbench [-r | -z] [-n MB] [-c chunk] [-l loss]\n");
+            return 1;
+        }
+    }
+    if (mb < 1) mb = DEFAULT_MB;
+    if (chunk < 1 || chunk > MAX_CHUNK) chunk = DEFAULT_CHUNK;
+    if (loss > 500) loss = 500;
+
+    if (!k->get_time_us || !k->net_get_if_stats || !k->tcp_get_stats) {
+        out_puts("netbench: kernel has no loopback interface\n");
+        return 1;
+    }
+    if (recv_mode == 2 && !k->tcp_recv_zc) {
+        out_puts("netbench: kernel has no zero-copy receive\n");
+        return 1;
+    }
+
+    char *buf = k->malloc(chunk);
+    if (!buf) {
+        out_puts("netbench: out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < chunk; i++) buf[i] = (char)(i * 7);
+
+    int port = recv_mode ? CHARGEN_PORT : DISCARD_PORT;
+    int sock = k->tcp_connect(MAKE_IP(127, 0, 0, 1), port);
+    if (sock < 0) {
+        out_puts("netbench: can't connect to 127.0.0.1:");
+        print_num(port);
+        out_putc('\n');
+        k->free(buf);
+        return 1;
+    }
+
+    out_puts("netbench: ");
+    print_num(mb);
+    if (recv_mode == 2) {
+        out_puts(" MB from 127.0.0.1:19, zero-copy");
+    } else if (recv_mode) {
+        out_puts(" MB from 127.0.0.1:19 in ");
+        print_num(chunk);
+        out_puts("-byte reads");
+    } else {
+        out_puts(" MB to 127.0.0.1:9 in ");
+        print_num(chunk);
+        out_puts("-byte writes");
+    }
+    if (loss) {
+        out_puts(", dropping ");
+        print_num(loss);
+        out_puts("/1000 packets");
+    }
+    out_putc('\n');
+
+    tcp_stats_t tcp_before, tcp_after;
+    k->tcp_get_stats(&tcp_before);
+    if (loss) k->net_set_loss(loss);
+
+    unsigned long total = (unsigned long)mb * 1024 * 1024;
+    unsigned long sent = 0;
+    unsigned long seg_start = lo_segments();
+    uint32_t start = k->get_time_us();
+
+    // Received bytes get summed so neither mode can skip looking at them
+    unsigned long checksum = 0;
+
+    while (recv_mode && sent < total) {
+        int r;
+        if (recv_mode == 2) {
+            const void *data;
+            r = k->tcp_recv_zc(sock, &data);
+            if (r > 0) {
+                if ((unsigned long)r > total - sent) r = (int)(total - sent);
+                const uint8_t *p = data;
+                for (int i = 0; i < r; i += 64) checksum += p[i];
+                k->tcp_recv_done(sock, r);
+            }
+        } else {
+            unsigned long n = total - sent;
+            if (n > (unsigned long)chunk) n = chunk;
+            r = k->tcp_recv(sock, buf, (uint32_t)n);
+            for (int i = 0; i < r; i += 64) checksum += (uint8_t)buf[i];
+        }
+        if (r < 0) {
+            out_puts("netbench: connection closed after ");
+            print_num(sent);
+            out_puts(" bytes\n");
+            break;
+        }
+        sent += r;
+    }
+
+    while (!recv_mode && sent < total) {
+        unsigned long n = total - sent;
+        if (n > (unsigned long)chunk) n = chunk;
+        int r = k->tcp_send(sock, buf, (uint32_t)n);
+        if (r <= 0) {
+            out_puts("netbench: send failed after ");
+            print_num(sent);
+            out_puts(" bytes\n");
+            break;
+        }
+        sent += r;
+    }
+
+    // tcp_send returns once data is buffered - closing waits for the last
+    // of it to be ACKed, so the clock stops on delivery. Receiving, it
+    // waits for chargen to wind down.
+    k->tcp_close(sock);
+    uint32_t us = k->get_time_us() - start;
+    unsigned long segments = lo_segments() - seg_start;
+    k->tcp_get_stats(&tcp_after);
+    if (loss) k->net_set_loss(0);
+    k->free(buf);
+
+    if (us == 0) us = 1;
+
+    out_puts(recv_mode ? "Received:   " : "Sent:       ");
+    print_num(sent / 1024);
+    out_puts(" KB in ");
+    print_num(us / 1000);
+    out_puts(" ms\n");
+
+    out_puts("Throughput: ");
+    print_num((unsigned long)((uint64_t)sent * 1000000 / 1024 / us));
+    out_puts(" KB/s\n");
+
+    out_puts("Segments:   ");
+    print_num(segments);
+    out_puts(" (data + ACK), ");
+    print_num((unsigned long)((uint64_t)segments * 1000000 / us));
+    out_puts("/s\n");
+
+    // Everything runs on this core, so wall time is CPU time
+    if (segments) {
+        out_puts("Cost:       ");
+        print_num((unsigned long)((uint64_t)us * 1000 / segments));
+        out_puts(" ns per segment\n");
+    }
+
+    // Bytes moved per thousand CPU cycles
+    uint32_t mhz = k->get_cpu_freq_mhz ? k->get_cpu_freq_mhz() : 0;
+    if (mhz) {
+        out_puts("Efficiency: ");
+        print_num((unsigned long)((uint64_t)sent * 1000 / ((uint64_t)us * mhz)));
+        out_puts(" bytes per 1000 cycles at ");
+        print_num(mhz);
+        out_puts(" MHz\n");
+    }
+    sink = checksum;
+
+    out_puts("Recovery:   ");
+    print_num(tcp_after.retransmits - tcp_before.retransmits);
+    out_puts(" retransmits (");
+    print_num(tcp_after.fast_retransmits - tcp_before.fast_retransmits);
+    out_puts(" fast, ");
+    print_num(tcp_after.timeouts - tcp_before.timeouts);
+    out_puts(" timeouts), ");
+    print_num(tcp_after.dup_acks - tcp_before.dup_acks);
+    out_puts(" dup ACKs\n");
+
+    return sent == total ? 0 : 1;
+}
@@ -1,8 +1,12 @@
 /*
  * VibeOS ping command
  *
- * Usage: ping <ip>
+ * Usage: ping [-c count] [-i interval_ms] <ip or hostname>
  * Example: ping 10.0.2.2
+ *
+ * Round-trip times are taken when the kernel handles each reply, so they
+ * show how quickly received packets get processed - run it with the
+ * desktop busy to see interrupt-to-handler latency.
  */
 
 #include "../lib/vibe.h"
@@ -41,6 +45,25 @@ static void out_num(int n) {
     }
 }
 
+// Print microseconds as milliseconds with three decimals
+static void out_ms(uint32_t us) {
+    out_num((int)(us / 1000));
+    out_putc('.');
+    uint32_t frac = us % 1000;
+    out_putc('0' + frac / 100);
+    out_putc('0' + (frac / 10) % 10);
+    out_putc('0' + frac % 10);
+}
+
+static int parse_num(const char *s) {
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s - '0');
+        s++;
+    }
+    return n;
+}
+
 // Check if string is an IP address (contains only digits and dots)
 static int is_ip_address(const char *s) {
     while (*s) {
@@ -91,15 +114,32 @@ static void print_ip(uint32_t ip) {
 int main(kapi_t *kapi, int argc, char **argv) {
     k = kapi;
 
-    if (argc < 2) {
-        out_puts("Usage: ping <ip or hostname>\n");
+    int count = 4;
+    int interval = 500;
+    const char *target = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'c' && i + 1 < argc) {
+            count = parse_num(argv[++i]);
+        } else if (argv[i][0] == '-' && argv[i][1] == 'i' && i + 1 < argc) {
+            interval = parse_num(argv[++i]);
+        } else if (argv[i][0] != '-' && !target) {
+            target = argv[i];
+        } else {
+            target = NULL;
+            break;
+        }
+    }
+
+    if (!target) {
+        out_puts("Usage: ping [-c count] [-i interval_ms] <ip or hostname>\n");
         out_puts("Example: ping 10.0.2.2\n");
-        out_puts("         ping google.com\n");
+        out_puts("         ping -c 100 -i 10 google.com\n");
         return 1;
     }
+    if (count < 1) count = 4;
 
     uint32_t ip;
-    const char *target = argv[1];
 
     // Check if it's an IP address or hostname
     if (is_ip_address(target)) {
@@ -132,18 +172,24 @@ int main(kapi_t *kapi, int argc, char **argv) {
 
     int sent = 0;
     int received = 0;
+    uint32_t rtt_min = 0xffffffff, rtt_max = 0;
+    uint64_t rtt_total = 0;
 
-    // Send 4 pings
-    for (int i = 0; i < 4; i++) {
-        int result = k->net_ping(ip, i + 1, 1000);  // 1 second timeout
+    for (int i = 0; i < count; i++) {
+        int rtt = k->net_ping(ip, i + 1, 1000);  // 1 second timeout
 
-        if (result == 0) {
+        if (rtt >= 0) {
             out_puts("Reply from ");
             print_ip(ip);
             out_puts(": seq=");
             out_num(i + 1);
-            out_puts("\n");
+            out_puts(" time=");
+            out_ms(rtt);
+            out_puts(" ms\n");
             received++;
+            rtt_total += rtt;
+            if ((uint32_t)rtt < rtt_min) rtt_min = rtt;
+            if ((uint32_t)rtt > rtt_max) rtt_max = rtt;
         } else {
             out_puts("Request timed out: seq=");
             out_num(i + 1);
@@ -152,7 +198,7 @@ int main(kapi_t *kapi, int argc, char **argv) {
         sent++;
 
         // Wait a bit between pings
-        k->sleep_ms(500);
+        if (interval > 0 && i + 1 < count) k->sleep_ms(interval);
     }
 
     out_puts("\n--- ");
@@ -165,5 +211,15 @@ int main(kapi_t *kapi, int argc, char **argv) {
     out_num(((sent - received) * 100) / sent);
     out_puts("% packet loss\n");
 
+    if (received) {
+        out_puts("rtt min/avg/max = ");
+        out_ms(rtt_min);
+        out_putc('/');
+        out_ms((uint32_t)(rtt_total / received));
+        out_putc('/');
+        out_ms(rtt_max);
+        out_puts(" ms\n");
+    }
+
     return 0;
 }
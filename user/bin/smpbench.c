@@ -0,0 +1,184 @@
+/*
+ * smpbench - multi-core scaling benchmark
+ *
+ * Usage: smpbench [-w workers] [-n millions]
+ *   Times one CPU-bound worker, then N identical workers at once
+ *   (default N = number of cores), and reports the speedup.
+ *   With one core, N workers take N times as long (speedup 1.00).
+ *
+ * Workers are copies of this program started with spawn_args. All programs
+ * share one address space, so each worker gets the address of its own
+ * "done" flag on the command line and sets it when finished.
+ */
+
+#include "../lib/vibe.h"
+
+static kapi_t *api;
+
+#define MAX_WORKERS    16
+#define DEFAULT_MILLIONS 20
+#define SELF_PATH      "/bin/smpbench"
+
+static volatile int done[MAX_WORKERS];
+static volatile unsigned long sink;
+
+// Per-worker argv storage (children read it from our memory)
+static char iter_arg[MAX_WORKERS][24];
+static char addr_arg[MAX_WORKERS][24];
+static char *worker_argv[MAX_WORKERS][4];
+
+static void out_puts(const char *s) {
+    if (api->stdio_puts) api->stdio_puts(s);
+    else api->puts(s);
+}
+
+static void out_putc(char c) {
+    if (api->stdio_putc) api->stdio_putc(c);
+    else api->putc(c);
+}
+
+static void print_num(unsigned long n) {
+    char buf[24];
+    int i = 0;
+
+    if (n == 0) {
+        out_putc('0');
+        return;
+    }
+
+    while (n > 0) {
+        buf[i++] = '0' + (n % 10);
+        n /= 10;
+    }
+
+    while (i > 0) {
+        out_putc(buf[--i]);
+    }
+}
+
+static unsigned long parse_num(const char *s) {
+    unsigned long n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s - '0');
+        s++;
+    }
+    return n;
+}
+
+static void format_num(char *buf, unsigned long n) {
+    char tmp[24];
+    int i = 0;
+    do {
+        tmp[i++] = '0' + (n % 10);
+        n /= 10;
+    } while (n > 0);
+    int j = 0;
+    while (i > 0) buf[j++] = tmp[--i];
+    buf[j] = '\0';
+}
+
+// The work itself: a dependent multiply/add chain, no memory traffic
+static void worker_run(unsigned long millions) {
+    unsigned long x = 12345;
+    for (unsigned long i = 0; i < millions * 1000000UL; i++) {
+        x = x * 1103515245 + 12345;
+    }
+    sink = x;
+}
+
+// Run n workers at once; returns elapsed ticks, or 0 if a spawn failed
+static unsigned long run_workers(int n, unsigned long millions) {
+    for (int i = 0; i < n; i++) {
+        done[i] = 0;
+        format_num(iter_arg[i], millions);
+        format_num(addr_arg[i], (unsigned long)&done[i]);
+        worker_argv[i][0] = SELF_PATH;
+        worker_argv[i][1] = "--worker";
+        worker_argv[i][2] = iter_arg[i];
+        worker_argv[i][3] = addr_arg[i];
+    }
+
+    unsigned long start = api->get_uptime_ticks();
+
+    for (int i = 0; i < n; i++) {
+        if (api->spawn_args(SELF_PATH, 4, worker_argv[i]) < 0) {
+            out_puts("smpbench: failed to spawn worker\n");
+            // Don't wait on workers that never started
+            for (int j = i; j < n; j++) done[j] = 1;
+            while (1) {
+                int all = 1;
+                for (int j = 0; j < n; j++) if (!done[j]) all = 0;
+                if (all) break;
+                api->yield();
+            }
+            return 0;
+        }
+    }
+
+    for (;;) {
+        int all = 1;
+        for (int i = 0; i < n; i++) {
+            if (!done[i]) all = 0;
+        }
+        if (all) break;
+        api->yield();
+    }
+
+    unsigned long ticks = api->get_uptime_ticks() - start;
+    return ticks ? ticks : 1;
+}
+
+int main(kapi_t *k, int argc, char **argv) {
+    api = k;
+
+    // Worker mode: smpbench --worker <millions> <done-flag address>
+    if (argc == 4 && argv[1][0] == '-' && argv[1][1] == '-') {
+        worker_run(parse_num(argv[2]));
+        *(volatile int *)parse_num(argv[3]) = 1;
+        return 0;
+    }
+
+    int cores = k->get_cpu_cores ? k->get_cpu_cores() : 1;
+    int workers = cores;
+    unsigned long millions = DEFAULT_MILLIONS;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'w' && i + 1 < argc) {
+            workers = (int)parse_num(argv[++i]);
+        } else if (argv[i][0] == '-' && argv[i][1] == 'n' && i + 1 < argc) {
+            millions = parse_num(argv[++i]);
+        }
+    }
+    if (workers < 1) workers = 1;
+    if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+    if (millions < 1) millions = DEFAULT_MILLIONS;
+
+    out_puts("smpbench: ");
+    print_num(cores);
+    out_puts(cores == 1 ? " core, " : " cores, ");
+    print_num(millions);
+    out_puts("M iterations per worker\n");
+
+    unsigned long t1 = run_workers(1, millions);
+    if (!t1) return 1;
+    out_puts("1 worker:   ");
+    print_num(t1 * 10);
+    out_puts(" ms\n");
+
+    unsigned long tn = run_workers(workers, millions);
+    if (!tn) return 1;
+    print_num(workers);
+    out_puts(workers == 1 ? " worker:   " : " workers:  ");
+    print_num(tn * 10);
+    out_puts(" ms, speedup ");
+
+    // Ideal is `workers` (all in parallel); 1.00 means fully serialized
+    unsigned long speedup = (unsigned long)workers * t1 * 100 / tn;
+    print_num(speedup / 100);
+    out_putc('.');
+    out_putc('0' + (speedup / 10) % 10);
+    out_putc('0' + speedup % 10);
+    out_putc('\n');
+
+    return 0;
+}
@@ -280,6 +280,7 @@ static void show_game_over(void) {
 // Wait for restart or quit
 static int wait_for_restart(void) {
     while (1) {
+        uint32_t seq = api->input_wait_queue ? api->input_wait_queue->seq : 0;
         if (api->has_key()) {
             int c = api->getc();
             if (c == 'r' || c == 'R') {
@@ -288,8 +289,14 @@ static int wait_for_restart(void) {
             if (c == 'q' || c == 'Q') {
                 return 0;
             }
+            continue;
+        }
+        // Block until the next key instead of polling
+        if (api->wait_queue_sleep && api->input_wait_queue) {
+            api->wait_queue_sleep(api->input_wait_queue, seq, 0);
+        } else {
+            api->sleep_ms(10);
         }
-        api->sleep_ms(10);
     }
 }
 
@@ -16,7 +16,7 @@ static gfx_ctx_t gfx;
 
 // Window content dimensions
 #define CONTENT_W 320
-#define CONTENT_H 520
+#define CONTENT_H 592
 
 // Process states (must match kernel)
 #define PROC_STATE_FREE    0
@@ -27,6 +27,9 @@ static gfx_ctx_t gfx;
 
 #define MAX_PROCESSES 16
 
+// How long the window sleeps between stat checks (without events)
+#define SYSMON_POLL_MS 250
+
 // State tracking for dirty-rectangle optimization
 // Only redraw when values actually change
 static unsigned long last_uptime_sec = 0;
@@ -41,6 +44,14 @@ static size_t cached_mem_used = 0;
 static size_t cached_mem_free = 0;
 static int cached_alloc_count = 0;
 static int cached_proc_count = 0;
+static uint64_t cached_cache_hits = 0;
+static uint64_t cached_cache_misses = 0;
+static uint64_t cached_cache_writebacks = 0;
+static int cached_idle_percent = -1;  // -1 until the first sample interval
+
+// CPU idle sampling: idle share of all cores' ticks since the last sample
+static uint64_t idle_sample_idle = 0;
+static uint64_t idle_sample_total = 0;
 
 // Modern colors
 #define COLOR_BG         0x00F5F5F5
@@ -157,6 +168,17 @@ static void format_uptime(char *buf, unsigned long ticks) {
     buf[pos] = '\0';
 }
 
+// Format "<hits> (<pct>%)" for the block cache hit counter
+static void format_hit_rate(char *buf, uint64_t hits, uint64_t misses) {
+    char tmp[8];
+    uint64_t total = hits + misses;
+    format_num(buf, hits);
+    strcat(buf, " (");
+    format_num(tmp, total ? (hits * 100) / total : 0);
+    strcat(buf, tmp);
+    strcat(buf, "%)");
+}
+
 static void format_datetime(char *buf, int year, int month, int day,
                             int hour, int minute, int second) {
     // Format: YYYY-MM-DD HH:MM:SS
@@ -242,6 +264,16 @@ static void draw_all(void) {
     api->get_datetime(&year, &month, &day, &hour, &minute, &second, &weekday);
     format_datetime(buf, year, month, day, hour, minute, second);
     draw_label_value(y, "Time:", buf);
+    y += 18;
+
+    // Share of timer ticks no core had anything to run
+    if (cached_idle_percent >= 0) {
+        format_num(buf, cached_idle_percent);
+        strcat(buf, "%");
+    } else {
+        strcpy(buf, "-");
+    }
+    draw_label_value(y, "CPU Idle:", buf);
     y += 24;
 
     // ============ Memory Section ============
@@ -316,6 +348,18 @@ static void draw_all(void) {
     int disk_total = api->get_disk_total();
     format_size_kb(buf, disk_total);
     draw_label_value(y, "Size:", buf);
+    y += 18;
+
+    format_hit_rate(buf, cached_cache_hits, cached_cache_misses);
+    draw_label_value(y, "Cache Hits:", buf);
+    y += 18;
+
+    format_num(buf, cached_cache_misses);
+    draw_label_value(y, "Misses:", buf);
+    y += 18;
+
+    format_num(buf, cached_cache_writebacks);
+    draw_label_value(y, "Writebacks:", buf);
     y += 24;
 
     // ============ Processes Section ============
@@ -384,9 +428,25 @@ static void check_for_changes(void) {
     cached_mem_free = api->get_mem_free();
     cached_alloc_count = api->get_alloc_count();
     cached_proc_count = api->get_process_count();
+    if (api->get_disk_cache_stats) {
+        api->get_disk_cache_stats(&cached_cache_hits, &cached_cache_misses,
+                                  &cached_cache_writebacks, NULL);
+    }
 
     unsigned long current_sec = cached_ticks / 100;
 
+    // Resample idle once per second (the display only changes then anyway)
+    if (api->get_cpu_ticks && current_sec != last_uptime_sec) {
+        uint64_t idle, total;
+        api->get_cpu_ticks(&idle, &total);
+        if (idle_sample_total && total > idle_sample_total) {
+            cached_idle_percent = (int)((idle - idle_sample_idle) * 100 /
+                                        (total - idle_sample_total));
+        }
+        idle_sample_idle = idle;
+        idle_sample_total = total;
+    }
+
     int sound_state = 0;  // idle
     if (api->sound_is_playing && api->sound_is_playing()) {
         sound_state = 1;  // playing
@@ -430,7 +490,18 @@ static void print_cli(void) {
     format_datetime(buf, year, month, day, hour, minute, second);
     out("Time:       ");
     out(buf);
-    out("\n\n");
+    out("\n");
+
+    // CPU idle since boot
+    if (api->get_cpu_ticks) {
+        uint64_t idle, total;
+        api->get_cpu_ticks(&idle, &total);
+        format_num(buf, total ? (unsigned long)(idle * 100 / total) : 0);
+        out("CPU Idle:   ");
+        out(buf);
+        out("% since boot\n");
+    }
+    out("\n");
 
     // RAM
     size_t ram_total = api->get_ram_total();
@@ -463,7 +534,26 @@ static void print_cli(void) {
     format_size_kb(buf, disk_total);
     out("Disk Size:  ");
     out(buf);
-    out("\n\n");
+    out("\n");
+
+    if (api->get_disk_cache_stats) {
+        uint64_t hits, misses, writebacks, readahead;
+        api->get_disk_cache_stats(&hits, &misses, &writebacks, &readahead);
+        format_hit_rate(buf, hits, misses);
+        out("Cache Hits: ");
+        out(buf);
+        out("\nMisses:     ");
+        format_num(buf, misses);
+        out(buf);
+        out("\nWritebacks: ");
+        format_num(buf, writebacks);
+        out(buf);
+        out("\nReadahead:  ");
+        format_num(buf, readahead);
+        out(buf);
+        out("\n");
+    }
+    out("\n");
 
     // Processes
     int proc_count = api->get_process_count();
@@ -539,7 +629,8 @@ int main(kapi_t *kapi, int argc, char **argv) {
     draw_all();
     needs_redraw = 0;
 
-    // Event loop - only redraw when data changes
+    // Event loop - only redraw when data changes. Nothing changes faster
+    // than once a second, so sleep on window events in between.
     int running = 1;
 
     while (running) {
@@ -571,7 +662,11 @@ int main(kapi_t *kapi, int argc, char **argv) {
             needs_redraw = 0;
         }
 
-        api->yield();
+        if (api->window_wait_event) {
+            api->window_wait_event(window_id, SYSMON_POLL_MS);
+        } else {
+            api->yield();
+        }
     }
 
     api->window_destroy(window_id);
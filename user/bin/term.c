@@ -3,7 +3,10 @@
  *
  * A windowed terminal that runs vibesh inside a desktop window.
  * Features:
- *   - 500-line scrollback buffer
+ *   - 500-line scrollback buffer of character cells
+ *   - ANSI colors, bold, underline and inverse (ESC [ ... m), plus
+ *     ESC [ K, ESC [ J and ESC [ H
+ *   - Output is batched: only rows that changed are drawn, once a frame
  *   - Draggable scrollbar (click and drag the thumb)
  *   - Mouse drag scrolling (click and drag text area to scroll)
  *   - Page Up/Page Down keyboard scrolling
@@ -43,6 +46,33 @@
 #define SCROLL_HOVER    0x00AAAAAA   // Scrollbar thumb hover
 #define CURSOR_COLOR    0x00007AFF   // Blue cursor
 
+// ANSI colors 0-15 (SGR 30-37, 90-97), darkened to read on white,
+// followed by the default foreground and background
+#define COLOR_DEFAULT_FG 16
+#define COLOR_DEFAULT_BG 17
+static const uint32_t palette[18] = {
+    0x00000000, 0x00CD3131, 0x0000A000, 0x00949800,
+    0x000451A5, 0x00BC05BC, 0x000598BC, 0x00555555,
+    0x00666666, 0x00E03C3C, 0x0014CE14, 0x00B5BA00,
+    0x000E6FD8, 0x00D63AD6, 0x0012A8CD, 0x00A5A5A5,
+    TERM_FG, TERM_BG,
+};
+
+// Cell attributes
+#define ATTR_BOLD       0x01   // Drawn with each glyph row smeared 1px right
+#define ATTR_UNDERLINE  0x02
+#define ATTR_INVERSE    0x04   // Swap fg and bg when drawing
+
+// One character cell
+typedef struct {
+    uint8_t ch;
+    uint8_t fg;     // Palette index
+    uint8_t bg;
+    uint8_t attr;   // ATTR_*
+} term_cell_t;
+
+static const term_cell_t blank_cell = { ' ', COLOR_DEFAULT_FG, COLOR_DEFAULT_BG, 0 };
+
 // Global state
 static kapi_t *api;
 static int window_id = -1;
@@ -50,8 +80,9 @@ static uint32_t *win_buffer;
 static int win_w, win_h;
 static gfx_ctx_t gfx;
 
-// Scrollback buffer - ring buffer of lines
-static char scrollback[SCROLLBACK_LINES][TERM_COLS];
+// Scrollback buffer - ring buffer of lines. Scrolling moves scroll_head
+// and blanks the one line it lands on; nothing else is copied.
+static term_cell_t scrollback[SCROLLBACK_LINES][TERM_COLS];
 static int scroll_head = 0;      // Next line to write to
 static int scroll_count = 0;     // Total lines in buffer
 static int scroll_offset = 0;    // How many lines scrolled back (0 = at bottom)
@@ -60,6 +91,18 @@ static int scroll_offset = 0;    // How many lines scrolled back (0 = at bottom)
 static int cursor_row = 0;       // Row within visible area
 static int cursor_col = 0;
 
+// Colors and attributes given to newly written characters (ch unused)
+static term_cell_t pen = { ' ', COLOR_DEFAULT_FG, COLOR_DEFAULT_BG, 0 };
+
+// Escape sequence parser: ESC [ params final
+#define ESC_NONE    0
+#define ESC_ESC     1   // Seen ESC
+#define ESC_CSI     2   // Seen ESC [, collecting parameters
+#define ESC_MAX_PARAMS 8
+static int esc_state = ESC_NONE;
+static int esc_params[ESC_MAX_PARAMS];
+static int esc_nparams = 0;
+
 // Cursor blink state
 static int cursor_visible = 1;
 static unsigned long last_blink_tick = 0;
@@ -69,28 +112,62 @@ static unsigned long last_blink_tick = 0;
 static int input_buffer[INPUT_BUF_SIZE];
 static int input_head = 0;
 static int input_tail = 0;
+static wait_queue_t input_wq;    // Woken by input_push (the shell sleeps here)
+
+// Longest the main loop sleeps between frames. Shell output arrives from
+// another process without a window event, so don't sleep past a frame.
+#define TERM_IDLE_MS 20
 
 // Flag to track if shell is still running
 static int shell_running = 1;
 
-// Dirty flag - screen needs redraw
-static int screen_dirty = 0;
+// What changed since the last frame. Output only touches the cells and
+// these; render_frame() turns them into pixels once per frame.
+static uint32_t dirty_rows = 0;  // Bit per display row
+static int pending_scroll = 0;   // Lines the bottom view moved up
+static int full_redraw = 1;      // View moved or window resized
+
+// What the last frame left on screen
+static int drawn_cursor_row = -1;  // -1 = cursor not drawn
+static int drawn_cursor_col = 0;
+static int drawn_scroll_count = -1;
+static int drawn_scroll_offset = -1;
+
+// Output comes from the shell's process, frames from ours. A flag plus a
+// wait queue: whoever finds it taken sleeps until the holder clears it.
+static volatile int term_lock = 0;
+static volatile int term_lock_waiters = 0;
+static wait_queue_t term_lock_wait = { 0 };
 
 // Scrollbar state
 static int scrollbar_dragging = 0;
 static int scrollbar_drag_start_y = 0;
 static int scrollbar_drag_start_offset = 0;
 
-// Forward declarations
-static void redraw_screen(void);
+static void term_lock_acquire(void) {
+    while (__atomic_test_and_set(&term_lock, __ATOMIC_ACQUIRE)) {
+        uint32_t seq = term_lock_wait.seq;
+        __atomic_add_fetch(&term_lock_waiters, 1, __ATOMIC_SEQ_CST);
+        // Look again once counted: a release from here on bumps seq
+        if (__atomic_load_n(&term_lock, __ATOMIC_SEQ_CST)) {
+            api->wait_queue_sleep(&term_lock_wait, seq, 0);
+        }
+        __atomic_sub_fetch(&term_lock_waiters, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void term_lock_release(void) {
+    __atomic_clear(&term_lock, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&term_lock_waiters, __ATOMIC_SEQ_CST)) {
+        api->wait_queue_wake(&term_lock_wait);
+    }
+}
 
 // ============ Scrollback Buffer Management ============
 
 // Get the line index in scrollback buffer for a given display row
 // row 0 is top of display, row TERM_ROWS-1 is bottom
 static int get_line_index(int display_row) {
-    // The visible area shows lines from (scroll_head - scroll_count + scroll_offset) to end
-    // Actually, let's think about this differently:
     // - scroll_head points to where the NEXT line will be written
     // - The most recent line written is at scroll_head - 1
     // - The bottom of the display (when scroll_offset=0) shows the most recent lines
@@ -108,26 +185,37 @@ static int get_line_index(int display_row) {
     return target_line;
 }
 
-// Get pointer to a line in scrollback
-static char *get_line(int display_row) {
-    int idx = get_line_index(display_row);
+// Get a row of the screen being written to (what the view shows at the bottom)
+static term_cell_t *get_screen_line(int row) {
+    int idx = scroll_head - (TERM_ROWS - row);
+    while (idx < 0) idx += SCROLLBACK_LINES;
+    idx = idx % SCROLLBACK_LINES;
     return scrollback[idx];
 }
 
 // Get the current write line (cursor row)
-static char *get_write_line(void) {
-    // Current write position is at scroll_head - (TERM_ROWS - cursor_row)
-    int idx = scroll_head - (TERM_ROWS - cursor_row);
-    while (idx < 0) idx += SCROLLBACK_LINES;
-    idx = idx % SCROLLBACK_LINES;
-    return scrollback[idx];
+static term_cell_t *get_write_line(void) {
+    return get_screen_line(cursor_row);
+}
+
+static void mark_dirty(int row) {
+    dirty_rows |= 1u << row;
+}
+
+// Output always shows the bottom of the buffer
+static void show_bottom(void) {
+    if (scroll_offset != 0) {
+        scroll_offset = 0;
+        full_redraw = 1;
+    }
 }
 
 // Add a new line (scroll the terminal content up)
 static void new_line(void) {
     // Clear the new line
+    term_cell_t *line = scrollback[scroll_head];
     for (int i = 0; i < TERM_COLS; i++) {
-        scrollback[scroll_head][i] = ' ';
+        line[i] = blank_cell;
     }
 
     scroll_head = (scroll_head + 1) % SCROLLBACK_LINES;
@@ -135,7 +223,8 @@ static void new_line(void) {
         scroll_count++;
     }
 
-    // If we're NOT scrolled back (scroll_offset == 0), stay at bottom
+    // If we're NOT scrolled back (scroll_offset == 0), stay at bottom and
+    // move what's on screen up a line next frame
     // If we ARE scrolled back, keep viewing the same content (offset increases by 1)
     if (scroll_offset > 0) {
         scroll_offset++;
@@ -144,16 +233,30 @@ static void new_line(void) {
         if (max_offset < 0) max_offset = 0;
         if (scroll_offset > max_offset) {
             scroll_offset = max_offset;
+            full_redraw = 1;
         }
+        mark_dirty(0);  // Scroll indicator
+    } else if (++pending_scroll >= TERM_ROWS) {
+        full_redraw = 1;
+    } else {
+        dirty_rows = (dirty_rows >> 1) | (1u << (TERM_ROWS - 1));
+    }
+}
+
+// Move the cursor down a line, scrolling at the bottom
+static void line_feed(void) {
+    cursor_row++;
+    if (cursor_row >= TERM_ROWS) {
+        cursor_row = TERM_ROWS - 1;
+        new_line();
     }
-    // else scroll_offset stays 0, we stay at bottom showing newest content
 }
 
 // Clear the entire scrollback and screen
 static void clear_all(void) {
     for (int i = 0; i < SCROLLBACK_LINES; i++) {
         for (int j = 0; j < TERM_COLS; j++) {
-            scrollback[i][j] = ' ';
+            scrollback[i][j] = blank_cell;
         }
     }
     scroll_head = TERM_ROWS;  // Leave room for visible area
@@ -161,46 +264,208 @@ static void clear_all(void) {
     scroll_offset = 0;
     cursor_row = 0;
     cursor_col = 0;
+    full_redraw = 1;
 }
 
-// ============ Drawing Functions ============
+// Blank columns [from, to) of a screen row in the current background
+static void erase_cells(int row, int from, int to) {
+    term_cell_t blank = { ' ', pen.fg, pen.bg, 0 };
+    term_cell_t *line = get_screen_line(row);
+    for (int i = from; i < to; i++) {
+        line[i] = blank;
+    }
+    mark_dirty(row);
+}
 
-static void draw_char_at(int row, int col, char c) {
-    if (row < 0 || row >= TERM_ROWS || col < 0 || col >= TERM_COLS) return;
+// ============ Escape Sequences ============
+
+// SGR: ESC [ n ; n ... m
+static void apply_sgr(void) {
+    if (esc_nparams == 0) esc_nparams = 1;  // ESC [ m is ESC [ 0 m
+
+    for (int i = 0; i < esc_nparams; i++) {
+        int p = esc_params[i];
+        if (p == 0) {
+            pen = blank_cell;
+        } else if (p == 1) {
+            pen.attr |= ATTR_BOLD;
+        } else if (p == 4) {
+            pen.attr |= ATTR_UNDERLINE;
+        } else if (p == 7) {
+            pen.attr |= ATTR_INVERSE;
+        } else if (p == 22) {
+            pen.attr &= ~ATTR_BOLD;
+        } else if (p == 24) {
+            pen.attr &= ~ATTR_UNDERLINE;
+        } else if (p == 27) {
+            pen.attr &= ~ATTR_INVERSE;
+        } else if (p >= 30 && p <= 37) {
+            pen.fg = p - 30;
+        } else if (p == 39) {
+            pen.fg = COLOR_DEFAULT_FG;
+        } else if (p >= 40 && p <= 47) {
+            pen.bg = p - 40;
+        } else if (p == 49) {
+            pen.bg = COLOR_DEFAULT_BG;
+        } else if (p >= 90 && p <= 97) {
+            pen.fg = p - 90 + 8;
+        } else if (p >= 100 && p <= 107) {
+            pen.bg = p - 100 + 8;
+        }
+        // 256-color and other SGRs are ignored
+    }
+}
 
-    int px = col * CHAR_WIDTH;
-    int py = row * CHAR_HEIGHT;
+// Run a complete CSI sequence. Only colors, erasing and cursor
+// positioning are understood; anything else is swallowed.
+static void apply_csi(char final) {
+    int p0 = esc_nparams > 0 ? esc_params[0] : 0;
+
+    switch (final) {
+        case 'm':
+            apply_sgr();
+            break;
+        case 'K':  // Erase in line: 0 to end, 1 to cursor, 2 all
+            if (p0 == 0) erase_cells(cursor_row, cursor_col, TERM_COLS);
+            else if (p0 == 1) erase_cells(cursor_row, 0, cursor_col + 1);
+            else if (p0 == 2) erase_cells(cursor_row, 0, TERM_COLS);
+            show_bottom();
+            break;
+        case 'J':  // Erase in screen: 0 to end, 1 to cursor, 2 all
+            if (p0 == 0) {
+                erase_cells(cursor_row, cursor_col, TERM_COLS);
+                for (int r = cursor_row + 1; r < TERM_ROWS; r++) erase_cells(r, 0, TERM_COLS);
+            } else if (p0 == 1) {
+                for (int r = 0; r < cursor_row; r++) erase_cells(r, 0, TERM_COLS);
+                erase_cells(cursor_row, 0, cursor_col + 1);
+            } else {
+                for (int r = 0; r < TERM_ROWS; r++) erase_cells(r, 0, TERM_COLS);
+            }
+            show_bottom();
+            break;
+        case 'H':  // Cursor position, 1-based row ; col
+        case 'f': {
+            int row = p0 > 0 ? p0 - 1 : 0;
+            int col = (esc_nparams > 1 && esc_params[1] > 0) ? esc_params[1] - 1 : 0;
+            cursor_row = row < TERM_ROWS ? row : TERM_ROWS - 1;
+            cursor_col = col < TERM_COLS ? col : TERM_COLS - 1;
+            show_bottom();
+            break;
+        }
+    }
+}
 
-    const uint8_t *glyph = &api->font_data[(unsigned char)c * 16];
+// Feed one byte of an escape sequence to the parser
+static void esc_feed(char c) {
+    if (esc_state == ESC_ESC) {
+        if (c == '[') {
+            esc_state = ESC_CSI;
+            esc_nparams = 0;
+            esc_params[0] = 0;
+        } else {
+            esc_state = ESC_NONE;  // Two-byte escapes aren't supported
+        }
+        return;
+    }
 
-    for (int y = 0; y < CHAR_HEIGHT; y++) {
-        for (int x = 0; x < CHAR_WIDTH; x++) {
-            uint32_t color = (glyph[y] & (0x80 >> x)) ? TERM_FG : TERM_BG;
-            int idx = (py + y) * win_w + (px + x);
-            if (idx >= 0 && idx < win_w * win_h) {
-                win_buffer[idx] = color;
-            }
+    // ESC_CSI
+    if (c >= '0' && c <= '9') {
+        if (esc_nparams == 0) esc_nparams = 1;
+        if (esc_nparams <= ESC_MAX_PARAMS) {
+            int *p = &esc_params[esc_nparams - 1];
+            if (*p < 10000) *p = *p * 10 + (c - '0');
         }
+    } else if (c == ';') {
+        if (esc_nparams == 0) esc_nparams = 1;
+        esc_nparams++;
+        if (esc_nparams <= ESC_MAX_PARAMS) esc_params[esc_nparams - 1] = 0;
+    } else if (c >= 0x40 && c <= 0x7E) {
+        if (esc_nparams > ESC_MAX_PARAMS) esc_nparams = ESC_MAX_PARAMS;
+        esc_state = ESC_NONE;
+        apply_csi(c);
+    } else if (c < 0x20 || c > 0x7E) {
+        esc_state = ESC_NONE;  // Not a CSI byte: give up on the sequence
     }
+    // Private markers (?) and intermediates are accepted and ignored
 }
 
-static void draw_cursor(void) {
-    // Only draw cursor if we're at the bottom (not scrolled back) and visible
-    if (scroll_offset != 0 || !cursor_visible) return;
+// ============ Drawing Functions ============
+
+static void cell_colors(const term_cell_t *cell, uint32_t *fg, uint32_t *bg) {
+    if (cell->attr & ATTR_INVERSE) {
+        *fg = palette[cell->bg];
+        *bg = palette[cell->fg];
+    } else {
+        *fg = palette[cell->fg];
+        *bg = palette[cell->bg];
+    }
+}
+
+// Draw one display row of cells, background included
+static void render_row(int row) {
+    int y0 = row * CHAR_HEIGHT;
+    if (y0 + CHAR_HEIGHT > win_h) return;
+    int cols = win_w / CHAR_WIDTH;
+    if (cols > TERM_COLS) cols = TERM_COLS;
+
+    const term_cell_t *line = scrollback[get_line_index(row)];
+    uint32_t *base = &win_buffer[y0 * win_w];
+
+    for (int col = 0; col < cols; col++) {
+        const term_cell_t *cell = &line[col];
+        uint32_t fg, bg;
+        cell_colors(cell, &fg, &bg);
+
+        const uint8_t *glyph = &gfx.font[cell->ch * CHAR_HEIGHT];
+        uint32_t *dst = base + col * CHAR_WIDTH;
+        for (int y = 0; y < CHAR_HEIGHT; y++, dst += win_w) {
+            uint8_t bits = glyph[y];
+            if (cell->attr & ATTR_BOLD) bits |= bits >> 1;
+            if ((cell->attr & ATTR_UNDERLINE) && y == CHAR_HEIGHT - 2) bits = 0xFF;
+            gfx_span_bits(dst, bits, 0, CHAR_WIDTH, fg, bg);
+        }
+    }
+}
+
+// Move the text area's pixels up by lines rows; the rows uncovered at
+// the bottom are left for render_row()
+static void scroll_pixels(int lines) {
+    int width = win_w < TERM_COLS * CHAR_WIDTH ? win_w : TERM_COLS * CHAR_WIDTH;
+    int height = win_h < WIN_HEIGHT ? win_h : WIN_HEIGHT;
+    int shift = lines * CHAR_HEIGHT;
 
+    for (int y = 0; y + shift < height; y++) {
+        gfx_span_copy(&win_buffer[y * win_w], &win_buffer[(y + shift) * win_w], width);
+    }
+}
+
+// Draw the "[N]" lines-back indicator over the top right of row 0
+static void draw_scroll_indicator(void) {
+    char indicator[16];
+    int lines_back = scroll_offset;
+    // Simple integer to string
+    int i = 0;
+    indicator[i++] = '[';
+    if (lines_back >= 100) indicator[i++] = '0' + (lines_back / 100) % 10;
+    if (lines_back >= 10) indicator[i++] = '0' + (lines_back / 10) % 10;
+    indicator[i++] = '0' + lines_back % 10;
+    indicator[i++] = ']';
+    indicator[i] = '\0';
+
+    // Draw at top right of text area, inverted
+    int start_col = TERM_COLS - i;
+    for (int j = 0; j < i && indicator[j]; j++) {
+        gfx_draw_char(&gfx, (start_col + j) * CHAR_WIDTH, 0, indicator[j], TERM_BG, TERM_FG);
+    }
+}
+
+static void draw_cursor(void) {
     // Draw modern blue bar cursor
     int px = cursor_col * CHAR_WIDTH;
     int py = cursor_row * CHAR_HEIGHT;
 
     // 2-pixel wide vertical bar cursor (modern style)
-    for (int y = 0; y < CHAR_HEIGHT; y++) {
-        for (int x = 0; x < 2; x++) {
-            int idx = (py + y) * win_w + (px + x);
-            if (idx >= 0 && idx < win_w * win_h) {
-                win_buffer[idx] = CURSOR_COLOR;
-            }
-        }
-    }
+    gfx_fill_rect(&gfx, px, py, 2, CHAR_HEIGHT, CURSOR_COLOR);
 }
 
 // Update cursor blink state
@@ -210,7 +475,6 @@ static void update_cursor_blink(void) {
     if (now - last_blink_tick >= 50) {
         cursor_visible = !cursor_visible;
         last_blink_tick = now;
-        screen_dirty = 1;  // Defer redraw to main loop
     }
 }
 
@@ -249,69 +513,101 @@ static void draw_scrollbar(void) {
     gfx_fill_rounded_rect(&gfx, sb_x + 4, thumb_y, SCROLLBAR_WIDTH - 8, thumb_h, 4, SCROLL_THUMB);
 }
 
-static void redraw_screen(void) {
-    // Clear buffer
-    for (int i = 0; i < win_w * win_h; i++) {
-        win_buffer[i] = TERM_BG;
+static void invalidate(int x, int y, int w, int h) {
+    if (api->window_invalidate_rect) api->window_invalidate_rect(window_id, x, y, w, h);
+    else api->window_invalidate(window_id);
+}
+
+// Bring the window up to date with the cells: scroll what's already
+// drawn, then draw only the rows that changed since the last frame
+static void render_frame(void) {
+    term_lock_acquire();
+
+    int full = full_redraw;
+    int scrolled = pending_scroll;
+    uint32_t dirty = dirty_rows;
+    full_redraw = 0;
+    pending_scroll = 0;
+    dirty_rows = 0;
+
+    if (full) {
+        gfx_fill_rect(&gfx, 0, 0, win_w, win_h, TERM_BG);
+        dirty = (1u << TERM_ROWS) - 1;
+        drawn_cursor_row = -1;
+    } else if (scrolled) {
+        scroll_pixels(scrolled);
+        drawn_cursor_row -= scrolled;
+        if (drawn_cursor_row < 0) drawn_cursor_row = -1;
+    }
+
+    // The cursor is drawn over its cell, so repaint the cell it leaves
+    int show_cursor = scroll_offset == 0 && cursor_visible;
+    int cursor_moved = drawn_cursor_row != cursor_row || drawn_cursor_col != cursor_col;
+    if (drawn_cursor_row >= 0 && (!show_cursor || cursor_moved)) {
+        dirty |= 1u << drawn_cursor_row;
+    }
+    if (show_cursor && cursor_moved) {
+        dirty |= 1u << cursor_row;
     }
 
-    // Draw all characters from scrollback
+    int first = -1, last = -1;
     for (int row = 0; row < TERM_ROWS; row++) {
-        char *line = get_line(row);
-        for (int col = 0; col < TERM_COLS; col++) {
-            char c = line[col];
-            if (c && c != ' ') {
-                draw_char_at(row, col, c);
-            }
-        }
+        if (!(dirty & (1u << row))) continue;
+        render_row(row);
+        if (first < 0) first = row;
+        last = row;
     }
 
-    // Draw scrollback indicator if scrolled back
-    if (scroll_offset > 0) {
-        // Draw a small indicator in top-right of text area
-        char indicator[16];
-        int lines_back = scroll_offset;
-        // Simple integer to string
-        int i = 0;
-        indicator[i++] = '[';
-        if (lines_back >= 100) indicator[i++] = '0' + (lines_back / 100) % 10;
-        if (lines_back >= 10) indicator[i++] = '0' + (lines_back / 10) % 10;
-        indicator[i++] = '0' + lines_back % 10;
-        indicator[i++] = ']';
-        indicator[i] = '\0';
-
-        // Draw at top right of text area, inverted
-        int start_col = TERM_COLS - i;
-        for (int j = 0; j < i && indicator[j]; j++) {
-            // Draw inverted
-            int px = (start_col + j) * CHAR_WIDTH;
-            int py = 0;
-            const uint8_t *glyph = &api->font_data[(unsigned char)indicator[j] * 16];
-            for (int y = 0; y < CHAR_HEIGHT; y++) {
-                for (int x = 0; x < CHAR_WIDTH; x++) {
-                    uint32_t color = (glyph[y] & (0x80 >> x)) ? TERM_BG : TERM_FG;
-                    int idx = (py + y) * win_w + (px + x);
-                    if (idx >= 0 && idx < win_w * win_h) {
-                        win_buffer[idx] = color;
-                    }
-                }
-            }
-        }
+    if (scroll_offset > 0 && (dirty & 1)) {
+        draw_scroll_indicator();
     }
 
-    // Draw cursor
-    draw_cursor();
+    if (show_cursor && (dirty & (1u << cursor_row))) {
+        draw_cursor();
+    }
+    drawn_cursor_row = show_cursor ? cursor_row : -1;
+    drawn_cursor_col = cursor_col;
+
+    int bar = full || scroll_count != drawn_scroll_count || scroll_offset != drawn_scroll_offset;
+    if (bar) {
+        draw_scrollbar();
+        drawn_scroll_count = scroll_count;
+        drawn_scroll_offset = scroll_offset;
+    }
 
-    // Draw scrollbar
-    draw_scrollbar();
+    term_lock_release();
 
-    // Tell desktop to redraw
-    api->window_invalidate(window_id);
+    // Tell desktop what to redraw
+    if (full) {
+        api->window_invalidate(window_id);
+        return;
+    }
+    if (scrolled) {
+        first = 0;
+        last = TERM_ROWS - 1;
+    }
+    if (first >= 0) {
+        invalidate(0, first * CHAR_HEIGHT, TERM_COLS * CHAR_WIDTH, (last - first + 1) * CHAR_HEIGHT);
+    }
+    if (bar) {
+        invalidate(TERM_COLS * CHAR_WIDTH, 0, SCROLLBAR_WIDTH, WIN_HEIGHT);
+    }
 }
 
 // ============ Terminal Operations ============
 
+// Callers hold term_mutex
 static void term_putc(char c) {
+    if (esc_state != ESC_NONE) {
+        esc_feed(c);
+        return;
+    }
+
+    if (c == '\033') {
+        esc_state = ESC_ESC;
+        return;
+    }
+
     if (c == '\f') {
         // Form feed - clear screen
         clear_all();
@@ -320,13 +616,9 @@ static void term_putc(char c) {
 
     if (c == '\n') {
         cursor_col = 0;
-        cursor_row++;
-        if (cursor_row >= TERM_ROWS) {
-            cursor_row = TERM_ROWS - 1;
-            new_line();
-        }
+        line_feed();
         // Jump to bottom when outputting
-        scroll_offset = 0;
+        show_bottom();
         return;
     }
 
@@ -346,49 +638,87 @@ static void term_putc(char c) {
         cursor_col = (cursor_col + 8) & ~7;
         if (cursor_col >= TERM_COLS) {
             cursor_col = 0;
-            cursor_row++;
-            if (cursor_row >= TERM_ROWS) {
-                cursor_row = TERM_ROWS - 1;
-                new_line();
-            }
+            line_feed();
         }
         return;
     }
 
     if (c >= 32 && c < 127) {
         // Printable character - write to current line
-        char *line = get_write_line();
-        line[cursor_col] = c;
+        term_cell_t *cell = &get_write_line()[cursor_col];
+        *cell = pen;
+        cell->ch = c;
+        mark_dirty(cursor_row);
         cursor_col++;
         if (cursor_col >= TERM_COLS) {
             cursor_col = 0;
-            cursor_row++;
-            if (cursor_row >= TERM_ROWS) {
-                cursor_row = TERM_ROWS - 1;
-                new_line();
-            }
+            line_feed();
         }
         // Jump to bottom when outputting
-        scroll_offset = 0;
+        show_bottom();
     }
 }
 
-static void term_puts(const char *s) {
-    while (*s) {
-        term_putc(*s++);
+// Callers hold term_mutex. Runs of printable characters go straight into
+// the current line; everything else goes through term_putc().
+static void term_write(const char *buf, uint32_t len) {
+    uint32_t i = 0;
+
+    while (i < len) {
+        unsigned char c = buf[i];
+        if (esc_state != ESC_NONE || c < 32 || c >= 127) {
+            term_putc(c);
+            i++;
+            continue;
+        }
+
+        term_cell_t *line = get_write_line();
+        term_cell_t cell = pen;
+        int col = cursor_col;
+        while (col < TERM_COLS && i < len) {
+            c = buf[i];
+            if (c < 32 || c >= 127) break;
+            cell.ch = c;
+            line[col++] = cell;
+            i++;
+        }
+
+        mark_dirty(cursor_row);
+        cursor_col = col;
+        if (cursor_col >= TERM_COLS) {
+            cursor_col = 0;
+            line_feed();
+        }
+        show_bottom();
     }
 }
 
+static void term_puts(const char *s) {
+    const char *end = s;
+    while (*end) end++;
+    term_write(s, end - s);
+}
+
 // ============ Stdio Hooks ============
 
+// Output only updates cells; the main loop draws them next frame
+
 static void stdio_hook_putc(char c) {
+    term_lock_acquire();
     term_putc(c);
-    screen_dirty = 1;  // Defer redraw to main loop
+    term_lock_release();
 }
 
 static void stdio_hook_puts(const char *s) {
+    term_lock_acquire();
     term_puts(s);
-    screen_dirty = 1;  // Defer redraw to main loop
+    term_lock_release();
+}
+
+static void stdio_hook_write(const char *buf, uint32_t len) {
+    term_lock_acquire();
+    term_write(buf, len);
+    term_lock_release();
 }
 
 static int stdio_hook_getc(void) {
@@ -404,43 +734,52 @@ static int stdio_hook_has_key(void) {
     return input_head != input_tail;
 }
 
+// Lets the shell sleep until we have a key for it instead of spinning
+static int stdio_hook_wait_key(uint32_t timeout_ms) {
+    uint32_t seq = input_wq.seq;
+    if (input_head != input_tail) return 1;
+    api->wait_queue_sleep(&input_wq, seq, timeout_ms);
+    return input_head != input_tail;
+}
+
 // Add a key to input buffer
 static void input_push(int c) {
     int next = (input_tail + 1) % INPUT_BUF_SIZE;
     if (next != input_head) {  // Not full
         input_buffer[input_tail] = c;
         input_tail = next;
+        if (api->wait_queue_wake) api->wait_queue_wake(&input_wq);
     }
 }
 
 // ============ Scrolling ============
 
-static void scroll_up(int lines) {
-    // Scroll view back (show older content)
+// Show the view lines_back lines up from the bottom (redrawn next frame)
+static void set_scroll_offset(int lines_back) {
+    term_lock_acquire();
     int max_offset = scroll_count - TERM_ROWS;
     if (max_offset < 0) max_offset = 0;
-
-    scroll_offset += lines;
-    if (scroll_offset > max_offset) {
-        scroll_offset = max_offset;
+    if (lines_back > max_offset) lines_back = max_offset;
+    if (lines_back < 0) lines_back = 0;
+    if (lines_back != scroll_offset) {
+        scroll_offset = lines_back;
+        full_redraw = 1;
     }
+    term_lock_release();
+}
 
-    redraw_screen();
+static void scroll_up(int lines) {
+    // Scroll view back (show older content)
+    set_scroll_offset(scroll_offset + lines);
 }
 
 static void scroll_down(int lines) {
     // Scroll view forward (show newer content)
-    scroll_offset -= lines;
-    if (scroll_offset < 0) {
-        scroll_offset = 0;
-    }
-
-    redraw_screen();
+    set_scroll_offset(scroll_offset - lines);
 }
 
 static void scroll_to_bottom(void) {
-    scroll_offset = 0;
-    redraw_screen();
+    set_scroll_offset(0);
 }
 
 // ============ Main ============
@@ -486,17 +825,21 @@ int main(kapi_t *kapi, int argc, char **argv) {
     // Register stdio hooks
     api->stdio_putc = stdio_hook_putc;
     api->stdio_puts = stdio_hook_puts;
+    api->stdio_write = stdio_hook_write;
     api->stdio_getc = stdio_hook_getc;
     api->stdio_has_key = stdio_hook_has_key;
+    if (api->wait_queue_sleep) {
+        api->stdio_wait_key = stdio_hook_wait_key;
+    }
 
     // Initial draw
-    redraw_screen();
+    render_frame();
 
     // Spawn vibesh - it will use our stdio hooks
     int shell_pid = api->spawn("/bin/vibesh");
     if (shell_pid < 0) {
-        term_puts("Failed to start shell!\n");
-        redraw_screen();
+        stdio_hook_puts("Failed to start shell!\n");
+        render_frame();
     }
 
     // Track last mouse Y for scroll detection
@@ -589,10 +932,7 @@ int main(kapi_t *kapi, int argc, char **argv) {
                         if (new_offset < 0) new_offset = 0;
                         if (new_offset > max_offset) new_offset = max_offset;
 
-                        if (new_offset != scroll_offset) {
-                            scroll_offset = new_offset;
-                            redraw_screen();
-                        }
+                        set_scroll_offset(new_offset);
                     }
                 }
                 // Handle content drag scrolling
@@ -614,21 +954,22 @@ int main(kapi_t *kapi, int argc, char **argv) {
                 // Re-fetch buffer with new dimensions
                 win_buffer = api->window_get_buffer(window_id, &win_w, &win_h);
                 gfx_init(&gfx, win_buffer, win_w, win_h, api->font_data);
-                redraw_screen();
+                full_redraw = 1;
             }
         }
 
         // Update cursor blink
         update_cursor_blink();
 
-        // Redraw if dirty (once per frame, not per character)
-        if (screen_dirty) {
-            redraw_screen();
-            screen_dirty = 0;
-        }
+        // Draw whatever changed (once per frame, not per character)
+        render_frame();
 
-        // Yield to other processes
-        api->yield();
+        // Sleep until the next window event (or frame), else yield
+        if (api->window_wait_event) {
+            api->window_wait_event(window_id, TERM_IDLE_MS);
+        } else {
+            api->yield();
+        }
     }
 
     // Kill the shell process if it's still running
@@ -639,8 +980,10 @@ int main(kapi_t *kapi, int argc, char **argv) {
     // Clean up stdio hooks
     api->stdio_putc = 0;
     api->stdio_puts = 0;
+    api->stdio_write = 0;
     api->stdio_getc = 0;
     api->stdio_has_key = 0;
+    api->stdio_wait_key = 0;
 
     // Destroy window
     api->window_destroy(window_id);
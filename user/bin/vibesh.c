@@ -81,6 +81,21 @@ static int sh_has_key(void) {
     }
 }
 
+// Sleep until a key may be available (terminal hook, else the input queue)
+static void sh_wait_key(void) {
+    if (k->stdio_getc) {
+        if (k->stdio_wait_key) k->stdio_wait_key(0);
+        else k->yield();
+        return;
+    }
+    if (k->wait_queue_sleep && k->input_wait_queue) {
+        uint32_t seq = k->input_wait_queue->seq;
+        if (!k->has_key()) k->wait_queue_sleep(k->input_wait_queue, seq, 0);
+        return;
+    }
+    k->yield();
+}
+
 static void sh_set_color(uint32_t fg, uint32_t bg) {
     // Only set color for console (not for terminal - it's B&W)
     if (!k->stdio_putc) {
@@ -667,7 +682,7 @@ static int read_line(void) {
         int c = sh_getc();
 
         if (c < 0) {
-            k->yield();
+            sh_wait_key();
             continue;
         }
 
@@ -3,6 +3,11 @@
  *
  * Common drawing primitives for GUI applications.
  * Works with any buffer - desktop backbuffer, window buffers, etc.
+ *
+ * Every primitive clips its rectangle once, up front, and then hands whole
+ * rows to a span kernel (gfx_span_*). Those come in two builds: with NEON
+ * they work 4-16 pixels at a time, and the _scalar versions are plain C -
+ * what compilers without NEON (TCC) get, and what gfxbench compares against.
  */
 
 #ifndef GFX_H
@@ -10,12 +15,18 @@
 
 #include "vibe.h"
 
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
 // Graphics context - describes a drawing target
 typedef struct {
     uint32_t *buffer;      // Pixel buffer
     int width;             // Buffer width in pixels
     int height;            // Buffer height in pixels
     const uint8_t *font;   // Font data (from kapi->font_data)
+    int clip_x0, clip_y0;  // Clip rectangle - drawing outside it is dropped
+    int clip_x1, clip_y1;  // (x1/y1 exclusive, always inside the buffer)
 } gfx_ctx_t;
 
 // Initialize a graphics context
@@ -24,50 +35,326 @@ static inline void gfx_init(gfx_ctx_t *ctx, uint32_t *buffer, int w, int h, cons
     ctx->width = w;
     ctx->height = h;
     ctx->font = font;
+    ctx->clip_x0 = 0;
+    ctx->clip_y0 = 0;
+    ctx->clip_x1 = w;
+    ctx->clip_y1 = h;
+}
+
+// Restrict drawing to a rectangle (intersected with the buffer)
+static inline void gfx_set_clip(gfx_ctx_t *ctx, int x, int y, int w, int h) {
+    ctx->clip_x0 = x < 0 ? 0 : x;
+    ctx->clip_y0 = y < 0 ? 0 : y;
+    ctx->clip_x1 = x + w > ctx->width ? ctx->width : x + w;
+    ctx->clip_y1 = y + h > ctx->height ? ctx->height : y + h;
+    if (ctx->clip_x1 < ctx->clip_x0) ctx->clip_x1 = ctx->clip_x0;
+    if (ctx->clip_y1 < ctx->clip_y0) ctx->clip_y1 = ctx->clip_y0;
+}
+
+// Allow drawing to the whole buffer again
+static inline void gfx_reset_clip(gfx_ctx_t *ctx) {
+    gfx_set_clip(ctx, 0, 0, ctx->width, ctx->height);
+}
+
+// Clip a rectangle in place; returns 0 if nothing is left to draw
+static inline int gfx_clip_rect(gfx_ctx_t *ctx, int *x, int *y, int *w, int *h) {
+    if (*x < ctx->clip_x0) { *w -= ctx->clip_x0 - *x; *x = ctx->clip_x0; }
+    if (*y < ctx->clip_y0) { *h -= ctx->clip_y0 - *y; *y = ctx->clip_y0; }
+    if (*x + *w > ctx->clip_x1) *w = ctx->clip_x1 - *x;
+    if (*y + *h > ctx->clip_y1) *h = ctx->clip_y1 - *y;
+    return *w > 0 && *h > 0;
+}
+
+// Is a pixel inside the clip rectangle?
+#define GFX_IN_CLIP(ctx, px, py) \
+    ((px) >= (ctx)->clip_x0 && (px) < (ctx)->clip_x1 && \
+     (py) >= (ctx)->clip_y0 && (py) < (ctx)->clip_y1)
+
+// ============ Colors ============
+
+// Extract RGB components
+#define GFX_R(c) (((c) >> 16) & 0xFF)
+#define GFX_G(c) (((c) >> 8) & 0xFF)
+#define GFX_B(c) ((c) & 0xFF)
+#define GFX_RGB(r, g, b) (((r) << 16) | ((g) << 8) | (b))
+
+// x / 255, rounded, for x up to 255 * 255 - without the divide
+static inline uint32_t gfx_div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// Blend two colors: result = src * alpha + dst * (255 - alpha)
+// alpha is 0-255
+static inline uint32_t gfx_blend(uint32_t src, uint32_t dst, uint8_t alpha) {
+    if (alpha == 255) return src;
+    if (alpha == 0) return dst;
+
+    uint32_t sr = GFX_R(src), sg = GFX_G(src), sb = GFX_B(src);
+    uint32_t dr = GFX_R(dst), dg = GFX_G(dst), db = GFX_B(dst);
+    uint32_t inv = 255 - alpha;
+
+    uint32_t r = gfx_div255(sr * alpha + dr * inv);
+    uint32_t g = gfx_div255(sg * alpha + dg * inv);
+    uint32_t b = gfx_div255(sb * alpha + db * inv);
+
+    return GFX_RGB(r, g, b);
+}
+
+// Interpolate between two colors (t is 0-255)
+static inline uint32_t gfx_lerp_color(uint32_t c1, uint32_t c2, uint8_t t) {
+    return gfx_blend(c2, c1, t);
+}
+
+// ============ Span Kernels ============
+
+// Each works on n pixels of one row, already clipped. n may be 0.
+
+// Solid fill
+static inline void gfx_span_fill_scalar(uint32_t *dst, int n, uint32_t color) {
+    if (n > 0) memset32_fast(dst, color, n);
+}
+
+static inline void gfx_span_fill(uint32_t *dst, int n, uint32_t color) {
+#ifdef __ARM_NEON
+    uint32x4_t v = vdupq_n_u32(color);
+    for (; n >= 8; n -= 8, dst += 8) {
+        vst1q_u32(dst, v);
+        vst1q_u32(dst + 4, v);
+    }
+    while (n-- > 0) *dst++ = color;
+#else
+    gfx_span_fill_scalar(dst, n, color);
+#endif
+}
+
+// Copy a row
+static inline void gfx_span_copy_scalar(uint32_t *dst, const uint32_t *src, int n) {
+    for (int i = 0; i < n; i++) dst[i] = src[i];
+}
+
+static inline void gfx_span_copy(uint32_t *dst, const uint32_t *src, int n) {
+#ifdef __ARM_NEON
+    for (; n >= 8; n -= 8, dst += 8, src += 8) {
+        uint32x4_t a = vld1q_u32(src);
+        uint32x4_t b = vld1q_u32(src + 4);
+        vst1q_u32(dst, a);
+        vst1q_u32(dst + 4, b);
+    }
+    while (n-- > 0) *dst++ = *src++;
+#else
+    gfx_span_copy_scalar(dst, src, n);
+#endif
+}
+
+// Blend one color over the row at a fixed alpha
+static inline void gfx_span_blend_scalar(uint32_t *dst, int n, uint32_t color, uint8_t alpha) {
+    if (alpha == 0) return;
+    if (alpha == 255) { gfx_span_fill_scalar(dst, n, color); return; }
+
+    // The source's share of each channel is the same for every pixel
+    uint32_t inv = 255 - alpha;
+    uint32_t sr = GFX_R(color) * alpha, sg = GFX_G(color) * alpha, sb = GFX_B(color) * alpha;
+    for (int i = 0; i < n; i++) {
+        uint32_t d = dst[i];
+        dst[i] = GFX_RGB(gfx_div255(sr + GFX_R(d) * inv),
+                         gfx_div255(sg + GFX_G(d) * inv),
+                         gfx_div255(sb + GFX_B(d) * inv));
+    }
+}
+
+static inline void gfx_span_blend(uint32_t *dst, int n, uint32_t color, uint8_t alpha) {
+#ifdef __ARM_NEON
+    if (alpha == 0) return;
+    if (alpha == 255) { gfx_span_fill(dst, n, color); return; }
+
+    // Byte-wise over 4 pixels: t = src * a + dst * (255 - a), then t / 255
+    // rounded as (t + (t + 128) / 256 + 128) / 256. The top byte is
+    // cleared afterwards, as gfx_blend() leaves it.
+    uint8x8_t src = vreinterpret_u8_u32(vdup_n_u32(color & 0xFFFFFF));
+    uint16x8_t sa = vmull_u8(src, vdup_n_u8(alpha));
+    uint8x8_t inv = vdup_n_u8(255 - alpha);
+    uint32x4_t rgb = vdupq_n_u32(0xFFFFFF);
+    for (; n >= 4; n -= 4, dst += 4) {
+        uint8x16_t d = vreinterpretq_u8_u32(vld1q_u32(dst));
+        uint16x8_t lo = vmlal_u8(sa, vget_low_u8(d), inv);
+        uint16x8_t hi = vmlal_u8(sa, vget_high_u8(d), inv);
+        uint8x16_t r = vcombine_u8(vraddhn_u16(lo, vrshrq_n_u16(lo, 8)),
+                                   vraddhn_u16(hi, vrshrq_n_u16(hi, 8)));
+        vst1q_u32(dst, vandq_u32(vreinterpretq_u32_u8(r), rgb));
+    }
+    for (int i = 0; i < n; i++) dst[i] = gfx_blend(color, dst[i], alpha);
+#else
+    gfx_span_blend_scalar(dst, n, color, alpha);
+#endif
+}
+
+// Antialiased coverage: each pixel gets fg over bg by its cov byte (TTF
+// glyph rows). Where cov is 0 the row is left alone.
+static inline void gfx_span_coverage_scalar(uint32_t *dst, const uint8_t *cov, int n,
+                                            uint32_t fg, uint32_t bg) {
+    for (int i = 0; i < n; i++) {
+        uint32_t a = cov[i];
+        if (a == 0) continue;
+        if (a == 255) { dst[i] = fg; continue; }
+        uint32_t inv = 255 - a;
+        dst[i] = GFX_RGB(gfx_div255(GFX_R(fg) * a + GFX_R(bg) * inv),
+                         gfx_div255(GFX_G(fg) * a + GFX_G(bg) * inv),
+                         gfx_div255(GFX_B(fg) * a + GFX_B(bg) * inv));
+    }
+}
+
+static inline void gfx_span_coverage(uint32_t *dst, const uint8_t *cov, int n,
+                                     uint32_t fg, uint32_t bg) {
+#ifdef __ARM_NEON
+    // 8 pixels a step, split into B, G, R, X planes so each byte of
+    // coverage lines up with one byte of each channel
+    uint8x8_t fgc[3], bgc[3];
+    for (int ch = 0; ch < 3; ch++) {
+        fgc[ch] = vdup_n_u8((fg >> (ch * 8)) & 0xFF);
+        bgc[ch] = vdup_n_u8((bg >> (ch * 8)) & 0xFF);
+    }
+    uint8x8_t zero = vdup_n_u8(0);
+    for (; n >= 8; n -= 8, dst += 8, cov += 8) {
+        uint8x8_t a = vld1_u8(cov);
+        if (vget_lane_u64(vreinterpret_u64_u8(a), 0) == 0) continue;
+
+        uint8x8_t inv = vmvn_u8(a);
+        uint8x8_t keep = vceq_u8(a, zero);
+        uint8x8x4_t d = vld4_u8((const uint8_t *)dst);
+        for (int ch = 0; ch < 3; ch++) {
+            uint16x8_t t = vmlal_u8(vmull_u8(fgc[ch], a), bgc[ch], inv);
+            uint8x8_t v = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+            d.val[ch] = vbsl_u8(keep, d.val[ch], v);
+        }
+        d.val[3] = vand_u8(keep, d.val[3]);
+        vst4_u8((uint8_t *)dst, d);
+    }
+#endif
+    gfx_span_coverage_scalar(dst, cov, n, fg, bg);
+}
+
+// 1bpp expansion: pixel i is fg where bit (7 - (first + i)) of bits is
+// set, bg where it's clear. Font rows are 8 pixels, MSB leftmost.
+static inline void gfx_span_bits_scalar(uint32_t *dst, uint8_t bits, int first, int n,
+                                        uint32_t fg, uint32_t bg) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = (bits & (0x80 >> (first + i))) ? fg : bg;
+    }
+}
+
+static inline void gfx_span_bits(uint32_t *dst, uint8_t bits, int first, int n,
+                                 uint32_t fg, uint32_t bg) {
+#ifdef __ARM_NEON
+    if (first == 0 && n == 8) {
+        // Test each bit into a byte mask (lane 0 tests 0x80), sign-extend
+        // the masks out to 32 bits and select fg or bg by them
+        uint8x8_t set = vtst_u8(vdup_n_u8(bits), vcreate_u8(0x0102040810204080ULL));
+        int16x8_t m = vmovl_s8(vreinterpret_s8_u8(set));
+        uint32x4_t lo = vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(m)));
+        uint32x4_t hi = vreinterpretq_u32_s32(vmovl_s16(vget_high_s16(m)));
+        uint32x4_t f = vdupq_n_u32(fg), b = vdupq_n_u32(bg);
+        vst1q_u32(dst, vbslq_u32(lo, f, b));
+        vst1q_u32(dst + 4, vbslq_u32(hi, f, b));
+        return;
+    }
+#endif
+    gfx_span_bits_scalar(dst, bits, first, n, fg, bg);
+}
+
+// Horizontal gradient: pixel i is pos + i steps of span along c1 -> c2.
+// Channels walk in 16.16 fixed point, so there's no per-pixel divide.
+static inline void gfx_span_gradient_scalar(uint32_t *dst, int n, uint32_t c1, uint32_t c2,
+                                            int pos, int span) {
+    if (span < 1) span = 1;
+    int rs = (((int)GFX_R(c2) - (int)GFX_R(c1)) << 16) / span;
+    int gs = (((int)GFX_G(c2) - (int)GFX_G(c1)) << 16) / span;
+    int bs = (((int)GFX_B(c2) - (int)GFX_B(c1)) << 16) / span;
+    int r = (GFX_R(c1) << 16) + 0x8000 + rs * pos;
+    int g = (GFX_G(c1) << 16) + 0x8000 + gs * pos;
+    int b = (GFX_B(c1) << 16) + 0x8000 + bs * pos;
+    for (int i = 0; i < n; i++) {
+        dst[i] = (r & 0xFF0000) | ((g >> 8) & 0xFF00) | ((b >> 16) & 0xFF);
+        r += rs;
+        g += gs;
+        b += bs;
+    }
+}
+
+static inline void gfx_span_gradient(uint32_t *dst, int n, uint32_t c1, uint32_t c2,
+                                     int pos, int span) {
+#ifdef __ARM_NEON
+    if (n >= 4) {
+        if (span < 1) span = 1;
+        int rs = (((int)GFX_R(c2) - (int)GFX_R(c1)) << 16) / span;
+        int gs = (((int)GFX_G(c2) - (int)GFX_G(c1)) << 16) / span;
+        int bs = (((int)GFX_B(c2) - (int)GFX_B(c1)) << 16) / span;
+
+        // Four pixels' worth of each channel, stepping four at a time
+        const int lanes[4] = { 0, 1, 2, 3 };
+        int32x4_t idx = vld1q_s32(lanes);
+        int32x4_t r = vmlaq_n_s32(vdupq_n_s32((GFX_R(c1) << 16) + 0x8000 + rs * pos), idx, rs);
+        int32x4_t g = vmlaq_n_s32(vdupq_n_s32((GFX_G(c1) << 16) + 0x8000 + gs * pos), idx, gs);
+        int32x4_t b = vmlaq_n_s32(vdupq_n_s32((GFX_B(c1) << 16) + 0x8000 + bs * pos), idx, bs);
+        int32x4_t r4 = vdupq_n_s32(rs * 4), g4 = vdupq_n_s32(gs * 4), b4 = vdupq_n_s32(bs * 4);
+        uint32x4_t rmask = vdupq_n_u32(0xFF0000), gmask = vdupq_n_u32(0xFF00);
+
+        int done = 0;
+        for (; n - done >= 4; done += 4) {
+            uint32x4_t px = vandq_u32(vreinterpretq_u32_s32(r), rmask);
+            px = vorrq_u32(px, vandq_u32(vreinterpretq_u32_s32(vshrq_n_s32(g, 8)), gmask));
+            px = vorrq_u32(px, vreinterpretq_u32_s32(vshrq_n_s32(b, 16)));
+            vst1q_u32(dst + done, px);
+            r = vaddq_s32(r, r4);
+            g = vaddq_s32(g, g4);
+            b = vaddq_s32(b, b4);
+        }
+        dst += done;
+        pos += done;
+        n -= done;
+    }
+#endif
+    gfx_span_gradient_scalar(dst, n, c1, c2, pos, span);
 }
 
 // ============ Basic Drawing Primitives ============
 
 // Put a single pixel
 static inline void gfx_put_pixel(gfx_ctx_t *ctx, int x, int y, uint32_t color) {
-    if (x >= 0 && x < ctx->width && y >= 0 && y < ctx->height) {
+    if (GFX_IN_CLIP(ctx, x, y)) {
         ctx->buffer[y * ctx->width + x] = color;
     }
 }
 
-// Fill a rectangle with solid color (optimized with 64-bit stores)
+// Fill a rectangle with solid color
 static inline void gfx_fill_rect(gfx_ctx_t *ctx, int x, int y, int w, int h, uint32_t color) {
     // Clip to bounds
-    if (x < 0) { w += x; x = 0; }
-    if (y < 0) { h += y; y = 0; }
-    if (x + w > ctx->width) w = ctx->width - x;
-    if (y + h > ctx->height) h = ctx->height - y;
-    if (w <= 0 || h <= 0) return;
+    if (!gfx_clip_rect(ctx, &x, &y, &w, &h)) return;
 
-    // Fill row by row using fast 64-bit memset
-    for (int py = y; py < y + h; py++) {
-        memset32_fast(&ctx->buffer[py * ctx->width + x], color, w);
+    uint32_t *row = &ctx->buffer[y * ctx->width + x];
+    for (int py = 0; py < h; py++, row += ctx->width) {
+        gfx_span_fill(row, w, color);
     }
 }
 
-// Draw a horizontal line (optimized with 64-bit stores)
+// Draw a horizontal line
 static inline void gfx_draw_hline(gfx_ctx_t *ctx, int x, int y, int w, uint32_t color) {
-    if (y < 0 || y >= ctx->height) return;
+    if (y < ctx->clip_y0 || y >= ctx->clip_y1) return;
     // Clip to bounds
-    if (x < 0) { w += x; x = 0; }
-    if (x + w > ctx->width) w = ctx->width - x;
+    if (x < ctx->clip_x0) { w -= ctx->clip_x0 - x; x = ctx->clip_x0; }
+    if (x + w > ctx->clip_x1) w = ctx->clip_x1 - x;
     if (w <= 0) return;
-    memset32_fast(&ctx->buffer[y * ctx->width + x], color, w);
+    gfx_span_fill(&ctx->buffer[y * ctx->width + x], w, color);
 }
 
 // Draw a vertical line
 static inline void gfx_draw_vline(gfx_ctx_t *ctx, int x, int y, int h, uint32_t color) {
-    if (x < 0 || x >= ctx->width) return;
-    for (int i = 0; i < h; i++) {
-        int py = y + i;
-        if (py >= 0 && py < ctx->height) {
-            ctx->buffer[py * ctx->width + x] = color;
-        }
+    int w = 1;
+    if (!gfx_clip_rect(ctx, &x, &y, &w, &h)) return;
+
+    uint32_t *p = &ctx->buffer[y * ctx->width + x];
+    for (int i = 0; i < h; i++, p += ctx->width) {
+        *p = color;
     }
 }
 
@@ -84,15 +371,15 @@ static inline void gfx_draw_rect(gfx_ctx_t *ctx, int x, int y, int w, int h, uin
 // Draw a single character (8x16 font)
 static inline void gfx_draw_char(gfx_ctx_t *ctx, int x, int y, char c, uint32_t fg, uint32_t bg) {
     const uint8_t *glyph = &ctx->font[(unsigned char)c * 16];
-    for (int row = 0; row < 16; row++) {
-        for (int col = 0; col < 8; col++) {
-            uint32_t color = (glyph[row] & (0x80 >> col)) ? fg : bg;
-            int px = x + col;
-            int py = y + row;
-            if (px >= 0 && px < ctx->width && py >= 0 && py < ctx->height) {
-                ctx->buffer[py * ctx->width + px] = color;
-            }
-        }
+
+    // Clip the cell once; what's left is a run of rows and columns
+    int cx = x, cy = y, cw = 8, ch = 16;
+    if (!gfx_clip_rect(ctx, &cx, &cy, &cw, &ch)) return;
+    int first = cx - x;
+
+    uint32_t *row = &ctx->buffer[cy * ctx->width + cx];
+    for (int r = cy - y; r < cy - y + ch; r++, row += ctx->width) {
+        gfx_span_bits(row, glyph[r], first, cw, fg, bg);
     }
 }
 
@@ -127,38 +414,38 @@ static inline void gfx_draw_ttf_glyph(gfx_ctx_t *ctx, int x, int y, ttf_glyph_t
     x += glyph->xoff;
     y += glyph->yoff;
 
-    uint8_t fg_r = (fg >> 16) & 0xFF;
-    uint8_t fg_g = (fg >> 8) & 0xFF;
-    uint8_t fg_b = fg & 0xFF;
-    uint8_t bg_r = (bg >> 16) & 0xFF;
-    uint8_t bg_g = (bg >> 8) & 0xFF;
-    uint8_t bg_b = bg & 0xFF;
-
-    for (int row = 0; row < glyph->height; row++) {
-        for (int col = 0; col < glyph->width; col++) {
-            int px = x + col;
-            int py = y + row;
-            if (px < 0 || px >= ctx->width || py < 0 || py >= ctx->height) continue;
-
-            uint8_t alpha = glyph->bitmap[row * glyph->width + col];
-            if (alpha == 0) continue;  // Fully transparent
-
-            if (alpha == 255) {
-                // Fully opaque
-                ctx->buffer[py * ctx->width + px] = fg;
-            } else {
-                // Blend
-                uint8_t r = (fg_r * alpha + bg_r * (255 - alpha)) / 255;
-                uint8_t g = (fg_g * alpha + bg_g * (255 - alpha)) / 255;
-                uint8_t b = (fg_b * alpha + bg_b * (255 - alpha)) / 255;
-                ctx->buffer[py * ctx->width + px] = (r << 16) | (g << 8) | b;
-            }
-        }
+    int cx = x, cy = y, cw = glyph->width, ch = glyph->height;
+    if (!gfx_clip_rect(ctx, &cx, &cy, &cw, &ch)) return;
+
+    const uint8_t *cov = &glyph->bitmap[(cy - y) * glyph->width + (cx - x)];
+    uint32_t *row = &ctx->buffer[cy * ctx->width + cx];
+    for (int r = 0; r < ch; r++, row += ctx->width, cov += glyph->width) {
+        gfx_span_coverage(row, cov, cw, fg, bg);
+    }
+}
+
+// Next codepoint of a UTF-8 string, stray bytes read as Latin-1
+static inline int gfx_utf8_next(const char **s) {
+    const unsigned char *p = (const unsigned char *)*s;
+    int c = *p++;
+    int more = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+    int cp = c & (0x3F >> more);
+    int i;
+
+    for (i = 0; i < more && (p[i] & 0xC0) == 0x80; i++) {
+        cp = (cp << 6) | (p[i] & 0x3F);
     }
+    if (more && i == more) {
+        *s = (const char *)p + more;
+        return cp;
+    }
+    *s = (const char *)p;
+    return c;
 }
 
-// Draw a TTF string at given size and style
-// Returns the width of the drawn string in pixels
+// Draw a UTF-8 TTF string at given size and style
+// Returns the width of the drawn string in pixels, the same as
+// k->ttf_measure() gives for it
 static inline int gfx_draw_ttf_string(gfx_ctx_t *ctx, kapi_t *k, int x, int y,
                                        const char *s, int size, int style,
                                        uint32_t fg, uint32_t bg) {
@@ -176,7 +463,7 @@ static inline int gfx_draw_ttf_string(gfx_ctx_t *ctx, kapi_t *k, int x, int y,
     int prev_cp = 0;
 
     while (*s) {
-        int cp = (unsigned char)*s;
+        int cp = gfx_utf8_next(&s);
 
         // Add kerning
         if (prev_cp) {
@@ -194,7 +481,6 @@ static inline int gfx_draw_ttf_string(gfx_ctx_t *ctx, kapi_t *k, int x, int y,
         }
 
         prev_cp = cp;
-        s++;
     }
 
     return x - start_x;
@@ -205,11 +491,7 @@ static inline int gfx_draw_ttf_string(gfx_ctx_t *ctx, kapi_t *k, int x, int y,
 // Classic Mac diagonal checkerboard pattern (optimized with 64-bit stores)
 static inline void gfx_fill_pattern(gfx_ctx_t *ctx, int x, int y, int w, int h, uint32_t c1, uint32_t c2) {
     // Clip to bounds
-    if (x < 0) { w += x; x = 0; }
-    if (y < 0) { h += y; y = 0; }
-    if (x + w > ctx->width) w = ctx->width - x;
-    if (y + h > ctx->height) h = ctx->height - y;
-    if (w <= 0 || h <= 0) return;
+    if (!gfx_clip_rect(ctx, &x, &y, &w, &h)) return;
 
     // Precompute 64-bit patterns for two pixels at a time
     // Pattern alternates c1,c2 or c2,c1 depending on row parity
@@ -243,44 +525,25 @@ static inline void gfx_fill_pattern(gfx_ctx_t *ctx, int x, int y, int w, int h,
 
 // 25% dither pattern (sparse dots)
 static inline void gfx_fill_dither25(gfx_ctx_t *ctx, int x, int y, int w, int h, uint32_t c1, uint32_t c2) {
-    for (int py = y; py < y + h && py < ctx->height; py++) {
-        if (py < 0) continue;
-        for (int px = x; px < x + w && px < ctx->width; px++) {
-            if (px < 0) continue;
-            int pattern = ((px % 2 == 0) && (py % 2 == 0)) ? 1 : 0;
-            ctx->buffer[py * ctx->width + px] = pattern ? c1 : c2;
+    if (!gfx_clip_rect(ctx, &x, &y, &w, &h)) return;
+
+    for (int py = y; py < y + h; py++) {
+        uint32_t *row = &ctx->buffer[py * ctx->width];
+        if (py % 2 != 0) {
+            gfx_span_fill(row + x, w, c2);
+            continue;
+        }
+        for (int px = x; px < x + w; px++) {
+            row[px] = (px % 2 == 0) ? c1 : c2;
         }
     }
 }
 
 // ============ Alpha Blending ============
 
-// Extract RGB components
-#define GFX_R(c) (((c) >> 16) & 0xFF)
-#define GFX_G(c) (((c) >> 8) & 0xFF)
-#define GFX_B(c) ((c) & 0xFF)
-#define GFX_RGB(r, g, b) (((r) << 16) | ((g) << 8) | (b))
-
-// Blend two colors: result = src * alpha + dst * (255 - alpha)
-// alpha is 0-255
-static inline uint32_t gfx_blend(uint32_t src, uint32_t dst, uint8_t alpha) {
-    if (alpha == 255) return src;
-    if (alpha == 0) return dst;
-
-    uint32_t sr = GFX_R(src), sg = GFX_G(src), sb = GFX_B(src);
-    uint32_t dr = GFX_R(dst), dg = GFX_G(dst), db = GFX_B(dst);
-    uint32_t inv = 255 - alpha;
-
-    uint32_t r = (sr * alpha + dr * inv) / 255;
-    uint32_t g = (sg * alpha + dg * inv) / 255;
-    uint32_t b = (sb * alpha + db * inv) / 255;
-
-    return GFX_RGB(r, g, b);
-}
-
 // Put a pixel with alpha blending
 static inline void gfx_put_pixel_alpha(gfx_ctx_t *ctx, int x, int y, uint32_t color, uint8_t alpha) {
-    if (x < 0 || x >= ctx->width || y < 0 || y >= ctx->height) return;
+    if (!GFX_IN_CLIP(ctx, x, y)) return;
     uint32_t dst = ctx->buffer[y * ctx->width + x];
     ctx->buffer[y * ctx->width + x] = gfx_blend(color, dst, alpha);
 }
@@ -288,84 +551,88 @@ static inline void gfx_put_pixel_alpha(gfx_ctx_t *ctx, int x, int y, uint32_t co
 // Fill rectangle with alpha blending
 static inline void gfx_fill_rect_alpha(gfx_ctx_t *ctx, int x, int y, int w, int h, uint32_t color, uint8_t alpha) {
     // Clip to bounds
-    if (x < 0) { w += x; x = 0; }
-    if (y < 0) { h += y; y = 0; }
-    if (x + w > ctx->width) w = ctx->width - x;
-    if (y + h > ctx->height) h = ctx->height - y;
-    if (w <= 0 || h <= 0) return;
+    if (!gfx_clip_rect(ctx, &x, &y, &w, &h)) return;
 
-    for (int py = y; py < y + h; py++) {
-        for (int px = x; px < x + w; px++) {
-            uint32_t dst = ctx->buffer[py * ctx->width + px];
-            ctx->buffer[py * ctx->width + px] = gfx_blend(color, dst, alpha);
-        }
+    uint32_t *row = &ctx->buffer[y * ctx->width + x];
+    for (int py = 0; py < h; py++, row += ctx->width) {
+        gfx_span_blend(row, w, color, alpha);
     }
 }
 
 // ============ Gradients ============
 
-// Interpolate between two colors (t is 0-255)
-static inline uint32_t gfx_lerp_color(uint32_t c1, uint32_t c2, uint8_t t) {
-    uint32_t r = (GFX_R(c1) * (255 - t) + GFX_R(c2) * t) / 255;
-    uint32_t g = (GFX_G(c1) * (255 - t) + GFX_G(c2) * t) / 255;
-    uint32_t b = (GFX_B(c1) * (255 - t) + GFX_B(c2) * t) / 255;
-    return GFX_RGB(r, g, b);
-}
-
 // Vertical gradient (top to bottom)
 static inline void gfx_gradient_v(gfx_ctx_t *ctx, int x, int y, int w, int h, uint32_t top, uint32_t bottom) {
-    if (x < 0) { w += x; x = 0; }
-    if (y < 0) { h += y; y = 0; }
-    if (x + w > ctx->width) w = ctx->width - x;
-    if (y + h > ctx->height) h = ctx->height - y;
-    if (w <= 0 || h <= 0) return;
+    // Colors follow the unclipped rectangle so partial redraws line up
+    int y0 = y, div = h > 1 ? h - 1 : 1;
+    if (!gfx_clip_rect(ctx, &x, &y, &w, &h)) return;
 
+    // One color per row, found the same way the horizontal one steps
     for (int py = 0; py < h; py++) {
-        uint8_t t = (py * 255) / (h > 1 ? h - 1 : 1);
-        uint32_t color = gfx_lerp_color(top, bottom, t);
-        memset32_fast(&ctx->buffer[(y + py) * ctx->width + x], color, w);
+        uint32_t color;
+        gfx_span_gradient_scalar(&color, 1, top, bottom, y + py - y0, div);
+        gfx_span_fill(&ctx->buffer[(y + py) * ctx->width + x], w, color);
     }
 }
 
 // Horizontal gradient (left to right)
 static inline void gfx_gradient_h(gfx_ctx_t *ctx, int x, int y, int w, int h, uint32_t left, uint32_t right) {
-    if (x < 0) { w += x; x = 0; }
-    if (y < 0) { h += y; y = 0; }
-    if (x + w > ctx->width) w = ctx->width - x;
-    if (y + h > ctx->height) h = ctx->height - y;
-    if (w <= 0 || h <= 0) return;
-
-    for (int py = 0; py < h; py++) {
-        uint32_t *row = &ctx->buffer[(y + py) * ctx->width + x];
-        for (int px = 0; px < w; px++) {
-            uint8_t t = (px * 255) / (w > 1 ? w - 1 : 1);
-            row[px] = gfx_lerp_color(left, right, t);
-        }
+    int x0 = x, div = w > 1 ? w - 1 : 1;
+    if (!gfx_clip_rect(ctx, &x, &y, &w, &h)) return;
+
+    // Every row is the same: work out the first, copy it down
+    uint32_t *first = &ctx->buffer[y * ctx->width + x];
+    gfx_span_gradient(first, w, left, right, x - x0, div);
+    for (int py = 1; py < h; py++) {
+        gfx_span_copy(first + py * ctx->width, first, w);
     }
 }
 
 // Vertical gradient with alpha
 static inline void gfx_gradient_v_alpha(gfx_ctx_t *ctx, int x, int y, int w, int h,
                                          uint32_t top, uint32_t bottom, uint8_t alpha) {
-    if (x < 0) { w += x; x = 0; }
-    if (y < 0) { h += y; y = 0; }
-    if (x + w > ctx->width) w = ctx->width - x;
-    if (y + h > ctx->height) h = ctx->height - y;
-    if (w <= 0 || h <= 0) return;
+    int y0 = y, div = h > 1 ? h - 1 : 1;
+    if (!gfx_clip_rect(ctx, &x, &y, &w, &h)) return;
 
     for (int py = 0; py < h; py++) {
-        uint8_t t = (py * 255) / (h > 1 ? h - 1 : 1);
-        uint32_t color = gfx_lerp_color(top, bottom, t);
-        for (int px = 0; px < w; px++) {
-            int sx = x + px, sy = y + py;
-            uint32_t dst = ctx->buffer[sy * ctx->width + sx];
-            ctx->buffer[sy * ctx->width + sx] = gfx_blend(color, dst, alpha);
-        }
+        uint32_t color;
+        gfx_span_gradient_scalar(&color, 1, top, bottom, y + py - y0, div);
+        gfx_span_blend(&ctx->buffer[(y + py) * ctx->width + x], w, color, alpha);
     }
 }
 
 // ============ Rounded Rectangles ============
 
+// Fill a rounded rectangle's four corners, a row of each at a time: in
+// corner row cy (counting in from the top or bottom edge) the run is the
+// last dx + 1 pixels of the r-wide corner, for the widest dx inside the
+// circle
+static inline void gfx_rounded_corners(gfx_ctx_t *ctx, int x, int y, int w, int h, int r,
+                                       uint32_t color, int blend, uint8_t alpha) {
+    int r2 = r * r;
+    int dx = -1;
+    for (int cy = 0; cy < r; cy++) {
+        int dy = r - 1 - cy;
+        // Rows get wider going in, so dx only ever grows
+        while (dx + 1 < r && (dx + 1) * (dx + 1) + dy * dy <= r2) dx++;
+        if (dx < 0) continue;
+
+        int len = dx + 1;
+        int left = x + r - len, right = x + w - r;
+        if (blend) {
+            gfx_fill_rect_alpha(ctx, left, y + cy, len, 1, color, alpha);
+            gfx_fill_rect_alpha(ctx, right, y + cy, len, 1, color, alpha);
+            gfx_fill_rect_alpha(ctx, left, y + h - 1 - cy, len, 1, color, alpha);
+            gfx_fill_rect_alpha(ctx, right, y + h - 1 - cy, len, 1, color, alpha);
+        } else {
+            gfx_draw_hline(ctx, left, y + cy, len, color);
+            gfx_draw_hline(ctx, right, y + cy, len, color);
+            gfx_draw_hline(ctx, left, y + h - 1 - cy, len, color);
+            gfx_draw_hline(ctx, right, y + h - 1 - cy, len, color);
+        }
+    }
+}
+
 // Fill a rounded rectangle
 static inline void gfx_fill_rounded_rect(gfx_ctx_t *ctx, int x, int y, int w, int h, int r, uint32_t color) {
     if (r > w / 2) r = w / 2;
@@ -377,24 +644,8 @@ static inline void gfx_fill_rounded_rect(gfx_ctx_t *ctx, int x, int y, int w, in
     gfx_fill_rect(ctx, x, y + r, r, h - 2 * r, color);      // Left side
     gfx_fill_rect(ctx, x + w - r, y + r, r, h - 2 * r, color); // Right side
 
-    // Fill corners using circle algorithm
-    int r2 = r * r;
-    for (int cy = 0; cy < r; cy++) {
-        for (int cx = 0; cx < r; cx++) {
-            int dx = r - 1 - cx;
-            int dy = r - 1 - cy;
-            if (dx * dx + dy * dy <= r2) {
-                // Top-left
-                gfx_put_pixel(ctx, x + cx, y + cy, color);
-                // Top-right
-                gfx_put_pixel(ctx, x + w - 1 - cx, y + cy, color);
-                // Bottom-left
-                gfx_put_pixel(ctx, x + cx, y + h - 1 - cy, color);
-                // Bottom-right
-                gfx_put_pixel(ctx, x + w - 1 - cx, y + h - 1 - cy, color);
-            }
-        }
-    }
+    // Fill corners
+    gfx_rounded_corners(ctx, x, y, w, h, r, color, 0, 255);
 }
 
 // Fill rounded rect with alpha
@@ -410,19 +661,7 @@ static inline void gfx_fill_rounded_rect_alpha(gfx_ctx_t *ctx, int x, int y, int
     gfx_fill_rect_alpha(ctx, x + w - r, y + r, r, h - 2 * r, color, alpha);
 
     // Fill corners
-    int r2 = r * r;
-    for (int cy = 0; cy < r; cy++) {
-        for (int cx = 0; cx < r; cx++) {
-            int dx = r - 1 - cx;
-            int dy = r - 1 - cy;
-            if (dx * dx + dy * dy <= r2) {
-                gfx_put_pixel_alpha(ctx, x + cx, y + cy, color, alpha);
-                gfx_put_pixel_alpha(ctx, x + w - 1 - cx, y + cy, color, alpha);
-                gfx_put_pixel_alpha(ctx, x + cx, y + h - 1 - cy, color, alpha);
-                gfx_put_pixel_alpha(ctx, x + w - 1 - cx, y + h - 1 - cy, color, alpha);
-            }
-        }
-    }
+    gfx_rounded_corners(ctx, x, y, w, h, r, color, 1, alpha);
 }
 
 // Draw rounded rectangle outline
@@ -502,52 +741,294 @@ static inline void gfx_box_shadow_rounded(gfx_ctx_t *ctx, int x, int y, int w, i
     }
 }
 
-// ============ Simple Box Blur ============
+// ============ Blur ============
 
-// Box blur a region of the buffer (for frosted glass effect)
-// This is EXPENSIVE - would need GPU for real-time
-static inline void gfx_blur_region(gfx_ctx_t *ctx, int x, int y, int w, int h, int radius) {
-    if (radius <= 0) return;
+// Box blur for frosted glass. Two passes, rows then columns, each keeping
+// a running sum per channel so a pixel costs the same at any radius. Each
+// line is copied to scratch first, so nothing reads a pixel already
+// written. With NEON four lines go at once, as 16 channel sums in two
+// registers. For big radii the region can be shrunk 2x or 4x first,
+// blurred small and scaled back up, which also smooths the box's edges.
 
-    // Clip
-    if (x < 0) { w += x; x = 0; }
-    if (y < 0) { h += y; y = 0; }
-    if (x + w > ctx->width) w = ctx->width - x;
-    if (y + h > ctx->height) h = ctx->height - y;
-    if (w <= 0 || h <= 0) return;
+#define GFX_BLUR_MAX        2048  // Longest row or column a blur will touch
+#define GFX_BLUR_MAX_RADIUS 127   // Keeps a channel's sum within 16 bits
 
-    // Allocate temp buffer (on stack for small regions, or skip if too large)
-    // For a real implementation, we'd need a separate buffer
-    // This is a simplified single-pass box blur
+// Scratch lines: four in, four out
+static inline uint32_t *gfx_blur_scratch(void) {
+    static uint32_t scratch[GFX_BLUR_MAX * 8];
+    return scratch;
+}
 
-    int kernel_size = radius * 2 + 1;
-    int divisor = kernel_size * kernel_size;
+// 65536 / (2r + 1), rounded: sum * this >> 16 is the average
+static inline uint32_t gfx_blur_mul(int r) {
+    return (65536 + r) / (2 * r + 1);
+}
 
-    // Process each pixel
-    for (int py = y; py < y + h; py++) {
-        for (int px = x; px < x + w; px++) {
-            uint32_t sum_r = 0, sum_g = 0, sum_b = 0;
-            int count = 0;
-
-            // Sample kernel
-            for (int ky = -radius; ky <= radius; ky++) {
-                for (int kx = -radius; kx <= radius; kx++) {
-                    int sx = px + kx, sy = py + ky;
-                    if (sx >= 0 && sx < ctx->width && sy >= 0 && sy < ctx->height) {
-                        uint32_t c = ctx->buffer[sy * ctx->width + sx];
-                        sum_r += GFX_R(c);
-                        sum_g += GFX_G(c);
-                        sum_b += GFX_B(c);
-                        count++;
-                    }
+// Blur one line of n pixels from in to out (every out_step pixels).
+// Pixels past the ends repeat the end ones.
+static inline void gfx_blur_line_scalar(const uint32_t *in, uint32_t *out, int out_step, int n, int r) {
+    uint32_t mul = gfx_blur_mul(r);
+    uint32_t sr = 0, sg = 0, sb = 0;
+    for (int k = -r; k <= r; k++) {
+        uint32_t c = in[k < 0 ? 0 : k >= n ? n - 1 : k];
+        sr += GFX_R(c);
+        sg += GFX_G(c);
+        sb += GFX_B(c);
+    }
+    for (int i = 0; i < n; i++, out += out_step) {
+        *out = GFX_RGB((sr * mul + 32768) >> 16, (sg * mul + 32768) >> 16, (sb * mul + 32768) >> 16);
+        uint32_t add = in[i + r + 1 < n ? i + r + 1 : n - 1];
+        uint32_t sub = in[i - r > 0 ? i - r : 0];
+        sr += GFX_R(add) - GFX_R(sub);
+        sg += GFX_G(add) - GFX_G(sub);
+        sb += GFX_B(add) - GFX_B(sub);
+    }
+}
+
+// Both passes over a w x h region at buf, rows stride pixels apart
+static inline void gfx_blur_box_scalar(uint32_t *buf, int stride, int w, int h, int r) {
+    uint32_t *line = gfx_blur_scratch();
+    for (int y = 0; y < h; y++) {
+        uint32_t *row = buf + y * stride;
+        gfx_span_copy_scalar(line, row, w);
+        gfx_blur_line_scalar(line, row, 1, w, r);
+    }
+    for (int x = 0; x < w; x++) {
+        for (int y = 0; y < h; y++) line[y] = buf[y * stride + x];
+        gfx_blur_line_scalar(line, buf + x, stride, h, r);
+    }
+}
+
+#ifdef __ARM_NEON
+// Four lines at once: in holds n groups of 4 pixels, pixel i of each
+// line; out gets the same, a group every out_step pixels
+static inline void gfx_blur_strip4(const uint32_t *in, uint32_t *out, int out_step, int n, int r) {
+    uint16x8_t lo = vdupq_n_u16(0), hi = vdupq_n_u16(0);
+    for (int k = -r; k <= r; k++) {
+        uint8x16_t p = vld1q_u8((const uint8_t *)(in + 4 * (k < 0 ? 0 : k >= n ? n - 1 : k)));
+        lo = vaddw_u8(lo, vget_low_u8(p));
+        hi = vaddw_u8(hi, vget_high_u8(p));
+    }
+
+    uint16x4_t mul = vdup_n_u16(gfx_blur_mul(r));
+    uint32x4_t rgb = vdupq_n_u32(0xFFFFFF);
+    for (int i = 0; i < n; i++, out += out_step) {
+        uint16x8_t alo = vcombine_u16(vrshrn_n_u32(vmull_u16(vget_low_u16(lo), mul), 16),
+                                      vrshrn_n_u32(vmull_u16(vget_high_u16(lo), mul), 16));
+        uint16x8_t ahi = vcombine_u16(vrshrn_n_u32(vmull_u16(vget_low_u16(hi), mul), 16),
+                                      vrshrn_n_u32(vmull_u16(vget_high_u16(hi), mul), 16));
+        uint8x16_t avg = vcombine_u8(vmovn_u16(alo), vmovn_u16(ahi));
+        vst1q_u32(out, vandq_u32(vreinterpretq_u32_u8(avg), rgb));
+
+        uint8x16_t add = vld1q_u8((const uint8_t *)(in + 4 * (i + r + 1 < n ? i + r + 1 : n - 1)));
+        uint8x16_t sub = vld1q_u8((const uint8_t *)(in + 4 * (i - r > 0 ? i - r : 0)));
+        lo = vsubw_u8(vaddw_u8(lo, vget_low_u8(add)), vget_low_u8(sub));
+        hi = vsubw_u8(vaddw_u8(hi, vget_high_u8(add)), vget_high_u8(sub));
+    }
+}
+
+// Transpose a 4x4 block of pixels
+static inline void gfx_transpose4(uint32x4_t *v) {
+    uint32x4x2_t ab = vtrnq_u32(v[0], v[1]);
+    uint32x4x2_t cd = vtrnq_u32(v[2], v[3]);
+    v[0] = vcombine_u32(vget_low_u32(ab.val[0]), vget_low_u32(cd.val[0]));
+    v[1] = vcombine_u32(vget_low_u32(ab.val[1]), vget_low_u32(cd.val[1]));
+    v[2] = vcombine_u32(vget_high_u32(ab.val[0]), vget_high_u32(cd.val[0]));
+    v[3] = vcombine_u32(vget_high_u32(ab.val[1]), vget_high_u32(cd.val[1]));
+}
+#endif
+
+static inline void gfx_blur_box(uint32_t *buf, int stride, int w, int h, int r) {
+#ifdef __ARM_NEON
+    uint32_t *in = gfx_blur_scratch(), *out = in + 4 * GFX_BLUR_MAX;
+    uint32x4_t v[4];
+
+    // Rows, four at a time, turned into columns of four and back
+    int y = 0;
+    for (; y + 4 <= h; y += 4) {
+        uint32_t *rows = buf + y * stride;
+        int x = 0;
+        for (; x + 4 <= w; x += 4) {
+            for (int k = 0; k < 4; k++) v[k] = vld1q_u32(rows + k * stride + x);
+            gfx_transpose4(v);
+            for (int k = 0; k < 4; k++) vst1q_u32(in + 4 * (x + k), v[k]);
+        }
+        for (; x < w; x++) {
+            for (int k = 0; k < 4; k++) in[4 * x + k] = rows[k * stride + x];
+        }
+
+        gfx_blur_strip4(in, out, 4, w, r);
+
+        for (x = 0; x + 4 <= w; x += 4) {
+            for (int k = 0; k < 4; k++) v[k] = vld1q_u32(out + 4 * (x + k));
+            gfx_transpose4(v);
+            for (int k = 0; k < 4; k++) vst1q_u32(rows + k * stride + x, v[k]);
+        }
+        for (; x < w; x++) {
+            for (int k = 0; k < 4; k++) rows[k * stride + x] = out[4 * x + k];
+        }
+    }
+    for (; y < h; y++) {
+        uint32_t *row = buf + y * stride;
+        gfx_span_copy(in, row, w);
+        gfx_blur_line_scalar(in, row, 1, w, r);
+    }
+
+    // Columns, four side by side, which loads straight from the rows
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        for (y = 0; y < h; y++) vst1q_u32(in + 4 * y, vld1q_u32(buf + y * stride + x));
+        gfx_blur_strip4(in, buf + x, stride, h, r);
+    }
+    for (; x < w; x++) {
+        for (y = 0; y < h; y++) in[y] = buf[y * stride + x];
+        gfx_blur_line_scalar(in, buf + x, stride, h, r);
+    }
+#else
+    gfx_blur_box_scalar(buf, stride, w, h, r);
+#endif
+}
+
+// Shrink a region by f (2 or 4) into its own top-left corner, averaging
+// f x f blocks. Going in order never overwrites a block before it's read.
+static inline void gfx_blur_down(uint32_t *buf, int stride, int w, int h, int f) {
+    int sw = (w + f - 1) / f, sh = (h + f - 1) / f;
+    int shift = f == 4 ? 4 : 2;
+    uint32_t half = 1 << (shift - 1);
+    for (int sy = 0; sy < sh; sy++) {
+        for (int sx = 0; sx < sw; sx++) {
+            uint32_t r = 0, g = 0, b = 0;
+            for (int j = 0; j < f; j++) {
+                int yy = sy * f + j < h ? sy * f + j : h - 1;
+                const uint32_t *row = buf + yy * stride;
+                for (int i = 0; i < f; i++) {
+                    uint32_t c = row[sx * f + i < w ? sx * f + i : w - 1];
+                    r += GFX_R(c);
+                    g += GFX_G(c);
+                    b += GFX_B(c);
                 }
             }
+            buf[sy * stride + sx] = GFX_RGB((r + half) >> shift, (g + half) >> shift, (b + half) >> shift);
+        }
+    }
+}
 
-            if (count > 0) {
-                ctx->buffer[py * ctx->width + px] = GFX_RGB(sum_r / count, sum_g / count, sum_b / count);
+// Where full-size pixel i falls between small pixels (f to one): the
+// left one, and how far on towards the next in 2f'ths
+static inline int gfx_blur_tap(int i, int f, int *frac) {
+    int num = 2 * i + 1 - f;
+    if (num <= 0) { *frac = 0; return 0; }
+    *frac = num % (2 * f);
+    return num / (2 * f);
+}
+
+// One small row stretched back to w pixels, interpolating across
+static inline void gfx_blur_expand(const uint32_t *small, int sw, uint32_t *out, int w, int f) {
+    int den = 2 * f, shift = f == 4 ? 3 : 2;
+    for (int x = 0; x < w; x++) {
+        int fx, s0 = gfx_blur_tap(x, f, &fx);
+        uint32_t a = small[s0], b = small[s0 + 1 < sw ? s0 + 1 : sw - 1];
+        uint32_t wa = den - fx, half = f;
+        out[x] = GFX_RGB((GFX_R(a) * wa + GFX_R(b) * fx + half) >> shift,
+                         (GFX_G(a) * wa + GFX_G(b) * fx + half) >> shift,
+                         (GFX_B(a) * wa + GFX_B(b) * fx + half) >> shift);
+    }
+}
+
+// out = a * wa + b * wb, over 2^shift (wa + wb)
+static inline void gfx_blur_mix_scalar(uint32_t *out, const uint32_t *a, const uint32_t *b,
+                                       int n, uint32_t wa, uint32_t wb, int shift) {
+    uint32_t half = 1 << (shift - 1);
+    for (int i = 0; i < n; i++) {
+        out[i] = GFX_RGB((GFX_R(a[i]) * wa + GFX_R(b[i]) * wb + half) >> shift,
+                         (GFX_G(a[i]) * wa + GFX_G(b[i]) * wb + half) >> shift,
+                         (GFX_B(a[i]) * wa + GFX_B(b[i]) * wb + half) >> shift);
+    }
+}
+
+static inline void gfx_blur_mix(uint32_t *out, const uint32_t *a, const uint32_t *b,
+                                int n, uint32_t wa, uint32_t wb, int shift) {
+#ifdef __ARM_NEON
+    // a and b come from gfx_blur_expand, so their top bytes are already 0
+    uint8x8_t va = vdup_n_u8(wa), vb = vdup_n_u8(wb);
+    int16x8_t sh = vdupq_n_s16(-shift);
+    for (; n >= 4; n -= 4, out += 4, a += 4, b += 4) {
+        uint8x16_t pa = vld1q_u8((const uint8_t *)a), pb = vld1q_u8((const uint8_t *)b);
+        uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(pa), va), vget_low_u8(pb), vb);
+        uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(pa), va), vget_high_u8(pb), vb);
+        uint8x16_t px = vcombine_u8(vmovn_u16(vrshlq_u16(lo, sh)), vmovn_u16(vrshlq_u16(hi, sh)));
+        vst1q_u8((uint8_t *)out, px);
+    }
+#endif
+    gfx_blur_mix_scalar(out, a, b, n, wa, wb, shift);
+}
+
+// Stretch the small image in the region's corner back over all of it.
+// Bottom-up, keeping the two small rows in use stretched in scratch: a
+// small row is copied out before the full-size row on top of it is
+// written.
+static inline void gfx_blur_up(uint32_t *buf, int stride, int w, int h, int f, int neon) {
+    int sw = (w + f - 1) / f, sh = (h + f - 1) / f;
+    int shift = f == 4 ? 3 : 2;
+    uint32_t *a = gfx_blur_scratch(), *b = a + GFX_BLUR_MAX;
+    int cur = -1;
+
+    for (int y = h - 1; y >= 0; y--) {
+        int fy, s0 = gfx_blur_tap(y, f, &fy);
+        if (s0 != cur) {
+            if (cur == s0 + 1) {
+                uint32_t *t = b; b = a; a = t;
+            } else {
+                gfx_blur_expand(buf + (s0 + 1 < sh ? s0 + 1 : sh - 1) * stride, sw, b, w, f);
             }
+            gfx_blur_expand(buf + s0 * stride, sw, a, w, f);
+            cur = s0;
         }
+        if (neon) gfx_blur_mix(buf + y * stride, a, b, w, 2 * f - fy, fy, shift);
+        else gfx_blur_mix_scalar(buf + y * stride, a, b, w, 2 * f - fy, fy, shift);
     }
 }
 
+static inline void gfx_blur_run(gfx_ctx_t *ctx, int x, int y, int w, int h, int radius,
+                                int factor, int neon) {
+    if (radius <= 0) return;
+    if (!gfx_clip_rect(ctx, &x, &y, &w, &h)) return;
+    if (w > GFX_BLUR_MAX) w = GFX_BLUR_MAX;
+    if (h > GFX_BLUR_MAX) h = GFX_BLUR_MAX;
+    if (factor != 2 && factor != 4) factor = 1;
+    if (w < 2 * factor || h < 2 * factor) factor = 1;
+
+    uint32_t *buf = &ctx->buffer[y * ctx->width + x];
+    int stride = ctx->width;
+    int r = factor > 1 ? (radius + factor / 2) / factor : radius;
+    if (r < 1) r = 1;
+    if (r > GFX_BLUR_MAX_RADIUS) r = GFX_BLUR_MAX_RADIUS;
+
+    if (factor > 1) gfx_blur_down(buf, stride, w, h, factor);
+    int bw = (w + factor - 1) / factor, bh = (h + factor - 1) / factor;
+    if (neon) gfx_blur_box(buf, stride, bw, bh, r);
+    else gfx_blur_box_scalar(buf, stride, bw, bh, r);
+    if (factor > 1) gfx_blur_up(buf, stride, w, h, factor, neon);
+}
+
+// Blur a region of the buffer, shrinking it factor (1, 2 or 4) times
+// while it's blurred. Only pixels inside the (clipped) region are
+// sampled, so a region redrawn in pieces won't match one done whole.
+static inline void gfx_blur_region_scaled(gfx_ctx_t *ctx, int x, int y, int w, int h,
+                                          int radius, int factor) {
+    gfx_blur_run(ctx, x, y, w, h, radius, factor, 1);
+}
+
+static inline void gfx_blur_region_scaled_scalar(gfx_ctx_t *ctx, int x, int y, int w, int h,
+                                                 int radius, int factor) {
+    gfx_blur_run(ctx, x, y, w, h, radius, factor, 0);
+}
+
+// Box blur a region of the buffer (for frosted glass effect), shrinking
+// it first when the radius is big enough that nobody can tell
+static inline void gfx_blur_region(gfx_ctx_t *ctx, int x, int y, int w, int h, int radius) {
+    int factor = radius >= 16 ? 4 : radius >= 6 ? 2 : 1;
+    gfx_blur_region_scaled(ctx, x, y, w, h, radius, factor);
+}
+
 #endif // GFX_H
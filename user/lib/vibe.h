@@ -15,6 +15,87 @@ typedef unsigned int uint32_t;
 typedef unsigned long uint64_t;
 typedef signed short int16_t;
 
+// Wait queue (must match kernel/spinlock.h). Read seq, check your condition,
+// then pass that seq to wait_queue_sleep() so a wakeup in between isn't lost.
+typedef struct {
+    volatile uint32_t seq;
+} wait_queue_t;
+
+// Network interface counters (must match kernel/net.h)
+typedef struct {
+    char name[8];
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t rx_packets;
+    uint32_t tx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint32_t tx_dropped;     // No route/neighbor, or lo queue full
+    uint32_t rx_csum_errors; // Dropped for a bad checksum
+    uint32_t rx_pps;         // Packets per second, over the last second
+    uint32_t tx_pps;
+    uint32_t tx_kicks;       // Times the NIC was notified (eth0); tx_packets / tx_kicks = batch size
+} net_if_stats_t;
+
+#define NET_IF_LO   0
+#define NET_IF_ETH0 1
+
+// TCP counters since boot (must match kernel/net.h)
+typedef struct {
+    uint32_t segs_out;
+    uint32_t segs_in;
+    uint32_t retransmits;       // All resends: timeouts, fast retransmit, SYNs
+    uint32_t fast_retransmits;  // Triggered by three duplicate ACKs
+    uint32_t timeouts;          // Retransmit timer expiries
+    uint32_t dup_acks;
+} tcp_stats_t;
+
+// DNS lookup result and resolver counters (must match kernel/net.h)
+#define DNS_SRC_LITERAL  0   // The name was an address already
+#define DNS_SRC_HOSTS    1   // /etc/hosts
+#define DNS_SRC_CACHE    2
+#define DNS_SRC_SERVER   3   // Asked the server just now
+
+#define DNS_RCODE_NOERROR   0
+#define DNS_RCODE_SERVFAIL  2
+#define DNS_RCODE_NXDOMAIN  3
+#define DNS_RCODE_TIMEOUT   (-1)
+
+typedef struct {
+    uint32_t ip;        // 0 if the name doesn't resolve
+    uint32_t ttl;       // Seconds the answer is cached for (0 = not cached)
+    int source;         // DNS_SRC_*
+    int rcode;          // DNS_RCODE_* (failures are cached too)
+} dns_answer_t;
+
+typedef struct {
+    uint32_t lookups;        // Names looked up (addresses don't count)
+    uint32_t hosts_hits;     // Answered from /etc/hosts
+    uint32_t hits;           // Answered from the cache...
+    uint32_t negative_hits;  // ...with a cached failure
+    uint32_t misses;         // Had to wait for the server
+    uint32_t coalesced;      // Joined a query already in flight
+    uint32_t queries;        // Queries sent, retransmits included
+    uint32_t retransmits;
+    uint32_t timeouts;       // The server never answered
+    uint32_t nxdomain;       // The server said there's no such name
+    uint32_t entries;        // Live cache entries right now
+    uint32_t hosts_entries;  // Names loaded from /etc/hosts
+} dns_stats_t;
+
+typedef struct {
+    uint32_t glyph_hits;      // ttf_get_glyph() answered from the cache
+    uint32_t glyph_misses;    // ...or had to rasterize
+    uint32_t glyphs;          // Glyphs cached right now
+    uint32_t pages;           // Atlas pages allocated
+    uint32_t page_bytes;      // ...and their total size
+    uint32_t page_evictions;  // Pages dropped to make room
+    uint32_t sizes;           // Pixel sizes with metrics set up
+    uint32_t run_hits;        // ttf_measure() answered from the run cache
+    uint32_t run_misses;
+    uint32_t runs;            // Runs cached right now
+} ttf_stats_t;
+
 // Kernel API structure (must match kernel/kapi.h)
 typedef struct kapi {
     uint32_t version;
@@ -146,7 +227,7 @@ typedef struct kapi {
     int (*get_alloc_count)(void);                            // Number of allocations
 
     // Networking
-    int (*net_ping)(uint32_t ip, uint16_t seq, uint32_t timeout_ms);  // Ping an IP, returns 0 on success
+    int (*net_ping)(uint32_t ip, uint16_t seq, uint32_t timeout_ms);  // Ping an IP, returns RTT in us or -1
     void (*net_poll)(void);                                           // Process incoming packets
     uint32_t (*net_get_ip)(void);                                     // Get our IP address
     void (*net_get_mac)(uint8_t *mac);                               // Get our MAC address (6 bytes)
@@ -210,6 +291,66 @@ typedef struct kapi {
     int (*dma_fb_copy)(uint32_t *dst, const uint32_t *src,      // Full framebuffer copy
                        uint32_t width, uint32_t height);
     int (*dma_fill)(void *dst, uint32_t value, uint32_t len);   // Fill with 32-bit value
+
+    // Disk block cache
+    void (*get_disk_cache_stats)(uint64_t *hits, uint64_t *misses,     // Block counters since boot
+                                 uint64_t *writebacks, uint64_t *readahead);
+    void (*disk_sync)(void);                 // Write all cached dirty blocks to disk
+
+    // Incremental file writes (write() replaces the whole file)
+    int (*pwrite)(void *file, const char *buf, size_t size, size_t offset);  // Write at offset, extends file
+    int (*append)(void *file, const char *buf, size_t size);                 // Write at end of file
+
+    // Heap fragmentation
+    size_t (*get_mem_largest_free)(void);    // Largest single free block in bytes
+
+    // Partial window redraw (set by desktop, like the window API above)
+    void (*window_invalidate_rect)(int wid, int x, int y, int w, int h);  // Content coords
+
+    // High-resolution timing
+    uint32_t (*get_time_us)(void);           // Microsecond counter (wraps, use differences)
+
+    // Streaming audio (PCM buffers play back to back)
+    int (*sound_stream_start)(uint8_t channels, uint32_t sample_rate);  // Start an empty stream
+    int (*sound_stream_queue)(const void *data, uint32_t samples);      // Queue buffer, -1 if full
+    uint32_t (*sound_stream_retired)(void);  // Buffers finished playing (reuse them)
+
+    // Blocking waits (timeout_ms 0 = wait forever)
+    int (*wait_queue_sleep)(wait_queue_t *wq, uint32_t seq, uint32_t timeout_ms);  // 0 woken, -1 timeout
+    void (*wait_queue_wake)(wait_queue_t *wq);
+    wait_queue_t *input_wait_queue;          // Woken on every key press / mouse event
+    int (*tcp_wait_readable)(int sock, uint32_t timeout_ms);  // 1 readable or closed, 0 timeout
+    int (*window_wait_event)(int wid, uint32_t timeout_ms);   // Set by desktop; 1 event pending
+    void (*get_cpu_ticks)(uint64_t *idle, uint64_t *total);   // Timer ticks over all cores
+    int (*stdio_wait_key)(uint32_t timeout_ms);  // Terminal provides; 1 key pending, 0 timeout
+
+    // Network interfaces (0 = lo, 1 = eth0)
+    int (*net_get_if_stats)(int index, net_if_stats_t *out);  // -1 if no such interface
+    void (*net_set_loss)(uint32_t per_mille);                 // Testing: drop outgoing packets
+    void (*tcp_get_stats)(tcp_stats_t *out);                  // Retransmits, dup ACKs, ...
+    int (*tcp_set_bufsize)(int sock, uint32_t rx_size, uint32_t tx_size);  // Grow buffers/window
+    int (*tls_set_bufsize)(int sock, uint32_t rx_size, uint32_t tx_size);  // Same, TLS socket
+    int (*tcp_recv_zc)(int sock, const void **data);          // Borrow received bytes in place
+    void (*tcp_recv_done)(int sock, uint32_t len);            // ...and give them back
+    int (*tcp_listen)(uint16_t port, int backlog);            // Listening socket or -1
+    int (*tcp_accept)(int listener, uint32_t timeout_ms);     // Connected socket, -1 on timeout
+    uint32_t (*csum_partial)(const void *data, uint32_t len, uint32_t sum);  // Internet checksum (NEON)
+    uint32_t (*csum_partial_scalar)(const void *data, uint32_t len, uint32_t sum);  // Same, word loop
+    int (*dns_lookup)(const char *hostname, dns_answer_t *out); // 0 if resolved; says where from
+    void (*dns_flush)(void);                                  // Drop the cache, reread /etc/hosts
+    void (*dns_get_stats)(dns_stats_t *out);                  // Cache hits, queries, timeouts, ...
+
+    // Font cache
+    int (*ttf_measure)(const char *text, int len, int size, int style);  // UTF-8 width, kerned, cached
+    void (*ttf_flush)(void);                                  // Drop cached glyphs and runs
+    void (*ttf_get_stats)(ttf_stats_t *out);                  // Glyph and run cache hits, pages, ...
+
+    // Bulk output
+    void (*stdio_write)(const char *buf, uint32_t len);      // Terminal provides; len bytes, no NUL needed
+
+    // TLS with buffers sized before the handshake (0 keeps the default)
+    int (*tls_connect_bufsize)(uint32_t ip, uint16_t port, const char *hostname,
+                               uint32_t rx_size, uint32_t tx_size);
 } kapi_t;
 
 // TTF glyph info (returned by ttf_get_glyph)
@@ -415,6 +556,12 @@ static inline void vibe_puts(kapi_t *k, const char *s) {
     else k->puts(s);
 }
 
+// Print len bytes in one call - uses stdio hooks if set, else console
+static inline void vibe_write(kapi_t *k, const char *buf, uint32_t len) {
+    if (k->stdio_write) k->stdio_write(buf, len);
+    else for (uint32_t i = 0; i < len; i++) vibe_putc(k, buf[i]);
+}
+
 // Read a character - uses stdio hooks if set, else console
 static inline int vibe_getc(kapi_t *k) {
     if (k->stdio_getc) return k->stdio_getc();